@@ -54,8 +54,10 @@ struct Buffer {
 };
 
 //--------- Assets -------------//
-enum class meshTypes {
-	TRIANGLE,
-	SQUARE,
-	STAR
+/**
+	A mesh and the material it is drawn with, as asset manager handles
+*/
+struct Renderable {
+	uint32_t mesh;
+	uint32_t material;
 };
\ No newline at end of file
@@ -1,12 +1,17 @@
 #include "app.h"
 
-App::App(int width, int height, bool debug) {
+App::App(int width, int height, bool debug, const std::string& sceneFile) {
 
 	build_glfw_window(width, height, debug);
 
 	graphicsEngine = new Engine(width, height, window, debug);
 
-	scene = new Scene();
+	if (sceneFile.empty()) {
+		scene = new Scene(graphicsEngine->get_renderables());
+	}
+	else {
+		scene = new Scene(sceneFile, graphicsEngine->get_renderables());
+	}
 }
 
 void App::build_glfw_window(int width, int height, bool debugMode) {
@@ -201,7 +206,11 @@ void App::calculateFrameRate_multi() {
 	if (delta >= 1) {
 		int framerate{ std::max(1, int(numFrames / delta)) };
 		std::stringstream title;
-		title << "Running at " << framerate << " fps.";
+		CullStats cull = graphicsEngine->get_cull_stats();
+		vkUtil::RecorderStats recorded = graphicsEngine->get_recorder_stats();
+		title << "Running at " << framerate << " fps. Drawing " << cull.visible << " of " << cull.tested
+			<< " instances, culled in " << cull.milliseconds << " ms. "
+			<< recorded.issued << " state commands, " << recorded.elided << " left out.";
 		glfwSetWindowTitle(window, title.str().c_str());
 		lastTime = currentTime;
 		numFrames = -1;
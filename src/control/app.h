@@ -37,7 +37,10 @@ private:
 	void scroll_process();
 
 public:
-	App(int width, int height, bool debug);
+	/**
+		\param sceneFile a scene file to stream, or empty for the generated scene
+	*/
+	App(int width, int height, bool debug, const std::string& sceneFile = "");
 	~App();
 	void run();
 };
\ No newline at end of file
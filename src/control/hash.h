@@ -0,0 +1,60 @@
+#pragma once
+#include "../config.h"
+
+namespace vkHash {
+
+	/**
+		64 bit xxHash (XXH64) of a block of memory.
+		\param data the bytes to hash
+		\param length number of bytes
+		\param seed starting value, different seeds give independent hashes
+		\returns the hash
+	*/
+	uint64_t xxhash64(const void* data, size_t length, uint64_t seed = 0);
+
+	/**
+		Open addressing table from hash to index, with linear probing.
+		Keys are not stored here: the caller keeps the hashed items in an array
+		and supplies an equality test against an existing index.
+	*/
+	class IndexTable {
+	public:
+
+		/**
+			\param expectedCount number of entries the table must hold,
+			it is sized so it never goes above half full.
+		*/
+		IndexTable(size_t expectedCount);
+
+		/**
+			Find an entry equal to the one being inserted, or add it.
+			\param hash hash of the new item
+			\param newIndex index the item will have if it is not found
+			\param equals tests the new item against the item at an existing index
+			\returns the index of the matching item, or newIndex if it was added
+		*/
+		template <typename Equals>
+		uint32_t find_or_insert(uint64_t hash, uint32_t newIndex, Equals equals) {
+
+			size_t slot = static_cast<size_t>(hash) & mask;
+			while (true) {
+				uint32_t index = indices[slot];
+				if (index == kEmpty) {
+					indices[slot] = newIndex;
+					hashes[slot] = hash;
+					return newIndex;
+				}
+				if (hashes[slot] == hash && equals(index)) {
+					return index;
+				}
+				slot = (slot + 1) & mask;
+			}
+		}
+
+	private:
+		static constexpr uint32_t kEmpty = 0xFFFFFFFF;
+		size_t mask;
+		std::vector<uint32_t> indices;
+		std::vector<uint64_t> hashes;
+	};
+}
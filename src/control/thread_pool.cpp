@@ -0,0 +1,138 @@
+#include "thread_pool.h"
+#include <memory>
+#include <exception>
+
+namespace vkJob {
+	ThreadPool* ThreadPool::pool;
+}
+
+vkJob::ThreadPool* vkJob::ThreadPool::get_pool() {
+	if (pool == nullptr) {
+		//leave a core for the render thread
+		int workerCount = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+		pool = new ThreadPool(std::max(1, workerCount));
+	}
+
+	return pool;
+}
+
+vkJob::ThreadPool::ThreadPool(int workerCount) {
+
+	activeJobs = 0;
+	stopping = false;
+
+	workers.reserve(workerCount);
+	for (int i = 0; i < workerCount; ++i) {
+		workers.emplace_back([this]() { worker_loop(); });
+	}
+}
+
+void vkJob::ThreadPool::submit(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	jobAvailable.notify_one();
+}
+
+void vkJob::ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	jobsFinished.wait(lock, [this]() { return jobs.empty() && activeJobs == 0; });
+}
+
+void vkJob::ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& body) {
+
+	if (count == 0) {
+		return;
+	}
+
+	struct Batch {
+		const std::function<void(size_t)>* body;
+		size_t count;
+		std::atomic<size_t> next;
+		std::atomic<size_t> finished;
+		std::mutex mutex;
+		std::condition_variable done;
+		std::exception_ptr error;
+	};
+
+	//helpers can outlive this call, they only touch body after claiming an item
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->body = &body;
+	batch->count = count;
+	batch->next.store(0);
+	batch->finished.store(0);
+
+	auto drain = [](Batch* batch) {
+		size_t i;
+		while ((i = batch->next.fetch_add(1)) < batch->count) {
+			try {
+				(*batch->body)(i);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(batch->mutex);
+				if (!batch->error) {
+					batch->error = std::current_exception();
+				}
+			}
+			if (batch->finished.fetch_add(1) + 1 == batch->count) {
+				std::lock_guard<std::mutex> lock(batch->mutex);
+				batch->done.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(count - 1, workers.size());
+	for (size_t i = 0; i < helpers; ++i) {
+		submit([batch, drain]() { drain(batch.get()); });
+	}
+	drain(batch.get());
+
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->done.wait(lock, [&batch]() { return batch->finished.load() == batch->count; });
+	if (batch->error) {
+		std::rethrow_exception(batch->error);
+	}
+}
+
+int vkJob::ThreadPool::get_worker_count() {
+	return static_cast<int>(workers.size());
+}
+
+void vkJob::ThreadPool::worker_loop() {
+
+	while (true) {
+
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping && jobs.empty()) {
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			++activeJobs;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--activeJobs;
+		}
+		jobsFinished.notify_all();
+	}
+}
+
+vkJob::ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "../config.h"
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+namespace vkJob {
+
+	/**
+		A fixed set of worker threads pulling jobs from a shared queue.
+		Used for work which must not block the render thread, eg. decoding assets.
+	*/
+	class ThreadPool {
+	public:
+		static ThreadPool* pool;
+
+		/**
+			\returns the shared pool, sized to the hardware concurrency
+		*/
+		static ThreadPool* get_pool();
+
+		ThreadPool(int workerCount);
+		~ThreadPool();
+
+		/**
+			Queue a job to be run on one of the workers.
+			\param job the work to run
+		*/
+		void submit(std::function<void()> job);
+
+		/**
+			Block until the queue is empty and no job is running.
+		*/
+		void wait();
+
+		/**
+			Run body(i) for every i in [0, count), spread across the workers.
+			The calling thread takes a share of the work too, so this is safe
+			to call from inside a job. Exceptions are rethrown on the caller.
+			\param count number of work items
+			\param body the work for a single item
+		*/
+		void parallel_for(size_t count, const std::function<void(size_t)>& body);
+
+		int get_worker_count();
+
+	private:
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> jobs;
+		std::mutex mutex;
+		std::condition_variable jobAvailable;
+		std::condition_variable jobsFinished;
+		int activeJobs;
+		bool stopping;
+
+		void worker_loop();
+	};
+}
@@ -1,11 +1,133 @@
 #include "control/app.h"
+#include "model/mesh_file.h"
+#include "model/instance_store.h"
+#include "model/bvh.h"
+#include "model/scene_graph.h"
+#include "model/draw_sort.h"
+#include "model/static_batcher.h"
+#include "model/occlusion_buffer.h"
+#include "model/scene_file.h"
+#include <iostream>
+#include <string>
+#include <stdexcept>
 
-int main(){
+/**
+	Read an optional instance count from the command line.
+	\param argc number of arguments
+	\param argv the arguments
+	\param index where the count is expected
+	\param fallback used when the count is left out
+	\param count set to the parsed count
+	\returns whether the count was left out or is a whole number, usage is printed otherwise
+*/
+static bool parse_count(int argc, char** argv, int index, size_t fallback, size_t& count) {
 
-    App* myApp = new App(640,480,true);
+    count = fallback;
+    if (argc <= index) {
+        return true;
+    }
+
+    std::string text = argv[index];
+    try {
+        size_t used;
+        count = std::stoul(text, &used);
+        if (used == text.size() && text[0] != '-') {
+            return true;
+        }
+    }
+    catch (std::invalid_argument) {}
+    catch (std::out_of_range) {}
+
+    std::cout << "usage: " << argv[0] << " " << argv[1] << (index == 3 ? " <file>" : "") << " [count]" << std::endl;
+    std::cout << "count must be a whole number, got \"" << text << "\"" << std::endl;
+    return false;
+}
+
+int main(int argc, char** argv){
+
+    //--bench-mesh <obj> <mesh>: compare OBJ parsing against the mapped binary format
+    if (argc >= 4 && std::string(argv[1]) == "--bench-mesh") {
+        vkMesh::benchmark_mesh_loading(argv[2], argv[3]);
+        return 0;
+    }
+
+    //--bench-instances [count]: compare the transform kernels against glm
+    if (argc >= 2 && std::string(argv[1]) == "--bench-instances") {
+        size_t count;
+        if (!parse_count(argc, argv, 2, 1000000, count)) {
+            return 1;
+        }
+        benchmark_instance_transforms(count);
+        return 0;
+    }
+
+    //--bench-bvh [count]: build, refit and query instance trees up to count instances
+    if (argc >= 2 && std::string(argv[1]) == "--bench-bvh") {
+        size_t count;
+        if (!parse_count(argc, argv, 2, 10000000, count)) {
+            return 1;
+        }
+        benchmark_bvh(count);
+        return 0;
+    }
+
+    //--bench-graph [count]: propagate assemblies of count nodes in full and after small changes
+    if (argc >= 2 && std::string(argv[1]) == "--bench-graph") {
+        size_t count;
+        if (!parse_count(argc, argv, 2, 1000000, count)) {
+            return 1;
+        }
+        benchmark_scene_graph(count);
+        return 0;
+    }
+
+    //--bench-sort [count]: sort draw keys with the radix sort and std::stable_sort, up to count draws
+    if (argc >= 2 && std::string(argv[1]) == "--bench-sort") {
+        size_t count;
+        if (!parse_count(argc, argv, 2, 1000000, count)) {
+            return 1;
+        }
+        benchmark_draw_sort(count);
+        return 0;
+    }
+
+    //--bench-static [count]: batch count instances, mostly static, then update after small changes
+    if (argc >= 2 && std::string(argv[1]) == "--bench-static") {
+        size_t count;
+        if (!parse_count(argc, argv, 2, 1000000, count)) {
+            return 1;
+        }
+        benchmark_static_batching(count);
+        return 0;
+    }
+
+    //--bench-occlusion [count]: draw walls into the CPU occlusion buffer and test count instances behind them
+    if (argc >= 2 && std::string(argv[1]) == "--bench-occlusion") {
+        size_t count;
+        if (!parse_count(argc, argv, 2, 1000000, count)) {
+            return 1;
+        }
+        benchmark_occlusion(count);
+        return 0;
+    }
+
+    //--bench-scene <file> [count]: write count instances as a scene file, raw and LZ4, and time streaming them
+    if (argc >= 3 && std::string(argv[1]) == "--bench-scene") {
+        size_t count;
+        if (!parse_count(argc, argv, 3, 1000000, count)) {
+            return 1;
+        }
+        benchmark_scene_streaming(argv[2], count);
+        return 0;
+    }
+
+    //--scene <file>: stream instances from a scene file instead of generating them
+    std::string sceneFile = argc >= 3 && std::string(argv[1]) == "--scene" ? argv[2] : "";
+
+    App* myApp = new App(640,480,true,sceneFile);
 
     myApp->run();
     delete myApp;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,691 @@
+#include "bvh.h"
+#include "../control/thread_pool.h"
+#include <chrono>
+#include <limits>
+#include <random>
+
+namespace {
+
+	const uint32_t kNone = 0xFFFFFFFF;
+
+	struct Box {
+		glm::vec3 lower = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 upper = glm::vec3(-std::numeric_limits<float>::max());
+
+		void grow(const glm::vec3& point) {
+			lower = glm::min(lower, point);
+			upper = glm::max(upper, point);
+		}
+
+		void grow(const Box& box) {
+			lower = glm::min(lower, box.lower);
+			upper = glm::max(upper, box.upper);
+		}
+
+		float area() const {
+			glm::vec3 extent = glm::max(upper - lower, glm::vec3(0.0f));
+			return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+		}
+	};
+
+	/**
+		What the builder sorts, kept together so partitioning moves them and binning reads them in order.
+	*/
+	struct Primitive {
+		Box box;
+		glm::vec3 centroid;
+		uint32_t instance;
+	};
+
+	struct Bin {
+		Box bounds;
+		uint32_t count = 0;
+	};
+
+	struct BuildNode {
+		Box bounds;
+		Box centroids;
+		uint32_t begin;
+		uint32_t count;
+		//children are left and left + 1, kNone for a leaf
+		uint32_t left;
+	};
+
+	/**
+		Splits nodes of a tree stored in build order, children are claimed in pairs
+		from an atomic counter so subtrees can be built on different threads.
+	*/
+	class Builder {
+	public:
+
+		Builder(std::vector<Primitive>& primitives)
+			: primitives(primitives), nodes(std::max<size_t>(2 * primitives.size(), 1)), nodeCount(1) {}
+
+		std::vector<Primitive>& primitives;
+		std::vector<BuildNode> nodes;
+		std::atomic<uint32_t> nodeCount;
+
+		/**
+			Bounds and centroid bounds of a run of primitives, in parallel for long runs.
+		*/
+		void summarize(uint32_t begin, uint32_t count, Box& bounds, Box& centroids) const {
+
+			size_t chunks = (count + InstanceBvh::kParallelSize - 1) / InstanceBvh::kParallelSize;
+			std::vector<Box> chunkBounds(chunks), chunkCentroids(chunks);
+			auto body = [&](size_t c) {
+				uint32_t first = begin + static_cast<uint32_t>(c) * InstanceBvh::kParallelSize;
+				uint32_t last = std::min(first + InstanceBvh::kParallelSize, begin + count);
+				for (uint32_t i = first; i < last; ++i) {
+					chunkBounds[c].grow(primitives[i].box);
+					chunkCentroids[c].grow(primitives[i].centroid);
+				}
+			};
+			if (chunks > 1) {
+				vkJob::ThreadPool::get_pool()->parallel_for(chunks, body);
+			}
+			else if (chunks == 1) {
+				body(0);
+			}
+
+			for (size_t c = 0; c < chunks; ++c) {
+				bounds.grow(chunkBounds[c]);
+				centroids.grow(chunkCentroids[c]);
+			}
+		}
+
+		/**
+			Drop a run of primitives into bins along each axis, in parallel for long runs.
+		*/
+		void bin(const BuildNode& node, const glm::vec3& scale, Bin bins[3][InstanceBvh::kBins]) const {
+
+			auto fill = [&](uint32_t first, uint32_t last, Bin* local) {
+				for (uint32_t i = first; i < last; ++i) {
+					const Primitive& primitive = primitives[i];
+					for (int axis = 0; axis < 3; ++axis) {
+						Bin& target = local[axis * InstanceBvh::kBins + bin_index(node, scale, primitive.centroid, axis)];
+						target.bounds.grow(primitive.box);
+						++target.count;
+					}
+				}
+			};
+
+			//most nodes are small, they bin straight into the result
+			if (node.count <= InstanceBvh::kParallelSize) {
+				fill(node.begin, node.begin + node.count, &bins[0][0]);
+				return;
+			}
+
+			size_t chunks = (node.count + InstanceBvh::kParallelSize - 1) / InstanceBvh::kParallelSize;
+			std::vector<Bin> chunkBins(chunks * 3 * InstanceBvh::kBins);
+			vkJob::ThreadPool::get_pool()->parallel_for(chunks, [&](size_t c) {
+				uint32_t first = node.begin + static_cast<uint32_t>(c) * InstanceBvh::kParallelSize;
+				fill(first, std::min(first + InstanceBvh::kParallelSize, node.begin + node.count), chunkBins.data() + c * 3 * InstanceBvh::kBins);
+			});
+
+			for (size_t c = 0; c < chunks; ++c) {
+				for (int axis = 0; axis < 3; ++axis) {
+					for (uint32_t b = 0; b < InstanceBvh::kBins; ++b) {
+						const Bin& source = chunkBins[(c * 3 + axis) * InstanceBvh::kBins + b];
+						bins[axis][b].bounds.grow(source.bounds);
+						bins[axis][b].count += source.count;
+					}
+				}
+			}
+		}
+
+		static uint32_t bin_index(const BuildNode& node, const glm::vec3& scale, const glm::vec3& center, int axis) {
+			float position = (center[axis] - node.centroids.lower[axis]) * scale[axis];
+			return std::min(static_cast<uint32_t>(std::max(position, 0.0f)), InstanceBvh::kBins - 1);
+		}
+
+		void split(uint32_t index) {
+
+			BuildNode& node = nodes[index];
+			node.left = kNone;
+			if (node.count <= InstanceBvh::kLeafSize) {
+				return;
+			}
+
+			//flat axes have every centroid in the first bin and no split
+			glm::vec3 extent = node.centroids.upper - node.centroids.lower;
+			glm::vec3 scale;
+			for (int axis = 0; axis < 3; ++axis) {
+				scale[axis] = extent[axis] > 0.0f ? static_cast<float>(InstanceBvh::kBins) / extent[axis] : 0.0f;
+			}
+
+			Bin bins[3][InstanceBvh::kBins];
+			bin(node, scale, bins);
+
+			//sweep from the right for the cost of each right side, then from the left
+			float bestCost = std::numeric_limits<float>::max();
+			int bestAxis = -1;
+			uint32_t bestBin = 0;
+			for (int axis = 0; axis < 3; ++axis) {
+
+				if (scale[axis] == 0.0f) {
+					continue;
+				}
+
+				float rightCosts[InstanceBvh::kBins];
+				Box right;
+				uint32_t rightCount = 0;
+				for (uint32_t b = InstanceBvh::kBins - 1; b > 0; --b) {
+					right.grow(bins[axis][b].bounds);
+					rightCount += bins[axis][b].count;
+					rightCosts[b] = rightCount ? right.area() * rightCount : -1.0f;
+				}
+
+				Box left;
+				uint32_t leftCount = 0;
+				for (uint32_t b = 0; b + 1 < InstanceBvh::kBins; ++b) {
+					left.grow(bins[axis][b].bounds);
+					leftCount += bins[axis][b].count;
+					if (leftCount == 0 || rightCosts[b + 1] < 0.0f) {
+						continue;
+					}
+					float cost = left.area() * leftCount + rightCosts[b + 1];
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = b;
+					}
+				}
+			}
+
+			//testing the instances directly is cheaper than another level
+			bool small = node.count <= InstanceBvh::kMaxLeafSize;
+			if (small && (bestAxis < 0 || bestCost >= node.bounds.area() * node.count)) {
+				return;
+			}
+
+			//the children's boxes come from the bins, their centroid boxes from the partition
+			Box leftBounds, rightBounds, leftCentroids, rightCentroids;
+			uint32_t leftCount;
+			if (bestAxis >= 0) {
+				for (uint32_t b = 0; b < InstanceBvh::kBins; ++b) {
+					(b <= bestBin ? leftBounds : rightBounds).grow(bins[bestAxis][b].bounds);
+				}
+
+				uint32_t first = node.begin, last = node.begin + node.count;
+				while (first < last) {
+					const glm::vec3& centroid = primitives[first].centroid;
+					if (bin_index(node, scale, centroid, bestAxis) <= bestBin) {
+						leftCentroids.grow(centroid);
+						++first;
+					}
+					else {
+						rightCentroids.grow(centroid);
+						std::swap(primitives[first], primitives[--last]);
+					}
+				}
+				leftCount = first - node.begin;
+			}
+			else {
+				//every centroid is in the same place, any split is as good
+				leftCount = node.count / 2;
+				summarize(node.begin, leftCount, leftBounds, leftCentroids);
+				summarize(node.begin + leftCount, node.count - leftCount, rightBounds, rightCentroids);
+			}
+
+			uint32_t left = nodeCount.fetch_add(2);
+			node.left = left;
+			nodes[left] = BuildNode{ leftBounds, leftCentroids, node.begin, leftCount, kNone };
+			nodes[left + 1] = BuildNode{ rightBounds, rightCentroids, node.begin + leftCount, node.count - leftCount, kNone };
+
+			if (node.count > InstanceBvh::kParallelSize) {
+				vkJob::ThreadPool::get_pool()->parallel_for(2, [this, left](size_t child) {
+					split(left + static_cast<uint32_t>(child));
+				});
+			}
+			else {
+				split(left);
+				split(left + 1);
+			}
+		}
+	};
+
+	bool box_outside(const glm::vec3& lower, const glm::vec3& upper, const glm::vec4& plane, bool& inside) {
+		glm::vec3 normal(plane);
+		glm::vec3 center = 0.5f * (lower + upper);
+		glm::vec3 extent = 0.5f * (upper - lower);
+		float distance = glm::dot(normal, center) + plane.w;
+		float reach = glm::dot(glm::abs(normal), extent);
+		inside = distance - reach >= 0.0f;
+		return distance + reach < 0.0f;
+	}
+
+	/**
+		\returns the distance the ray enters the box, or infinity if it misses
+	*/
+	float ray_box(const glm::vec3& origin, const glm::vec3& inverse, float maxDistance, const glm::vec3& lower, const glm::vec3& upper) {
+		glm::vec3 toLower = (lower - origin) * inverse;
+		glm::vec3 toUpper = (upper - origin) * inverse;
+		glm::vec3 entry = glm::min(toLower, toUpper);
+		glm::vec3 exit = glm::max(toLower, toUpper);
+		float enter = std::max(std::max(entry.x, entry.y), std::max(entry.z, 0.0f));
+		float leave = std::min(std::min(exit.x, exit.y), std::min(exit.z, maxDistance));
+		return enter <= leave ? enter : std::numeric_limits<float>::infinity();
+	}
+
+	bool boxes_overlap(const glm::vec3& lowerA, const glm::vec3& upperA, const glm::vec3& lowerB, const glm::vec3& upperB) {
+		return glm::all(glm::lessThanEqual(lowerA, upperB)) && glm::all(glm::lessThanEqual(lowerB, upperA));
+	}
+
+	bool sphere_box_overlap(const glm::vec3& center, float radius, const glm::vec3& lower, const glm::vec3& upper) {
+		glm::vec3 offset = center - glm::clamp(center, lower, upper);
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+}
+
+void InstanceBvh::build(const InstanceStore& instances, const std::vector<InstanceGroup>& groups, const std::vector<float>& radii) {
+
+	nodes.clear();
+	parents.clear();
+	order.clear();
+	this->radii.assign(instances.size(), 0.0f);
+	leaves.assign(instances.size(), kNone);
+
+	for (size_t g = 0; g < groups.size(); ++g) {
+		for (uint32_t instance = groups[g].firstInstance; instance < groups[g].firstInstance + groups[g].instanceCount; ++instance) {
+			this->radii[instance] = radii[g];
+			order.push_back(instance);
+		}
+	}
+	if (order.empty()) {
+		return;
+	}
+
+	std::vector<Primitive> primitives(order.size());
+	vkJob::ThreadPool::get_pool()->parallel_for((order.size() + kParallelSize - 1) / kParallelSize, [&](size_t c) {
+		size_t last = std::min(order.size(), (c + 1) * kParallelSize);
+		for (size_t i = c * kParallelSize; i < last; ++i) {
+			Primitive& primitive = primitives[i];
+			primitive.instance = order[i];
+			primitive.centroid = instances.get_position(order[i]);
+			glm::vec3 reach(bounding_radius(instances, order[i]));
+			primitive.box.lower = primitive.centroid - reach;
+			primitive.box.upper = primitive.centroid + reach;
+		}
+	});
+
+	Builder builder(primitives);
+	BuildNode& root = builder.nodes[0];
+	root.begin = 0;
+	root.count = static_cast<uint32_t>(primitives.size());
+	builder.summarize(0, root.count, root.bounds, root.centroids);
+	builder.split(0);
+	for (size_t i = 0; i < primitives.size(); ++i) {
+		order[i] = primitives[i].instance;
+	}
+
+	//depth first, so the left child follows its parent
+	struct Pending {
+		uint32_t build;
+		uint32_t parent;
+		bool right;
+	};
+	nodes.reserve(builder.nodeCount.load());
+	parents.reserve(builder.nodeCount.load());
+	std::vector<Pending> stack = { { 0, kNone, false } };
+	while (!stack.empty()) {
+
+		Pending pending = stack.back();
+		stack.pop_back();
+
+		uint32_t index = static_cast<uint32_t>(nodes.size());
+		if (pending.right) {
+			nodes[pending.parent].first = index;
+		}
+
+		const BuildNode& source = builder.nodes[pending.build];
+		bool leaf = source.left == kNone;
+		nodes.push_back(Node{ source.bounds.lower, leaf ? source.begin : 0, source.bounds.upper, leaf ? source.count : 0 });
+		parents.push_back(pending.parent);
+
+		if (leaf) {
+			for (uint32_t i = source.begin; i < source.begin + source.count; ++i) {
+				leaves[order[i]] = index;
+			}
+		}
+		else {
+			stack.push_back({ source.left + 1, index, true });
+			stack.push_back({ source.left, index, false });
+		}
+	}
+}
+
+float InstanceBvh::bounding_radius(const InstanceStore& instances, uint32_t instance) const {
+	float scale = std::max(std::abs(instances.scaleX[instance]), std::max(std::abs(instances.scaleY[instance]), std::abs(instances.scaleZ[instance])));
+	return radii[instance] * scale;
+}
+
+void InstanceBvh::fit_leaf(const InstanceStore& instances, Node& node) const {
+
+	Box box;
+	for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+		glm::vec3 reach(bounding_radius(instances, order[i]));
+		box.grow(instances.get_position(order[i]) - reach);
+		box.grow(instances.get_position(order[i]) + reach);
+	}
+	node.lower = box.lower;
+	node.upper = box.upper;
+}
+
+void InstanceBvh::refit(const InstanceStore& instances, const uint32_t* changed, size_t count) {
+
+	for (size_t c = 0; c < count; ++c) {
+
+		if (changed[c] >= leaves.size() || leaves[changed[c]] == kNone) {
+			continue;
+		}
+
+		uint32_t index = leaves[changed[c]];
+		Node& leaf = nodes[index];
+		glm::vec3 lower = leaf.lower, upper = leaf.upper;
+		fit_leaf(instances, leaf);
+		if (leaf.lower == lower && leaf.upper == upper) {
+			continue;
+		}
+
+		for (uint32_t parent = parents[index]; parent != kNone; parent = parents[parent]) {
+			Node& node = nodes[parent];
+			glm::vec3 fitLower = glm::min(nodes[parent + 1].lower, nodes[node.first].lower);
+			glm::vec3 fitUpper = glm::max(nodes[parent + 1].upper, nodes[node.first].upper);
+			if (fitLower == node.lower && fitUpper == node.upper) {
+				break;
+			}
+			node.lower = fitLower;
+			node.upper = fitUpper;
+		}
+	}
+}
+
+void InstanceBvh::query_frustum(const InstanceStore& instances, const Frustum& frustum, std::vector<uint32_t>& found, size_t* tested) const {
+
+	size_t tests = 0;
+	if (!nodes.empty()) {
+
+		//planes a node is already wholly inside are not tested again below it
+		struct Entry {
+			uint32_t node;
+			uint32_t planes;
+		};
+		std::vector<Entry> stack = { { 0, 0x3F } };
+		while (!stack.empty()) {
+
+			Entry entry = stack.back();
+			stack.pop_back();
+			const Node& node = nodes[entry.node];
+
+			bool outside = false;
+			for (uint32_t p = 0; p < 6 && !outside; ++p) {
+				bool inside;
+				if ((entry.planes & (1u << p)) && !(outside = box_outside(node.lower, node.upper, frustum.planes[p], inside)) && inside) {
+					entry.planes &= ~(1u << p);
+				}
+			}
+			if (outside) {
+				continue;
+			}
+
+			if (node.count == 0) {
+				stack.push_back({ node.first, entry.planes });
+				stack.push_back({ entry.node + 1, entry.planes });
+				continue;
+			}
+
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				uint32_t instance = order[i];
+				if (entry.planes == 0) {
+					if (!(instances.flags[instance] & INSTANCE_UNDRAWN)) {
+						found.push_back(instance);
+					}
+					continue;
+				}
+				++tests;
+				if (is_instance_visible(frustum, instances, instance, radii[instance])) {
+					found.push_back(instance);
+				}
+			}
+		}
+	}
+
+	if (tested) {
+		*tested = tests;
+	}
+}
+
+bool InstanceBvh::ray_cast(const InstanceStore& instances, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const {
+
+	if (nodes.empty()) {
+		return false;
+	}
+
+	glm::vec3 inverse = 1.0f / direction;
+	float best = maxDistance;
+	bool found = false;
+
+	//nearer children are visited first, so farther ones are often skipped
+	struct Entry {
+		uint32_t node;
+		float distance;
+	};
+	std::vector<Entry> stack;
+	float rootDistance = ray_box(origin, inverse, best, nodes[0].lower, nodes[0].upper);
+	if (rootDistance < best) {
+		stack.push_back({ 0, rootDistance });
+	}
+
+	while (!stack.empty()) {
+
+		Entry entry = stack.back();
+		stack.pop_back();
+		if (entry.distance > best) {
+			continue;
+		}
+		const Node& node = nodes[entry.node];
+
+		if (node.count == 0) {
+			uint32_t closer = entry.node + 1, farther = node.first;
+			float closerDistance = ray_box(origin, inverse, best, nodes[closer].lower, nodes[closer].upper);
+			float fartherDistance = ray_box(origin, inverse, best, nodes[farther].lower, nodes[farther].upper);
+			if (fartherDistance < closerDistance) {
+				std::swap(closer, farther);
+				std::swap(closerDistance, fartherDistance);
+			}
+			if (fartherDistance <= best) {
+				stack.push_back({ farther, fartherDistance });
+			}
+			if (closerDistance <= best) {
+				stack.push_back({ closer, closerDistance });
+			}
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+
+			uint32_t instance = order[i];
+			if (instances.flags[instance] & INSTANCE_HIDDEN) {
+				continue;
+			}
+
+			float radius = bounding_radius(instances, instance);
+			glm::vec3 offset = origin - instances.get_position(instance);
+			float b = glm::dot(offset, direction);
+			float c = glm::dot(offset, offset) - radius * radius;
+			float discriminant = b * b - c;
+			if (discriminant < 0.0f) {
+				continue;
+			}
+			float root = std::sqrt(discriminant);
+			if (-b + root < 0.0f) {
+				continue;
+			}
+
+			//starting inside a sphere hits it straight away
+			float distance = std::max(-b - root, 0.0f);
+			if (distance <= best) {
+				best = distance;
+				hit.instance = instance;
+				hit.distance = distance;
+				found = true;
+			}
+		}
+	}
+
+	return found;
+}
+
+void InstanceBvh::query_box(const InstanceStore& instances, const glm::vec3& lower, const glm::vec3& upper, std::vector<uint32_t>& found) const {
+
+	if (nodes.empty()) {
+		return;
+	}
+
+	std::vector<uint32_t> stack = { 0 };
+	while (!stack.empty()) {
+
+		uint32_t index = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+		if (!boxes_overlap(node.lower, node.upper, lower, upper)) {
+			continue;
+		}
+
+		if (node.count == 0) {
+			stack.push_back(node.first);
+			stack.push_back(index + 1);
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+			uint32_t instance = order[i];
+			if (!(instances.flags[instance] & INSTANCE_HIDDEN)
+				&& sphere_box_overlap(instances.get_position(instance), bounding_radius(instances, instance), lower, upper)) {
+				found.push_back(instance);
+			}
+		}
+	}
+}
+
+void InstanceBvh::query_sphere(const InstanceStore& instances, const glm::vec3& center, float radius, std::vector<uint32_t>& found) const {
+
+	if (nodes.empty()) {
+		return;
+	}
+
+	std::vector<uint32_t> stack = { 0 };
+	while (!stack.empty()) {
+
+		uint32_t index = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+		if (!sphere_box_overlap(center, radius, node.lower, node.upper)) {
+			continue;
+		}
+
+		if (node.count == 0) {
+			stack.push_back(node.first);
+			stack.push_back(index + 1);
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+			uint32_t instance = order[i];
+			float reach = radius + bounding_radius(instances, instance);
+			glm::vec3 offset = instances.get_position(instance) - center;
+			if (!(instances.flags[instance] & INSTANCE_HIDDEN) && glm::dot(offset, offset) <= reach * reach) {
+				found.push_back(instance);
+			}
+		}
+	}
+}
+
+size_t InstanceBvh::size() const {
+	return order.size();
+}
+
+void benchmark_bvh(size_t maxCount) {
+
+	using clock = std::chrono::steady_clock;
+	auto since = [](clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+	const size_t queries = 10000;
+
+	for (size_t count = 10000; count <= maxCount; count *= 10) {
+
+		//same density at every size, about one instance per 8 cubic units
+		std::mt19937 random(7);
+		float side = 2.0f * std::cbrt(static_cast<float>(count));
+		std::uniform_real_distribution<float> position(-0.5f * side, 0.5f * side);
+		std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+
+		InstanceStore instances;
+		for (size_t i = 0; i < count; ++i) {
+			float size = scale(random);
+			instances.add(Renderable{ 0, 0 }, glm::vec3(position(random), position(random), position(random)),
+				glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(size));
+		}
+		std::vector<InstanceGroup> groups = { InstanceGroup{ Renderable{ 0, 0 }, 0, static_cast<uint32_t>(count) } };
+		std::vector<float> radii = { 0.5f };
+
+		clock::time_point start = clock::now();
+		InstanceBvh bvh;
+		bvh.build(instances, groups, radii);
+		double buildTime = since(start);
+
+		//nudge one in a hundred
+		std::vector<uint32_t> moved;
+		std::uniform_real_distribution<float> nudge(-0.5f, 0.5f);
+		for (uint32_t i = 0; i < count; i += 100) {
+			instances.set_position(i, instances.get_position(i) + glm::vec3(nudge(random), nudge(random), nudge(random)));
+			moved.push_back(i);
+		}
+		start = clock::now();
+		bvh.refit(instances, moved.data(), moved.size());
+		double refitTime = since(start);
+
+		//looking at a corner of the scene
+		glm::vec3 eye(0.5f * side, 0.5f * side, 0.5f * side);
+		glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 0.5f * side)
+			* glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		Frustum frustum = make_frustum(viewProjection);
+
+		std::vector<uint32_t> found;
+		size_t tested = 0;
+		start = clock::now();
+		bvh.query_frustum(instances, frustum, found, &tested);
+		double frustumTime = since(start);
+
+		FrustumCuller culler;
+		culler.cull(instances, groups, radii, frustum);
+
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		size_t hits = 0;
+		start = clock::now();
+		for (size_t q = 0; q < queries; ++q) {
+			glm::vec3 direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.001f));
+			RayHit hit;
+			hits += bvh.ray_cast(instances, glm::vec3(position(random), position(random), position(random)), direction, side, hit) ? 1 : 0;
+		}
+		double rayTime = since(start);
+
+		size_t ranged = 0;
+		start = clock::now();
+		for (size_t q = 0; q < queries; ++q) {
+			std::vector<uint32_t> nearby;
+			bvh.query_sphere(instances, glm::vec3(position(random), position(random), position(random)), 5.0f, nearby);
+			ranged += nearby.size();
+		}
+		double rangeTime = since(start);
+
+		std::cout << "Instances: " << count << "\n";
+		std::cout << "  build " << buildTime << " ms, " << bvh.nodes.size() << " nodes\n";
+		std::cout << "  refit of " << moved.size() << " moved " << refitTime << " ms\n";
+		std::cout << "  frustum query " << frustumTime << " ms, " << found.size() << " visible, " << tested
+			<< " tested; brute force " << culler.stats.milliseconds << " ms, " << culler.stats.visible << " visible\n";
+		std::cout << "  " << queries << " ray casts " << rayTime << " ms, " << hits << " hits\n";
+		std::cout << "  " << queries << " sphere queries " << rangeTime << " ms, " << ranged << " found\n";
+	}
+}
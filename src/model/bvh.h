@@ -0,0 +1,118 @@
+#pragma once
+#include "../config.h"
+#include "frustum_culler.h"
+
+/**
+	Nearest instance a ray passes through
+*/
+struct RayHit {
+	uint32_t instance;
+	float distance;
+};
+
+/**
+	Bounding volume hierarchy over the bounding spheres of scene instances.
+
+	Built top down with binned SAH, splitting large nodes on the thread pool.
+	Nodes are stored depth first, 32 bytes each: an interior node's left child
+	is the next node and only the right child's index is kept, so a descent
+	mostly reads forward through memory. The instances of any subtree are a
+	contiguous run of order.
+
+	Moving instances only needs a refit, which regrows their leaves and walks up
+	until a node's box stops changing. Refits loosen the tree, build again when
+	instances are added or queries slow down. Queries skip hidden instances.
+*/
+class InstanceBvh {
+public:
+
+	//leaves are made at this size or below
+	static const uint32_t kLeafSize = 4;
+	//and may stay up to this size when SAH finds no worthwhile split
+	static const uint32_t kMaxLeafSize = 16;
+	//candidate split planes per axis
+	static const uint32_t kBins = 16;
+	//nodes with more instances than this are binned and split in parallel
+	static const uint32_t kParallelSize = 16384;
+
+	struct Node {
+		glm::vec3 lower;
+		//leaf: first entry of order, interior: index of the right child
+		uint32_t first;
+		glm::vec3 upper;
+		//instances in a leaf, 0 for interior nodes
+		uint32_t count;
+	};
+
+	/**
+		Build over every instance of the groups.
+
+		\param instances the store the groups index into
+		\param groups runs of instances sharing a mesh
+		\param radii the bounding radius of each group's mesh
+	*/
+	void build(const InstanceStore& instances, const std::vector<InstanceGroup>& groups, const std::vector<float>& radii);
+
+	/**
+		Regrow the boxes holding instances which moved, rotated or were scaled.
+
+		\param changed store indices, instances not in the tree are ignored
+		\param count number of changed instances
+	*/
+	void refit(const InstanceStore& instances, const uint32_t* changed, size_t count);
+
+	/**
+		Append the visible instances which are drawn on their own, neither hidden nor batched. Subtrees found wholly inside
+		are taken without testing further.
+
+		\param tested if given, receives the number of instances tested individually
+	*/
+	void query_frustum(const InstanceStore& instances, const Frustum& frustum, std::vector<uint32_t>& found, size_t* tested = nullptr) const;
+
+	/**
+		Find the closest instance whose bounding sphere the ray enters, for picking.
+
+		\param direction normalized
+		\param maxDistance hits beyond this are ignored
+		\returns whether anything was hit
+	*/
+	bool ray_cast(const InstanceStore& instances, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+
+	/**
+		Append the instances whose bounding spheres overlap the box.
+	*/
+	void query_box(const InstanceStore& instances, const glm::vec3& lower, const glm::vec3& upper, std::vector<uint32_t>& found) const;
+
+	/**
+		Append the instances whose bounding spheres overlap the sphere.
+	*/
+	void query_sphere(const InstanceStore& instances, const glm::vec3& center, float radius, std::vector<uint32_t>& found) const;
+
+	/**
+		\returns the number of instances in the tree
+	*/
+	size_t size() const;
+
+	std::vector<Node> nodes;
+	//store index of each instance, in leaf order
+	std::vector<uint32_t> order;
+
+private:
+
+	//per store instance, the group's mesh radius
+	std::vector<float> radii;
+	//per store instance, the leaf holding it
+	std::vector<uint32_t> leaves;
+	std::vector<uint32_t> parents;
+
+	float bounding_radius(const InstanceStore& instances, uint32_t instance) const;
+	void fit_leaf(const InstanceStore& instances, Node& node) const;
+};
+
+/**
+	Build, refit and query trees of random instances, up to maxCount,
+	against the brute force culler, and report the timings.
+
+	\param maxCount the largest scene, sizes grow by ten from 10 thousand
+*/
+void benchmark_bvh(size_t maxCount);
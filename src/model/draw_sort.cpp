@@ -0,0 +1,161 @@
+#include "draw_sort.h"
+#include "../control/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+namespace {
+
+	const uint32_t kRadixBits = 8;
+	const uint32_t kBuckets = 1 << kRadixBits;
+	//below this many draws per chunk the workers cost more than they save
+	const size_t kChunkSize = 16384;
+
+	uint64_t field(uint32_t value, uint32_t bits) {
+		return static_cast<uint64_t>(value) & ((uint64_t(1) << bits) - 1);
+	}
+}
+
+uint32_t quantize_depth(float depth) {
+
+	//positive floats order like their bits, the top ones are kept
+	depth = std::max(depth, 0.0f);
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> (31 - drawKeys::kDepthBits);
+}
+
+uint64_t make_draw_key(drawLayers layer, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth) {
+
+	using namespace drawKeys;
+	uint64_t key = field(static_cast<uint32_t>(layer), kLayerBits) << (64 - kLayerBits);
+	uint64_t state = field(pipeline, kPipelineBits) << (kMaterialBits + kMeshBits)
+		| field(material, kMaterialBits) << kMeshBits
+		| field(mesh, kMeshBits);
+	uint32_t quantized = quantize_depth(depth);
+
+	if (layer == drawLayers::LAYER_TRANSPARENT) {
+		uint32_t farFirst = ((1u << kDepthBits) - 1) - quantized;
+		return key | field(farFirst, kDepthBits) << (kPipelineBits + kMaterialBits + kMeshBits) | state;
+	}
+	return key | state << kDepthBits | quantized;
+}
+
+void sort_draws(std::vector<DrawItem>& items, std::vector<DrawItem>& scratch) {
+
+	size_t count = items.size();
+	if (count < 2) {
+		return;
+	}
+	scratch.resize(count);
+
+	//bytes where every key matches the first would not move anything
+	uint64_t varying = 0;
+	for (const DrawItem& item : items) {
+		varying |= item.key ^ items[0].key;
+	}
+
+	vkJob::ThreadPool* pool = vkJob::ThreadPool::get_pool();
+	size_t chunks = std::min<size_t>((count + kChunkSize - 1) / kChunkSize, pool->get_worker_count() + 1);
+	size_t chunkLength = (count + chunks - 1) / chunks;
+	std::vector<size_t> offsets(chunks * kBuckets);
+
+	for (uint32_t shift = 0; shift < 64; shift += kRadixBits) {
+
+		if (((varying >> shift) & (kBuckets - 1)) == 0) {
+			continue;
+		}
+
+		//each chunk counts its digits
+		auto count_digits = [&](size_t c) {
+			size_t* histogram = offsets.data() + c * kBuckets;
+			std::fill(histogram, histogram + kBuckets, 0);
+			size_t last = std::min(count, (c + 1) * chunkLength);
+			for (size_t i = c * chunkLength; i < last; ++i) {
+				++histogram[(items[i].key >> shift) & (kBuckets - 1)];
+			}
+		};
+
+		//then takes its place in each bucket after the chunks before it, which keeps the sort stable
+		auto scatter = [&](size_t c) {
+			size_t* next = offsets.data() + c * kBuckets;
+			size_t last = std::min(count, (c + 1) * chunkLength);
+			for (size_t i = c * chunkLength; i < last; ++i) {
+				scratch[next[(items[i].key >> shift) & (kBuckets - 1)]++] = items[i];
+			}
+		};
+
+		if (chunks == 1) {
+			count_digits(0);
+		}
+		else {
+			pool->parallel_for(chunks, count_digits);
+		}
+
+		size_t total = 0;
+		for (uint32_t digit = 0; digit < kBuckets; ++digit) {
+			for (size_t c = 0; c < chunks; ++c) {
+				size_t digitCount = offsets[c * kBuckets + digit];
+				offsets[c * kBuckets + digit] = total;
+				total += digitCount;
+			}
+		}
+
+		if (chunks == 1) {
+			scatter(0);
+		}
+		else {
+			pool->parallel_for(chunks, scatter);
+		}
+		items.swap(scratch);
+	}
+}
+
+void benchmark_draw_sort(size_t count) {
+
+	using clock = std::chrono::steady_clock;
+	auto since = [](clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	std::cout << "Workers: " << vkJob::ThreadPool::get_pool()->get_worker_count() << "\n";
+
+	//a few pipelines and materials, many meshes, depths spread over a large view
+	std::mt19937 random(5);
+	std::uniform_int_distribution<uint32_t> pipelines(0, 3), materials(0, 255), meshes(0, 4095);
+	std::uniform_real_distribution<float> depths(0.1f, 5000.0f);
+	std::uniform_int_distribution<uint32_t> transparent(0, 9);
+
+	std::vector<DrawItem> items, expected, scratch;
+	for (size_t draws = std::min<size_t>(1000, count); draws > 0; draws = std::min(draws * 10, count)) {
+
+		items.resize(draws);
+		for (size_t i = 0; i < draws; ++i) {
+			drawLayers layer = transparent(random) == 0 ? drawLayers::LAYER_TRANSPARENT : drawLayers::LAYER_OPAQUE;
+			items[i].key = make_draw_key(layer, pipelines(random), materials(random), meshes(random), depths(random));
+			items[i].draw = static_cast<uint32_t>(i);
+		}
+		expected = items;
+
+		clock::time_point start = clock::now();
+		std::stable_sort(expected.begin(), expected.end(), [](const DrawItem& a, const DrawItem& b) {
+			return a.key < b.key;
+		});
+		double reference = since(start);
+
+		start = clock::now();
+		sort_draws(items, scratch);
+		double radix = since(start);
+
+		bool agree = std::equal(items.begin(), items.end(), expected.begin(), [](const DrawItem& a, const DrawItem& b) {
+			return a.key == b.key && a.draw == b.draw;
+		});
+		std::cout << "  " << draws << " draws: radix " << radix << " ms, std::stable_sort " << reference
+			<< " ms" << (agree ? "" : ", ORDER DIFFERS") << "\n";
+
+		if (draws == count) {
+			break;
+		}
+	}
+}
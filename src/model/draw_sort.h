@@ -0,0 +1,72 @@
+#pragma once
+#include "../config.h"
+
+/**
+	Passes a frame draws, in this order. Opaque draws go front to back so
+	early depth testing rejects what they hide, transparent ones back to
+	front so they blend over what is behind them.
+*/
+enum class drawLayers {
+	LAYER_OPAQUE,
+	LAYER_TRANSPARENT,
+	LAYER_OVERLAY
+};
+
+/**
+	Draws are ordered by one 64 bit key, the most significant field first.
+
+	Opaque keys hold, from the top: layer (2 bits), pipeline (6), material
+	(12), mesh (20) and depth (24), so state changes as rarely as it can and
+	draws sharing all of it go nearest first. Transparent keys put the
+	depth, farthest first, straight after the layer, since blending needs
+	that order whatever the state costs. Overlay keys are laid out like
+	opaque ones.
+*/
+namespace drawKeys {
+	const uint32_t kLayerBits = 2;
+	const uint32_t kPipelineBits = 6;
+	const uint32_t kMaterialBits = 12;
+	const uint32_t kMeshBits = 20;
+	const uint32_t kDepthBits = 24;
+}
+
+/**
+	\param depth distance along the view direction, negative depths count as 0
+	\returns the depth as kDepthBits bits which order like the depth does
+*/
+uint32_t quantize_depth(float depth);
+
+/**
+	Fields wider than their bits keep the low ones.
+	\param depth distance along the view direction
+	\returns the key ordering the draw within its layer
+*/
+uint64_t make_draw_key(drawLayers layer, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+/**
+	A draw to be sorted, named by its position in the caller's draw list
+*/
+struct DrawItem {
+	uint64_t key;
+	uint32_t draw;
+};
+
+/**
+	Sort draws by key, keeping the order of equal keys. A least significant
+	digit radix sort, eight bits a pass, which skips the bytes every key
+	shares. Large lists are split into chunks over the thread pool: each
+	chunk counts its digits, the counts give every chunk its place in each
+	bucket, and the chunks scatter in parallel.
+
+	\param items the draws, sorted on return
+	\param scratch holds the other copy between passes, kept to save allocating it again
+*/
+void sort_draws(std::vector<DrawItem>& items, std::vector<DrawItem>& scratch);
+
+/**
+	Sort shuffled draw lists with sort_draws and with std::stable_sort, check
+	they agree and report the timings.
+
+	\param count the largest number of draws
+*/
+void benchmark_draw_sort(size_t count);
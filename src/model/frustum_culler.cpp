@@ -0,0 +1,286 @@
+#include "frustum_culler.h"
+#include "bvh.h"
+#include "../control/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+	/**
+		Column pointers for the instances being culled, offset so index 0 is the first.
+	*/
+	struct CullSource {
+		const float* positionX;
+		const float* positionY;
+		const float* positionZ;
+		const float* scaleX;
+		const float* scaleY;
+		const float* scaleZ;
+		const uint32_t* flags;
+	};
+
+	float largest_scale(float x, float y, float z) {
+		return std::max(std::abs(x), std::max(std::abs(y), std::abs(z)));
+	}
+
+	/**
+		\returns the number of visible instances written to visible, as first + i
+	*/
+	uint32_t cull_scalar(const CullSource& source, uint32_t begin, uint32_t count, uint32_t first,
+		float radius, const Frustum& frustum, uint32_t* visible) {
+
+		uint32_t written = 0;
+		for (uint32_t i = begin; i < count; ++i) {
+
+			float r = radius * largest_scale(source.scaleX[i], source.scaleY[i], source.scaleZ[i]);
+			bool inside = (source.flags[i] & INSTANCE_UNDRAWN) == 0;
+			for (const glm::vec4& plane : frustum.planes) {
+				inside &= plane.x * source.positionX[i] + plane.y * source.positionY[i]
+					+ plane.z * source.positionZ[i] + plane.w >= -r;
+			}
+
+			//write unconditionally, only keep it if visible
+			visible[written] = first + i;
+			written += inside ? 1 : 0;
+		}
+		return written;
+	}
+
+#ifdef VK_SIMD_X86
+	VK_TARGET_AVX2 uint32_t cull_avx2(const CullSource& source, uint32_t count, uint32_t first,
+		float radius, const Frustum& frustum, uint32_t* visible) {
+
+		const __m256 signBit = _mm256_set1_ps(-0.0f);
+		const __m256i hidden = _mm256_set1_epi32(INSTANCE_UNDRAWN);
+		const __m256 negativeRadius = _mm256_set1_ps(-radius);
+
+		__m256 planes[6][4];
+		for (int p = 0; p < 6; ++p) {
+			for (int c = 0; c < 4; ++c) {
+				planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+			}
+		}
+
+		uint32_t written = 0;
+		uint32_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+
+			__m256 x = _mm256_loadu_ps(source.positionX + i);
+			__m256 y = _mm256_loadu_ps(source.positionY + i);
+			__m256 z = _mm256_loadu_ps(source.positionZ + i);
+
+			__m256 scale = _mm256_max_ps(
+				_mm256_andnot_ps(signBit, _mm256_loadu_ps(source.scaleX + i)),
+				_mm256_max_ps(
+					_mm256_andnot_ps(signBit, _mm256_loadu_ps(source.scaleY + i)),
+					_mm256_andnot_ps(signBit, _mm256_loadu_ps(source.scaleZ + i))));
+			__m256 limit = _mm256_mul_ps(negativeRadius, scale);
+
+			__m256i flags = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source.flags + i));
+			__m256 inside = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(flags, hidden), _mm256_setzero_si256()));
+
+			for (int p = 0; p < 6; ++p) {
+				__m256 distance = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(planes[p][0], x), _mm256_mul_ps(planes[p][1], y)),
+					_mm256_add_ps(_mm256_mul_ps(planes[p][2], z), planes[p][3]));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, limit, _CMP_GE_OQ));
+			}
+
+			int mask = _mm256_movemask_ps(inside);
+			for (uint32_t k = 0; k < 8; ++k) {
+				visible[written] = first + i + k;
+				written += (mask >> k) & 1;
+			}
+		}
+
+		return written + cull_scalar(source, i, count, first, radius, frustum, visible + written);
+	}
+#endif
+
+#ifdef VK_SIMD_NEON
+	uint32_t cull_neon(const CullSource& source, uint32_t count, uint32_t first,
+		float radius, const Frustum& frustum, uint32_t* visible) {
+
+		const uint32x4_t hidden = vdupq_n_u32(INSTANCE_UNDRAWN);
+		const float32x4_t negativeRadius = vdupq_n_f32(-radius);
+
+		uint32_t written = 0;
+		uint32_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+
+			float32x4_t x = vld1q_f32(source.positionX + i);
+			float32x4_t y = vld1q_f32(source.positionY + i);
+			float32x4_t z = vld1q_f32(source.positionZ + i);
+
+			float32x4_t scale = vmaxq_f32(
+				vabsq_f32(vld1q_f32(source.scaleX + i)),
+				vmaxq_f32(vabsq_f32(vld1q_f32(source.scaleY + i)), vabsq_f32(vld1q_f32(source.scaleZ + i))));
+			float32x4_t limit = vmulq_f32(negativeRadius, scale);
+
+			uint32x4_t inside = vceqq_u32(vandq_u32(vld1q_u32(source.flags + i), hidden), vdupq_n_u32(0));
+			for (const glm::vec4& plane : frustum.planes) {
+				float32x4_t distance = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(plane.w), x, plane.x), y, plane.y), z, plane.z);
+				inside = vandq_u32(inside, vcgeq_f32(distance, limit));
+			}
+
+			uint32_t lanes[4];
+			vst1q_u32(lanes, inside);
+			for (uint32_t k = 0; k < 4; ++k) {
+				visible[written] = first + i + k;
+				written += lanes[k] & 1;
+			}
+		}
+
+		return written + cull_scalar(source, i, count, first, radius, frustum, visible + written);
+	}
+#endif
+}
+
+Frustum make_frustum(const glm::mat4& viewProjection) {
+
+	//rows of the column major matrix
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; ++r) {
+		rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	//depth runs 0 to w
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	for (glm::vec4& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+bool is_instance_visible(const Frustum& frustum, const InstanceStore& instances, size_t instance, float radius) {
+
+	if (instances.flags[instance] & INSTANCE_UNDRAWN) {
+		return false;
+	}
+
+	glm::vec3 center = instances.get_position(instance);
+	float r = radius * largest_scale(instances.scaleX[instance], instances.scaleY[instance], instances.scaleZ[instance]);
+	for (const glm::vec4& plane : frustum.planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -r) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool is_box_visible(const Frustum& frustum, const glm::vec3& lower, const glm::vec3& upper) {
+
+	for (const glm::vec4& plane : frustum.planes) {
+		glm::vec3 furthest(
+			plane.x >= 0.0f ? upper.x : lower.x,
+			plane.y >= 0.0f ? upper.y : lower.y,
+			plane.z >= 0.0f ? upper.z : lower.z);
+		if (glm::dot(glm::vec3(plane), furthest) + plane.w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+FrustumCuller::FrustumCuller() {
+	stats = { 0, 0, 0.0 };
+}
+
+void FrustumCuller::cull(const InstanceStore& instances, const std::vector<InstanceGroup>& groups,
+	const std::vector<float>& radii, const Frustum& frustum, simdLevels kernel) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	//each chunk writes to its own share of the group's list
+	chunks.clear();
+	visible.resize(groups.size());
+	stats.tested = 0;
+	for (uint32_t g = 0; g < groups.size(); ++g) {
+		visible[g].resize(groups[g].instanceCount);
+		for (uint32_t first = 0; first < groups[g].instanceCount; first += kChunkSize) {
+			chunks.push_back(Chunk{ g, first, std::min(kChunkSize, groups[g].instanceCount - first), 0 });
+		}
+		stats.tested += groups[g].instanceCount;
+	}
+
+	vkJob::ThreadPool::get_pool()->parallel_for(chunks.size(), [&](size_t c) {
+
+		Chunk& chunk = chunks[c];
+		uint32_t first = groups[chunk.group].firstInstance + chunk.first;
+		float radius = radii[chunk.group];
+		uint32_t* output = visible[chunk.group].data() + chunk.first;
+
+		CullSource source;
+		source.positionX = instances.positionX.data() + first;
+		source.positionY = instances.positionY.data() + first;
+		source.positionZ = instances.positionZ.data() + first;
+		source.scaleX = instances.scaleX.data() + first;
+		source.scaleY = instances.scaleY.data() + first;
+		source.scaleZ = instances.scaleZ.data() + first;
+		source.flags = instances.flags.data() + first;
+
+		switch (kernel) {
+#ifdef VK_SIMD_X86
+		case simdLevels::AVX2:
+			chunk.visible = cull_avx2(source, chunk.count, first, radius, frustum, output);
+			break;
+#endif
+#ifdef VK_SIMD_NEON
+		case simdLevels::NEON:
+			chunk.visible = cull_neon(source, chunk.count, first, radius, frustum, output);
+			break;
+#endif
+		default:
+			chunk.visible = cull_scalar(source, 0, chunk.count, first, radius, frustum, output);
+			break;
+		}
+	});
+
+	//close the gaps between chunks, they only ever move down
+	stats.visible = 0;
+	std::vector<uint32_t> groupVisible(groups.size(), 0);
+	for (const Chunk& chunk : chunks) {
+		std::vector<uint32_t>& list = visible[chunk.group];
+		uint32_t& end = groupVisible[chunk.group];
+		if (end != chunk.first) {
+			std::copy(list.begin() + chunk.first, list.begin() + chunk.first + chunk.visible, list.begin() + end);
+		}
+		end += chunk.visible;
+	}
+	for (uint32_t g = 0; g < groups.size(); ++g) {
+		visible[g].resize(groupVisible[g]);
+		stats.visible += groupVisible[g];
+	}
+
+	stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrustumCuller::cull(const InstanceBvh& bvh, const InstanceStore& instances, const std::vector<InstanceGroup>& groups,
+	const Frustum& frustum) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	found.clear();
+	bvh.query_frustum(instances, frustum, found, &stats.tested);
+
+	//groups are runs of the store, in store order
+	visible.resize(groups.size());
+	for (std::vector<uint32_t>& list : visible) {
+		list.clear();
+	}
+	for (uint32_t instance : found) {
+		std::vector<InstanceGroup>::const_iterator group = std::upper_bound(groups.begin(), groups.end(), instance,
+			[](uint32_t index, const InstanceGroup& group) { return index < group.firstInstance; });
+		visible[group - groups.begin() - 1].push_back(instance);
+	}
+	stats.visible = found.size();
+
+	stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "../config.h"
+#include "scene.h"
+#include "simd.h"
+
+class InstanceBvh;
+
+/**
+	Planes facing into the view volume, a point p is inside when
+	dot(plane.xyz, p) + plane.w >= 0 for all six. Normalized, so the same sum is a distance.
+*/
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+/**
+	Extract the planes of a view projection with vulkan's 0 to 1 depth range.
+*/
+Frustum make_frustum(const glm::mat4& viewProjection);
+
+/**
+	\returns whether any of the instance's bounding sphere is inside the frustum
+		and the instance is drawn on its own, neither hidden nor batched
+*/
+bool is_instance_visible(const Frustum& frustum, const InstanceStore& instances, size_t instance, float radius);
+
+/**
+	\returns whether any of the axis aligned box is inside the frustum, by
+		testing the corner furthest along each plane's normal
+*/
+bool is_box_visible(const Frustum& frustum, const glm::vec3& lower, const glm::vec3& upper);
+
+/**
+	What the last cull did
+*/
+struct CullStats {
+	size_t tested;
+	size_t visible;
+	double milliseconds;
+};
+
+/**
+	Tests instance bounding spheres against the view frustum, eight at a time,
+	with each group split into chunks spread over the thread pool.
+	A sphere is the group mesh's bounding radius scaled by the instance's largest scale.
+*/
+class FrustumCuller {
+public:
+
+	//instances per parallel job
+	static const uint32_t kChunkSize = 4096;
+
+	FrustumCuller();
+
+	/**
+		Cull every group, visible[g] receives the visible store indices of group g, in store order.
+
+		\param instances the store the groups index into
+		\param groups runs of instances sharing a mesh
+		\param radii the bounding radius of each group's mesh
+		\param frustum the view to test against
+		\param kernel the kernel to test with, must be supported
+	*/
+	void cull(const InstanceStore& instances, const std::vector<InstanceGroup>& groups,
+		const std::vector<float>& radii, const Frustum& frustum, simdLevels kernel = get_simd_level());
+
+	/**
+		Cull every group through the tree, skipping whole subtrees outside the view.
+		visible[g] receives the visible store indices of group g, in tree order.
+
+		\param bvh built over the same instances and groups
+	*/
+	void cull(const InstanceBvh& bvh, const InstanceStore& instances, const std::vector<InstanceGroup>& groups,
+		const Frustum& frustum);
+
+	std::vector<std::vector<uint32_t>> visible;
+	CullStats stats;
+
+private:
+
+	struct Chunk {
+		uint32_t group;
+		uint32_t first;
+		uint32_t count;
+		//written by the job, visible instances at the start of the chunk's share of the list
+		uint32_t visible;
+	};
+
+	std::vector<Chunk> chunks;
+	//tree query results, before sorting into groups
+	std::vector<uint32_t> found;
+};
@@ -0,0 +1,469 @@
+#include "instance_store.h"
+#include <chrono>
+#include <random>
+
+namespace {
+
+	/**
+		Column pointers for one run of instances, the kernels only see these.
+	*/
+	struct TransformSource {
+		const float* positionX;
+		const float* positionY;
+		const float* positionZ;
+		const float* rotationX;
+		const float* rotationY;
+		const float* rotationZ;
+		const float* rotationW;
+		const float* scaleX;
+		const float* scaleY;
+		const float* scaleZ;
+	};
+
+	float* destination(glm::mat4* transforms, const uint32_t* slots, size_t i) {
+		if (!slots) {
+			return &transforms[i][0][0];
+		}
+		return slots[i] == InstanceStore::kSkipSlot ? nullptr : &transforms[slots[i]][0][0];
+	}
+
+	/**
+		Same arithmetic as glm::mat4_cast, with the scale folded into the columns.
+	*/
+	void build_scalar(const TransformSource& source, size_t first, size_t count, const uint32_t* slots, glm::mat4* transforms) {
+
+		for (size_t i = first; i < count; ++i) {
+
+			float* matrix = destination(transforms, slots, i);
+			if (!matrix) {
+				continue;
+			}
+
+			float x = source.rotationX[i], y = source.rotationY[i], z = source.rotationZ[i], w = source.rotationW[i];
+			float xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+			float xy = 2.0f * x * y, xz = 2.0f * x * z, yz = 2.0f * y * z;
+			float wx = 2.0f * w * x, wy = 2.0f * w * y, wz = 2.0f * w * z;
+			float sx = source.scaleX[i], sy = source.scaleY[i], sz = source.scaleZ[i];
+
+			matrix[0] = (1.0f - yy - zz) * sx;
+			matrix[1] = (xy + wz) * sx;
+			matrix[2] = (xz - wy) * sx;
+			matrix[3] = 0.0f;
+
+			matrix[4] = (xy - wz) * sy;
+			matrix[5] = (1.0f - xx - zz) * sy;
+			matrix[6] = (yz + wx) * sy;
+			matrix[7] = 0.0f;
+
+			matrix[8] = (xz + wy) * sz;
+			matrix[9] = (yz - wx) * sz;
+			matrix[10] = (1.0f - xx - yy) * sz;
+			matrix[11] = 0.0f;
+
+			matrix[12] = source.positionX[i];
+			matrix[13] = source.positionY[i];
+			matrix[14] = source.positionZ[i];
+			matrix[15] = 1.0f;
+		}
+	}
+
+#ifdef VK_SIMD_X86
+	/**
+		Turn one column of eight instances, held as a register per component,
+		into a register per instance pair: columns[k] holds instance k in its
+		low half and instance k + 4 in its high half.
+	*/
+	VK_TARGET_AVX2 void transpose_column(__m256 x, __m256 y, __m256 z, __m256 w, __m256* columns) {
+		__m256 xyLow = _mm256_unpacklo_ps(x, y);
+		__m256 xyHigh = _mm256_unpackhi_ps(x, y);
+		__m256 zwLow = _mm256_unpacklo_ps(z, w);
+		__m256 zwHigh = _mm256_unpackhi_ps(z, w);
+		columns[0] = _mm256_shuffle_ps(xyLow, zwLow, _MM_SHUFFLE(1, 0, 1, 0));
+		columns[1] = _mm256_shuffle_ps(xyLow, zwLow, _MM_SHUFFLE(3, 2, 3, 2));
+		columns[2] = _mm256_shuffle_ps(xyHigh, zwHigh, _MM_SHUFFLE(1, 0, 1, 0));
+		columns[3] = _mm256_shuffle_ps(xyHigh, zwHigh, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	/**
+		Eight instances per iteration. Each matrix is written whole with streaming
+		stores, a full cache line at a time, so write combined memory is not read back.
+	*/
+	VK_TARGET_AVX2 void build_avx2(const TransformSource& source, size_t count, const uint32_t* slots, glm::mat4* transforms) {
+
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 zero = _mm256_setzero_ps();
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+
+			__m256 x = _mm256_loadu_ps(source.rotationX + i);
+			__m256 y = _mm256_loadu_ps(source.rotationY + i);
+			__m256 z = _mm256_loadu_ps(source.rotationZ + i);
+			__m256 w = _mm256_loadu_ps(source.rotationW + i);
+			__m256 x2 = _mm256_add_ps(x, x);
+			__m256 y2 = _mm256_add_ps(y, y);
+			__m256 z2 = _mm256_add_ps(z, z);
+
+			__m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+			__m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+			__m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+			__m256 sx = _mm256_loadu_ps(source.scaleX + i);
+			__m256 sy = _mm256_loadu_ps(source.scaleY + i);
+			__m256 sz = _mm256_loadu_ps(source.scaleZ + i);
+
+			__m256 columns[4][4];
+			transpose_column(
+				_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx),
+				_mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+				_mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+				zero, columns[0]);
+			transpose_column(
+				_mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+				_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+				_mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+				zero, columns[1]);
+			transpose_column(
+				_mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+				_mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+				_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz),
+				zero, columns[2]);
+			transpose_column(
+				_mm256_loadu_ps(source.positionX + i),
+				_mm256_loadu_ps(source.positionY + i),
+				_mm256_loadu_ps(source.positionZ + i),
+				one, columns[3]);
+
+			for (size_t k = 0; k < 4; ++k) {
+				float* matrix = destination(transforms, slots, i + k);
+				if (matrix) {
+					_mm_stream_ps(matrix, _mm256_castps256_ps128(columns[0][k]));
+					_mm_stream_ps(matrix + 4, _mm256_castps256_ps128(columns[1][k]));
+					_mm_stream_ps(matrix + 8, _mm256_castps256_ps128(columns[2][k]));
+					_mm_stream_ps(matrix + 12, _mm256_castps256_ps128(columns[3][k]));
+				}
+			}
+			for (size_t k = 0; k < 4; ++k) {
+				float* matrix = destination(transforms, slots, i + 4 + k);
+				if (matrix) {
+					_mm_stream_ps(matrix, _mm256_extractf128_ps(columns[0][k], 1));
+					_mm_stream_ps(matrix + 4, _mm256_extractf128_ps(columns[1][k], 1));
+					_mm_stream_ps(matrix + 8, _mm256_extractf128_ps(columns[2][k], 1));
+					_mm_stream_ps(matrix + 12, _mm256_extractf128_ps(columns[3][k], 1));
+				}
+			}
+		}
+
+		//streaming stores are weakly ordered, finish them before the gpu is told to read
+		_mm_sfence();
+
+		build_scalar(source, i, count, slots, transforms);
+	}
+#endif
+
+#ifdef VK_SIMD_NEON
+	/**
+		Turn one column of four instances, held as a register per component,
+		into a register per instance.
+	*/
+	void transpose_column(float32x4_t x, float32x4_t y, float32x4_t z, float32x4_t w, float32x4_t* columns) {
+		float32x4x2_t xy = vzipq_f32(x, y);
+		float32x4x2_t zw = vzipq_f32(z, w);
+		columns[0] = vcombine_f32(vget_low_f32(xy.val[0]), vget_low_f32(zw.val[0]));
+		columns[1] = vcombine_f32(vget_high_f32(xy.val[0]), vget_high_f32(zw.val[0]));
+		columns[2] = vcombine_f32(vget_low_f32(xy.val[1]), vget_low_f32(zw.val[1]));
+		columns[3] = vcombine_f32(vget_high_f32(xy.val[1]), vget_high_f32(zw.val[1]));
+	}
+
+	/**
+		Four instances per iteration, each matrix written whole.
+	*/
+	void build_neon(const TransformSource& source, size_t count, const uint32_t* slots, glm::mat4* transforms) {
+
+		const float32x4_t one = vdupq_n_f32(1.0f);
+		const float32x4_t zero = vdupq_n_f32(0.0f);
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+
+			float32x4_t x = vld1q_f32(source.rotationX + i);
+			float32x4_t y = vld1q_f32(source.rotationY + i);
+			float32x4_t z = vld1q_f32(source.rotationZ + i);
+			float32x4_t w = vld1q_f32(source.rotationW + i);
+			float32x4_t x2 = vaddq_f32(x, x);
+			float32x4_t y2 = vaddq_f32(y, y);
+			float32x4_t z2 = vaddq_f32(z, z);
+
+			float32x4_t xx = vmulq_f32(x, x2), yy = vmulq_f32(y, y2), zz = vmulq_f32(z, z2);
+			float32x4_t xy = vmulq_f32(x, y2), xz = vmulq_f32(x, z2), yz = vmulq_f32(y, z2);
+			float32x4_t wx = vmulq_f32(w, x2), wy = vmulq_f32(w, y2), wz = vmulq_f32(w, z2);
+
+			float32x4_t sx = vld1q_f32(source.scaleX + i);
+			float32x4_t sy = vld1q_f32(source.scaleY + i);
+			float32x4_t sz = vld1q_f32(source.scaleZ + i);
+
+			float32x4_t columns[4][4];
+			transpose_column(
+				vmulq_f32(vsubq_f32(one, vaddq_f32(yy, zz)), sx),
+				vmulq_f32(vaddq_f32(xy, wz), sx),
+				vmulq_f32(vsubq_f32(xz, wy), sx),
+				zero, columns[0]);
+			transpose_column(
+				vmulq_f32(vsubq_f32(xy, wz), sy),
+				vmulq_f32(vsubq_f32(one, vaddq_f32(xx, zz)), sy),
+				vmulq_f32(vaddq_f32(yz, wx), sy),
+				zero, columns[1]);
+			transpose_column(
+				vmulq_f32(vaddq_f32(xz, wy), sz),
+				vmulq_f32(vsubq_f32(yz, wx), sz),
+				vmulq_f32(vsubq_f32(one, vaddq_f32(xx, yy)), sz),
+				zero, columns[2]);
+			transpose_column(
+				vld1q_f32(source.positionX + i),
+				vld1q_f32(source.positionY + i),
+				vld1q_f32(source.positionZ + i),
+				one, columns[3]);
+
+			for (size_t k = 0; k < 4; ++k) {
+				float* matrix = destination(transforms, slots, i + k);
+				if (matrix) {
+					vst1q_f32(matrix, columns[0][k]);
+					vst1q_f32(matrix + 4, columns[1][k]);
+					vst1q_f32(matrix + 8, columns[2][k]);
+					vst1q_f32(matrix + 12, columns[3][k]);
+				}
+			}
+		}
+
+		build_scalar(source, i, count, slots, transforms);
+	}
+#endif
+}
+
+uint32_t InstanceStore::add(const Renderable& renderable, const glm::vec3& position,
+	const glm::quat& rotation, const glm::vec3& scale, uint32_t flags) {
+
+	positionX.push_back(position.x);
+	positionY.push_back(position.y);
+	positionZ.push_back(position.z);
+	rotationX.push_back(rotation.x);
+	rotationY.push_back(rotation.y);
+	rotationZ.push_back(rotation.z);
+	rotationW.push_back(rotation.w);
+	scaleX.push_back(scale.x);
+	scaleY.push_back(scale.y);
+	scaleZ.push_back(scale.z);
+	meshes.push_back(renderable.mesh);
+	materials.push_back(renderable.material);
+	this->flags.push_back(flags);
+
+	uint32_t instance = static_cast<uint32_t>(positionX.size() - 1);
+	if (instance % kPageSize == 0) {
+		pageStale.push_back(0);
+	}
+	mark(instance);
+	++layoutVersion;
+
+	return instance;
+}
+
+size_t InstanceStore::size() const {
+	return positionX.size();
+}
+
+glm::vec3 InstanceStore::get_position(size_t instance) const {
+	return glm::vec3(positionX[instance], positionY[instance], positionZ[instance]);
+}
+
+void InstanceStore::set_position(uint32_t instance, const glm::vec3& position) {
+	positionX[instance] = position.x;
+	positionY[instance] = position.y;
+	positionZ[instance] = position.z;
+	mark(instance);
+}
+
+void InstanceStore::set_rotation(uint32_t instance, const glm::quat& rotation) {
+	rotationX[instance] = rotation.x;
+	rotationY[instance] = rotation.y;
+	rotationZ[instance] = rotation.z;
+	rotationW[instance] = rotation.w;
+	mark(instance);
+}
+
+void InstanceStore::set_scale(uint32_t instance, const glm::vec3& scale) {
+	scaleX[instance] = scale.x;
+	scaleY[instance] = scale.y;
+	scaleZ[instance] = scale.z;
+	mark(instance);
+}
+
+void InstanceStore::set_flags(uint32_t instance, uint32_t flags) {
+	if (this->flags[instance] != flags) {
+		this->flags[instance] = flags;
+		mark(instance);
+		++layoutVersion;
+	}
+}
+
+void InstanceStore::set_renderable(uint32_t instance, const Renderable& renderable) {
+	if (meshes[instance] != renderable.mesh || materials[instance] != renderable.material) {
+		meshes[instance] = renderable.mesh;
+		materials[instance] = renderable.material;
+		mark(instance);
+		++layoutVersion;
+	}
+}
+
+void InstanceStore::mark_changed(const uint32_t* changed, size_t count) {
+
+	std::lock_guard<std::mutex> lock(changeMutex);
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t page = changed[i] / kPageSize;
+		if (pageStale[page] == 0) {
+			stalePages.push_back(page);
+		}
+		pageStale[page] = 0xFFFFFFFF;
+	}
+}
+
+uint64_t InstanceStore::get_layout_version() const {
+	return layoutVersion;
+}
+
+void InstanceStore::mark(uint32_t instance) {
+	mark_changed(&instance, 1);
+}
+
+void InstanceStore::take_stale_pages(uint32_t copy, uint32_t copies, std::vector<uint32_t>& pages) {
+
+	std::lock_guard<std::mutex> lock(changeMutex);
+	pages.clear();
+	uint32_t live = copies >= 32 ? 0xFFFFFFFF : (1u << copies) - 1;
+	uint32_t bit = 1u << copy;
+
+	size_t kept = 0;
+	for (uint32_t page : stalePages) {
+		if (pageStale[page] & bit) {
+			pages.push_back(page);
+			pageStale[page] &= ~bit;
+		}
+		if (pageStale[page] & live) {
+			stalePages[kept++] = page;
+		}
+		else {
+			pageStale[page] = 0;
+		}
+	}
+	stalePages.resize(kept);
+}
+
+void InstanceStore::write_transforms(size_t first, size_t count, const uint32_t* slots, glm::mat4* transforms,
+	simdLevels kernel) const {
+
+	TransformSource source;
+	source.positionX = positionX.data() + first;
+	source.positionY = positionY.data() + first;
+	source.positionZ = positionZ.data() + first;
+	source.rotationX = rotationX.data() + first;
+	source.rotationY = rotationY.data() + first;
+	source.rotationZ = rotationZ.data() + first;
+	source.rotationW = rotationW.data() + first;
+	source.scaleX = scaleX.data() + first;
+	source.scaleY = scaleY.data() + first;
+	source.scaleZ = scaleZ.data() + first;
+
+	//the vector stores need whole aligned columns
+	if (reinterpret_cast<uintptr_t>(transforms) % 16 != 0) {
+		kernel = simdLevels::SCALAR;
+	}
+
+	switch (kernel) {
+#ifdef VK_SIMD_X86
+	case simdLevels::AVX2:
+		build_avx2(source, count, slots, transforms);
+		return;
+#endif
+#ifdef VK_SIMD_NEON
+	case simdLevels::NEON:
+		build_neon(source, count, slots, transforms);
+		return;
+#endif
+	default:
+		build_scalar(source, 0, count, slots, transforms);
+		return;
+	}
+}
+
+void benchmark_instance_transforms(size_t count) {
+
+	using clock = std::chrono::steady_clock;
+	const int runs = 5;
+
+	//random placement, rotation and scale
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	InstanceStore store;
+	std::vector<glm::vec3> positions(count);
+	for (size_t i = 0; i < count; ++i) {
+		positions[i] = glm::vec3(unit(random), unit(random), unit(random)) * 100.0f;
+		glm::quat rotation = glm::normalize(glm::quat(unit(random), unit(random), unit(random), unit(random)));
+		glm::vec3 scale = glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(2.0f);
+		store.add(Renderable{ 0, 0 }, positions[i], rotation, scale);
+	}
+
+	//whole cache lines, as mapped gpu memory would be
+	struct alignas(64) Transform {
+		glm::mat4 matrix;
+	};
+	std::vector<Transform> reference(count), built(count);
+
+	//best of several runs, the first touches the pages
+	auto time = [&](auto build) {
+		double best = 0.0;
+		for (int run = 0; run < runs; ++run) {
+			clock::time_point start = clock::now();
+			build();
+			double elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+			best = run == 0 ? elapsed : std::min(best, elapsed);
+		}
+		return best;
+	};
+
+	double translateTime = time([&]() {
+		for (size_t i = 0; i < count; ++i) {
+			reference[i].matrix = glm::translate(glm::mat4(1.0f), positions[i]);
+		}
+	});
+
+	double trsTime = time([&]() {
+		for (size_t i = 0; i < count; ++i) {
+			glm::quat rotation(store.rotationW[i], store.rotationX[i], store.rotationY[i], store.rotationZ[i]);
+			glm::vec3 scale(store.scaleX[i], store.scaleY[i], store.scaleZ[i]);
+			reference[i].matrix = glm::translate(glm::mat4(1.0f), positions[i]) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+		}
+	});
+
+	std::cout << "Instances: " << count << "\n";
+	std::cout << "glm::translate, positions only: " << translateTime << " ms\n";
+	std::cout << "glm translate * rotate * scale: " << trsTime << " ms\n";
+
+	simdLevels kernels[] = { simdLevels::SCALAR, get_simd_level() };
+	size_t kernelCount = kernels[1] == simdLevels::SCALAR ? 1 : 2;
+	for (size_t k = 0; k < kernelCount; ++k) {
+
+		double kernelTime = time([&]() {
+			store.write_transforms(0, count, nullptr, &built[0].matrix, kernels[k]);
+		});
+
+		float error = 0.0f;
+		for (size_t i = 0; i < count; ++i) {
+			for (int column = 0; column < 4; ++column) {
+				glm::vec4 difference = glm::abs(built[i].matrix[column] - reference[i].matrix[column]);
+				error = std::max(error, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+			}
+		}
+
+		std::cout << get_simd_name(kernels[k]) << " kernel, translate * rotate * scale: " << kernelTime
+			<< " ms (" << (kernelTime > 0.0 ? trsTime / kernelTime : 0.0) << "x glm, largest error " << error << ")\n";
+	}
+}
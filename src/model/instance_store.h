@@ -0,0 +1,127 @@
+#pragma once
+#include "../config.h"
+#include "gtc/quaternion.hpp"
+#include "simd.h"
+#include <mutex>
+
+/**
+	Per instance flags
+*/
+enum instanceFlags : uint32_t {
+	//kept in the store but not drawn
+	INSTANCE_HIDDEN = 1 << 0,
+	//never moves, so it may be merged into a static batch
+	INSTANCE_STATIC = 1 << 1,
+	//drawn as part of a static batch, set and cleared by the batcher
+	INSTANCE_BATCHED = 1 << 2,
+	//its mesh is drawn into the CPU occlusion buffer, hiding what is behind it
+	INSTANCE_OCCLUDER = 1 << 3,
+	//left out of the per instance draws, though spatial queries still find batched instances
+	INSTANCE_UNDRAWN = INSTANCE_HIDDEN | INSTANCE_BATCHED
+};
+
+/**
+	Instance data as a structure of arrays, so the transform kernels can load
+	one component of eight instances with a single instruction.
+	An instance's transform is translation * rotation * scale.
+
+	Changes are tracked in pages of instances. Each page holds a bit per copy of
+	the transforms (one per frame in flight) which is set when the page changes
+	and cleared when that copy takes it, so a copy only rewrites what it has not seen.
+*/
+class InstanceStore {
+public:
+
+	//slot for instances write_transforms should skip
+	static const uint32_t kSkipSlot = 0xFFFFFFFF;
+	//instances per page, a page of transforms is 4KB
+	static const uint32_t kPageSize = 64;
+
+	/**
+		\returns the index of the new instance
+	*/
+	uint32_t add(const Renderable& renderable, const glm::vec3& position,
+		const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+		const glm::vec3& scale = glm::vec3(1.0f), uint32_t flags = 0);
+
+	size_t size() const;
+
+	glm::vec3 get_position(size_t instance) const;
+
+	void set_position(uint32_t instance, const glm::vec3& position);
+	void set_rotation(uint32_t instance, const glm::quat& rotation);
+	void set_scale(uint32_t instance, const glm::vec3& scale);
+
+	/**
+		Flags decide which instances are drawn, so changing them changes the layout.
+	*/
+	void set_flags(uint32_t instance, uint32_t flags);
+
+	/**
+		The renderable decides which draw the instance belongs to, so changing it changes the layout.
+	*/
+	void set_renderable(uint32_t instance, const Renderable& renderable);
+
+	/**
+		Record changes made by writing the arrays directly, as parallel writers
+		do rather than taking the change lock once per instance.
+
+		\param changed the instances written
+		\param count number of instances written
+	*/
+	void mark_changed(const uint32_t* changed, size_t count);
+
+	/**
+		\returns a number which changes whenever instances are added or their flags or renderable change
+	*/
+	uint64_t get_layout_version() const;
+
+	/**
+		Hand a copy of the transforms the pages it has not seen since it last asked.
+		Pages every copy has taken leave the change list.
+
+		\param copy which copy is asking, below 32
+		\param copies how many copies there are
+		\param pages receives the stale pages
+	*/
+	void take_stale_pages(uint32_t copy, uint32_t copies, std::vector<uint32_t>& pages);
+
+	/**
+		Build the transforms of a run of instances.
+
+		\param first the first instance to build
+		\param count the number of instances to build
+		\param slots where each instance's transform goes, kSkipSlot to leave it out,
+			or nullptr to write them in order
+		\param transforms destination, 16 byte aligned, usually mapped memory
+		\param kernel the kernel to build with, must be supported
+	*/
+	void write_transforms(size_t first, size_t count, const uint32_t* slots, glm::mat4* transforms,
+		simdLevels kernel = get_simd_level()) const;
+
+	//write through the setters, or report writes with mark_changed, so the change is seen
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	std::vector<uint32_t> meshes, materials;
+	std::vector<uint32_t> flags;
+
+private:
+
+	//per page, a bit for each copy which has not taken the change
+	std::vector<uint32_t> pageStale;
+	//pages with any bit set
+	std::vector<uint32_t> stalePages;
+	uint64_t layoutVersion = 0;
+	std::mutex changeMutex;
+
+	void mark(uint32_t instance);
+};
+
+/**
+	Build the transforms of count instances with each kernel and with the
+	glm::translate path the engine used before, and report the timings.
+
+	\param count the number of instances
+*/
+void benchmark_instance_transforms(size_t count);
@@ -0,0 +1,186 @@
+#include "lz4_block.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+	const size_t kMinMatch = 4;
+	//the last five bytes are always literals, and the last match starts at least twelve before the end
+	const size_t kLastLiterals = 5;
+	const size_t kMatchLimit = 12;
+	const size_t kMaxOffset = 65535;
+	const uint32_t kHashBits = 12;
+	const uint32_t kNoPosition = 0xFFFFFFFF;
+
+	uint32_t read32(const uint8_t* at) {
+		uint32_t value;
+		std::memcpy(&value, at, sizeof(value));
+		return value;
+	}
+
+	uint32_t hash(uint32_t sequence) {
+		return (sequence * 2654435761u) >> (32 - kHashBits);
+	}
+
+	/**
+		Appends to a block, remembering when it runs out of room.
+	*/
+	struct BlockWriter {
+		uint8_t* at;
+		uint8_t* end;
+		bool full;
+
+		void put(uint8_t byte) {
+			if (at == end) {
+				full = true;
+				return;
+			}
+			*at++ = byte;
+		}
+
+		void put(const uint8_t* bytes, size_t count) {
+			if (static_cast<size_t>(end - at) < count) {
+				full = true;
+				return;
+			}
+			std::memcpy(at, bytes, count);
+			at += count;
+		}
+
+		//lengths past the token's fifteen go in bytes of 255, then the rest
+		void put_length(size_t length) {
+			while (length >= 255) {
+				put(255);
+				length -= 255;
+			}
+			put(static_cast<uint8_t>(length));
+		}
+
+		/**
+			\param matchLength zero for the last sequence, which has no match
+		*/
+		void put_sequence(const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength) {
+
+			size_t matchCode = matchLength >= kMinMatch ? matchLength - kMinMatch : 0;
+			uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15));
+			put(token);
+			if (literalCount >= 15) {
+				put_length(literalCount - 15);
+			}
+			put(literals, literalCount);
+			if (matchLength == 0) {
+				return;
+			}
+			put(static_cast<uint8_t>(offset & 0xFF));
+			put(static_cast<uint8_t>(offset >> 8));
+			if (matchCode >= 15) {
+				put_length(matchCode - 15);
+			}
+		}
+	};
+}
+
+size_t lz4_block_bound(size_t size) {
+	return size + size / 255 + 16;
+}
+
+size_t lz4_compress_block(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity) {
+
+	BlockWriter writer{ destination, destination + capacity, false };
+	uint32_t table[1 << kHashBits];
+	std::fill(table, table + (1 << kHashBits), kNoPosition);
+
+	//greedy, the first match found is taken and skipped over
+	size_t anchor = 0;
+	size_t i = 0;
+	if (size > kMatchLimit) {
+		size_t matchEnd = size - kLastLiterals;
+		while (i < size - kMatchLimit && !writer.full) {
+
+			uint32_t sequence = read32(source + i);
+			uint32_t& slot = table[hash(sequence)];
+			uint32_t candidate = slot;
+			slot = static_cast<uint32_t>(i);
+			if (candidate == kNoPosition || i - candidate > kMaxOffset || read32(source + candidate) != sequence) {
+				++i;
+				continue;
+			}
+
+			size_t length = kMinMatch;
+			while (i + length < matchEnd && source[candidate + length] == source[i + length]) {
+				++length;
+			}
+			writer.put_sequence(source + anchor, i - anchor, i - candidate, length);
+			i += length;
+			anchor = i;
+		}
+	}
+	writer.put_sequence(source + anchor, size - anchor, 0, 0);
+
+	return writer.full ? 0 : static_cast<size_t>(writer.at - destination);
+}
+
+bool lz4_decompress_block(const uint8_t* source, size_t size, uint8_t* destination, size_t decompressedSize) {
+
+	size_t s = 0;
+	size_t d = 0;
+	while (s < size) {
+
+		uint8_t token = source[s++];
+		size_t literals = token >> 4;
+		if (literals == 15) {
+			uint8_t extra;
+			do {
+				if (s >= size) {
+					return false;
+				}
+				extra = source[s++];
+				literals += extra;
+			} while (extra == 255);
+		}
+		if (literals > size - s || literals > decompressedSize - d) {
+			return false;
+		}
+		std::memcpy(destination + d, source + s, literals);
+		s += literals;
+		d += literals;
+
+		//the last sequence ends after its literals
+		if (s == size) {
+			break;
+		}
+
+		if (size - s < 2) {
+			return false;
+		}
+		size_t offset = source[s] | (static_cast<size_t>(source[s + 1]) << 8);
+		s += 2;
+		if (offset == 0 || offset > d) {
+			return false;
+		}
+
+		size_t length = token & 15;
+		if (length == 15) {
+			uint8_t extra;
+			do {
+				if (s >= size) {
+					return false;
+				}
+				extra = source[s++];
+				length += extra;
+			} while (extra == 255);
+		}
+		length += kMinMatch;
+		if (length > decompressedSize - d) {
+			return false;
+		}
+
+		//matches may overlap what they write, byte by byte keeps the repeat
+		const uint8_t* from = destination + d - offset;
+		for (size_t k = 0; k < length; ++k) {
+			destination[d + k] = from[k];
+		}
+		d += length;
+	}
+	return d == decompressedSize;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "../config.h"
+
+/*
+	Blocks in LZ4's block format: sequences of a token, literals, a two byte
+	offset and a match length, the last sequence literals only. Blocks written
+	here can be read by the reference decoder and the other way round, though the
+	compressor is a plain greedy one with a single hash table, made for pages
+	of a few hundred kilobytes rather than for ratio.
+*/
+
+/**
+	\returns the most bytes compressing size bytes can take
+*/
+size_t lz4_block_bound(size_t size);
+
+/**
+	Compress a block.
+
+	\param source the bytes to compress
+	\param size the number of bytes
+	\param destination receives the block
+	\param capacity room at destination
+	\returns the size of the block, or 0 when it does not fit
+*/
+size_t lz4_compress_block(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity);
+
+/**
+	Decompress a block whose decompressed size is known.
+
+	\param source the block
+	\param size the block's size
+	\param destination receives the bytes
+	\param decompressedSize exactly how many bytes the block holds
+	\returns whether the block was well formed and held exactly decompressedSize bytes
+*/
+bool lz4_decompress_block(const uint8_t* source, size_t size, uint8_t* destination, size_t decompressedSize);
@@ -0,0 +1,289 @@
+#include "mesh_file.h"
+#include "obj_loader.h"
+#include "mesh_optimizer.h"
+#include <chrono>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	uint64_t align_up(uint64_t offset) {
+		return (offset + vkMesh::kMeshFileAlignment - 1) & ~static_cast<uint64_t>(vkMesh::kMeshFileAlignment - 1);
+	}
+
+	void write_padding(std::ofstream& file, uint64_t target) {
+		static const char zeros[vkMesh::kMeshFileAlignment] = {};
+		uint64_t position = static_cast<uint64_t>(file.tellp());
+		file.write(zeros, static_cast<std::streamsize>(target - position));
+	}
+}
+
+bool vkMesh::write_mesh_file(
+	const std::string& filename,
+	const std::vector<float>& vertexData, uint32_t floatsPerVertex, uint32_t positionComponents,
+	const std::vector<uint32_t>& indexData,
+	std::vector<MeshFileSubmesh> submeshes) {
+
+	uint32_t vertexCount = static_cast<uint32_t>(vertexData.size() / floatsPerVertex);
+
+	MeshFileHeader header = {};
+	header.magic = kMeshFileMagic;
+	header.version = kMeshFileVersion;
+	header.streamCount = 1;
+	header.vertexCount = vertexCount;
+	header.indexCount = static_cast<uint32_t>(indexData.size());
+
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	for (uint32_t i = 0; i < vertexCount; ++i) {
+		glm::vec3 position(0.0f);
+		for (uint32_t c = 0; c < positionComponents; ++c) {
+			position[c] = vertexData[i * floatsPerVertex + c];
+		}
+		boundsMin = glm::min(boundsMin, position);
+		boundsMax = glm::max(boundsMax, position);
+	}
+	if (vertexCount == 0) {
+		boundsMin = boundsMax = glm::vec3(0.0f);
+	}
+	for (int c = 0; c < 3; ++c) {
+		header.boundsMin[c] = boundsMin[c];
+		header.boundsMax[c] = boundsMax[c];
+	}
+
+	if (submeshes.empty()) {
+		MeshFileSubmesh whole = {};
+		whole.indexCount = header.indexCount;
+		glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+		whole.center[0] = center.x;
+		whole.center[1] = center.y;
+		whole.center[2] = center.z;
+		whole.radius = glm::length(boundsMax - center);
+		submeshes.push_back(whole);
+	}
+	header.submeshCount = static_cast<uint32_t>(submeshes.size());
+
+	MeshFileStream stream = {};
+	stream.offset = align_up(sizeof(MeshFileHeader) + sizeof(MeshFileStream));
+	stream.stride = floatsPerVertex * sizeof(float);
+	header.indexOffset = align_up(stream.offset + sizeof(float) * vertexData.size());
+	header.submeshOffset = align_up(header.indexOffset + sizeof(uint32_t) * indexData.size());
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&stream), sizeof(stream));
+	write_padding(file, stream.offset);
+	file.write(reinterpret_cast<const char*>(vertexData.data()), sizeof(float) * vertexData.size());
+	write_padding(file, header.indexOffset);
+	file.write(reinterpret_cast<const char*>(indexData.data()), sizeof(uint32_t) * indexData.size());
+	write_padding(file, header.submeshOffset);
+	file.write(reinterpret_cast<const char*>(submeshes.data()), sizeof(MeshFileSubmesh) * submeshes.size());
+
+	return file.good();
+}
+
+vkMesh::MappedMesh::MappedMesh(const std::string& filename) {
+
+	data = nullptr;
+	size = 0;
+
+#ifdef _WIN32
+	mapping = nullptr;
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("failed to open mesh file\n");
+	}
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file, &fileSize)) {
+		size = static_cast<size_t>(fileSize.QuadPart);
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	}
+	if (mapping) {
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	file = open(filename.c_str(), O_RDONLY);
+	if (file < 0) {
+		throw std::runtime_error("failed to open mesh file\n");
+	}
+	struct stat fileInfo;
+	void* mapped = MAP_FAILED;
+	if (fstat(file, &fileInfo) == 0 && fileInfo.st_size > 0) {
+		size = static_cast<size_t>(fileInfo.st_size);
+		mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	}
+	if (mapped != MAP_FAILED) {
+		data = static_cast<const char*>(mapped);
+		//the whole file is about to be copied front to back,
+		//advice values are not flags so each takes its own call
+		madvise(mapped, size, MADV_SEQUENTIAL);
+		madvise(mapped, size, MADV_WILLNEED);
+	}
+#endif
+
+	//a bad file must not keep its handle and mapping, the destructor never runs
+	try {
+		validate();
+	}
+	catch (const std::runtime_error&) {
+		unmap();
+		throw;
+	}
+}
+
+void vkMesh::MappedMesh::validate() {
+
+	if (data == nullptr || size < sizeof(MeshFileHeader)) {
+		throw std::runtime_error("failed to map mesh file\n");
+	}
+
+	header = reinterpret_cast<const MeshFileHeader*>(data);
+	if (header->magic != kMeshFileMagic || header->version != kMeshFileVersion) {
+		throw std::runtime_error("unsupported mesh file version\n");
+	}
+
+	//every range is checked against what is left after its offset, so a corrupt header cannot wrap around
+	if (header->streamCount == 0
+		|| header->streamCount > (size - sizeof(MeshFileHeader)) / sizeof(MeshFileStream)) {
+		throw std::runtime_error("truncated mesh file\n");
+	}
+	const MeshFileStream* streams = reinterpret_cast<const MeshFileStream*>(data + sizeof(MeshFileHeader));
+	for (uint32_t i = 0; i < header->streamCount; ++i) {
+		uint64_t bytes = static_cast<uint64_t>(streams[i].stride) * header->vertexCount;
+		if (!is_within(streams[i].offset, bytes)) {
+			throw std::runtime_error("truncated mesh file\n");
+		}
+	}
+	if (!is_within(header->indexOffset, sizeof(uint32_t) * static_cast<uint64_t>(header->indexCount))
+		|| !is_within(header->submeshOffset, sizeof(MeshFileSubmesh) * static_cast<uint64_t>(header->submeshCount))) {
+		throw std::runtime_error("truncated mesh file\n");
+	}
+
+	const MeshFileSubmesh* table = submeshes();
+	for (uint32_t i = 0; i < header->submeshCount; ++i) {
+		if (table[i].firstIndex > header->indexCount || table[i].indexCount > header->indexCount - table[i].firstIndex) {
+			throw std::runtime_error("mesh file submesh out of range\n");
+		}
+	}
+}
+
+bool vkMesh::MappedMesh::is_within(uint64_t offset, uint64_t bytes) const {
+	//sections are cast to their types, so their offsets must keep the file's alignment
+	return offset % kMeshFileAlignment == 0 && offset <= size && bytes <= size - offset;
+}
+
+void vkMesh::MappedMesh::unmap() {
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+#else
+	if (data) {
+		munmap(const_cast<char*>(data), size);
+	}
+	close(file);
+#endif
+	data = nullptr;
+}
+
+const void* vkMesh::MappedMesh::stream(uint32_t index) const {
+	const MeshFileStream* streams = reinterpret_cast<const MeshFileStream*>(data + sizeof(MeshFileHeader));
+	return data + streams[index].offset;
+}
+
+uint32_t vkMesh::MappedMesh::stream_stride(uint32_t index) const {
+	const MeshFileStream* streams = reinterpret_cast<const MeshFileStream*>(data + sizeof(MeshFileHeader));
+	return streams[index].stride;
+}
+
+const uint32_t* vkMesh::MappedMesh::indices() const {
+	return reinterpret_cast<const uint32_t*>(data + header->indexOffset);
+}
+
+const vkMesh::MeshFileSubmesh* vkMesh::MappedMesh::submeshes() const {
+	return reinterpret_cast<const MeshFileSubmesh*>(data + header->submeshOffset);
+}
+
+vkMesh::MappedMesh::~MappedMesh() {
+	unmap();
+}
+
+bool vkMesh::convert_obj_to_mesh_file(const std::string& objFilename, const std::string& meshFilename) {
+
+	try {
+		Model model(objFilename);
+		std::vector<float> vertexData = model.get_menagerie_vertices();
+		std::pair<VertexCacheStats, VertexCacheStats> stats = optimize_mesh(vertexData, 7, 2, model.indices);
+		std::cout << objFilename << ": ACMR " << stats.first.acmr << " -> " << stats.second.acmr
+			<< ", ATVR " << stats.first.atvr << " -> " << stats.second.atvr << std::endl;
+		return write_mesh_file(meshFilename, vertexData, 7, 2, model.indices, {});
+	}
+	catch (std::runtime_error err) {
+		std::cout << err.what() << std::endl;
+		return false;
+	}
+}
+
+void vkMesh::benchmark_mesh_loading(const std::string& objFilename, const std::string& meshFilename) {
+
+	std::ifstream existing(meshFilename, std::ios::binary);
+	if (!existing.is_open() && !convert_obj_to_mesh_file(objFilename, meshFilename)) {
+		std::cout << "Unable to convert " << objFilename << std::endl;
+		return;
+	}
+	existing.close();
+
+	using clock = std::chrono::steady_clock;
+
+	clock::time_point start = clock::now();
+	tinyobj::attrib_t attributes;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warning, error;
+	tinyobj::LoadObj(&attributes, &shapes, &materials, &warning, &error, objFilename.c_str());
+	double objTime = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+	start = clock::now();
+	size_t uniqueVertices = Model(objFilename).vertices.size();
+	double parallelTime = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+	start = clock::now();
+	size_t copied = 0;
+	try {
+		MappedMesh mesh(meshFilename);
+		size_t vertexBytes = static_cast<size_t>(mesh.header->vertexCount) * mesh.stream_stride(0);
+		size_t indexBytes = sizeof(uint32_t) * mesh.header->indexCount;
+
+		//stands in for the mapped staging buffer
+		std::vector<char> staging(vertexBytes + indexBytes);
+		memcpy(staging.data(), mesh.stream(0), vertexBytes);
+		memcpy(staging.data() + vertexBytes, mesh.indices(), indexBytes);
+		copied = staging.size();
+	}
+	catch (std::runtime_error err) {
+		std::cout << meshFilename << ": " << err.what() << std::endl;
+		return;
+	}
+	double binaryTime = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+	std::cout << "OBJ parse (" << objFilename << "): " << objTime << " ms\n";
+	std::cout << "Parallel OBJ load with dedup (" << uniqueVertices << " vertices): " << parallelTime << " ms\n";
+	std::cout << "Mapped mesh to staging (" << meshFilename << ", " << copied << " bytes): " << binaryTime << " ms\n";
+	std::cout << "Speedup: " << (binaryTime > 0.0 ? objTime / binaryTime : 0.0) << "x\n";
+}
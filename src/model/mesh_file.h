@@ -0,0 +1,135 @@
+#pragma once
+#include "../config.h"
+
+namespace vkMesh {
+
+	const uint32_t kMeshFileMagic = 0x48534D56; //"VMSH"
+	const uint32_t kMeshFileVersion = 1;
+	const uint32_t kMeshFileAlignment = 16;
+
+	/**
+		Start of a binary mesh file. It is followed by the stream table,
+		then each section, each aligned to kMeshFileAlignment:
+		vertex streams, index data (uint32), submesh table.
+	*/
+	struct MeshFileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t streamCount;
+		uint32_t submeshCount;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint64_t indexOffset;
+		uint64_t submeshOffset;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+	static_assert(sizeof(MeshFileHeader) == 64, "mesh file header layout changed");
+
+	/**
+		Where a vertex stream lives in the file, stride is in bytes
+	*/
+	struct MeshFileStream {
+		uint64_t offset;
+		uint32_t stride;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(MeshFileStream) == 16, "mesh file stream layout changed");
+
+	/**
+		A range of the index data, with a bounding sphere for culling
+	*/
+	struct MeshFileSubmesh {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t baseVertex;
+		uint32_t materialIndex;
+		float center[3];
+		float radius;
+	};
+	static_assert(sizeof(MeshFileSubmesh) == 32, "mesh file submesh layout changed");
+
+	/**
+		Write a mesh with a single interleaved vertex stream.
+		\param filename the file to write
+		\param vertexData interleaved vertices, position first (x, y, [z])
+		\param floatsPerVertex floats in each vertex
+		\param positionComponents how many of those floats are the position
+		\param indexData triangle list indices
+		\param submeshes index ranges, if empty the whole mesh is a single submesh
+		\returns whether the file could be written
+	*/
+	bool write_mesh_file(
+		const std::string& filename,
+		const std::vector<float>& vertexData, uint32_t floatsPerVertex, uint32_t positionComponents,
+		const std::vector<uint32_t>& indexData,
+		std::vector<MeshFileSubmesh> submeshes);
+
+	/**
+		A read-only view of a mesh file mapped into memory.
+		Nothing is parsed, the pointers refer straight into the mapping, though
+		the header's ranges are checked against the file. Index values are not.
+	*/
+	class MappedMesh {
+	public:
+
+		/**
+			Map and validate a mesh file, throws std::runtime_error on failure.
+		*/
+		MappedMesh(const std::string& filename);
+		~MappedMesh();
+
+		const MeshFileHeader* header;
+
+		/**
+			\returns the start of a vertex stream
+		*/
+		const void* stream(uint32_t index) const;
+
+		uint32_t stream_stride(uint32_t index) const;
+
+		const uint32_t* indices() const;
+
+		const MeshFileSubmesh* submeshes() const;
+
+	private:
+		const char* data;
+		size_t size;
+#ifdef _WIN32
+		void* file;
+		void* mapping;
+#else
+		int file;
+#endif
+
+		/**
+			Check the header and that every section lies inside the file,
+			throws std::runtime_error if not.
+		*/
+		void validate();
+
+		/**
+			\returns whether an aligned section of the given size starting at offset fits in the file
+		*/
+		bool is_within(uint64_t offset, uint64_t bytes) const;
+
+		/**
+			Release the mapping and the file.
+		*/
+		void unmap();
+	};
+
+	/**
+		Convert an OBJ file to the binary mesh format, deduplicated by Model and run through optimize_mesh,
+		in the layout VertexMenagerie consumes (x y r g b u v).
+		\returns whether the file could be written
+	*/
+	bool convert_obj_to_mesh_file(const std::string& objFilename, const std::string& meshFilename);
+
+	/**
+		Time parsing an OBJ file, with tinyobj and with Model, against mapping its binary equivalent
+		and copying it into a staging-sized allocation, then print the results.
+		The binary file is written first if it does not exist.
+	*/
+	void benchmark_mesh_loading(const std::string& objFilename, const std::string& meshFilename);
+}
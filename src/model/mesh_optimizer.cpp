@@ -0,0 +1,249 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+
+vkMesh::VertexCacheStats vkMesh::analyze_vertex_cache(
+	const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+
+	VertexCacheStats stats = { 0.0f, 0.0f };
+	if (indexCount < 3 || vertexCount == 0) {
+		return stats;
+	}
+
+	//a vertex is cached while fewer than cacheSize misses have happened since it was loaded
+	std::vector<size_t> loadedAt(vertexCount, 0);
+	std::vector<bool> used(vertexCount, false);
+	size_t misses = 0;
+	size_t uniqueCount = 0;
+
+	for (size_t i = 0; i < indexCount; ++i) {
+		uint32_t vertex = indices[i];
+		if (!used[vertex]) {
+			used[vertex] = true;
+			++uniqueCount;
+		}
+		else if (misses - loadedAt[vertex] < cacheSize) {
+			continue;
+		}
+		++misses;
+		loadedAt[vertex] = misses;
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+	stats.atvr = static_cast<float>(misses) / static_cast<float>(uniqueCount);
+	return stats;
+}
+
+std::vector<uint32_t> vkMesh::optimize_vertex_cache(
+	uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+
+	std::vector<uint32_t> clusters;
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return clusters;
+	}
+
+	//triangles around each vertex, packed
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; ++i) {
+		++liveTriangles[indices[i]];
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<uint32_t> adjacency(indexCount);
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < indexCount; ++i) {
+		adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<uint32_t> source(indices, indices + indexCount);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	uint32_t timestamp = cacheSize + 1;
+	size_t output = 0;
+	size_t scan = 0;
+
+	int64_t fanning = indices[0];
+	clusters.push_back(0);
+	while (fanning >= 0) {
+
+		//emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a) {
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle]) {
+				continue;
+			}
+			emitted[triangle] = true;
+			for (int corner = 0; corner < 3; ++corner) {
+				uint32_t vertex = source[3 * triangle + corner];
+				indices[output++] = vertex;
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				--liveTriangles[vertex];
+				if (timestamp - cacheTime[vertex] > cacheSize) {
+					cacheTime[vertex] = timestamp++;
+				}
+			}
+		}
+
+		//prefer the oldest vertex that will still be in the cache after its fan
+		fanning = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates) {
+			if (liveTriangles[vertex] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (timestamp - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+				priority = timestamp - cacheTime[vertex];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fanning = vertex;
+			}
+		}
+		if (fanning >= 0) {
+			continue;
+		}
+
+		//dead end: back up through recent vertices, then scan forwards
+		while (!deadEnds.empty() && fanning < 0) {
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex] > 0) {
+				fanning = vertex;
+			}
+		}
+		while (fanning < 0 && scan < vertexCount) {
+			if (liveTriangles[scan] > 0) {
+				fanning = static_cast<int64_t>(scan);
+			}
+			++scan;
+		}
+		if (fanning >= 0) {
+			clusters.push_back(static_cast<uint32_t>(output));
+		}
+	}
+
+	return clusters;
+}
+
+void vkMesh::optimize_overdraw(
+	uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& clusters,
+	const float* vertexData, uint32_t floatsPerVertex, uint32_t positionComponents) {
+
+	if (clusters.size() < 2) {
+		return;
+	}
+
+	auto position = [&](uint32_t vertex) {
+		glm::vec3 result(0.0f);
+		for (uint32_t c = 0; c < positionComponents; ++c) {
+			result[c] = vertexData[vertex * floatsPerVertex + c];
+		}
+		return result;
+	};
+
+	//area weighted centroid and normal for the mesh and each cluster
+	struct Cluster {
+		uint32_t begin;
+		uint32_t end;
+		glm::vec3 centroid;
+		glm::vec3 normal;
+		float sortKey;
+	};
+	std::vector<Cluster> sorted(clusters.size());
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t i = 0; i < clusters.size(); ++i) {
+		Cluster& cluster = sorted[i];
+		cluster.begin = clusters[i];
+		cluster.end = (i + 1 < clusters.size()) ? clusters[i + 1] : static_cast<uint32_t>(indexCount);
+		cluster.centroid = glm::vec3(0.0f);
+		cluster.normal = glm::vec3(0.0f);
+
+		float area = 0.0f;
+		for (uint32_t t = cluster.begin; t < cluster.end; t += 3) {
+			glm::vec3 a = position(indices[t]);
+			glm::vec3 b = position(indices[t + 1]);
+			glm::vec3 c = position(indices[t + 2]);
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float triangleArea = glm::length(normal);
+			cluster.centroid += triangleArea * (a + b + c) / 3.0f;
+			cluster.normal += normal;
+			area += triangleArea;
+		}
+
+		meshCentroid += cluster.centroid;
+		meshArea += area;
+		if (area > 0.0f) {
+			cluster.centroid /= area;
+		}
+		float length = glm::length(cluster.normal);
+		if (length > 0.0f) {
+			cluster.normal /= length;
+		}
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	for (Cluster& cluster : sorted) {
+		cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> source(indices, indices + indexCount);
+	size_t output = 0;
+	for (const Cluster& cluster : sorted) {
+		for (uint32_t i = cluster.begin; i < cluster.end; ++i) {
+			indices[output++] = source[i];
+		}
+	}
+}
+
+size_t vkMesh::optimize_vertex_fetch(
+	std::vector<float>& vertexData, uint32_t floatsPerVertex, std::vector<uint32_t>& indices) {
+
+	size_t vertexCount = vertexData.size() / floatsPerVertex;
+	const uint32_t unassigned = 0xFFFFFFFF;
+	std::vector<uint32_t> remap(vertexCount, unassigned);
+	std::vector<float> reordered;
+	reordered.reserve(vertexData.size());
+
+	uint32_t next = 0;
+	for (uint32_t& index : indices) {
+		if (remap[index] == unassigned) {
+			remap[index] = next++;
+			reordered.insert(reordered.end(),
+				vertexData.begin() + index * floatsPerVertex,
+				vertexData.begin() + (index + 1) * floatsPerVertex);
+		}
+		index = remap[index];
+	}
+
+	vertexData.swap(reordered);
+	return next;
+}
+
+std::pair<vkMesh::VertexCacheStats, vkMesh::VertexCacheStats> vkMesh::optimize_mesh(
+	std::vector<float>& vertexData, uint32_t floatsPerVertex, uint32_t positionComponents,
+	std::vector<uint32_t>& indices) {
+
+	size_t vertexCount = vertexData.size() / floatsPerVertex;
+	VertexCacheStats before = analyze_vertex_cache(indices.data(), indices.size(), vertexCount);
+
+	std::vector<uint32_t> clusters = optimize_vertex_cache(indices.data(), indices.size(), vertexCount);
+	optimize_overdraw(indices.data(), indices.size(), clusters, vertexData.data(), floatsPerVertex, positionComponents);
+	vertexCount = optimize_vertex_fetch(vertexData, floatsPerVertex, indices);
+
+	VertexCacheStats after = analyze_vertex_cache(indices.data(), indices.size(), vertexCount);
+	return std::make_pair(before, after);
+}
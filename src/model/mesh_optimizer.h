@@ -0,0 +1,72 @@
+#pragma once
+#include "../config.h"
+
+namespace vkMesh {
+
+	/**
+		How well an index order uses a FIFO post-transform cache.
+		acmr: vertices transformed per triangle, 0.5 is ideal for a large grid, 3 is the worst.
+		atvr: vertices transformed per unique vertex, 1 is ideal.
+	*/
+	struct VertexCacheStats {
+		float acmr;
+		float atvr;
+	};
+
+	/**
+		Simulate a FIFO post-transform cache over a triangle list.
+		\param indices triangle list indices
+		\param indexCount number of indices
+		\param vertexCount number of vertices the indices refer to
+		\param cacheSize entries in the simulated cache
+		\returns the cache statistics
+	*/
+	VertexCacheStats analyze_vertex_cache(
+		const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+	/**
+		Reorder triangles for the post-transform cache (Tipsify, Sander et al. 2007).
+		\param indices triangle list indices, reordered in place
+		\param indexCount number of indices
+		\param vertexCount number of vertices the indices refer to
+		\param cacheSize entries in the targeted cache
+		\returns the index offset where each cluster starts, a cluster begins
+		wherever the walk had to jump to a vertex outside the cache
+	*/
+	std::vector<uint32_t> optimize_vertex_cache(
+		uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+	/**
+		Reorder the clusters from optimize_vertex_cache so those facing away from
+		the mesh center, which are most likely to occlude the rest, are drawn first.
+		The triangle order inside each cluster, and so the cache efficiency, is kept.
+		\param indices triangle list indices, reordered in place
+		\param indexCount number of indices
+		\param clusters index offset where each cluster starts
+		\param vertexData interleaved vertices, position first
+		\param floatsPerVertex floats in each vertex
+		\param positionComponents how many of those floats are the position, 2 or 3
+	*/
+	void optimize_overdraw(
+		uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& clusters,
+		const float* vertexData, uint32_t floatsPerVertex, uint32_t positionComponents);
+
+	/**
+		Renumber vertices in the order the indices first use them, so vertex
+		fetches walk memory forwards. Unreferenced vertices are dropped.
+		\param vertexData interleaved vertices, rewritten in place
+		\param floatsPerVertex floats in each vertex
+		\param indices triangle list indices, rewritten in place
+		\returns the number of vertices kept
+	*/
+	size_t optimize_vertex_fetch(
+		std::vector<float>& vertexData, uint32_t floatsPerVertex, std::vector<uint32_t>& indices);
+
+	/**
+		Run the cache, overdraw and fetch passes in turn.
+		\returns cache statistics before and after
+	*/
+	std::pair<VertexCacheStats, VertexCacheStats> optimize_mesh(
+		std::vector<float>& vertexData, uint32_t floatsPerVertex, uint32_t positionComponents,
+		std::vector<uint32_t>& indices);
+}
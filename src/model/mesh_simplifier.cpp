@@ -0,0 +1,275 @@
+#include "mesh_simplifier.h"
+#include <algorithm>
+
+namespace {
+
+	/**
+		Symmetric 4x4 error quadric, the squared distance to a set of weighted planes
+	*/
+	struct Quadric {
+		double a00, a01, a02, a11, a12, a22;
+		double b0, b1, b2;
+		double c;
+
+		void add_plane(glm::dvec3 normal, double distance, double weight) {
+			a00 += weight * normal.x * normal.x;
+			a01 += weight * normal.x * normal.y;
+			a02 += weight * normal.x * normal.z;
+			a11 += weight * normal.y * normal.y;
+			a12 += weight * normal.y * normal.z;
+			a22 += weight * normal.z * normal.z;
+			b0 += weight * normal.x * distance;
+			b1 += weight * normal.y * distance;
+			b2 += weight * normal.z * distance;
+			c += weight * distance * distance;
+		}
+
+		void add(const Quadric& other) {
+			a00 += other.a00; a01 += other.a01; a02 += other.a02;
+			a11 += other.a11; a12 += other.a12; a22 += other.a22;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+		}
+
+		double evaluate(glm::dvec3 p) const {
+			double result = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+				+ 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+				+ 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z)
+				+ c;
+			return std::max(result, 0.0);
+		}
+	};
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		float cost;
+	};
+
+	uint64_t edge_key(uint32_t a, uint32_t b) {
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	}
+
+	//boundary planes dominate so outlines survive long after flat interiors are gone
+	const double kBoundaryWeight = 10.0;
+}
+
+std::vector<uint32_t> vkMesh::simplify_mesh(const SimplificationInputChunk& input, float& resultError) {
+
+	resultError = 0.0f;
+	std::vector<uint32_t> indices(input.indices, input.indices + input.indexCount);
+	size_t vertexCount = input.vertexCount;
+
+	std::vector<glm::dvec3> positions(vertexCount, glm::dvec3(0.0));
+	glm::dvec3 lower(std::numeric_limits<double>::max());
+	glm::dvec3 upper(-std::numeric_limits<double>::max());
+	for (size_t v = 0; v < vertexCount; ++v) {
+		for (uint32_t c = 0; c < input.positionComponents; ++c) {
+			positions[v][c] = input.vertexData[v * input.floatsPerVertex + c];
+		}
+		lower = glm::min(lower, positions[v]);
+		upper = glm::max(upper, positions[v]);
+	}
+	if (vertexCount == 0 || indices.size() <= input.targetIndexCount) {
+		return indices;
+	}
+	double extent = std::max(glm::length(upper - lower), 1e-12);
+
+	//attribute differences are measured against the size of the mesh, so weights are scale free
+	auto attribute_cost = [&](uint32_t a, uint32_t b) {
+		if (input.attributeWeights == nullptr) {
+			return 0.0;
+		}
+		double cost = 0.0;
+		for (uint32_t c = input.positionComponents; c < input.floatsPerVertex; ++c) {
+			double difference = input.vertexData[a * input.floatsPerVertex + c] - input.vertexData[b * input.floatsPerVertex + c];
+			cost += input.attributeWeights[c - input.positionComponents] * difference * difference;
+		}
+		return cost * extent * extent;
+	};
+
+	auto face_normal = [&](uint32_t a, uint32_t b, uint32_t c) {
+		return glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+	};
+
+	//plane quadrics from every face, and from every boundary edge
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+	std::unordered_map<uint64_t, int> edgeUses;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		for (int e = 0; e < 3; ++e) {
+			++edgeUses[edge_key(indices[t + e], indices[t + (e + 1) % 3])];
+		}
+	}
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+
+		glm::dvec3 normal = face_normal(indices[t], indices[t + 1], indices[t + 2]);
+		double area = glm::length(normal);
+		if (area <= 0.0) {
+			continue;
+		}
+		normal /= area;
+		for (int corner = 0; corner < 3; ++corner) {
+			quadrics[indices[t + corner]].add_plane(normal, -glm::dot(normal, positions[indices[t]]), area);
+		}
+
+		for (int e = 0; e < 3; ++e) {
+			uint32_t a = indices[t + e];
+			uint32_t b = indices[t + (e + 1) % 3];
+			if (edgeUses[edge_key(a, b)] != 1) {
+				continue;
+			}
+			glm::dvec3 edge = positions[b] - positions[a];
+			glm::dvec3 side = glm::cross(edge, normal);
+			double length = glm::length(side);
+			if (length <= 0.0) {
+				continue;
+			}
+			side /= length;
+			double weight = kBoundaryWeight * glm::dot(edge, edge);
+			quadrics[a].add_plane(side, -glm::dot(side, positions[a]), weight);
+			quadrics[b].add_plane(side, -glm::dot(side, positions[a]), weight);
+		}
+	}
+
+	std::vector<bool> boundary(vertexCount, false);
+	for (const auto& [key, uses] : edgeUses) {
+		if (uses == 1) {
+			boundary[key >> 32] = true;
+			boundary[key & 0xFFFFFFFF] = true;
+		}
+	}
+
+	double errorLimit = static_cast<double>(input.targetError) * input.targetError;
+	double largestCost = 0.0;
+
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> locked(vertexCount);
+	std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+	std::vector<uint32_t> triangles;
+	std::vector<Collapse> collapses;
+
+	while (indices.size() > input.targetIndexCount) {
+
+		size_t triangleCount = indices.size() / 3;
+
+		//triangles around each vertex
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for (uint32_t index : indices) {
+			++triangleOffsets[index + 1];
+		}
+		for (size_t v = 0; v < vertexCount; ++v) {
+			triangleOffsets[v + 1] += triangleOffsets[v];
+		}
+		triangles.resize(indices.size());
+		std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i) {
+			triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		//cheapest allowed direction of every edge
+		edgeUses.clear();
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			for (int e = 0; e < 3; ++e) {
+				++edgeUses[edge_key(indices[t + e], indices[t + (e + 1) % 3])];
+			}
+		}
+		collapses.clear();
+		for (const auto& [key, uses] : edgeUses) {
+			uint32_t a = static_cast<uint32_t>(key >> 32);
+			uint32_t b = static_cast<uint32_t>(key & 0xFFFFFFFF);
+			bool onBoundary = uses == 1;
+
+			Collapse best = { 0, 0, std::numeric_limits<float>::max() };
+			uint32_t ends[2][2] = { { a, b }, { b, a } };
+			for (auto& end : ends) {
+				uint32_t from = end[0];
+				uint32_t to = end[1];
+				if (boundary[from] && !onBoundary) {
+					continue;
+				}
+				Quadric combined = quadrics[from];
+				combined.add(quadrics[to]);
+				float cost = static_cast<float>(combined.evaluate(positions[to]) + attribute_cost(from, to));
+				if (cost < best.cost) {
+					best = { from, to, cost };
+				}
+			}
+			if (best.cost < std::numeric_limits<float>::max()) {
+				collapses.push_back(best);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+			return a.cost < b.cost;
+		});
+
+		//each collapse removes about two triangles, stop short of the target
+		size_t wanted = std::max<size_t>(1, (triangleCount - input.targetIndexCount / 3) / 2);
+		size_t applied = 0;
+		for (size_t v = 0; v < vertexCount; ++v) {
+			remap[v] = static_cast<uint32_t>(v);
+		}
+		std::fill(locked.begin(), locked.end(), false);
+
+		for (const Collapse& collapse : collapses) {
+
+			if (collapse.cost > errorLimit || applied >= wanted) {
+				break;
+			}
+			if (locked[collapse.from] || locked[collapse.to]) {
+				continue;
+			}
+
+			//reject collapses which would fold a surviving triangle over
+			bool flips = false;
+			for (uint32_t a = triangleOffsets[collapse.from]; a < triangleOffsets[collapse.from + 1] && !flips; ++a) {
+				const uint32_t* triangle = &indices[3 * triangles[a]];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+					continue;
+				}
+				glm::dvec3 before = face_normal(triangle[0], triangle[1], triangle[2]);
+				uint32_t moved[3];
+				for (int corner = 0; corner < 3; ++corner) {
+					moved[corner] = triangle[corner] == collapse.from ? collapse.to : triangle[corner];
+				}
+				glm::dvec3 after = face_normal(moved[0], moved[1], moved[2]);
+				flips = glm::dot(before, after) <= 0.0;
+			}
+			if (flips) {
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			largestCost = std::max(largestCost, static_cast<double>(collapse.cost));
+			++applied;
+
+			//neighbours are locked so this pass's flip tests stay valid
+			for (uint32_t a = triangleOffsets[collapse.from]; a < triangleOffsets[collapse.from + 1]; ++a) {
+				for (int corner = 0; corner < 3; ++corner) {
+					locked[indices[3 * triangles[a] + corner]] = true;
+				}
+			}
+		}
+
+		if (applied == 0) {
+			break;
+		}
+
+		size_t output = 0;
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			uint32_t a = remap[indices[t]];
+			uint32_t b = remap[indices[t + 1]];
+			uint32_t c = remap[indices[t + 2]];
+			if (a == b || b == c || a == c) {
+				continue;
+			}
+			indices[output++] = a;
+			indices[output++] = b;
+			indices[output++] = c;
+		}
+		indices.resize(output);
+	}
+
+	resultError = static_cast<float>(std::sqrt(largestCost));
+	return indices;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "../config.h"
+
+namespace vkMesh {
+
+	/**
+		For simplifying a mesh
+	*/
+	struct SimplificationInputChunk {
+		//interleaved vertices, position first
+		const float* vertexData;
+		size_t vertexCount;
+		uint32_t floatsPerVertex;
+		uint32_t positionComponents;
+		//how much a difference in each non-position float costs, relative to
+		//moving across the whole mesh, nullptr to ignore attributes
+		const float* attributeWeights;
+		const uint32_t* indices;
+		size_t indexCount;
+		//stop once the mesh is this small
+		size_t targetIndexCount;
+		//never make a collapse costing more than this, in object space units
+		float targetError;
+	};
+
+	/**
+		Simplify a triangle list by edge collapse, ordered by quadric error
+		(Garland and Heckbert 1997) plus the weighted attribute difference.
+		Collapses only move a vertex onto a neighbour, so the result indexes
+		the same vertices as the input, and LODs can share one vertex buffer.
+		Boundary vertices only slide along the boundary.
+		\param input the mesh and the targets
+		\param resultError receives the largest error introduced, in object space units
+		\returns the simplified indices
+	*/
+	std::vector<uint32_t> simplify_mesh(const SimplificationInputChunk& input, float& resultError);
+}
@@ -0,0 +1,133 @@
+#include "meshlet.h"
+
+namespace {
+
+	void compute_bounds(
+		const vkMesh::MeshletInputChunk& input, size_t firstTriangle, size_t triangleCount,
+		const std::vector<uint32_t>& vertices, vkMesh::Meshlet& meshlet) {
+
+		auto position = [&input](uint32_t vertex) {
+			glm::vec3 result(0.0f);
+			for (uint32_t c = 0; c < input.positionComponents; ++c) {
+				result[c] = input.vertexData[vertex * input.floatsPerVertex + c];
+			}
+			return result;
+		};
+
+		//sphere around the box center, loose but cheap
+		glm::vec3 lower(std::numeric_limits<float>::max());
+		glm::vec3 upper(-std::numeric_limits<float>::max());
+		for (uint32_t vertex : vertices) {
+			lower = glm::min(lower, position(vertex));
+			upper = glm::max(upper, position(vertex));
+		}
+		glm::vec3 center = 0.5f * (lower + upper);
+		float radius = 0.0f;
+		for (uint32_t vertex : vertices) {
+			radius = std::max(radius, glm::length(position(vertex) - center));
+		}
+
+		//normal cone, the tightest axis is approximated by the average normal
+		std::vector<glm::vec3> normals;
+		glm::vec3 axis(0.0f);
+		for (size_t t = firstTriangle; t < firstTriangle + triangleCount; ++t) {
+			glm::vec3 a = position(input.indices[3 * t]);
+			glm::vec3 b = position(input.indices[3 * t + 1]);
+			glm::vec3 c = position(input.indices[3 * t + 2]);
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float length = glm::length(normal);
+			if (length > 0.0f) {
+				normals.push_back(normal / length);
+				axis += normals.back();
+			}
+		}
+
+		float cutoff = 1.0f;
+		float axisLength = glm::length(axis);
+		if (axisLength > 0.0f) {
+			axis /= axisLength;
+			float spread = 1.0f;
+			for (const glm::vec3& normal : normals) {
+				spread = std::min(spread, glm::dot(normal, axis));
+			}
+			//a cone wider than a hemisphere can never be entirely backfacing
+			if (spread > 0.0f) {
+				cutoff = std::sqrt(1.0f - spread * spread);
+			}
+		}
+
+		for (int c = 0; c < 3; ++c) {
+			meshlet.center[c] = center[c];
+			meshlet.coneAxis[c] = axis[c];
+		}
+		meshlet.radius = radius;
+		meshlet.coneCutoff = cutoff;
+	}
+}
+
+void vkMesh::build_meshlets(
+	const MeshletInputChunk& input,
+	std::vector<Meshlet>& meshlets,
+	std::vector<uint32_t>& meshletVertices,
+	std::vector<uint32_t>& meshletTriangles) {
+
+	size_t triangleCount = input.indexCount / 3;
+	size_t globalTriangle = input.firstIndex / 3;
+	if (meshletTriangles.size() < globalTriangle + triangleCount) {
+		meshletTriangles.resize(globalTriangle + triangleCount);
+	}
+
+	//local slot of each vertex in the meshlet being built
+	std::unordered_map<uint32_t, uint32_t> local;
+	std::vector<uint32_t> vertices;
+	size_t meshletStart = 0;
+
+	auto flush = [&](size_t end) {
+		if (end == meshletStart) {
+			return;
+		}
+		Meshlet meshlet;
+		meshlet.firstIndex = input.firstIndex + static_cast<uint32_t>(3 * meshletStart);
+		meshlet.triangleCount = static_cast<uint32_t>(end - meshletStart);
+		meshlet.firstVertex = static_cast<uint32_t>(meshletVertices.size());
+		meshlet.vertexCount = static_cast<uint32_t>(vertices.size());
+		compute_bounds(input, meshletStart, end - meshletStart, vertices, meshlet);
+		meshlets.push_back(meshlet);
+
+		for (uint32_t vertex : vertices) {
+			meshletVertices.push_back(vertex + input.rebase);
+		}
+		local.clear();
+		vertices.clear();
+		meshletStart = end;
+	};
+
+	for (size_t t = 0; t < triangleCount; ++t) {
+
+		const uint32_t* triangle = input.indices + 3 * t;
+		uint32_t added = 0;
+		for (int corner = 0; corner < 3; ++corner) {
+			added += local.count(triangle[corner]) == 0 ? 1 : 0;
+		}
+		if (vertices.size() + added > kMeshletMaxVertices || t - meshletStart >= kMeshletMaxTriangles) {
+			flush(t);
+		}
+
+		uint32_t packed = 0;
+		for (int corner = 0; corner < 3; ++corner) {
+			auto found = local.find(triangle[corner]);
+			uint32_t slot;
+			if (found == local.end()) {
+				slot = static_cast<uint32_t>(vertices.size());
+				local[triangle[corner]] = slot;
+				vertices.push_back(triangle[corner]);
+			}
+			else {
+				slot = found->second;
+			}
+			packed |= slot << (8 * corner);
+		}
+		meshletTriangles[globalTriangle + t] = packed;
+	}
+	flush(triangleCount);
+}
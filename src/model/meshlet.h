@@ -0,0 +1,65 @@
+#pragma once
+#include "../config.h"
+
+namespace vkMesh {
+
+	const uint32_t kMeshletMaxVertices = 64;
+	const uint32_t kMeshletMaxTriangles = 124;
+
+	/**
+		A small cluster of triangles which is culled as a unit.
+		Its triangles are a contiguous range of the index buffer, so the
+		classic indexed draw and the mesh shader read the same data.
+		Laid out for std430, shared with the culling shaders.
+	*/
+	struct Meshlet {
+		uint32_t firstIndex;
+		uint32_t triangleCount;
+		//into the meshlet vertex list, which maps local vertices to mesh vertices
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		float center[3];
+		float radius;
+		//average of the triangles' cross product normals, which point away from
+		//viewers of the front face (frontFace is clockwise). Every triangle is
+		//backfacing when dot(eye - center, coneAxis) >= coneCutoff * |eye - center| + radius,
+		//a coneCutoff of 1 disables the test
+		float coneAxis[3];
+		float coneCutoff;
+	};
+	static_assert(sizeof(Meshlet) == 48, "meshlet layout changed");
+
+	/**
+		For partitioning a range of the index buffer into meshlets
+	*/
+	struct MeshletInputChunk {
+		//interleaved vertices, position first
+		const float* vertexData;
+		uint32_t floatsPerVertex;
+		uint32_t positionComponents;
+		//triangle list, relative to vertexData
+		const uint32_t* indices;
+		size_t indexCount;
+		//where the indices sit in the index buffer
+		uint32_t firstIndex;
+		//added to every vertex in the meshlet vertex list, to match the index buffer
+		uint32_t rebase;
+	};
+
+	/**
+		Greedily split a triangle list, in its current order, into meshlets
+		of at most kMeshletMaxVertices vertices and kMeshletMaxTriangles triangles.
+		Run it after the vertex cache optimizer, whose order already keeps
+		neighbouring triangles together.
+		\param input the triangles to split
+		\param meshlets receives the meshlets
+		\param meshletVertices receives each meshlet's vertex list
+		\param meshletTriangles receives one entry per triangle, indexed by
+			firstIndex / 3, holding its three local vertices packed in 8 bits each
+	*/
+	void build_meshlets(
+		const MeshletInputChunk& input,
+		std::vector<Meshlet>& meshlets,
+		std::vector<uint32_t>& meshletVertices,
+		std::vector<uint32_t>& meshletTriangles);
+}
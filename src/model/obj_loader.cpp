@@ -7,7 +7,6 @@
 #include <vulkan/vulkan.h>
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
-#include <gtx/hash.hpp>
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
@@ -17,11 +16,14 @@
 #include <optional>
 #include <set>
 #include <cstdint>
+#include <cmath>
 #include <fstream>
 #include <chrono>
 #include <unordered_map>
 #include "../view/vkImage/image.h"
 #include "obj_loader.h"
+#include "../control/thread_pool.h"
+#include "../control/hash.h"
 
 
 vk::VertexInputBindingDescription vkMesh::Vertex::getBindingDescription() {
@@ -66,51 +68,356 @@ bool vkMesh::Vertex::operator==(const Vertex& other) const {
 	return pos == other.pos && normal == other.normal && texCoord == other.texCoord;
 }
 
+namespace {
+
+	//vertices are hashed and compared as raw bytes
+	static_assert(sizeof(vkMesh::Vertex) == 8 * sizeof(float), "vertex must be tightly packed");
+
+	//an OBJ index which has not been resolved against the global attribute counts yet
+	const int32_t kMissing = INT32_MIN;
+
+	/**
+		Everything parsed from one slice of the file.
+		Corner indices are zero based, relative ones (negative in the file)
+		are stored against this chunk's own counts and flagged so they can
+		be offset once the earlier chunks have been counted.
+	*/
+	struct ObjChunk {
+		const char* begin;
+		const char* end;
+		std::vector<float> positions;
+		std::vector<float> normals;
+		std::vector<float> texCoords;
+		std::vector<int32_t> corners; //position, texCoord, normal for each triangle corner
+		std::vector<uint8_t> relative; //bit per component of each corner
+	};
+
+	bool is_space(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	const char* skip_space(const char* cursor, const char* end) {
+		while (cursor < end && is_space(*cursor)) {
+			++cursor;
+		}
+		return cursor;
+	}
+
+	/**
+		Locale independent float parsing, the accuracy of strtof is not needed for mesh data
+	*/
+	const char* parse_float(const char* cursor, const char* end, float& result) {
+
+		cursor = skip_space(cursor, end);
+
+		bool negative = false;
+		if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+			negative = *cursor == '-';
+			++cursor;
+		}
+
+		double value = 0.0;
+		while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+			value = value * 10.0 + (*cursor - '0');
+			++cursor;
+		}
+		if (cursor < end && *cursor == '.') {
+			++cursor;
+			double scale = 0.1;
+			while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+				value += (*cursor - '0') * scale;
+				scale *= 0.1;
+				++cursor;
+			}
+		}
+		if (cursor < end && (*cursor == 'e' || *cursor == 'E')) {
+			++cursor;
+			bool negativeExponent = false;
+			if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+				negativeExponent = *cursor == '-';
+				++cursor;
+			}
+			int exponent = 0;
+			while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+				exponent = exponent * 10 + (*cursor - '0');
+				++cursor;
+			}
+			value *= std::pow(10.0, negativeExponent ? -exponent : exponent);
+		}
+
+		result = static_cast<float>(negative ? -value : value);
+		return cursor;
+	}
+
+	const char* parse_int(const char* cursor, const char* end, int32_t& result) {
+
+		bool negative = false;
+		if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+			negative = *cursor == '-';
+			++cursor;
+		}
+		int32_t value = 0;
+		while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+			value = value * 10 + (*cursor - '0');
+			++cursor;
+		}
+		result = negative ? -value : value;
+		return cursor;
+	}
+
+	/**
+		Parse one corner of a face, "v", "v/t", "v//n" or "v/t/n"
+	*/
+	const char* parse_corner(const char* cursor, const char* end, int32_t counts[3], int32_t corner[3], uint8_t& relative) {
+
+		relative = 0;
+		for (int component = 0; component < 3; ++component) {
+
+			corner[component] = kMissing;
+			if (component > 0) {
+				if (cursor >= end || *cursor != '/') {
+					continue;
+				}
+				++cursor;
+			}
+			if (cursor >= end || *cursor == '/' || is_space(*cursor) || *cursor == '\n') {
+				continue;
+			}
+
+			int32_t index;
+			cursor = parse_int(cursor, end, index);
+			if (index > 0) {
+				corner[component] = index - 1;
+			}
+			else if (index < 0) {
+				corner[component] = counts[component] + index;
+				relative |= 1 << component;
+			}
+		}
+		return cursor;
+	}
+
+	void parse_chunk(ObjChunk& chunk) {
+
+		const char* cursor = chunk.begin;
+		const char* end = chunk.end;
+
+		std::vector<int32_t> face;
+		std::vector<uint8_t> faceRelative;
+
+		while (cursor < end) {
+
+			cursor = skip_space(cursor, end);
+			const char* lineEnd = static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+			if (lineEnd == nullptr) {
+				lineEnd = end;
+			}
+
+			if (lineEnd - cursor > 2 && cursor[0] == 'v') {
+				std::vector<float>* target = nullptr;
+				int components = 3;
+				if (is_space(cursor[1])) {
+					target = &chunk.positions;
+				}
+				else if (cursor[1] == 'n') {
+					target = &chunk.normals;
+				}
+				else if (cursor[1] == 't') {
+					target = &chunk.texCoords;
+					components = 2;
+				}
+				if (target) {
+					const char* field = cursor + 2;
+					for (int i = 0; i < components; ++i) {
+						float value = 0.0f;
+						field = parse_float(field, lineEnd, value);
+						target->push_back(value);
+					}
+				}
+			}
+			else if (lineEnd - cursor > 2 && cursor[0] == 'f' && is_space(cursor[1])) {
+
+				int32_t counts[3] = {
+					static_cast<int32_t>(chunk.positions.size() / 3),
+					static_cast<int32_t>(chunk.texCoords.size() / 2),
+					static_cast<int32_t>(chunk.normals.size() / 3)
+				};
+
+				face.clear();
+				faceRelative.clear();
+				const char* field = skip_space(cursor + 1, lineEnd);
+				//the face ends at the first token that is not an index, such as a # comment
+				//or a \ continuation, which would otherwise never move the field on
+				while (field < lineEnd && (*field == '-' || (*field >= '0' && *field <= '9'))) {
+					int32_t corner[3];
+					uint8_t relative;
+					field = parse_corner(field, lineEnd, counts, corner, relative);
+					face.insert(face.end(), corner, corner + 3);
+					faceRelative.push_back(relative);
+					field = skip_space(field, lineEnd);
+				}
+
+				//triangle fan
+				size_t cornerCount = faceRelative.size();
+				for (size_t i = 2; i < cornerCount; ++i) {
+					size_t fan[3] = { 0, i - 1, i };
+					for (size_t corner : fan) {
+						chunk.corners.insert(chunk.corners.end(), &face[3 * corner], &face[3 * corner] + 3);
+						chunk.relative.push_back(faceRelative[corner]);
+					}
+				}
+			}
+
+			cursor = lineEnd + 1;
+		}
+	}
+}
+
 vkMesh::Model::Model(const std::string& filename){
-	model_buffer = readFile(filename);
+	loadModel(filename);
 }
 
 void vkMesh::Model::loadModel(const std::string& filename){
-	/*
-	tinyobj::attrib_t attributes;
-		std::vector<tinyobj::shape_t> shapes;
-		std::vector<tinyobj::material_t> materials;
-		std::string warning, error;
-
-		std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-		if (!tinyobj::LoadObj(&attributes, &shapes, &materials, &warning, &error, filename.c_str() ) ) {  //"models/statue.obj"
-			throw std::runtime_error(warning + error);
+	model_buffer = readFile(filename);
+	parse();
+
+	//the text is no longer needed once parsed
+	std::vector<char>().swap(model_buffer);
+}
+
+void vkMesh::Model::parse() {
+
+	vertices.clear();
+	indices.clear();
+	if (model_buffer.empty()) {
+		return;
+	}
+
+	vkJob::ThreadPool* pool = vkJob::ThreadPool::get_pool();
+
+	//split the file into a few chunks per thread, each starting at a line
+	const char* fileBegin = model_buffer.data();
+	const char* fileEnd = fileBegin + model_buffer.size();
+	size_t chunkCount = std::max<size_t>(1, std::min<size_t>(
+		4 * static_cast<size_t>(pool->get_worker_count() + 1),
+		model_buffer.size() / (64 * 1024)));
+
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char* cursor = fileBegin;
+	for (size_t i = 0; i < chunkCount; ++i) {
+		chunks[i].begin = cursor;
+		const char* split = (i + 1 == chunkCount) ? fileEnd : fileBegin + (model_buffer.size() * (i + 1)) / chunkCount;
+		if (split < cursor) {
+			split = cursor;
 		}
+		const char* lineEnd = static_cast<const char*>(memchr(split, '\n', fileEnd - split));
+		cursor = lineEnd ? lineEnd + 1 : fileEnd;
+		chunks[i].end = cursor;
+	}
 
-		for (const auto& shape : shapes) {
-			for (const auto& index : shape.mesh.indices) {
-				Vertex vertex{};
+	pool->parallel_for(chunkCount, [&chunks](size_t i) {
+		parse_chunk(chunks[i]);
+	});
 
-				vertex.pos = {
-					attributes.vertices[3 * index.vertex_index],
-					attributes.vertices[3 * index.vertex_index + 1],
-					attributes.vertices[3 * index.vertex_index + 2]
-				};
+	//where each chunk's attributes and corners land in the combined arrays
+	std::vector<int32_t> positionBase(chunkCount), texCoordBase(chunkCount), normalBase(chunkCount);
+	std::vector<size_t> cornerBase(chunkCount);
+	int32_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+	size_t cornerCount = 0;
+	for (size_t i = 0; i < chunkCount; ++i) {
+		positionBase[i] = positionCount;
+		texCoordBase[i] = texCoordCount;
+		normalBase[i] = normalCount;
+		cornerBase[i] = cornerCount;
+		positionCount += static_cast<int32_t>(chunks[i].positions.size() / 3);
+		texCoordCount += static_cast<int32_t>(chunks[i].texCoords.size() / 2);
+		normalCount += static_cast<int32_t>(chunks[i].normals.size() / 3);
+		cornerCount += chunks[i].relative.size();
+	}
 
-				vertex.normal = {
-					attributes.normals[3 * index.normal_index],
-					attributes.normals[3 * index.normal_index + 1],
-					attributes.normals[3 * index.normal_index + 2]
-				};
+	std::vector<float> positions(3 * static_cast<size_t>(positionCount));
+	std::vector<float> texCoords(2 * static_cast<size_t>(texCoordCount));
+	std::vector<float> normals(3 * static_cast<size_t>(normalCount));
+	pool->parallel_for(chunkCount, [&](size_t i) {
+		std::copy(chunks[i].positions.begin(), chunks[i].positions.end(), positions.begin() + 3 * positionBase[i]);
+		std::copy(chunks[i].texCoords.begin(), chunks[i].texCoords.end(), texCoords.begin() + 2 * texCoordBase[i]);
+		std::copy(chunks[i].normals.begin(), chunks[i].normals.end(), normals.begin() + 3 * normalBase[i]);
+	});
 
-				vertex.texCoord = {
-					attributes.texcoords[2 * index.texcoord_index],
-					attributes.texcoords[2 * index.texcoord_index + 1]
-				};
+	//build and hash every corner in parallel, the table insertion after is cheap
+	std::vector<Vertex> cornerVertices(cornerCount);
+	std::vector<uint64_t> cornerHashes(cornerCount);
+	std::atomic<bool> malformed(false);
+	pool->parallel_for(chunkCount, [&](size_t i) {
+
+		const ObjChunk& chunk = chunks[i];
+		int32_t bases[3] = { positionBase[i], texCoordBase[i], normalBase[i] };
+		int32_t counts[3] = { positionCount, texCoordCount, normalCount };
+
+		for (size_t corner = 0; corner < chunk.relative.size(); ++corner) {
 
-				if (uniqueVertices.count(vertex) == 0) {
-					uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-					vertices.push_back(vertex);
+			int32_t resolved[3];
+			for (int component = 0; component < 3; ++component) {
+				int32_t index = chunk.corners[3 * corner + component];
+				if (index != kMissing && (chunk.relative[corner] & (1 << component))) {
+					index += bases[component];
 				}
-				indices.push_back(uniqueVertices[vertex]);
+				if (index != kMissing && (index < 0 || index >= counts[component])) {
+					malformed.store(true);
+					index = kMissing;
+				}
+				resolved[component] = index;
 			}
+
+			Vertex& vertex = cornerVertices[cornerBase[i] + corner];
+			vertex.pos = resolved[0] == kMissing ? glm::vec3(0.0f)
+				: glm::vec3(positions[3 * resolved[0]], positions[3 * resolved[0] + 1], positions[3 * resolved[0] + 2]);
+			vertex.texCoord = resolved[1] == kMissing ? glm::vec2(0.0f)
+				: glm::vec2(texCoords[2 * resolved[1]], texCoords[2 * resolved[1] + 1]);
+			vertex.normal = resolved[2] == kMissing ? glm::vec3(0.0f)
+				: glm::vec3(normals[3 * resolved[2]], normals[3 * resolved[2] + 1], normals[3 * resolved[2] + 2]);
+
+			cornerHashes[cornerBase[i] + corner] = vkHash::xxhash64(&vertex, sizeof(Vertex));
 		}
-	*/
+	});
+
+	if (malformed.load()) {
+		throw std::runtime_error("OBJ face refers to a missing vertex\n");
+	}
+
+	vkHash::IndexTable uniqueVertices(cornerCount);
+	vertices.reserve(cornerCount / 4);
+	indices.resize(cornerCount);
+	for (size_t corner = 0; corner < cornerCount; ++corner) {
+
+		const Vertex& vertex = cornerVertices[corner];
+		uint32_t newIndex = static_cast<uint32_t>(vertices.size());
+		uint32_t index = uniqueVertices.find_or_insert(cornerHashes[corner], newIndex,
+			[this, &vertex](uint32_t existing) {
+				return memcmp(&vertices[existing], &vertex, sizeof(Vertex)) == 0;
+			});
+
+		if (index == newIndex) {
+			vertices.push_back(vertex);
+		}
+		indices[corner] = index;
+	}
+}
+
+std::vector<float> vkMesh::Model::get_menagerie_vertices() {
+
+	std::vector<float> vertexData;
+	vertexData.reserve(7 * vertices.size());
+	for (const Vertex& vertex : vertices) {
+		vertexData.push_back(vertex.pos.x);
+		vertexData.push_back(vertex.pos.y);
+		vertexData.push_back(0.5f * vertex.normal.x + 0.5f);
+		vertexData.push_back(0.5f * vertex.normal.y + 0.5f);
+		vertexData.push_back(0.5f * vertex.normal.z + 0.5f);
+		vertexData.push_back(vertex.texCoord.x);
+		vertexData.push_back(vertex.texCoord.y);
+	}
+	return vertexData;
 }
 
 std::vector<char> vkMesh::Model::readFile(const std::string& filename) {
@@ -9,7 +9,6 @@
 #include <vulkan/vulkan.h>
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
-#include <gtx/hash.hpp>
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
@@ -50,20 +49,31 @@ namespace vkMesh{
 	    bool operator==(const Vertex& other) const;
     };
 
+    /**
+		Loads a triangulated, deduplicated mesh from an OBJ file.
+		The file is split on line boundaries and the chunks are parsed in parallel,
+		then identical vertices are merged through an open addressing table.
+	*/
     class Model{
+	public:
+		/**
+			Read and parse an OBJ file, throws std::runtime_error on failure.
+		*/
         Model(const std::string& filename);
         void loadModel(const std::string& filename);
+
+		/**
+			\returns the vertices in the layout VertexMenagerie consumes (x y r g b u v),
+			normals stand in for the color.
+		*/
+		std::vector<float> get_menagerie_vertices();
+
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+
+	private:
         std::vector<char> model_buffer; //read from file
         static std::vector<char> readFile(const std::string& filename);
+		void parse();
     };
 }
-
-namespace std {
-	template<> struct hash<vkMesh::Vertex> {
-		size_t operator()(vkMesh::Vertex const& vertex) const {
-			return ((hash<glm::vec3>()(vertex.pos) ^
-				(hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^
-				(hash<glm::vec2>()(vertex.texCoord) << 1);
-		}
-	};
-}
\ No newline at end of file
@@ -0,0 +1,546 @@
+#include "occlusion_buffer.h"
+#include "../control/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace {
+
+	const uint32_t kFullRow = 0xFFFFFFFF;
+
+	float largest_scale(float x, float y, float z) {
+		return std::max(std::abs(x), std::max(std::abs(y), std::abs(z)));
+	}
+
+	/**
+		Which of a tile's pixel centres are inside all three edges, a row per word.
+
+		\param left the tile's first column, in pixels
+		\param top the tile's first row, in pixels
+	*/
+	void cover_scalar(const float* edgeA, const float* edgeB, const float* edgeC,
+		float left, float top, uint32_t* mask) {
+
+		for (uint32_t r = 0; r < OcclusionBuffer::kTileHeight; ++r) {
+			float y = top + static_cast<float>(r) + 0.5f;
+			uint32_t row = 0;
+			for (uint32_t c = 0; c < OcclusionBuffer::kTileWidth; ++c) {
+				float x = left + static_cast<float>(c) + 0.5f;
+				bool inside = true;
+				for (int e = 0; e < 3; ++e) {
+					inside &= edgeA[e] * x + edgeB[e] * y + edgeC[e] >= 0.0f;
+				}
+				row |= static_cast<uint32_t>(inside) << c;
+			}
+			mask[r] = row;
+		}
+	}
+
+#ifdef VK_SIMD_X86
+	VK_TARGET_AVX2 void cover_avx2(const float* edgeA, const float* edgeB, const float* edgeC,
+		float left, float top, uint32_t* mask) {
+
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 centres = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+
+		//each edge along the first eight centres of a row, stepped eight pixels at a time
+		__m256 along[3];
+		__m256 step[3];
+		for (int e = 0; e < 3; ++e) {
+			along[e] = _mm256_mul_ps(_mm256_set1_ps(edgeA[e]), _mm256_add_ps(_mm256_set1_ps(left), centres));
+			step[e] = _mm256_set1_ps(8.0f * edgeA[e]);
+		}
+
+		for (uint32_t r = 0; r < OcclusionBuffer::kTileHeight; ++r) {
+			float y = top + static_cast<float>(r) + 0.5f;
+			__m256 value[3];
+			for (int e = 0; e < 3; ++e) {
+				value[e] = _mm256_add_ps(along[e], _mm256_set1_ps(edgeB[e] * y + edgeC[e]));
+			}
+
+			uint32_t row = 0;
+			for (uint32_t g = 0; g < OcclusionBuffer::kTileWidth / 8; ++g) {
+				__m256 inside = _mm256_and_ps(
+					_mm256_cmp_ps(value[0], zero, _CMP_GE_OQ),
+					_mm256_and_ps(_mm256_cmp_ps(value[1], zero, _CMP_GE_OQ), _mm256_cmp_ps(value[2], zero, _CMP_GE_OQ)));
+				row |= static_cast<uint32_t>(_mm256_movemask_ps(inside)) << (8 * g);
+				for (int e = 0; e < 3; ++e) {
+					value[e] = _mm256_add_ps(value[e], step[e]);
+				}
+			}
+			mask[r] = row;
+		}
+	}
+#endif
+
+#ifdef VK_SIMD_NEON
+	void cover_neon(const float* edgeA, const float* edgeB, const float* edgeC,
+		float left, float top, uint32_t* mask) {
+
+		const float centreValues[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
+		const uint32_t bitValues[4] = { 1, 2, 4, 8 };
+		const float32x4_t centres = vaddq_f32(vld1q_f32(centreValues), vdupq_n_f32(left));
+		const uint32x4_t bits = vld1q_u32(bitValues);
+
+		float32x4_t along[3];
+		float32x4_t step[3];
+		for (int e = 0; e < 3; ++e) {
+			along[e] = vmulq_n_f32(centres, edgeA[e]);
+			step[e] = vdupq_n_f32(4.0f * edgeA[e]);
+		}
+
+		for (uint32_t r = 0; r < OcclusionBuffer::kTileHeight; ++r) {
+			float y = top + static_cast<float>(r) + 0.5f;
+			float32x4_t value[3];
+			for (int e = 0; e < 3; ++e) {
+				value[e] = vaddq_f32(along[e], vdupq_n_f32(edgeB[e] * y + edgeC[e]));
+			}
+
+			uint32_t row = 0;
+			for (uint32_t g = 0; g < OcclusionBuffer::kTileWidth / 4; ++g) {
+				const float32x4_t zero = vdupq_n_f32(0.0f);
+				uint32x4_t inside = vandq_u32(vcgeq_f32(value[0], zero),
+					vandq_u32(vcgeq_f32(value[1], zero), vcgeq_f32(value[2], zero)));
+				row |= vaddvq_u32(vandq_u32(inside, bits)) << (4 * g);
+				for (int e = 0; e < 3; ++e) {
+					value[e] = vaddq_f32(value[e], step[e]);
+				}
+			}
+			mask[r] = row;
+		}
+	}
+#endif
+
+	/**
+		Bits first to last - 1 of a row.
+	*/
+	uint32_t row_bits(uint32_t first, uint32_t last) {
+		uint32_t below = last >= 32 ? kFullRow : (1u << last) - 1;
+		return below & ~((1u << first) - 1);
+	}
+}
+
+OcclusionBuffer::OcclusionBuffer() {
+	stats = { 0, 0, 0, 0, 0.0, 0.0 };
+	tiles.resize(kTilesX * kTilesY);
+	viewProjection = glm::mat4(1.0f);
+}
+
+void OcclusionBuffer::render(const std::vector<Occluder>& occluders, const glm::mat4& viewProjection,
+	simdLevels kernel) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	this->viewProjection = viewProjection;
+
+	for (Tile& tile : tiles) {
+		std::fill(tile.mask, tile.mask + kTileHeight, 0u);
+		tile.reference = 1.0f;
+		tile.working = 0.0f;
+	}
+
+	//clipping against the near plane makes at most two triangles of one
+	firstVertices.resize(occluders.size());
+	firstTriangles.resize(occluders.size());
+	triangleCounts.resize(occluders.size());
+	size_t vertexCount = 0;
+	size_t triangleCount = 0;
+	for (size_t o = 0; o < occluders.size(); ++o) {
+		firstVertices[o] = vertexCount;
+		firstTriangles[o] = triangleCount;
+		vertexCount += occluders[o].mesh->vertices.size() / 7;
+		triangleCount += 2 * (occluders[o].mesh->indices.size() / 3);
+	}
+	clipVertices.resize(vertexCount);
+	triangles.resize(triangleCount);
+
+	vkJob::ThreadPool* pool = vkJob::ThreadPool::get_pool();
+	pool->parallel_for(occluders.size(), [&](size_t o) {
+		triangleCounts[o] = setup(occluders[o], clipVertices.data() + firstVertices[o], triangles.data() + firstTriangles[o]);
+	});
+
+	//bands share no tiles, each draws the triangles in the order given
+	pool->parallel_for(kBins, [&](size_t bin) {
+		rasterize_bin(static_cast<uint32_t>(bin), kernel);
+	});
+
+	stats.occluders = occluders.size();
+	stats.triangles = 0;
+	for (uint32_t count : triangleCounts) {
+		stats.triangles += count;
+	}
+	stats.rasterMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint32_t OcclusionBuffer::setup(const Occluder& occluder, glm::vec4* vertices, Triangle* output) const {
+
+	//source vertices are flat, x y then colour and texture coordinates
+	const MeshSource& mesh = *occluder.mesh;
+	glm::mat4 transform = viewProjection * occluder.transform;
+	size_t vertexCount = mesh.vertices.size() / 7;
+	for (size_t v = 0; v < vertexCount; ++v) {
+		vertices[v] = transform * glm::vec4(mesh.vertices[7 * v], mesh.vertices[7 * v + 1], 0.0f, 1.0f);
+	}
+
+	uint32_t written = 0;
+	for (size_t i = 0; i + 3 <= mesh.indices.size(); i += 3) {
+
+		//keep the part in front of the near plane, where depth is at least 0
+		glm::vec4 clipped[4];
+		uint32_t corners = 0;
+		for (int e = 0; e < 3; ++e) {
+			const glm::vec4& p = vertices[mesh.indices[i + e]];
+			const glm::vec4& q = vertices[mesh.indices[i + (e + 1) % 3]];
+			if (p.z >= 0.0f) {
+				clipped[corners++] = p;
+			}
+			if ((p.z >= 0.0f) != (q.z >= 0.0f)) {
+				clipped[corners++] = p + (q - p) * (p.z / (p.z - q.z));
+			}
+		}
+
+		//to pixels, with depth
+		glm::vec3 screen[4];
+		for (uint32_t c = 0; c < corners; ++c) {
+			float w = std::max(clipped[c].w, 1e-6f);
+			screen[c] = glm::vec3(
+				(clipped[c].x / w * 0.5f + 0.5f) * static_cast<float>(kWidth),
+				(clipped[c].y / w * 0.5f + 0.5f) * static_cast<float>(kHeight),
+				clipped[c].z / w);
+		}
+
+		for (uint32_t c = 1; c + 1 < corners; ++c) {
+			const glm::vec3& v0 = screen[0];
+			const glm::vec3& v1 = screen[c];
+			const glm::vec3& v2 = screen[c + 1];
+
+			float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+			if (area == 0.0f || !std::isfinite(area)) {
+				continue;
+			}
+
+			glm::vec3 lower = glm::min(v0, glm::min(v1, v2));
+			glm::vec3 upper = glm::max(v0, glm::max(v1, v2));
+			if (upper.x < 0.0f || upper.y < 0.0f || lower.x >= static_cast<float>(kWidth) || lower.y >= static_cast<float>(kHeight)
+				|| lower.z >= 1.0f) {
+				continue;
+			}
+
+			//either winding is drawn, flipped so inside is positive
+			Triangle& triangle = output[written++];
+			float sign = area > 0.0f ? 1.0f : -1.0f;
+			const glm::vec3* edge[3][2] = { { &v0, &v1 }, { &v1, &v2 }, { &v2, &v0 } };
+			for (int e = 0; e < 3; ++e) {
+				const glm::vec3& p = *edge[e][0];
+				const glm::vec3& q = *edge[e][1];
+				triangle.edgeA[e] = sign * (p.y - q.y);
+				triangle.edgeB[e] = sign * (q.x - p.x);
+				triangle.edgeC[e] = -(triangle.edgeA[e] * p.x + triangle.edgeB[e] * p.y);
+			}
+
+			triangle.depthA = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+			triangle.depthB = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+			triangle.depthC = v0.z - triangle.depthA * v0.x - triangle.depthB * v0.y;
+			triangle.depthMax = upper.z;
+
+			triangle.tileLower[0] = static_cast<uint32_t>(std::max(lower.x, 0.0f)) / kTileWidth;
+			triangle.tileLower[1] = static_cast<uint32_t>(std::max(lower.y, 0.0f)) / kTileHeight;
+			triangle.tileUpper[0] = static_cast<uint32_t>(std::min(upper.x, kWidth - 1.0f)) / kTileWidth;
+			triangle.tileUpper[1] = static_cast<uint32_t>(std::min(upper.y, kHeight - 1.0f)) / kTileHeight;
+		}
+	}
+	return written;
+}
+
+void OcclusionBuffer::rasterize_bin(uint32_t bin, simdLevels kernel) {
+
+	uint32_t firstRow = bin * (kTilesY / kBins);
+	uint32_t lastRow = firstRow + kTilesY / kBins - 1;
+
+	for (size_t o = 0; o < triangleCounts.size(); ++o) {
+		const Triangle* first = triangles.data() + firstTriangles[o];
+		for (const Triangle* triangle = first; triangle < first + triangleCounts[o]; ++triangle) {
+
+			uint32_t rowLower = std::max(triangle->tileLower[1], firstRow);
+			uint32_t rowUpper = std::min(triangle->tileUpper[1], lastRow);
+			for (uint32_t ty = rowLower; ty <= rowUpper; ++ty) {
+				for (uint32_t tx = triangle->tileLower[0]; tx <= triangle->tileUpper[0]; ++tx) {
+
+					Tile& tile = tiles[ty * kTilesX + tx];
+					float left = static_cast<float>(tx * kTileWidth);
+					float top = static_cast<float>(ty * kTileHeight);
+
+					//the plane is farthest at a corner of the tile's centres, and never past the farthest vertex
+					float x0 = left + 0.5f, x1 = left + kTileWidth - 0.5f;
+					float y0 = top + 0.5f, y1 = top + kTileHeight - 0.5f;
+					float farthest = std::max(triangle->depthA * x0, triangle->depthA * x1)
+						+ std::max(triangle->depthB * y0, triangle->depthB * y1) + triangle->depthC;
+					float depth = std::min(farthest, triangle->depthMax);
+					if (depth >= tile.reference) {
+						continue;
+					}
+
+					uint32_t mask[kTileHeight];
+					switch (kernel) {
+#ifdef VK_SIMD_X86
+					case simdLevels::AVX2:
+						cover_avx2(triangle->edgeA, triangle->edgeB, triangle->edgeC, left, top, mask);
+						break;
+#endif
+#ifdef VK_SIMD_NEON
+					case simdLevels::NEON:
+						cover_neon(triangle->edgeA, triangle->edgeB, triangle->edgeC, left, top, mask);
+						break;
+#endif
+					default:
+						cover_scalar(triangle->edgeA, triangle->edgeB, triangle->edgeC, left, top, mask);
+						break;
+					}
+					merge(tile, mask, depth);
+				}
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::merge(Tile& tile, const uint32_t* mask, float depth) {
+
+	uint32_t covered = 0;
+	uint32_t working = 0;
+	for (uint32_t r = 0; r < kTileHeight; ++r) {
+		covered |= mask[r];
+		working |= tile.mask[r];
+	}
+	if (covered == 0) {
+		return;
+	}
+
+	//a triangle well in front of the working layer starts it again, rather than
+	//spreading the layer's farther depth over pixels it hides much closer
+	if (working != 0 && depth < tile.working && tile.working - depth > tile.reference - tile.working) {
+		working = 0;
+		std::fill(tile.mask, tile.mask + kTileHeight, 0u);
+	}
+	tile.working = working == 0 ? depth : std::max(tile.working, depth);
+
+	uint32_t full = kFullRow;
+	for (uint32_t r = 0; r < kTileHeight; ++r) {
+		tile.mask[r] |= mask[r];
+		full &= tile.mask[r];
+	}
+
+	//every pixel is now no farther than the working depth
+	if (full == kFullRow) {
+		tile.reference = tile.working;
+		tile.working = 0.0f;
+		std::fill(tile.mask, tile.mask + kTileHeight, 0u);
+	}
+}
+
+bool OcclusionBuffer::hides(const Tile& tile, uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float depth) {
+
+	if (depth >= tile.reference) {
+		return true;
+	}
+	if (depth < tile.working) {
+		return false;
+	}
+	uint32_t row = row_bits(x0, x1);
+	for (uint32_t r = y0; r < y1; ++r) {
+		if ((tile.mask[r] & row) != row) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool OcclusionBuffer::is_box_visible(const glm::vec3& lower, const glm::vec3& upper) const {
+
+	//the screen rectangle around the corners, and the nearest of them
+	glm::vec2 screenLower(std::numeric_limits<float>::max());
+	glm::vec2 screenUpper(-std::numeric_limits<float>::max());
+	float nearest = 1.0f;
+	//the corners are the lower one plus any of the three edges, projected once
+	glm::vec4 origin = viewProjection * glm::vec4(lower, 1.0f);
+	glm::vec3 size = upper - lower;
+	glm::vec4 edges[3] = { viewProjection[0] * size.x, viewProjection[1] * size.y, viewProjection[2] * size.z };
+	for (int c = 0; c < 8; ++c) {
+		glm::vec4 corner = origin;
+		for (int e = 0; e < 3; ++e) {
+			if (c & (1 << e)) {
+				corner += edges[e];
+			}
+		}
+		if (corner.z < 0.0f || corner.w <= 0.0f) {
+			return true;
+		}
+		float inverse = 1.0f / corner.w;
+		glm::vec2 screen = (glm::vec2(corner) * inverse * 0.5f + 0.5f) * glm::vec2(kWidth, kHeight);
+		screenLower = glm::min(screenLower, screen);
+		screenUpper = glm::max(screenUpper, screen);
+		nearest = std::min(nearest, corner.z * inverse);
+	}
+
+	//every pixel the rectangle touches
+	if (screenUpper.x < 0.0f || screenUpper.y < 0.0f
+		|| screenLower.x >= static_cast<float>(kWidth) || screenLower.y >= static_cast<float>(kHeight)) {
+		return true;
+	}
+	uint32_t x0 = static_cast<uint32_t>(std::max(screenLower.x, 0.0f));
+	uint32_t y0 = static_cast<uint32_t>(std::max(screenLower.y, 0.0f));
+	uint32_t x1 = static_cast<uint32_t>(std::min(screenUpper.x, kWidth - 1.0f)) + 1;
+	uint32_t y1 = static_cast<uint32_t>(std::min(screenUpper.y, kHeight - 1.0f)) + 1;
+
+	for (uint32_t ty = y0 / kTileHeight; ty <= (y1 - 1) / kTileHeight; ++ty) {
+		uint32_t top = ty * kTileHeight;
+		for (uint32_t tx = x0 / kTileWidth; tx <= (x1 - 1) / kTileWidth; ++tx) {
+			uint32_t left = tx * kTileWidth;
+			if (!hides(tiles[ty * kTilesX + tx],
+				std::max(x0, left) - left, std::min(x1, left + kTileWidth) - left,
+				std::max(y0, top) - top, std::min(y1, top + kTileHeight) - top, nearest)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool OcclusionBuffer::is_sphere_visible(const glm::vec3& center, float radius) const {
+	return is_box_visible(center - glm::vec3(radius), center + glm::vec3(radius));
+}
+
+void OcclusionBuffer::cull(const InstanceStore& instances, const std::vector<float>& radii,
+	std::vector<std::vector<uint32_t>>& visible) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	chunks.clear();
+	stats.tested = 0;
+	for (uint32_t g = 0; g < visible.size(); ++g) {
+		uint32_t count = static_cast<uint32_t>(visible[g].size());
+		for (uint32_t first = 0; first < count; first += kChunkSize) {
+			chunks.push_back(Chunk{ g, first, std::min(kChunkSize, count - first), 0 });
+		}
+		stats.tested += count;
+	}
+
+	//each chunk packs its kept instances to the front of its own share
+	vkJob::ThreadPool::get_pool()->parallel_for(chunks.size(), [&](size_t c) {
+
+		Chunk& chunk = chunks[c];
+		uint32_t* list = visible[chunk.group].data() + chunk.first;
+		float radius = radii[chunk.group];
+		for (uint32_t i = 0; i < chunk.count; ++i) {
+			uint32_t instance = list[i];
+			bool kept = (instances.flags[instance] & INSTANCE_OCCLUDER)
+				|| is_sphere_visible(instances.get_position(instance), radius
+					* largest_scale(instances.scaleX[instance], instances.scaleY[instance], instances.scaleZ[instance]));
+			list[chunk.kept] = instance;
+			chunk.kept += kept ? 1 : 0;
+		}
+	});
+
+	//close the gaps between chunks, they only ever move down
+	stats.occluded = stats.tested;
+	std::vector<uint32_t> groupKept(visible.size(), 0);
+	for (const Chunk& chunk : chunks) {
+		std::vector<uint32_t>& list = visible[chunk.group];
+		uint32_t& end = groupKept[chunk.group];
+		if (end != chunk.first) {
+			std::copy(list.begin() + chunk.first, list.begin() + chunk.first + chunk.kept, list.begin() + end);
+		}
+		end += chunk.kept;
+	}
+	for (uint32_t g = 0; g < visible.size(); ++g) {
+		visible[g].resize(groupKept[g]);
+		stats.occluded -= groupKept[g];
+	}
+
+	stats.testMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+const glm::mat4& OcclusionBuffer::get_view_projection() const {
+	return viewProjection;
+}
+
+void benchmark_occlusion(size_t count) {
+
+	using clock = std::chrono::steady_clock;
+	const int runs = 5;
+
+	//a wall is a quad of two triangles, scaled and placed per occluder
+	MeshSource quad;
+	quad.vertices = {
+		-0.5f, -0.5f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f,
+		 0.5f, -0.5f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f,
+		 0.5f,  0.5f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f,
+		-0.5f,  0.5f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f
+	};
+	quad.indices = { 0, 1, 2, 2, 3, 0 };
+
+	//looking down -z, as the engine's projection is set up
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 2.0f, 0.1f, 200.0f);
+	projection[1][1] *= -1;
+	glm::mat4 viewProjection = projection * view;
+
+	//walls in the middle distance, some turned, the crowd behind and among them
+	std::mt19937 random(17);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<Occluder> occluders;
+	for (int i = 0; i < 256; ++i) {
+		glm::vec3 position(unit(random) * 30.0f, unit(random) * 8.0f, -25.0f + unit(random) * 10.0f);
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), position)
+			* glm::rotate(glm::mat4(1.0f), unit(random) * 0.6f, glm::vec3(0.0f, 1.0f, 0.0f))
+			* glm::scale(glm::mat4(1.0f), glm::vec3(6.0f, 4.0f, 1.0f));
+		occluders.push_back(Occluder{ &quad, transform });
+	}
+
+	InstanceStore instances;
+	for (size_t i = 0; i < count; ++i) {
+		float depth = 15.0f + 0.5f * (unit(random) + 1.0f) * 85.0f;
+		glm::vec3 position(unit(random) * depth * 0.7f, unit(random) * depth * 0.35f, -depth);
+		instances.add(Renderable{ 0, 0 }, position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+	}
+	std::vector<uint32_t> everything(count);
+	for (size_t i = 0; i < count; ++i) {
+		everything[i] = static_cast<uint32_t>(i);
+	}
+	std::vector<float> radii = { 0.5f };
+
+	std::cout << "Occluders: " << occluders.size() << ", instances: " << count
+		<< ", buffer " << OcclusionBuffer::kWidth << "x" << OcclusionBuffer::kHeight << "\n";
+
+	simdLevels kernels[] = { simdLevels::SCALAR, get_simd_level() };
+	size_t kernelCount = kernels[1] == simdLevels::SCALAR ? 1 : 2;
+	std::vector<uint32_t> reference;
+	for (size_t k = 0; k < kernelCount; ++k) {
+
+		//best of several runs, the first touches the memory
+		OcclusionBuffer buffer;
+		double rasterTime = 0.0, testTime = 0.0;
+		std::vector<std::vector<uint32_t>> visible;
+		for (int run = 0; run < runs; ++run) {
+			clock::time_point start = clock::now();
+			buffer.render(occluders, viewProjection, kernels[k]);
+			double raster = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+			visible.assign(1, everything);
+			start = clock::now();
+			buffer.cull(instances, radii, visible);
+			double test = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+			rasterTime = run == 0 ? raster : std::min(rasterTime, raster);
+			testTime = run == 0 ? test : std::min(testTime, test);
+		}
+		if (k == 0) {
+			reference = visible[0];
+		}
+
+		std::cout << get_simd_name(kernels[k]) << " kernel: " << buffer.stats.triangles << " triangles drawn in "
+			<< rasterTime << " ms, tested in " << testTime << " ms, "
+			<< buffer.stats.occluded << " occluded (" << 100.0 * buffer.stats.occluded / std::max<size_t>(count, 1) << "%)"
+			<< (visible[0] == reference ? "" : ", differs from scalar") << "\n";
+	}
+}
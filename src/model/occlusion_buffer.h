@@ -0,0 +1,167 @@
+#pragma once
+#include "../config.h"
+#include "scene.h"
+#include "simd.h"
+#include "static_batcher.h"
+
+/**
+	A mesh drawn into the occlusion buffer, as loaded, and where it is placed.
+*/
+struct Occluder {
+	const MeshSource* mesh;
+	glm::mat4 transform;
+};
+
+/**
+	What the last render and test did
+*/
+struct OcclusionStats {
+	size_t occluders;
+	size_t triangles;
+	size_t tested;
+	size_t occluded;
+	double rasterMilliseconds;
+	double testMilliseconds;
+};
+
+/**
+	A small depth buffer rasterized on the CPU from a few designated occluders,
+	for dropping the instances they hide before the draw lists are built.
+
+	The screen is split into tiles of 32x8 pixels. Rather than a depth per pixel,
+	each tile keeps two layers: a reference depth no pixel of the tile is farther
+	than, and a working depth no pixel under the working mask is farther than.
+	Triangles are merged into the working layer, which replaces the reference
+	once its mask covers the whole tile. Depth runs 0 near to 1 far, as vulkan's does.
+
+	Coverage is found at pixel centres, eight pixels at a time, and the screen is
+	split into bands of tile rows rasterized in parallel, each band taking the
+	triangles in order. Bounds are tested against the tiles their screen rectangle touches.
+*/
+class OcclusionBuffer {
+public:
+
+	static const uint32_t kWidth = 256;
+	static const uint32_t kHeight = 128;
+	//a bit per pixel, a row per 32 bit word
+	static const uint32_t kTileWidth = 32;
+	static const uint32_t kTileHeight = 8;
+	static const uint32_t kTilesX = kWidth / kTileWidth;
+	static const uint32_t kTilesY = kHeight / kTileHeight;
+	//bands of tile rows rasterized in parallel
+	static const uint32_t kBins = 8;
+	//instances per parallel test job
+	static const uint32_t kChunkSize = 4096;
+
+	OcclusionBuffer();
+
+	/**
+		Clear the buffer, then draw the occluders into it.
+
+		\param occluders the meshes to draw, both sides of each triangle are drawn
+		\param viewProjection the view to draw them from
+		\param kernel the kernel to find coverage with, must be supported
+	*/
+	void render(const std::vector<Occluder>& occluders, const glm::mat4& viewProjection,
+		simdLevels kernel = get_simd_level());
+
+	/**
+		\returns whether any of the axis aligned box may be seen past the occluders.
+			Boxes reaching past the near plane are always visible
+	*/
+	bool is_box_visible(const glm::vec3& lower, const glm::vec3& upper) const;
+
+	/**
+		\returns whether any of the sphere may be seen past the occluders, tested as its box
+	*/
+	bool is_sphere_visible(const glm::vec3& center, float radius) const;
+
+	/**
+		Remove the instances hidden by the occluders from each group's list of
+		visible instances, keeping the order. Occluders themselves are kept.
+
+		\param instances the store the lists index into
+		\param radii the bounding radius of each group's mesh
+		\param visible per group, as the frustum culler leaves them
+	*/
+	void cull(const InstanceStore& instances, const std::vector<float>& radii,
+		std::vector<std::vector<uint32_t>>& visible);
+
+	/**
+		\returns the view the buffer was last rendered from
+	*/
+	const glm::mat4& get_view_projection() const;
+
+	OcclusionStats stats;
+
+private:
+
+	struct Tile {
+		uint32_t mask[kTileHeight];
+		float reference;
+		float working;
+	};
+
+	struct Triangle {
+		//at pixel centres, inside where a x + b y + c >= 0 for all three edges
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		//depth as a plane over the screen, and the farthest vertex
+		float depthA;
+		float depthB;
+		float depthC;
+		float depthMax;
+		//tiles the bounds touch, inclusive
+		uint32_t tileLower[2];
+		uint32_t tileUpper[2];
+	};
+
+	struct Chunk {
+		uint32_t group;
+		uint32_t first;
+		uint32_t count;
+		//written by the job, kept instances at the start of the chunk's share of the list
+		uint32_t kept;
+	};
+
+	std::vector<Tile> tiles;
+	glm::mat4 viewProjection;
+	//each occluder's share starts at its first, with room for its triangles clipped in two
+	std::vector<glm::vec4> clipVertices;
+	std::vector<Triangle> triangles;
+	std::vector<size_t> firstVertices;
+	std::vector<size_t> firstTriangles;
+	std::vector<uint32_t> triangleCounts;
+	std::vector<Chunk> chunks;
+
+	/**
+		Transform and clip an occluder's triangles against the near plane.
+
+		\returns the number of triangles written to output
+	*/
+	uint32_t setup(const Occluder& occluder, glm::vec4* vertices, Triangle* output) const;
+
+	/**
+		Draw every triangle's share of one band of tile rows.
+	*/
+	void rasterize_bin(uint32_t bin, simdLevels kernel);
+
+	/**
+		Merge a triangle's coverage of a tile into it.
+	*/
+	static void merge(Tile& tile, const uint32_t* mask, float depth);
+
+	/**
+		\returns whether the tile hides every pixel of a rectangle inside it, at a depth
+	*/
+	static bool hides(const Tile& tile, uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float depth);
+};
+
+/**
+	Draw a few hundred walls, test a crowd of instances behind them with each
+	kernel, and report the timings.
+
+	\param count the number of instances tested
+*/
+void benchmark_occlusion(size_t count);
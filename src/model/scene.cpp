@@ -1,35 +1,53 @@
 #include "scene.h"
+#include "scene_file.h"
 
 /**
 * Scene constructor
 */
-Scene::Scene() {
+Scene::Scene(const std::vector<Renderable>& renderables) {
 
-	float x = -0.3f;
-	for (float z = -1.0f; z <= 1.0f; z += 0.2f) {
-		for (float y = -1.0f; y <= 1.0f; y += 0.2f) {
+	streamer = nullptr;
 
-			trianglesPositions.push_back(glm::vec3(x, y, z));
+	//columns 0.3 apart, centered on the origin, every other one never moves and may be batched
+	float x = -0.15f * static_cast<float>(renderables.size() - 1);
+	uint32_t flags = INSTANCE_STATIC;
+	for (const Renderable& renderable : renderables) {
 
-		}
-	}
+		InstanceGroup group;
+		group.renderable = renderable;
+		group.firstInstance = static_cast<uint32_t>(instances.size());
+		uint32_t column = graph.add_node(SceneGraph::kNoParent, glm::vec3(x, 0.0f, 0.0f));
+		for (float z = -1.0f; z <= 1.0f; z += 0.2f) {
+			for (float y = -1.0f; y < 1.0f; y += 0.2f) {
 
-	x = 0.0f;
-	for (float z = -1.0f; z <= 1.0f; z += 0.2f) {
-		for (float y = -1.0f; y < 1.0f; y += 0.2f) {
-
-			squarePositions.push_back(glm::vec3(x, y, z));
+				uint32_t instance = instances.add(renderable, glm::vec3(x, y, z), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f), flags);
+				graph.add_node(column, glm::vec3(0.0f, y, z), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f), instance);
 
+			}
 		}
+		group.instanceCount = static_cast<uint32_t>(instances.size()) - group.firstInstance;
+		groups.push_back(group);
+		groupNodes.push_back(column);
+
+		x += 0.3f;
+		flags ^= INSTANCE_STATIC;
 	}
 
-	x = 0.3f;
-	for (float z = -1.0f; z <= 1.0f; z += 0.2f) {
-		for (float y = -1.0f; y < 1.0f; y += 0.2f) {
+};
 
-			starPositions.push_back(glm::vec3(x, y, z));
+Scene::Scene(const std::string& filename, const std::vector<Renderable>& renderables, uint32_t residentPages) {
 
-		}
-	}
+	//instances are placed by the file, the graph stays empty
+	streamer = new SceneStreamer(filename, renderables);
+	streamer->reserve(instances, groups, residentPages);
+}
 
-};
\ No newline at end of file
+Scene::~Scene() {
+	delete streamer;
+}
+
+void Scene::stream(const glm::vec3& center, float radius, const RadiusLookup& radii) {
+	if (streamer) {
+		streamer->update(instances, groups, center, radius, radii);
+	}
+}
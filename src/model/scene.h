@@ -1,13 +1,60 @@
 #pragma once
 #include "../config.h"
+#include "instance_store.h"
+#include "scene_graph.h"
+#include <functional>
+
+/**
+	A run of instances in the store sharing a renderable, drawn together
+*/
+struct InstanceGroup {
+	Renderable renderable;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+class SceneStreamer;
 
 class Scene {
 public:
-    Scene();
 
-    std::vector<glm::vec3> trianglesPositions;
+	//pages of a streamed scene held at once
+	static const uint32_t kResidentPages = 256;
+
+	//the distance from a mesh's origin to its furthest vertex, 0 while it is not resident
+	typedef std::function<float(uint32_t mesh)> RadiusLookup;
+
+	/**
+		Lay out a column of instances for each renderable, each column one assembly.
+	*/
+	Scene(const std::vector<Renderable>& renderables);
+
+	/**
+		Stream instances from a scene file, only the pages near the camera are in the store.
+		Throws std::runtime_error if the file cannot be mapped.
+
+		\param filename a file written by write_scene_file
+		\param renderables what the file's renderable indices refer to, as it was written against
+		\param residentPages the most pages in the store at once
+	*/
+	Scene(const std::string& filename, const std::vector<Renderable>& renderables, uint32_t residentPages = kResidentPages);
+	~Scene();
+
+	/**
+		Page the parts of a streamed scene around a point in and out, does nothing for generated scenes.
 
-    std::vector<glm::vec3> squarePositions;
+		\param center usually the camera
+		\param radius past the farthest position that may be seen
+		\param radii the meshes' bounding radii, pages reach past their positions by them
+	*/
+	void stream(const glm::vec3& center, float radius, const RadiusLookup& radii);
 
-	std::vector<glm::vec3> starPositions;
-};
\ No newline at end of file
+	InstanceStore instances;
+	std::vector<InstanceGroup> groups;
+	//places instances relative to their parents, propagated into instances each frame
+	SceneGraph graph;
+	//per group, the node its instances hang from
+	std::vector<uint32_t> groupNodes;
+	//for scenes loaded from a file, nullptr otherwise
+	SceneStreamer* streamer;
+};
@@ -0,0 +1,552 @@
+#include "scene_file.h"
+#include "lz4_block.h"
+#include "../control/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	uint64_t align_up(uint64_t offset) {
+		return (offset + kSceneFileAlignment - 1) & ~static_cast<uint64_t>(kSceneFileAlignment - 1);
+	}
+
+	void write_padding(std::ofstream& file, uint64_t target) {
+		static const char zeros[kSceneFileAlignment] = {};
+		uint64_t position = static_cast<uint64_t>(file.tellp());
+		file.write(zeros, static_cast<std::streamsize>(target - position));
+	}
+
+	//ten bits of each coordinate, interleaved
+	uint32_t spread_bits(uint32_t value) {
+		value &= 0x3FF;
+		value = (value | (value << 16)) & 0x030000FF;
+		value = (value | (value << 8)) & 0x0300F00F;
+		value = (value | (value << 4)) & 0x030C30C3;
+		value = (value | (value << 2)) & 0x09249249;
+		return value;
+	}
+
+	uint32_t morton_code(const glm::vec3& position, const glm::vec3& lower, const glm::vec3& extent) {
+		glm::vec3 cell = glm::clamp((position - lower) / extent, 0.0f, 1.0f) * 1023.0f;
+		return spread_bits(static_cast<uint32_t>(cell.x))
+			| (spread_bits(static_cast<uint32_t>(cell.y)) << 1)
+			| (spread_bits(static_cast<uint32_t>(cell.z)) << 2);
+	}
+}
+
+bool write_scene_file(const std::string& filename, const InstanceStore& instances,
+	const std::vector<Renderable>& renderables, bool compress) {
+
+	size_t count = instances.size();
+
+	//the file holds each instance's place in the list rather than its handles
+	std::unordered_map<uint64_t, uint32_t> indices;
+	for (size_t r = 0; r < renderables.size(); ++r) {
+		uint64_t key = (static_cast<uint64_t>(renderables[r].mesh) << 32) | renderables[r].material;
+		indices.insert(std::make_pair(key, static_cast<uint32_t>(r)));
+	}
+	std::vector<uint32_t> renderableIndices(count);
+	for (size_t i = 0; i < count; ++i) {
+		auto found = indices.find((static_cast<uint64_t>(instances.meshes[i]) << 32) | instances.materials[i]);
+		if (found == indices.end()) {
+			return false;
+		}
+		renderableIndices[i] = found->second;
+	}
+
+	SceneFileHeader header = {};
+	header.magic = kSceneFileMagic;
+	header.version = kSceneFileVersion;
+	header.pageInstances = kScenePageInstances;
+	header.instanceCount = count;
+
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	for (size_t i = 0; i < count; ++i) {
+		boundsMin = glm::min(boundsMin, instances.get_position(i));
+		boundsMax = glm::max(boundsMax, instances.get_position(i));
+	}
+	if (count == 0) {
+		boundsMin = boundsMax = glm::vec3(0.0f);
+	}
+	for (int c = 0; c < 3; ++c) {
+		header.boundsMin[c] = boundsMin[c];
+		header.boundsMax[c] = boundsMax[c];
+	}
+
+	//a page never mixes renderables, and holds instances close to each other
+	glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(1e-6f));
+	std::vector<uint32_t> codes(count);
+	std::vector<uint32_t> order(count);
+	for (size_t i = 0; i < count; ++i) {
+		codes[i] = morton_code(instances.get_position(i), boundsMin, extent);
+		order[i] = static_cast<uint32_t>(i);
+	}
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		if (renderableIndices[a] != renderableIndices[b]) return renderableIndices[a] < renderableIndices[b];
+		return codes[a] < codes[b];
+	});
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+	//written again once the index is placed
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	std::vector<SceneFilePage> index;
+	std::vector<uint8_t> page(kScenePageBytes);
+	std::vector<uint8_t> packed(lz4_block_bound(kScenePageBytes));
+	size_t next = 0;
+	while (next < count) {
+
+		SceneFilePage entry = {};
+		entry.renderable = renderableIndices[order[next]];
+		while (next + entry.count < count && entry.count < kScenePageInstances
+			&& renderableIndices[order[next + entry.count]] == entry.renderable) {
+			++entry.count;
+		}
+
+		//unused rows are left zero, they compress to almost nothing
+		std::fill(page.begin(), page.end(), 0);
+		float* columns = reinterpret_cast<float*>(page.data());
+		uint32_t* flags = reinterpret_cast<uint32_t*>(columns + 10 * kScenePageInstances);
+		glm::vec3 pageMin(std::numeric_limits<float>::max());
+		glm::vec3 pageMax(-std::numeric_limits<float>::max());
+		for (uint32_t i = 0; i < entry.count; ++i) {
+			uint32_t instance = order[next + i];
+			const float values[10] = {
+				instances.positionX[instance], instances.positionY[instance], instances.positionZ[instance],
+				instances.rotationX[instance], instances.rotationY[instance], instances.rotationZ[instance], instances.rotationW[instance],
+				instances.scaleX[instance], instances.scaleY[instance], instances.scaleZ[instance]
+			};
+			for (uint32_t c = 0; c < 10; ++c) {
+				columns[c * kScenePageInstances + i] = values[c];
+			}
+			flags[i] = instances.flags[instance] & ~INSTANCE_BATCHED;
+
+			pageMin = glm::min(pageMin, instances.get_position(instance));
+			pageMax = glm::max(pageMax, instances.get_position(instance));
+			entry.largestScale = std::max(entry.largestScale, std::max(std::abs(values[7]),
+				std::max(std::abs(values[8]), std::abs(values[9]))));
+		}
+		for (int c = 0; c < 3; ++c) {
+			entry.boundsMin[c] = pageMin[c];
+			entry.boundsMax[c] = pageMax[c];
+		}
+
+		entry.offset = align_up(static_cast<uint64_t>(file.tellp()));
+		write_padding(file, entry.offset);
+		size_t packedSize = compress ? lz4_compress_block(page.data(), page.size(), packed.data(), packed.size()) : 0;
+		if (packedSize > 0 && packedSize < page.size()) {
+			entry.compression = scenePageCompression::LZ4;
+			entry.storedSize = static_cast<uint32_t>(packedSize);
+			file.write(reinterpret_cast<const char*>(packed.data()), static_cast<std::streamsize>(packedSize));
+		}
+		else {
+			entry.compression = scenePageCompression::NONE;
+			entry.storedSize = static_cast<uint32_t>(page.size());
+			file.write(reinterpret_cast<const char*>(page.data()), static_cast<std::streamsize>(page.size()));
+		}
+
+		index.push_back(entry);
+		next += entry.count;
+	}
+
+	header.pageCount = static_cast<uint32_t>(index.size());
+	header.indexOffset = align_up(static_cast<uint64_t>(file.tellp()));
+	write_padding(file, header.indexOffset);
+	file.write(reinterpret_cast<const char*>(index.data()), sizeof(SceneFilePage) * index.size());
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	return file.good();
+}
+
+SceneStreamer::SceneStreamer(const std::string& filename, const std::vector<Renderable>& renderables) {
+
+	this->renderables = renderables;
+	meshRadii.assign(renderables.size(), 0.0f);
+	data = nullptr;
+	size = 0;
+	firstInstance = 0;
+	firstGroup = 0;
+	loading = 0;
+	stats = { 0, 0, 0, 0, 0, 0, 0.0 };
+
+#ifdef _WIN32
+	mapping = nullptr;
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("failed to open scene file\n");
+	}
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file, &fileSize)) {
+		size = static_cast<size_t>(fileSize.QuadPart);
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	}
+	if (mapping) {
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	file = open(filename.c_str(), O_RDONLY);
+	if (file < 0) {
+		throw std::runtime_error("failed to open scene file\n");
+	}
+	struct stat fileInfo;
+	void* mapped = MAP_FAILED;
+	if (fstat(file, &fileInfo) == 0 && fileInfo.st_size > 0) {
+		size = static_cast<size_t>(fileInfo.st_size);
+		mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	}
+	if (mapped != MAP_FAILED) {
+		data = static_cast<const char*>(mapped);
+		//pages are read wherever the camera goes, reading ahead only wastes memory
+		madvise(mapped, size, MADV_RANDOM);
+	}
+#endif
+
+	//a bad file must not keep its handle and mapping, the destructor never runs
+	try {
+		validate();
+	}
+	catch (const std::runtime_error&) {
+		unmap();
+		throw;
+	}
+
+	pageSlots.assign(header->pageCount, kNoSlot);
+}
+
+void SceneStreamer::validate() {
+
+	if (data == nullptr || size < sizeof(SceneFileHeader)) {
+		throw std::runtime_error("failed to map scene file\n");
+	}
+
+	header = reinterpret_cast<const SceneFileHeader*>(data);
+	if (header->magic != kSceneFileMagic || header->version != kSceneFileVersion
+		|| header->pageInstances != kScenePageInstances) {
+		throw std::runtime_error("unsupported scene file version\n");
+	}
+
+	//ranges are checked against what is left after their offset, so a corrupt header cannot wrap around
+	if (header->indexOffset % kSceneFileAlignment != 0 || header->indexOffset > size
+		|| header->pageCount > (size - header->indexOffset) / sizeof(SceneFilePage)) {
+		throw std::runtime_error("truncated scene file\n");
+	}
+	for (uint32_t p = 0; p < header->pageCount; ++p) {
+		const SceneFilePage& page = pages()[p];
+		if (page.offset > size || page.storedSize > size - page.offset || page.count > kScenePageInstances) {
+			throw std::runtime_error("truncated scene file\n");
+		}
+		if (page.renderable >= renderables.size()) {
+			throw std::runtime_error("scene file refers to a renderable which is not loaded\n");
+		}
+	}
+}
+
+void SceneStreamer::unmap() {
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+#else
+	if (data) {
+		munmap(const_cast<char*>(data), size);
+	}
+	close(file);
+#endif
+	data = nullptr;
+}
+
+const SceneFilePage* SceneStreamer::pages() const {
+	return reinterpret_cast<const SceneFilePage*>(data + header->indexOffset);
+}
+
+void SceneStreamer::reserve(InstanceStore& instances, std::vector<InstanceGroup>& groups, uint32_t residentPages) {
+
+	firstInstance = static_cast<uint32_t>(instances.size());
+	firstGroup = static_cast<uint32_t>(groups.size());
+	slots.resize(residentPages);
+	for (uint32_t s = 0; s < residentPages; ++s) {
+
+		InstanceGroup group;
+		group.renderable = Renderable{ 0, 0 };
+		group.firstInstance = static_cast<uint32_t>(instances.size());
+		group.instanceCount = kScenePageInstances;
+		for (uint32_t i = 0; i < kScenePageInstances; ++i) {
+			instances.add(group.renderable, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f), INSTANCE_HIDDEN);
+		}
+		groups.push_back(group);
+
+		slots[s].state = slotStates::FREE;
+		slots[s].page = 0;
+		slots[s].failed = false;
+		//the lowest slots are taken first
+		freeSlots.push_back(residentPages - 1 - s);
+	}
+}
+
+float SceneStreamer::distance(const SceneFilePage& page, const glm::vec3& point) const {
+	glm::vec3 lower(page.boundsMin[0], page.boundsMin[1], page.boundsMin[2]);
+	glm::vec3 upper(page.boundsMax[0], page.boundsMax[1], page.boundsMax[2]);
+	//the bounds are of positions, a large instance on their edge reaches past them
+	float reach = page.largestScale * meshRadii[page.renderable];
+	return std::max(0.0f, glm::length(point - glm::clamp(point, lower, upper)) - reach);
+}
+
+void SceneStreamer::update(InstanceStore& instances, std::vector<InstanceGroup>& groups, const glm::vec3& center, float radius,
+	const Scene::RadiusLookup& radii) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	//looked up once per renderable, not per page, meshes may become resident between updates
+	for (size_t r = 0; r < renderables.size(); ++r) {
+		meshRadii[r] = radii(renderables[r].mesh);
+	}
+
+	std::vector<uint32_t> finished;
+	{
+		std::lock_guard<std::mutex> lock(readMutex);
+		finished.swap(readSlots);
+	}
+	for (uint32_t slot : finished) {
+		commit(instances, groups, slot);
+		--loading;
+	}
+
+	for (uint32_t slot = 0; slot < slots.size(); ++slot) {
+		if (slots[slot].state == slotStates::RESIDENT && distance(pages()[slots[slot].page], center) > radius * kEvictScale) {
+			evict(instances, slot);
+		}
+	}
+
+	//the index is small next to the pages, a scan of it is cheap
+	std::vector<std::pair<float, uint32_t>> wanted;
+	for (uint32_t p = 0; p < header->pageCount; ++p) {
+		if (pageSlots[p] != kNoSlot) {
+			continue;
+		}
+		float away = distance(pages()[p], center);
+		if (away <= radius) {
+			wanted.push_back({ away, p });
+		}
+	}
+	std::sort(wanted.begin(), wanted.end());
+
+	vkJob::ThreadPool* pool = vkJob::ThreadPool::get_pool();
+	for (size_t w = 0; w < wanted.size() && !freeSlots.empty(); ++w) {
+		uint32_t slot = freeSlots.back();
+		freeSlots.pop_back();
+		slots[slot].state = slotStates::LOADING;
+		slots[slot].page = wanted[w].second;
+		slots[slot].columns.resize(kScenePageBytes);
+		pageSlots[wanted[w].second] = slot;
+		++loading;
+		pool->submit([this, slot]() { read(slot); });
+	}
+
+	stats.residentPages = 0;
+	stats.residentInstances = 0;
+	for (const Slot& slot : slots) {
+		if (slot.state == slotStates::RESIDENT) {
+			++stats.residentPages;
+			stats.residentInstances += slot.failed ? 0 : pages()[slot.page].count;
+		}
+	}
+	stats.loadingPages = loading;
+	stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SceneStreamer::read(uint32_t slot) {
+
+	Slot& target = slots[slot];
+	const SceneFilePage& page = pages()[target.page];
+	const uint8_t* stored = reinterpret_cast<const uint8_t*>(data + page.offset);
+
+	//the first touch of the mapping faults the page in from disk, here rather than on the render thread
+	if (page.compression == scenePageCompression::LZ4) {
+		target.failed = !lz4_decompress_block(stored, page.storedSize, target.columns.data(), kScenePageBytes);
+	}
+	else {
+		target.failed = page.compression != scenePageCompression::NONE || page.storedSize != kScenePageBytes;
+		if (!target.failed) {
+			std::memcpy(target.columns.data(), stored, kScenePageBytes);
+		}
+	}
+
+#ifndef _WIN32
+	//give the file's pages back, they are read again from disk if the page comes back.
+	//Neighbours sharing a memory page are read again too, which is harmless
+	uintptr_t memoryPage = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	uintptr_t begin = reinterpret_cast<uintptr_t>(stored) & ~(memoryPage - 1);
+	uintptr_t end = reinterpret_cast<uintptr_t>(stored) + page.storedSize;
+	madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+
+	std::lock_guard<std::mutex> lock(readMutex);
+	readSlots.push_back(slot);
+}
+
+void SceneStreamer::commit(InstanceStore& instances, std::vector<InstanceGroup>& groups, uint32_t slot) {
+
+	Slot& source = slots[slot];
+	const SceneFilePage& page = pages()[source.page];
+	uint32_t count = source.failed ? 0 : page.count;
+	const float* columns = reinterpret_cast<const float*>(source.columns.data());
+	const uint32_t* flags = reinterpret_cast<const uint32_t*>(columns + 10 * kScenePageInstances);
+	std::vector<float>* destinations[10] = {
+		&instances.positionX, &instances.positionY, &instances.positionZ,
+		&instances.rotationX, &instances.rotationY, &instances.rotationZ, &instances.rotationW,
+		&instances.scaleX, &instances.scaleY, &instances.scaleZ
+	};
+
+	//rows past the page's count stay hidden
+	uint32_t first = firstInstance + slot * kScenePageInstances;
+	for (uint32_t c = 0; c < 10; ++c) {
+		std::copy(columns + c * kScenePageInstances, columns + c * kScenePageInstances + count, destinations[c]->begin() + first);
+	}
+	Renderable renderable = renderables[page.renderable];
+	std::vector<uint32_t> changed(kScenePageInstances);
+	for (uint32_t i = 0; i < kScenePageInstances; ++i) {
+		changed[i] = first + i;
+		instances.set_renderable(first + i, renderable);
+		instances.set_flags(first + i, i < count ? flags[i] & ~INSTANCE_BATCHED : INSTANCE_HIDDEN);
+	}
+	instances.mark_changed(changed.data(), changed.size());
+	groups[firstGroup + slot].renderable = renderable;
+
+	source.state = slotStates::RESIDENT;
+	std::vector<uint8_t>().swap(source.columns);
+	++stats.pagesLoaded;
+	stats.bytesRead += page.storedSize;
+}
+
+void SceneStreamer::evict(InstanceStore& instances, uint32_t slot) {
+
+	uint32_t first = firstInstance + slot * kScenePageInstances;
+	for (uint32_t i = 0; i < kScenePageInstances; ++i) {
+		instances.set_flags(first + i, INSTANCE_HIDDEN);
+	}
+
+	pageSlots[slots[slot].page] = kNoSlot;
+	slots[slot].state = slotStates::FREE;
+	slots[slot].failed = false;
+	freeSlots.push_back(slot);
+	++stats.pagesEvicted;
+}
+
+bool SceneStreamer::is_idle() {
+	std::lock_guard<std::mutex> lock(readMutex);
+	return readSlots.size() == loading;
+}
+
+SceneStreamer::~SceneStreamer() {
+
+	//jobs still reading write into the slots and the mapping
+	while (!is_idle()) {
+		std::this_thread::yield();
+	}
+
+	unmap();
+}
+
+void benchmark_scene_streaming(const std::string& filename, size_t count) {
+
+	using clock = std::chrono::steady_clock;
+	auto since = [](clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	//a wide flat scene of a few renderables, turned about y, mostly at unit scale.
+	//The file stores places in this list, which --scene takes as the engine's first four
+	const std::vector<Renderable> renderables = {
+		Renderable{ 0, 0 }, Renderable{ 0, 1 }, Renderable{ 1, 0 }, Renderable{ 1, 1 }
+	};
+	std::mt19937 random(23);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_int_distribution<uint32_t> kinds(0, 3), scaled(0, 9);
+	InstanceStore source;
+	float half = 0.5f * std::sqrt(static_cast<float>(count));
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t kind = kinds(random);
+		float angle = unit(random) * 3.14159265f;
+		glm::quat rotation = glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::vec3 scale = scaled(random) == 0 ? glm::vec3(1.0f + unit(random) * 0.5f) : glm::vec3(1.0f);
+		source.add(renderables[kind], glm::vec3(unit(random) * half, unit(random), unit(random) * half),
+			rotation, scale, scaled(random) < 8 ? static_cast<uint32_t>(INSTANCE_STATIC) : 0);
+	}
+
+	std::cout << "Instances: " << count << " over " << 2.0f * half << " units square, "
+		<< kScenePageInstances << " per page\n";
+
+	std::string rawFilename = filename + ".raw";
+	for (int compressed = 0; compressed < 2; ++compressed) {
+
+		const std::string& name = compressed ? filename : rawFilename;
+		clock::time_point start = clock::now();
+		if (!write_scene_file(name, source, renderables, compressed != 0)) {
+			std::cout << "failed to write " << name << "\n";
+			return;
+		}
+		double writeTime = since(start);
+		std::ifstream written(name, std::ios::binary | std::ios::ate);
+		double megabytes = static_cast<double>(written.tellg()) / (1024.0 * 1024.0);
+
+		SceneStreamer streamer(name, renderables);
+		InstanceStore instances;
+		std::vector<InstanceGroup> groups;
+		streamer.reserve(instances, groups, 256);
+
+		//page in around one corner, waiting for the workers, then walk across the scene.
+		//The meshes stand in for the built in ones, about a unit across
+		const float radius = 0.25f * half;
+		Scene::RadiusLookup radii = [](uint32_t) {
+			return 0.5f;
+		};
+		auto settle = [&](const glm::vec3& center) {
+			do {
+				streamer.update(instances, groups, center, radius, radii);
+				std::this_thread::yield();
+			} while (!streamer.is_idle() || streamer.stats.loadingPages > 0);
+		};
+		glm::vec3 center(-0.5f * half, 0.0f, -0.5f * half);
+		start = clock::now();
+		settle(center);
+		double firstTime = since(start);
+		size_t firstPages = streamer.stats.residentPages;
+
+		const int steps = 20;
+		start = clock::now();
+		for (int step = 0; step < steps; ++step) {
+			center += glm::vec3(half / steps, 0.0f, half / steps);
+			settle(center);
+		}
+		double walkTime = since(start);
+
+		std::cout << (compressed ? "LZ4 pages: " : "Raw pages: ") << streamer.header->pageCount << " pages, "
+			<< megabytes << " MB written in " << writeTime << " ms\n"
+			<< "  first region: " << firstPages << " pages in " << firstTime << " ms\n"
+			<< "  walk of " << steps << " steps: " << walkTime << " ms, " << streamer.stats.pagesLoaded << " pages loaded, "
+			<< streamer.stats.pagesEvicted << " evicted, " << streamer.stats.bytesRead / (1024.0 * 1024.0) << " MB read\n"
+			<< "  resident: " << streamer.stats.residentPages << " pages, " << streamer.stats.residentInstances
+			<< " instances (" << 100.0 * streamer.stats.residentInstances / std::max<size_t>(count, 1) << "%)\n";
+	}
+}
@@ -0,0 +1,231 @@
+#pragma once
+#include "../config.h"
+#include "scene.h"
+#include <mutex>
+
+const uint32_t kSceneFileMagic = 0x4E435356; //"VSCN"
+const uint32_t kSceneFileVersion = 2;
+const uint32_t kSceneFileAlignment = 16;
+//instances per page, every page holds this many whether or not all are used
+const uint32_t kScenePageInstances = 4096;
+//position xyz, rotation xyzw, scale xyz as floats, then flags
+const uint32_t kScenePageColumns = 11;
+const size_t kScenePageBytes = static_cast<size_t>(kScenePageColumns) * kScenePageInstances * sizeof(float);
+
+/**
+	How a page is stored
+*/
+enum class scenePageCompression : uint32_t {
+	NONE,
+	LZ4
+};
+
+/**
+	Start of a binary scene file. Pages follow, each aligned to kSceneFileAlignment,
+	then the page index. Each page is kScenePageBytes of columns, kScenePageInstances
+	long, in the order of the store's: positionX, Y, Z, rotationX, Y, Z, W, scaleX, Y, Z, flags.
+*/
+struct SceneFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t pageInstances;
+	uint32_t pageCount;
+	uint64_t instanceCount;
+	uint64_t indexOffset;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t reserved[2];
+};
+static_assert(sizeof(SceneFileHeader) == 64, "scene file header layout changed");
+
+/**
+	Where a page lives in the file and what it holds. All of a page's instances
+	share one renderable, and its bounds are those of their positions.
+
+	Asset handles only mean something to the process which registered the assets,
+	so the renderable is stored as its index in the list the file was written
+	against, the engine's: built in renderables, then one per manifest line.
+*/
+struct SceneFilePage {
+	uint64_t offset;
+	uint32_t storedSize;
+	scenePageCompression compression;
+	uint32_t count;
+	uint32_t renderable;
+	//of the page's instances, so meshes' bounding radii can be scaled by it
+	float largestScale;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t reserved[3];
+};
+static_assert(sizeof(SceneFilePage) == 64, "scene file page layout changed");
+static_assert(kSceneFileAlignment % alignof(SceneFilePage) == 0, "scene file index must be aligned for its pages");
+
+/**
+	Write a store's instances as a scene file. Instances are sorted by renderable,
+	then along a space filling curve, so each page covers a small region.
+	Batched flags are left out, the batcher sets them again.
+
+	\param filename the file to write
+	\param instances the instances to write
+	\param renderables what the file's renderable indices refer to, every instance's renderable must be listed
+	\param compress store pages as LZ4 blocks, where that makes them smaller
+	\returns whether the file could be written
+*/
+bool write_scene_file(const std::string& filename, const InstanceStore& instances,
+	const std::vector<Renderable>& renderables, bool compress);
+
+/**
+	What the streamer holds and has done
+*/
+struct StreamStats {
+	size_t residentPages;
+	size_t loadingPages;
+	size_t residentInstances;
+	//since the streamer was made
+	size_t pagesLoaded;
+	size_t pagesEvicted;
+	size_t bytesRead;
+	double milliseconds;
+};
+
+/**
+	Keeps the pages of a mapped scene file which overlap a region resident in a store.
+
+	The store is given a fixed number of page slots up front, each a run of
+	kScenePageInstances hidden instances and a group of its own, so instances never
+	move and groups stay runs of one renderable. Pages in the region are read on the
+	thread pool, decompressed when stored as LZ4, and copied into a free slot on the
+	next update. Pages well outside the region are hidden and their slot reused.
+
+	The file is only read through the mapping, and the parts of it a page was read
+	from are given back once the page is in the store, so a scene much larger than
+	memory only costs its resident pages and its index.
+*/
+class SceneStreamer {
+public:
+
+	//pages are evicted once past the region by this factor, so pages on its edge do not come and go
+	static constexpr float kEvictScale = 1.25f;
+	static constexpr uint32_t kNoSlot = 0xFFFFFFFF;
+
+	/**
+		Map and validate a scene file, throws std::runtime_error on failure.
+
+		\param renderables what the file's renderable indices refer to, as it was written against
+	*/
+	SceneStreamer(const std::string& filename, const std::vector<Renderable>& renderables);
+	~SceneStreamer();
+
+	/**
+		Add the page slots to a store, all hidden, and a group for each.
+
+		\param residentPages the most pages resident at once
+	*/
+	void reserve(InstanceStore& instances, std::vector<InstanceGroup>& groups, uint32_t residentPages);
+
+	/**
+		Move pages which finished reading into the store, evict pages outside the
+		region, and start reading those inside it, nearest first, while slots are free.
+
+		\param center the middle of the region, usually the camera
+		\param radius the region's radius, past the farthest position that may be seen
+		\param radii the meshes' bounding radii, each page's bounds grow by its mesh's times its largest scale
+	*/
+	void update(InstanceStore& instances, std::vector<InstanceGroup>& groups, const glm::vec3& center, float radius,
+		const Scene::RadiusLookup& radii);
+
+	/**
+		\returns whether no page is being read
+	*/
+	bool is_idle();
+
+	const SceneFileHeader* header;
+
+	const SceneFilePage* pages() const;
+
+	StreamStats stats;
+
+private:
+
+	enum class slotStates {
+		FREE,
+		LOADING,
+		RESIDENT
+	};
+
+	struct Slot {
+		slotStates state;
+		uint32_t page;
+		//written by the reading job, copied into the store on the next update
+		std::vector<uint8_t> columns;
+		bool failed;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+	//per page, the slot holding or reading it
+	std::vector<uint32_t> pageSlots;
+	uint32_t firstInstance;
+	uint32_t firstGroup;
+
+	//slots whose page has been read, handed over by the jobs
+	std::mutex readMutex;
+	std::vector<uint32_t> readSlots;
+	size_t loading;
+
+	//pages' renderable indices are looked up here as they are committed
+	std::vector<Renderable> renderables;
+	//per renderable, its mesh's bounding radius as of the last update
+	std::vector<float> meshRadii;
+
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int file;
+#endif
+
+	/**
+		Check the header and that the index and every page lie inside the file,
+		throws std::runtime_error if not.
+	*/
+	void validate();
+
+	/**
+		Release the mapping and the file.
+	*/
+	void unmap();
+
+	/**
+		Read a page into its slot, on a worker.
+	*/
+	void read(uint32_t slot);
+
+	/**
+		Copy a slot's columns into its instances of the store.
+	*/
+	void commit(InstanceStore& instances, std::vector<InstanceGroup>& groups, uint32_t slot);
+
+	/**
+		Hide a slot's instances and free it.
+	*/
+	void evict(InstanceStore& instances, uint32_t slot);
+
+	/**
+		\returns the distance from a point to a page's bounds, grown by the reach of its largest instance
+	*/
+	float distance(const SceneFilePage& page, const glm::vec3& point) const;
+};
+
+/**
+	Write count instances as a scene file, raw and compressed, then stream a
+	region of each in and move it across the scene, and report the timings.
+	The files are left for --scene to load.
+
+	\param filename the compressed file, the raw one has .raw appended
+	\param count the number of instances
+*/
+void benchmark_scene_streaming(const std::string& filename, size_t count);
@@ -0,0 +1,316 @@
+#include "scene_graph.h"
+#include "../control/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <type_traits>
+
+uint32_t SceneGraph::add_node(uint32_t parent, const glm::vec3& position, const glm::quat& rotation,
+	const glm::vec3& scale, uint32_t instance) {
+
+	uint32_t handle = static_cast<uint32_t>(handleIndex.size());
+	uint32_t index = static_cast<uint32_t>(handles.size());
+	handleIndex.push_back(index);
+	depths.push_back(parent == kNoParent ? 0 : depths[parent] + 1);
+
+	//appended unsorted, parents by their current position
+	handles.push_back(handle);
+	uint32_t parentIndex = kNoParent;
+	if (parent != kNoParent) {
+		parentIndex = handleIndex[parent];
+	}
+	parents.push_back(parentIndex);
+	nodeInstances.push_back(instance);
+	localPositions.push_back(position);
+	localRotations.push_back(rotation);
+	localScales.push_back(scale);
+	worldPositions.push_back(position);
+	worldRotations.push_back(rotation);
+	worldScales.push_back(scale);
+	dirty.push_back(1);
+	sorted = false;
+
+	return handle;
+}
+
+void SceneGraph::set_local_position(uint32_t node, const glm::vec3& position) {
+	localPositions[handleIndex[node]] = position;
+	mark(node);
+}
+
+void SceneGraph::set_local_rotation(uint32_t node, const glm::quat& rotation) {
+	localRotations[handleIndex[node]] = rotation;
+	mark(node);
+}
+
+void SceneGraph::set_local_scale(uint32_t node, const glm::vec3& scale) {
+	localScales[handleIndex[node]] = scale;
+	mark(node);
+}
+
+glm::vec3 SceneGraph::get_world_position(uint32_t node) const {
+	return worldPositions[handleIndex[node]];
+}
+
+size_t SceneGraph::size() const {
+	return handles.size();
+}
+
+size_t SceneGraph::get_depth() const {
+	if (!sorted) {
+		return depths.empty() ? 0 : *std::max_element(depths.begin(), depths.end()) + 1;
+	}
+	return levels.empty() ? 0 : levels.size() - 1;
+}
+
+void SceneGraph::mark(uint32_t node) {
+	dirty[handleIndex[node]] = 1;
+	//sort finds the dirty levels itself
+	if (sorted) {
+		dirtyLevels[depths[node]] = 1;
+	}
+}
+
+void SceneGraph::sort() {
+
+	size_t count = handles.size();
+	uint32_t levelCount = 0;
+	for (uint32_t depth : depths) {
+		levelCount = std::max(levelCount, depth + 1);
+	}
+
+	//bucket by depth, keeping the current order within a level
+	levels.assign(levelCount + 1, 0);
+	for (uint32_t depth : depths) {
+		++levels[depth + 1];
+	}
+	for (uint32_t level = 0; level < levelCount; ++level) {
+		levels[level + 1] += levels[level];
+	}
+	std::vector<uint32_t> order(count);
+	std::vector<uint32_t> next(levels.begin(), levels.end() - 1);
+	for (uint32_t i = 0; i < count; ++i) {
+		order[next[depths[handles[i]]]++] = i;
+	}
+
+	//then by parent, level by level, so siblings sit together
+	std::vector<uint32_t> newIndex(count);
+	for (uint32_t level = 0; level < levelCount; ++level) {
+		std::vector<uint32_t>::iterator begin = order.begin() + levels[level];
+		std::vector<uint32_t>::iterator end = order.begin() + levels[level + 1];
+		if (level > 0) {
+			std::stable_sort(begin, end, [&](uint32_t a, uint32_t b) {
+				return newIndex[parents[a]] < newIndex[parents[b]];
+			});
+		}
+		for (uint32_t k = levels[level]; k < levels[level + 1]; ++k) {
+			newIndex[order[k]] = k;
+		}
+	}
+
+	auto permute = [&](auto& values) {
+		typename std::remove_reference<decltype(values)>::type sortedValues(count);
+		for (size_t k = 0; k < count; ++k) {
+			sortedValues[k] = values[order[k]];
+		}
+		values.swap(sortedValues);
+	};
+	permute(handles);
+	permute(parents);
+	permute(nodeInstances);
+	permute(localPositions);
+	permute(localRotations);
+	permute(localScales);
+	permute(worldPositions);
+	permute(worldRotations);
+	permute(worldScales);
+	permute(dirty);
+
+	for (uint32_t k = 0; k < count; ++k) {
+		if (parents[k] != kNoParent) {
+			parents[k] = newIndex[parents[k]];
+		}
+		handleIndex[handles[k]] = k;
+	}
+
+	dirtyLevels.assign(levelCount, 0);
+	for (uint32_t level = 0; level < levelCount; ++level) {
+		for (uint32_t k = levels[level]; k < levels[level + 1] && !dirtyLevels[level]; ++k) {
+			dirtyLevels[level] = dirty[k];
+		}
+	}
+	sorted = true;
+}
+
+size_t SceneGraph::propagate(InstanceStore& instances) {
+
+	if (!sorted) {
+		sort();
+	}
+
+	size_t recomputed = 0;
+	std::vector<uint32_t> changed;
+	std::vector<size_t> chunkCounts;
+	std::vector<std::vector<uint32_t>> chunkInstances;
+
+	//a level is visited when it was changed or the level above recomputed anything
+	bool above = false;
+	uint32_t firstVisited = kNoParent, lastVisited = 0;
+	for (uint32_t level = 0; level + 1 < levels.size(); ++level) {
+
+		if (!above && !dirtyLevels[level]) {
+			continue;
+		}
+		dirtyLevels[level] = 0;
+		firstVisited = std::min(firstVisited, level);
+		lastVisited = level;
+
+		uint32_t begin = levels[level], end = levels[level + 1];
+		size_t chunks = (end - begin + kChunkSize - 1) / kChunkSize;
+		chunkCounts.assign(chunks, 0);
+		chunkInstances.resize(std::max(chunkInstances.size(), chunks));
+
+		vkJob::ThreadPool::get_pool()->parallel_for(chunks, [&](size_t c) {
+
+			uint32_t first = begin + static_cast<uint32_t>(c) * kChunkSize;
+			uint32_t last = std::min(end, first + kChunkSize);
+			std::vector<uint32_t>& written = chunkInstances[c];
+			written.clear();
+
+			//parents are a level up, already final
+			for (uint32_t i = first; i < last; ++i) {
+
+				uint32_t parent = parents[i];
+				if (!dirty[i] && (parent == kNoParent || !dirty[parent])) {
+					continue;
+				}
+				dirty[i] = 1;
+				++chunkCounts[c];
+
+				if (parent == kNoParent) {
+					worldPositions[i] = localPositions[i];
+					worldRotations[i] = localRotations[i];
+					worldScales[i] = localScales[i];
+				}
+				else {
+					worldPositions[i] = worldPositions[parent] + worldRotations[parent] * (worldScales[parent] * localPositions[i]);
+					worldRotations[i] = worldRotations[parent] * localRotations[i];
+					worldScales[i] = worldScales[parent] * localScales[i];
+				}
+
+				uint32_t instance = nodeInstances[i];
+				if (instance == kNoInstance) {
+					continue;
+				}
+				instances.positionX[instance] = worldPositions[i].x;
+				instances.positionY[instance] = worldPositions[i].y;
+				instances.positionZ[instance] = worldPositions[i].z;
+				instances.rotationX[instance] = worldRotations[i].x;
+				instances.rotationY[instance] = worldRotations[i].y;
+				instances.rotationZ[instance] = worldRotations[i].z;
+				instances.rotationW[instance] = worldRotations[i].w;
+				instances.scaleX[instance] = worldScales[i].x;
+				instances.scaleY[instance] = worldScales[i].y;
+				instances.scaleZ[instance] = worldScales[i].z;
+				written.push_back(instance);
+			}
+		});
+
+		size_t levelCount = 0;
+		for (size_t c = 0; c < chunks; ++c) {
+			levelCount += chunkCounts[c];
+			changed.insert(changed.end(), chunkInstances[c].begin(), chunkInstances[c].end());
+		}
+		recomputed += levelCount;
+		above = levelCount > 0;
+	}
+
+	if (firstVisited != kNoParent) {
+		std::fill(dirty.begin() + levels[firstVisited], dirty.begin() + levels[lastVisited + 1], 0);
+	}
+	if (!changed.empty()) {
+		instances.mark_changed(changed.data(), changed.size());
+	}
+	return recomputed;
+}
+
+void benchmark_scene_graph(size_t count) {
+
+	using clock = std::chrono::steady_clock;
+	auto since = [](clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	//assemblies of eight subassemblies, four levels down, with a part at each leaf
+	const uint32_t branching = 8;
+	const uint32_t assemblyDepth = 4;
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	SceneGraph graph;
+	InstanceStore instances;
+	std::vector<uint32_t> roots, parts;
+	while (graph.size() < count) {
+
+		uint32_t root = graph.add_node(SceneGraph::kNoParent, glm::vec3(unit(random), unit(random), unit(random)) * 1000.0f);
+		roots.push_back(root);
+		std::vector<uint32_t> level = { root };
+		for (uint32_t depth = 1; depth <= assemblyDepth && graph.size() < count; ++depth) {
+			std::vector<uint32_t> below;
+			for (uint32_t parent : level) {
+				for (uint32_t b = 0; b < branching && graph.size() < count; ++b) {
+					glm::vec3 offset = glm::vec3(unit(random), unit(random), unit(random)) * 4.0f;
+					glm::quat rotation = glm::normalize(glm::quat(unit(random), unit(random), unit(random), unit(random)));
+					uint32_t instance = SceneGraph::kNoInstance;
+					if (depth == assemblyDepth) {
+						instance = instances.add(Renderable{ 0, 0 }, glm::vec3(0.0f));
+					}
+					uint32_t node = graph.add_node(parent, offset, rotation, glm::vec3(1.0f), instance);
+					below.push_back(node);
+					if (depth == assemblyDepth) {
+						parts.push_back(node);
+					}
+				}
+			}
+			level.swap(below);
+		}
+	}
+	std::cout << "Nodes: " << graph.size() << ", levels: " << graph.get_depth()
+		<< ", assemblies: " << roots.size() << ", parts: " << parts.size()
+		<< ", workers: " << vkJob::ThreadPool::get_pool()->get_worker_count() << "\n";
+
+	std::vector<uint32_t> stalePages;
+	auto report = [&](const char* name, size_t recomputed, double milliseconds) {
+		instances.take_stale_pages(0, 1, stalePages);
+		std::cout << "  " << name << ": " << milliseconds << " ms, " << recomputed << " nodes, "
+			<< stalePages.size() << " pages changed\n";
+	};
+
+	clock::time_point start = clock::now();
+	size_t recomputed = graph.propagate(instances);
+	report("first propagate, sorting by depth", recomputed, since(start));
+
+	start = clock::now();
+	recomputed = graph.propagate(instances);
+	report("nothing changed", recomputed, since(start));
+
+	for (uint32_t root : roots) {
+		graph.set_local_rotation(root, glm::normalize(glm::quat(unit(random), unit(random), unit(random), unit(random))));
+	}
+	start = clock::now();
+	recomputed = graph.propagate(instances);
+	report("every assembly turned", recomputed, since(start));
+
+	graph.set_local_position(roots[roots.size() / 2], glm::vec3(0.0f));
+	start = clock::now();
+	recomputed = graph.propagate(instances);
+	report("one assembly moved", recomputed, since(start));
+
+	std::uniform_int_distribution<size_t> pick(0, parts.size() - 1);
+	for (size_t i = 0; i < parts.size() / 100; ++i) {
+		graph.set_local_position(parts[pick(random)], glm::vec3(unit(random), unit(random), unit(random)));
+	}
+	start = clock::now();
+	recomputed = graph.propagate(instances);
+	report("1% of parts moved", recomputed, since(start));
+}
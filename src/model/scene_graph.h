@@ -0,0 +1,98 @@
+#pragma once
+#include "../config.h"
+#include "instance_store.h"
+
+/**
+	Parent and child transforms for assemblies of instances.
+
+	Nodes hold a local translation, rotation and scale, and optionally drive an
+	instance of the store, whose transform becomes the node's world transform.
+	Nodes are kept sorted by depth, breadth first, so every level is one
+	contiguous run and a parent always comes before its children. Propagation
+	walks the levels in order, with each level spread over the thread pool, and
+	only recomputes nodes below a change.
+
+	World transforms stay translation, rotation and scale: scales multiply
+	per axis, so a non-uniform scale under a rotated child does not shear.
+
+	Nodes are named by the handle add_node returns, which stays valid when
+	the nodes are sorted again.
+*/
+class SceneGraph {
+public:
+
+	//parent of root nodes
+	static const uint32_t kNoParent = 0xFFFFFFFF;
+	//for nodes which only group others
+	static const uint32_t kNoInstance = 0xFFFFFFFF;
+	//nodes per parallel job
+	static const uint32_t kChunkSize = 2048;
+
+	/**
+		\param parent handle of the parent, or kNoParent for a root
+		\param instance the store instance this node places, or kNoInstance
+		\returns the new node's handle
+	*/
+	uint32_t add_node(uint32_t parent, const glm::vec3& position,
+		const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+		const glm::vec3& scale = glm::vec3(1.0f), uint32_t instance = kNoInstance);
+
+	void set_local_position(uint32_t node, const glm::vec3& position);
+	void set_local_rotation(uint32_t node, const glm::quat& rotation);
+	void set_local_scale(uint32_t node, const glm::vec3& scale);
+
+	/**
+		\returns the node's world position as of the last propagate
+	*/
+	glm::vec3 get_world_position(uint32_t node) const;
+
+	/**
+		Bring the world transforms below every change up to date, and write
+		those of nodes with instances into the store.
+
+		\returns the number of nodes recomputed
+	*/
+	size_t propagate(InstanceStore& instances);
+
+	size_t size() const;
+
+	/**
+		\returns the number of levels, one more than the deepest node's depth
+	*/
+	size_t get_depth() const;
+
+private:
+
+	//per handle, the node's position in the sorted arrays
+	std::vector<uint32_t> handleIndex;
+	//per handle, its depth
+	std::vector<uint32_t> depths;
+
+	//sorted by depth, once sorted is set
+	std::vector<uint32_t> handles;
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> nodeInstances;
+	std::vector<glm::vec3> localPositions, localScales;
+	std::vector<glm::quat> localRotations;
+	std::vector<glm::vec3> worldPositions, worldScales;
+	std::vector<glm::quat> worldRotations;
+	//changed since the last propagate, during it: needs recomputing
+	std::vector<uint8_t> dirty;
+
+	//first node of each level, and one past the last node
+	std::vector<uint32_t> levels;
+	//per level, whether a node in it was changed
+	std::vector<uint8_t> dirtyLevels;
+	bool sorted = true;
+
+	void mark(uint32_t node);
+	void sort();
+};
+
+/**
+	Build assemblies of parts, propagate them in full and after moving a few
+	parts, and report the timings.
+
+	\param count the number of nodes
+*/
+void benchmark_scene_graph(size_t count);
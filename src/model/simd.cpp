@@ -0,0 +1,55 @@
+#include "simd.h"
+
+namespace {
+
+#ifdef VK_SIMD_X86
+	bool supports_avx2() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		//the os has to save ymm registers too
+		__cpuid(info, 1);
+		bool osSaves = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osSaves || !avx || (_xgetbv(0) & 6) != 6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	simdLevels detect_simd_level() {
+#if defined(VK_SIMD_X86)
+		if (supports_avx2()) {
+			return simdLevels::AVX2;
+		}
+#elif defined(VK_SIMD_NEON)
+		return simdLevels::NEON;
+#endif
+		return simdLevels::SCALAR;
+	}
+}
+
+simdLevels get_simd_level() {
+	static const simdLevels level = detect_simd_level();
+	return level;
+}
+
+const char* get_simd_name(simdLevels level) {
+	switch (level) {
+	case simdLevels::AVX2:
+		return "AVX2";
+	case simdLevels::NEON:
+		return "NEON";
+	default:
+		return "scalar";
+	}
+}
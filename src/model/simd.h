@@ -0,0 +1,38 @@
+#pragma once
+#include "../config.h"
+
+/*
+	Vector instruction sets the CPU kernels are written for. x86 builds compile
+	the AVX2 kernels with a target attribute and only call them after checking
+	the CPU at runtime; aarch64 always has NEON.
+*/
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VK_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+//msvc takes avx2 intrinsics anywhere, the cpu check guards them
+#define VK_TARGET_AVX2
+#else
+#define VK_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define VK_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+	Kernel variants, the best one the CPU supports is picked at runtime.
+*/
+enum class simdLevels {
+	SCALAR,
+	AVX2,
+	NEON
+};
+
+/**
+	\returns the widest instructions this CPU supports, checked once
+*/
+simdLevels get_simd_level();
+
+const char* get_simd_name(simdLevels level);
@@ -0,0 +1,281 @@
+#include "static_batcher.h"
+#include "../control/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+
+StaticBatcher::StaticBatcher() {
+	scanned = false;
+	stats = { 0, 0, 0, 0.0 };
+}
+
+uint32_t StaticBatcher::find_cluster(uint32_t material, const glm::vec3& position) {
+
+	StaticCellKey key;
+	key.material = material;
+	key.x = static_cast<int32_t>(std::floor(position.x / kCellSize));
+	key.y = static_cast<int32_t>(std::floor(position.y / kCellSize));
+	key.z = static_cast<int32_t>(std::floor(position.z / kCellSize));
+
+	std::map<StaticCellKey, uint32_t>::iterator found = clustersByCell.find(key);
+	if (found != clustersByCell.end()) {
+		return found->second;
+	}
+
+	uint32_t cluster;
+	if (freeClusters.empty()) {
+		cluster = static_cast<uint32_t>(clusters.size());
+		clusters.emplace_back();
+		dirty.push_back(0);
+	}
+	else {
+		cluster = freeClusters.back();
+		freeClusters.pop_back();
+	}
+	clusters[cluster] = StaticCluster();
+	clusters[cluster].material = material;
+	clusters[cluster].cell = key;
+	clusters[cluster].live = true;
+	clustersByCell[key] = cluster;
+	return cluster;
+}
+
+StaticBatcher::Placement StaticBatcher::get_placement(const InstanceStore& instances, uint32_t instance) {
+
+	Placement placement;
+	placement.position = instances.get_position(instance);
+	placement.rotation = glm::quat(instances.rotationW[instance], instances.rotationX[instance],
+		instances.rotationY[instance], instances.rotationZ[instance]);
+	placement.scale = glm::vec3(instances.scaleX[instance], instances.scaleY[instance], instances.scaleZ[instance]);
+	placement.mesh = instances.meshes[instance];
+	return placement;
+}
+
+void StaticBatcher::mark_dirty(uint32_t cluster) {
+	if (!dirty[cluster]) {
+		dirty[cluster] = 1;
+		changed.push_back(cluster);
+	}
+}
+
+bool StaticBatcher::update(InstanceStore& instances, uint32_t copy, uint32_t copies, const SourceLookup& sources) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	changed.clear();
+	instances.take_stale_pages(copy, copies, stalePages);
+	clusterOf.resize(instances.size(), kNoCluster);
+	placements.resize(instances.size());
+
+	//adding instances and changing their flags or renderables mark their pages too,
+	//so after the first update only stale pages and instances still waiting are looked at
+	std::vector<uint32_t> candidates;
+	if (!scanned) {
+		candidates.resize(instances.size());
+		for (size_t i = 0; i < instances.size(); ++i) {
+			candidates[i] = static_cast<uint32_t>(i);
+		}
+		waiting.clear();
+	}
+	else {
+		candidates.swap(waiting);
+		for (uint32_t page : stalePages) {
+			size_t first = static_cast<size_t>(page) * InstanceStore::kPageSize;
+			size_t last = std::min<size_t>(first + InstanceStore::kPageSize, instances.size());
+			for (size_t i = first; i < last; ++i) {
+				candidates.push_back(static_cast<uint32_t>(i));
+			}
+		}
+		//a waiting instance in a stale page would otherwise wait twice
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+	}
+
+	for (uint32_t instance : candidates) {
+
+		uint32_t flags = instances.flags[instance];
+		uint32_t target = kNoCluster;
+		Placement placement = get_placement(instances, instance);
+		if ((flags & INSTANCE_STATIC) && !(flags & INSTANCE_HIDDEN)) {
+			if (sources(instances.meshes[instance])) {
+				target = find_cluster(instances.materials[instance], placement.position);
+			}
+			else {
+				waiting.push_back(instance);
+			}
+		}
+
+		uint32_t current = clusterOf[instance];
+		if (current != target) {
+			if (current != kNoCluster) {
+				std::vector<uint32_t>& members = clusters[current].members;
+				members.erase(std::find(members.begin(), members.end(), instance));
+				mark_dirty(current);
+			}
+			if (target != kNoCluster) {
+				clusters[target].members.push_back(instance);
+				mark_dirty(target);
+			}
+			clusterOf[instance] = target;
+		}
+		else if (target != kNoCluster && !(placements[instance] == placement)) {
+			mark_dirty(target);
+		}
+		placements[instance] = placement;
+
+		uint32_t wanted = target == kNoCluster ? flags & ~INSTANCE_BATCHED : flags | INSTANCE_BATCHED;
+		if (wanted != flags) {
+			instances.set_flags(instance, wanted);
+		}
+	}
+
+	//the flags just set are not changes the batcher needs to see again
+	instances.take_stale_pages(copy, copies, stalePages);
+	scanned = true;
+
+	//emptied clusters give up their cell, the rest are built again side by side
+	std::vector<uint32_t> rebuilt;
+	for (uint32_t cluster : changed) {
+		dirty[cluster] = 0;
+		StaticCluster& record = clusters[cluster];
+		if (record.members.empty()) {
+			clustersByCell.erase(record.cell);
+			record = StaticCluster();
+			record.live = false;
+			freeClusters.push_back(cluster);
+		}
+		else {
+			std::sort(record.members.begin(), record.members.end());
+			rebuilt.push_back(cluster);
+		}
+	}
+	vkJob::ThreadPool::get_pool()->parallel_for(rebuilt.size(), [&](size_t i) {
+		rebuild(instances, clusters[rebuilt[i]], sources);
+	});
+
+	stats.clusters = clustersByCell.size();
+	stats.batched = 0;
+	for (const StaticCluster& cluster : clusters) {
+		stats.batched += cluster.members.size();
+	}
+	stats.rebuilt = rebuilt.size();
+	stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	return !changed.empty();
+}
+
+void StaticBatcher::rebuild(const InstanceStore& instances, StaticCluster& cluster, const SourceLookup& sources) {
+
+	cluster.vertices.clear();
+	cluster.indices.clear();
+	cluster.lower = glm::vec3(std::numeric_limits<float>::max());
+	cluster.upper = glm::vec3(-std::numeric_limits<float>::max());
+
+	for (uint32_t instance : cluster.members) {
+
+		const MeshSource* source = sources(instances.meshes[instance]);
+		if (!source) {
+			continue;
+		}
+
+		glm::quat rotation(instances.rotationW[instance], instances.rotationX[instance],
+			instances.rotationY[instance], instances.rotationZ[instance]);
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), instances.get_position(instance))
+			* glm::mat4_cast(rotation)
+			* glm::scale(glm::mat4(1.0f), glm::vec3(instances.scaleX[instance], instances.scaleY[instance], instances.scaleZ[instance]));
+
+		uint32_t base = static_cast<uint32_t>(cluster.vertices.size());
+		for (size_t v = 0; v + 7 <= source->vertices.size(); v += 7) {
+			const float* vertex = source->vertices.data() + v;
+			StaticVertex placed;
+			placed.position = glm::vec3(transform * glm::vec4(vertex[0], vertex[1], 0.0f, 1.0f));
+			placed.color = glm::vec3(vertex[2], vertex[3], vertex[4]);
+			placed.texCoord = glm::vec2(vertex[5], vertex[6]);
+			cluster.lower = glm::min(cluster.lower, placed.position);
+			cluster.upper = glm::max(cluster.upper, placed.position);
+			cluster.vertices.push_back(placed);
+		}
+		for (uint32_t index : source->indices) {
+			cluster.indices.push_back(base + index);
+		}
+	}
+}
+
+void benchmark_static_batching(size_t count) {
+
+	using clock = std::chrono::steady_clock;
+	auto since = [](clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	//a quad per instance, spread over a few hundred cells, most of them static
+	MeshSource quad;
+	quad.vertices = {
+		-0.05f, -0.05f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f,
+		 0.05f, -0.05f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f,
+		 0.05f,  0.05f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f,
+		-0.05f,  0.05f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f
+	};
+	quad.indices = { 0, 1, 2, 2, 3, 0 };
+	StaticBatcher::SourceLookup sources = [&quad](uint32_t) {
+		return &quad;
+	};
+
+	std::mt19937 random(13);
+	std::uniform_real_distribution<float> spread(-8.0f, 8.0f);
+	std::uniform_int_distribution<uint32_t> materials(0, 3), staticChance(0, 9);
+	InstanceStore instances;
+	std::vector<uint32_t> statics;
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t flags = staticChance(random) < 8 ? static_cast<uint32_t>(INSTANCE_STATIC) : 0;
+		uint32_t instance = instances.add(Renderable{ 0, materials(random) },
+			glm::vec3(spread(random), spread(random), spread(random)),
+			glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f), flags);
+		if (flags) {
+			statics.push_back(instance);
+		}
+	}
+	std::cout << "Instances: " << count << ", static: " << statics.size()
+		<< ", workers: " << vkJob::ThreadPool::get_pool()->get_worker_count() << "\n";
+
+	StaticBatcher batcher;
+	auto report = [&](const char* name, double milliseconds) {
+		std::cout << "  " << name << ": " << milliseconds << " ms, " << batcher.stats.rebuilt
+			<< " clusters built, " << batcher.stats.clusters << " clusters hold "
+			<< batcher.stats.batched << " instances\n";
+	};
+
+	clock::time_point start = clock::now();
+	batcher.update(instances, 0, 1, sources);
+	report("first batch", since(start));
+
+	start = clock::now();
+	batcher.update(instances, 0, 1, sources);
+	report("nothing changed", since(start));
+
+	//nudged within their cells, and carried into others
+	std::shuffle(statics.begin(), statics.end(), random);
+	size_t moves = std::max<size_t>(1, statics.size() / 1000);
+	for (size_t i = 0; i < moves; ++i) {
+		instances.set_position(statics[i], instances.get_position(statics[i]) + glm::vec3(0.01f));
+	}
+	start = clock::now();
+	batcher.update(instances, 0, 1, sources);
+	report("a few nudged", since(start));
+
+	for (size_t i = 0; i < moves; ++i) {
+		instances.set_position(statics[i], glm::vec3(spread(random), spread(random), spread(random)));
+	}
+	start = clock::now();
+	batcher.update(instances, 0, 1, sources);
+	report("a few carried off", since(start));
+
+	for (size_t i = 0; i < moves; ++i) {
+		instances.set_flags(statics[i], instances.flags[statics[i]] & ~INSTANCE_STATIC);
+	}
+	start = clock::now();
+	batcher.update(instances, 0, 1, sources);
+	report("a few made dynamic", since(start));
+}
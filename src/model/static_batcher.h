@@ -0,0 +1,159 @@
+#pragma once
+#include "../config.h"
+#include "instance_store.h"
+#include <functional>
+#include <map>
+
+/**
+	A mesh as it was loaded, interleaved x y r g b u v with triangle list indices.
+	The geometry pool keeps no copy on the CPU, so meshes which may be batched keep this one.
+*/
+struct MeshSource {
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+};
+
+/**
+	A vertex already placed in the world, colour and texture coordinates as loaded.
+*/
+struct StaticVertex {
+	glm::vec3 position;
+	glm::vec3 color;
+	glm::vec2 texCoord;
+};
+
+/**
+	A material and a grid cell, which a static cluster is built for.
+*/
+struct StaticCellKey {
+	uint32_t material;
+	int32_t x, y, z;
+
+	bool operator<(const StaticCellKey& other) const {
+		if (material != other.material) return material < other.material;
+		if (x != other.x) return x < other.x;
+		if (y != other.y) return y < other.y;
+		return z < other.z;
+	}
+};
+
+/**
+	Static instances sharing a material and a cell of space, merged into one mesh.
+	Indices are local to the cluster's vertices.
+*/
+struct StaticCluster {
+	uint32_t material;
+	StaticCellKey cell;
+	//store indices, ascending
+	std::vector<uint32_t> members;
+	std::vector<StaticVertex> vertices;
+	std::vector<uint32_t> indices;
+	//world space bounds of the vertices
+	glm::vec3 lower;
+	glm::vec3 upper;
+	//emptied clusters keep their slot until a new cluster takes it
+	bool live;
+};
+
+/**
+	What the last update did
+*/
+struct StaticBatchStats {
+	size_t clusters;
+	size_t batched;
+	size_t rebuilt;
+	double milliseconds;
+};
+
+/**
+	Merges instances flagged INSTANCE_STATIC into clusters of pre-transformed
+	geometry, one per material and grid cell, and flags them INSTANCE_BATCHED
+	so the per instance paths leave them out.
+
+	The batcher holds a copy of the store's change tracking: only instances in
+	pages changed since its last update are looked at, flags and meshes changing
+	included, and only the clusters they leave, join or move within are built
+	again. Pages change a page at a time, so each instance's placement is kept
+	to tell which of a page's members actually changed. Static instances whose
+	mesh has no source yet stay drawn on their own and are tried again every update.
+*/
+class StaticBatcher {
+public:
+
+	//side of a grid cell, a cluster spans one cell by its members' origins
+	static constexpr float kCellSize = 1.0f;
+	//for instances in no cluster
+	static constexpr uint32_t kNoCluster = 0xFFFFFFFF;
+
+	/**
+		\returns the source of a mesh, or nullptr if it has none
+	*/
+	typedef std::function<const MeshSource*(uint32_t mesh)> SourceLookup;
+
+	StaticBatcher();
+
+	/**
+		Bring the clusters up to date with the store, setting and clearing INSTANCE_BATCHED.
+		changed receives the clusters which were built again or emptied.
+
+		\param copy which copy of the store's change tracking the batcher takes
+		\param copies how many copies there are
+		\param sources finds the meshes' geometry
+		\returns whether any cluster changed
+	*/
+	bool update(InstanceStore& instances, uint32_t copy, uint32_t copies, const SourceLookup& sources);
+
+	std::vector<StaticCluster> clusters;
+	std::vector<uint32_t> changed;
+	StaticBatchStats stats;
+
+private:
+
+	/**
+		Where a batched instance was, and what it drew, when its cluster was built.
+	*/
+	struct Placement {
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+		uint32_t mesh;
+
+		bool operator==(const Placement& other) const {
+			return position == other.position && rotation == other.rotation && scale == other.scale
+				&& mesh == other.mesh;
+		}
+	};
+
+	std::map<StaticCellKey, uint32_t> clustersByCell;
+	std::vector<uint32_t> freeClusters;
+	//per instance, its cluster or kNoCluster
+	std::vector<uint32_t> clusterOf;
+	//per instance, meaningful while it is batched
+	std::vector<Placement> placements;
+	std::vector<uint8_t> dirty;
+	//static instances waiting for their mesh's source
+	std::vector<uint32_t> waiting;
+	std::vector<uint32_t> stalePages;
+	bool scanned;
+
+	/**
+		\returns the cluster for the cell holding position, made if there is none
+	*/
+	uint32_t find_cluster(uint32_t material, const glm::vec3& position);
+
+	static Placement get_placement(const InstanceStore& instances, uint32_t instance);
+
+	void mark_dirty(uint32_t cluster);
+
+	/**
+		Transform every member's mesh into the cluster's vertices.
+	*/
+	void rebuild(const InstanceStore& instances, StaticCluster& cluster, const SourceLookup& sources);
+};
+
+/**
+	Batch a scene of static instances, then move a few and update again, and report the timings.
+
+	\param count the number of instances
+*/
+void benchmark_static_batching(size_t count);
@@ -0,0 +1,181 @@
+#include "vertex_encoding.h"
+#include "obj_loader.h"
+#include "gtc/packing.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VK_MESH_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define VK_MESH_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+	/**
+		Bounds of the positions, widened so a flat axis still has a usable scale
+	*/
+	vkMesh::QuantizationRange make_range(glm::vec3 lower, glm::vec3 upper) {
+
+		vkMesh::QuantizationRange range;
+		range.offset = 0.5f * (lower + upper);
+		range.scale = glm::max(0.5f * (upper - lower), glm::vec3(1e-6f));
+		return range;
+	}
+}
+
+glm::vec2 vkMesh::octahedral_encode(glm::vec3 normal) {
+
+	normal /= std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	glm::vec2 encoded(normal.x, normal.y);
+
+	//lower hemisphere folds over the diagonals
+	if (normal.z < 0.0f) {
+		encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x)))
+			* glm::vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return encoded;
+}
+
+glm::vec3 vkMesh::octahedral_decode(glm::vec2 encoded) {
+
+	glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+	float fold = std::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+	return glm::normalize(normal);
+}
+
+vkMesh::QuantizationRange vkMesh::encode_compact_vertices(
+	const float* vertexData, size_t vertexCount, std::vector<CompactVertex>& encoded) {
+
+	size_t first = encoded.size();
+	encoded.resize(first + vertexCount);
+	return encode_compact_vertices(vertexData, vertexCount, encoded.data() + first);
+}
+
+vkMesh::QuantizationRange vkMesh::encode_compact_vertices(
+	const float* vertexData, size_t vertexCount, CompactVertex* encoded) {
+
+	glm::vec3 lower(std::numeric_limits<float>::max());
+	glm::vec3 upper(-std::numeric_limits<float>::max());
+	for (size_t i = 0; i < vertexCount; ++i) {
+		glm::vec3 position(vertexData[7 * i], vertexData[7 * i + 1], 0.0f);
+		lower = glm::min(lower, position);
+		upper = glm::max(upper, position);
+	}
+	if (vertexCount == 0) {
+		lower = upper = glm::vec3(0.0f);
+	}
+	QuantizationRange range = make_range(lower, upper);
+
+	for (size_t i = 0; i < vertexCount; ++i) {
+		const float* vertex = vertexData + 7 * i;
+		glm::vec2 position = (glm::vec2(vertex[0], vertex[1]) - glm::vec2(range.offset)) / glm::vec2(range.scale);
+
+		CompactVertex& compact = encoded[i];
+		compact.position = glm::packSnorm2x16(position);
+		compact.color = glm::packUnorm4x8(glm::vec4(vertex[2], vertex[3], vertex[4], 1.0f));
+		compact.texCoord = glm::packHalf2x16(glm::vec2(vertex[5], vertex[6]));
+	}
+
+	return range;
+}
+
+void vkMesh::encode_indices(const uint32_t* indices, size_t indexCount, vk::IndexType indexType, void* encoded) {
+
+	if (indexType == vk::IndexType::eUint32) {
+		if (encoded != indices) {
+			memcpy(encoded, indices, sizeof(uint32_t) * indexCount);
+		}
+		return;
+	}
+
+	//every block is loaded before it is stored, and a block's output never
+	//reaches input not yet read, so narrowing in place is safe
+	const unsigned char* source = reinterpret_cast<const unsigned char*>(indices);
+	unsigned char* destination = static_cast<unsigned char*>(encoded);
+	size_t i = 0;
+#if defined(VK_MESH_SSE2)
+	//packs saturates signed values, so shift the range to signed and back
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16(static_cast<short>(0x8000));
+	for (; i + 8 <= indexCount; i += 8) {
+		__m128i low = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 4 * i)), bias32);
+		__m128i high = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 4 * i + 16)), bias32);
+		__m128i packed = _mm_xor_si128(_mm_packs_epi32(low, high), bias16);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + 2 * i), packed);
+	}
+#elif defined(VK_MESH_NEON)
+	for (; i + 8 <= indexCount; i += 8) {
+		uint32x4_t low = vreinterpretq_u32_u8(vld1q_u8(source + 4 * i));
+		uint32x4_t high = vreinterpretq_u32_u8(vld1q_u8(source + 4 * i + 16));
+		uint16x8_t packed = vcombine_u16(vmovn_u32(low), vmovn_u32(high));
+		vst1q_u8(destination + 2 * i, vreinterpretq_u8_u16(packed));
+	}
+#endif
+	for (; i < indexCount; ++i) {
+		uint32_t index;
+		memcpy(&index, source + 4 * i, sizeof(uint32_t));
+		uint16_t narrow = static_cast<uint16_t>(index);
+		memcpy(destination + 2 * i, &narrow, sizeof(uint16_t));
+	}
+}
+
+uint32_t vkMesh::largest_index(const uint32_t* indices, size_t indexCount) {
+
+	uint32_t largest = 0;
+	size_t i = 0;
+#if defined(VK_MESH_SSE2)
+	//no unsigned max before SSE4.1, compare with the sign bit flipped instead
+	const __m128i flip = _mm_set1_epi32(static_cast<int>(0x80000000));
+	__m128i best = flip;
+	for (; i + 4 <= indexCount; i += 4) {
+		__m128i value = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i)), flip);
+		__m128i greater = _mm_cmpgt_epi32(value, best);
+		best = _mm_or_si128(_mm_and_si128(greater, value), _mm_andnot_si128(greater, best));
+	}
+	uint32_t lanes[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_xor_si128(best, flip));
+	largest = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#elif defined(VK_MESH_NEON)
+	uint32x4_t best = vdupq_n_u32(0);
+	for (; i + 4 <= indexCount; i += 4) {
+		best = vmaxq_u32(best, vld1q_u32(indices + i));
+	}
+	largest = vmaxvq_u32(best);
+#endif
+	for (; i < indexCount; ++i) {
+		largest = std::max(largest, indices[i]);
+	}
+	return largest;
+}
+
+vkMesh::QuantizationRange vkMesh::encode_compact_vertices(
+	const std::vector<Vertex>& vertices, std::vector<CompactModelVertex>& encoded) {
+
+	glm::vec3 lower(std::numeric_limits<float>::max());
+	glm::vec3 upper(-std::numeric_limits<float>::max());
+	for (const Vertex& vertex : vertices) {
+		lower = glm::min(lower, vertex.pos);
+		upper = glm::max(upper, vertex.pos);
+	}
+	if (vertices.empty()) {
+		lower = upper = glm::vec3(0.0f);
+	}
+	QuantizationRange range = make_range(lower, upper);
+
+	encoded.reserve(encoded.size() + vertices.size());
+	for (const Vertex& vertex : vertices) {
+		glm::vec3 position = (vertex.pos - range.offset) / range.scale;
+		glm::vec3 normal = glm::length(vertex.normal) > 0.0f ? vertex.normal : glm::vec3(0.0f, 0.0f, 1.0f);
+
+		CompactModelVertex compact;
+		compact.position = glm::packSnorm4x16(glm::vec4(position, 0.0f));
+		compact.normal = glm::packSnorm2x16(octahedral_encode(normal));
+		compact.texCoord = glm::packHalf2x16(vertex.texCoord);
+		encoded.push_back(compact);
+	}
+
+	return range;
+}
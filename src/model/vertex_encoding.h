@@ -0,0 +1,95 @@
+#pragma once
+#include "../config.h"
+
+namespace vkMesh {
+
+	class Vertex;
+
+	/**
+		Compact form of the menagerie's x y r g b u v vertex, 12 bytes instead of 28.
+		position: 2 x snorm16 across the mesh bounds, see QuantizedMesh
+		color: 4 x unorm8
+		texCoord: 2 x half float
+	*/
+	struct CompactVertex {
+		uint32_t position;
+		uint32_t color;
+		uint32_t texCoord;
+	};
+	static_assert(sizeof(CompactVertex) == 12, "compact vertex layout changed");
+
+	/**
+		Compact form of vkMesh::Vertex, 16 bytes instead of 32.
+		position: 4 x snorm16 across the mesh bounds (w is unused)
+		normal: octahedral, 2 x snorm16
+		texCoord: 2 x half float
+	*/
+	struct CompactModelVertex {
+		uint64_t position;
+		uint32_t normal;
+		uint32_t texCoord;
+	};
+	static_assert(sizeof(CompactModelVertex) == 16, "compact model vertex layout changed");
+
+	/**
+		Maps decoded snorm positions back to object space:
+		position = offset + scale * decoded
+	*/
+	struct QuantizationRange {
+		glm::vec3 offset;
+		glm::vec3 scale;
+	};
+
+	/**
+		Fold a unit vector onto the octahedron and flatten it.
+		\returns the encoding, each component in [-1, 1]
+	*/
+	glm::vec2 octahedral_encode(glm::vec3 normal);
+
+	/**
+		\returns the unit vector for an octahedral encoding
+	*/
+	glm::vec3 octahedral_decode(glm::vec2 encoded);
+
+	/**
+		Encode interleaved x y r g b u v vertices.
+		\param vertexData the full precision vertices
+		\param vertexCount number of vertices
+		\param encoded receives the compact vertices
+		\returns the range which decodes the positions
+	*/
+	QuantizationRange encode_compact_vertices(
+		const float* vertexData, size_t vertexCount, std::vector<CompactVertex>& encoded);
+
+	/**
+		Encode interleaved x y r g b u v vertices straight into place, eg. mapped staging memory.
+		\param encoded receives vertexCount compact vertices
+		\returns the range which decodes the positions
+	*/
+	QuantizationRange encode_compact_vertices(
+		const float* vertexData, size_t vertexCount, CompactVertex* encoded);
+
+	/**
+		Write triangle list indices at the given width, 16 bit indices are truncated.
+		Runs four or eight at a time with SSE2 or NEON.
+		\param indices the 32 bit indices
+		\param indexCount number of indices
+		\param indexType eUint16 or eUint32
+		\param encoded receives the indices, may be indices itself
+	*/
+	void encode_indices(const uint32_t* indices, size_t indexCount, vk::IndexType indexType, void* encoded);
+
+	/**
+		\returns the largest of the indices, 0 if there are none
+	*/
+	uint32_t largest_index(const uint32_t* indices, size_t indexCount);
+
+	/**
+		Encode model vertices.
+		\param vertices the full precision vertices
+		\param encoded receives the compact vertices
+		\returns the range which decodes the positions
+	*/
+	QuantizationRange encode_compact_vertices(
+		const std::vector<Vertex>& vertices, std::vector<CompactModelVertex>& encoded);
+}
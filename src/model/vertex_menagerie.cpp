@@ -1,95 +1,784 @@
 #include "vertex_menagerie.h"
+#include "mesh_simplifier.h"
+#include "meshlet.h"
+#include "../view/vkUtil/memory.h"
+#include <algorithm>
 
-VertexMenagerie::VertexMenagerie() {
-	indexOffset = 0;
+namespace {
+
+	//r g b u v, relative to moving across the whole mesh
+	const float kLodAttributeWeights[5] = { 0.25f, 0.25f, 0.25f, 1.0f, 1.0f };
+
+	//below this there is too little to gain from another level
+	const size_t kMinLodIndices = 3 * 32;
+
+	//smallest arena in elements, so the first few meshes added at runtime need not grow it
+	const uint32_t kMinArenaCapacity = 1024;
+
+	//an arena whose free space is scattered more than this is packed on the next flush
+	const float kMaxFragmentation = 0.5f;
+
+	//meshes are staged into chunks of at least this many bytes
+	const vk::DeviceSize kStagingChunkSize = 4 << 20;
+
+	//one packed meshlet triangle per three indices of the index arena
+	vk::DeviceSize triangle_bytes(uint32_t indexCount) {
+		return sizeof(uint32_t) * static_cast<vk::DeviceSize>((indexCount + 2) / 3);
+	}
+}
+
+VertexMenagerie::VertexMenagerie(VertexMenagerieInputChunk input) {
+	logicalDevice = input.logicalDevice;
+	physicalDevice = input.physicalDevice;
+	compact = input.compact;
+	indexType = vk::IndexType::eUint32;
+	finalized = false;
+	resident.store(false);
+	reclaimed = std::make_shared<std::vector<Allocation>>();
+	widening = false;
+	readback = {};
+	readbackData = nullptr;
+	readbackDone = std::make_shared<std::atomic<bool>>(false);
+
+	arenas[VERTEX_ARENA].buffer = &vertexBuffer;
+	arenas[VERTEX_ARENA].stride = compact ? sizeof(vkMesh::CompactVertex) : 7 * sizeof(float);
+	arenas[VERTEX_ARENA].usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer;
+
+	//the index width is settled at finalization
+	arenas[INDEX_ARENA].buffer = &indexBuffer;
+	arenas[INDEX_ARENA].stride = sizeof(uint32_t);
+	arenas[INDEX_ARENA].usage = vk::BufferUsageFlagBits::eIndexBuffer;
+
+	arenas[MESHLET_ARENA].buffer = &meshletBuffer;
+	arenas[MESHLET_ARENA].stride = sizeof(vkMesh::Meshlet);
+	arenas[MESHLET_ARENA].usage = vk::BufferUsageFlagBits::eStorageBuffer;
+
+	arenas[MESHLET_VERTEX_ARENA].buffer = &meshletVertexBuffer;
+	arenas[MESHLET_VERTEX_ARENA].stride = sizeof(uint32_t);
+	arenas[MESHLET_VERTEX_ARENA].usage = vk::BufferUsageFlagBits::eStorageBuffer;
+
+	for (Arena& arena : arenas) {
+		arena.generation = 0;
+	}
+}
+
+uint32_t VertexMenagerie::consume(const std::vector<float>& vertexData, const std::vector<uint32_t>& indexData) {
+	return consume(vertexData.data(), vertexData.size(), indexData.data(), indexData.size());
+}
+
+uint32_t VertexMenagerie::consume(const float* vertexData, size_t vertexFloats, const uint32_t* indexData, size_t indexCount) {
+
+	size_t vertexCount = vertexFloats / 7;
+
+	uint32_t largestIndex = vkMesh::largest_index(indexData, indexCount);
+	if (finalized && indexType == vk::IndexType::eUint16 && largestIndex > 0xFFFF && !widening) {
+		begin_widening();
+	}
+
+	uint32_t slot;
+	if (freeRanges.empty()) {
+		slot = static_cast<uint32_t>(ranges.size());
+		ranges.emplace_back();
+		allocations.emplace_back();
+		lods.resize(lods.size() + kMaxLods);
+	}
+	else {
+		slot = freeRanges.back();
+		freeRanges.pop_back();
+	}
+
+	PendingMesh mesh;
+	mesh.range = slot;
+	mesh.largestIndex = largestIndex;
+	mesh.indexCount = 0;
+
+	MeshDrawRange range;
+	range.firstIndex = 0;
+	range.indexCount = static_cast<int>(indexCount);
+	range.vertexOffset = 0;
+	range.firstMeshletVertex = 0;
+	range.resident = false;
+	range.quantization = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
+	range.boundingRadius = 0.0f;
+	for (size_t i = 0; i < vertexCount; ++i) {
+		glm::vec2 position = { vertexData[7 * i], vertexData[7 * i + 1] };
+		range.boundingRadius = std::max(range.boundingRadius, glm::length(position));
+	}
+
+	//vertices are written once, into staging
+	if (compact && vertexCount > 0) {
+		vkMesh::CompactVertex* encoded = reinterpret_cast<vkMesh::CompactVertex*>(
+			stage(mesh, VERTEX_ARENA, 0, sizeof(vkMesh::CompactVertex) * vertexCount));
+		vkMesh::QuantizationRange quantization = vkMesh::encode_compact_vertices(vertexData, vertexCount, encoded);
+		range.quantization = glm::vec4(quantization.offset.x, quantization.offset.y, quantization.scale.x, quantization.scale.y);
+	}
+	else if (vertexCount > 0) {
+		memcpy(stage(mesh, VERTEX_ARENA, 0, sizeof(float) * 7 * vertexCount), vertexData, sizeof(float) * 7 * vertexCount);
+	}
+
+	MeshletLists meshlets;
+	build_lods(range, mesh, meshlets, vertexData, vertexCount, indexData, indexCount);
+
+	//meshlets come from every level, so they are staged once the levels are done
+	if (!meshlets.meshlets.empty()) {
+		vk::DeviceSize size = sizeof(vkMesh::Meshlet) * meshlets.meshlets.size();
+		memcpy(stage(mesh, MESHLET_ARENA, 0, size), meshlets.meshlets.data(), size);
+		size = sizeof(uint32_t) * meshlets.vertices.size();
+		memcpy(stage(mesh, MESHLET_VERTEX_ARENA, 0, size), meshlets.vertices.data(), size);
+		size = sizeof(uint32_t) * meshlets.triangles.size();
+		memcpy(stage(mesh, INDEX_ARENA, 0, size, true), meshlets.triangles.data(), size);
+	}
+
+	//everything is relative to the mesh until flush places it
+	Allocation& allocation = allocations[slot];
+	allocation.counts[VERTEX_ARENA] = static_cast<uint32_t>(vertexCount);
+	allocation.counts[INDEX_ARENA] = mesh.indexCount;
+	allocation.counts[MESHLET_ARENA] = static_cast<uint32_t>(meshlets.meshlets.size());
+	allocation.counts[MESHLET_VERTEX_ARENA] = static_cast<uint32_t>(meshlets.vertices.size());
+	for (int arena = 0; arena < ARENA_COUNT; ++arena) {
+		allocation.offsets[arena] = 0;
+		allocation.generations[arena] = 0;
+	}
+	allocation.live = false;
+
+	ranges[slot] = range;
+	pending.push_back(std::move(mesh));
+	return slot;
+}
+
+void VertexMenagerie::build_lods(MeshDrawRange& range, PendingMesh& mesh, MeshletLists& meshlets, const float* vertexData, size_t vertexCount, const uint32_t* indexData, size_t indexCount) {
+
+	range.firstLod = mesh.range * kMaxLods;
+	MeshLod& full = lods[range.firstLod];
+	full.firstIndex = 0;
+	full.indexCount = static_cast<int>(indexCount);
+	full.error = 0.0f;
+	add_meshlets(full, meshlets, vertexData, indexData);
+	stage_indices(mesh, 0, indexData, indexCount);
+	mesh.indexCount = static_cast<uint32_t>(indexCount);
+	range.lodCount = 1;
+
+	//the first level simplifies the caller's indices where they are
+	const uint32_t* previous = indexData;
+	size_t previousCount = indexCount;
+	std::vector<uint32_t> coarser;
+	float error = 0.0f;
+	while (static_cast<int>(range.lodCount) < kMaxLods && previousCount >= kMinLodIndices) {
+
+		vkMesh::SimplificationInputChunk input;
+		input.vertexData = vertexData;
+		input.vertexCount = vertexCount;
+		input.floatsPerVertex = 7;
+		input.positionComponents = 2;
+		input.attributeWeights = kLodAttributeWeights;
+		input.indices = previous;
+		input.indexCount = previousCount;
+		input.targetIndexCount = previousCount / 2;
+		input.targetError = std::numeric_limits<float>::max();
+
+		float stepError;
+		std::vector<uint32_t> simplified = vkMesh::simplify_mesh(input, stepError);
+		if (simplified.empty() || simplified.size() * 5 > previousCount * 4) {
+			break;
+		}
+
+		//each level is simplified from the last, so the errors stack up
+		error += stepError;
+
+		MeshLod& lod = lods[range.firstLod + range.lodCount];
+		lod.firstIndex = static_cast<int>(mesh.indexCount);
+		lod.indexCount = static_cast<int>(simplified.size());
+		lod.error = error;
+		add_meshlets(lod, meshlets, vertexData, simplified.data());
+		stage_indices(mesh, mesh.indexCount, simplified.data(), simplified.size());
+		mesh.indexCount += static_cast<uint32_t>(simplified.size());
+		++range.lodCount;
+
+		coarser.swap(simplified);
+		previous = coarser.data();
+		previousCount = coarser.size();
+	}
+}
+
+void VertexMenagerie::add_meshlets(MeshLod& lod, MeshletLists& meshlets, const float* vertexData, const uint32_t* indexData) {
+
+	vkMesh::MeshletInputChunk input;
+	input.vertexData = vertexData;
+	input.floatsPerVertex = 7;
+	input.positionComponents = 2;
+	input.indices = indexData;
+	input.indexCount = lod.indexCount;
+	input.firstIndex = lod.firstIndex;
+	input.rebase = 0;
+
+	lod.firstMeshlet = static_cast<int>(meshlets.meshlets.size());
+	vkMesh::build_meshlets(input, meshlets.meshlets, meshlets.vertices, meshlets.triangles);
+	lod.meshletCount = static_cast<int>(meshlets.meshlets.size()) - lod.firstMeshlet;
+}
+
+char* VertexMenagerie::stage(PendingMesh& mesh, int arena, uint32_t first, vk::DeviceSize size, bool triangles) {
+
+	vk::DeviceSize offset = staging.empty() ? 0 : (staging.back().used + 15) & ~static_cast<vk::DeviceSize>(15);
+	if (staging.empty() || offset + size > staging.back().size) {
+
+		BufferInputChunk inputChunk;
+		inputChunk.logicalDevice = logicalDevice;
+		inputChunk.physicalDevice = physicalDevice;
+		inputChunk.size = std::max(size, kStagingChunkSize);
+		inputChunk.usage = vk::BufferUsageFlagBits::eTransferSrc;
+		inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+
+		StagingChunk chunk;
+		chunk.buffer = vkUtil::createBuffer(inputChunk);
+		chunk.data = static_cast<char*>(logicalDevice.mapMemory(chunk.buffer.bufferMemory, 0, inputChunk.size));
+		chunk.size = inputChunk.size;
+		chunk.used = 0;
+		staging.push_back(chunk);
+		offset = 0;
+	}
+
+	StagingChunk& chunk = staging.back();
+	chunk.used = offset + size;
+
+	StagedCopy copy;
+	copy.arena = arena;
+	copy.triangles = triangles;
+	copy.first = first;
+	copy.source = chunk.buffer.buffer;
+	copy.data = chunk.data + offset;
+	copy.offset = offset;
+	copy.size = size;
+	mesh.copies.push_back(copy);
+	return copy.data;
+}
+
+void VertexMenagerie::stage_indices(PendingMesh& mesh, uint32_t first, const uint32_t* indices, size_t indexCount) {
+
+	if (indexCount == 0) {
+		return;
+	}
+
+	//32 bit until finalization settles the width, and again once widening has begun
+	vk::IndexType type = finalized && !widening ? indexType : vk::IndexType::eUint32;
+	vk::DeviceSize stride = type == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	vkMesh::encode_indices(indices, indexCount, type, stage(mesh, INDEX_ARENA, first, stride * indexCount));
+}
+
+void VertexMenagerie::release_staging(vkUtil::UploadQueue* uploads) {
+
+	vk::Device device = logicalDevice;
+	for (StagingChunk& chunk : staging) {
+		//freeing the memory unmaps it
+		Buffer buffer = chunk.buffer;
+		uploads->release_later([device, buffer]() {
+			device.destroyBuffer(buffer.buffer);
+			device.freeMemory(buffer.bufferMemory);
+		});
+	}
+	staging.clear();
+}
+
+Buffer VertexMenagerie::make_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage) {
+
+	BufferInputChunk inputChunk;
+	inputChunk.logicalDevice = logicalDevice;
+	inputChunk.physicalDevice = physicalDevice;
+	inputChunk.size = size;
+	inputChunk.usage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst | usage;
+	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+	return vkUtil::createBuffer(inputChunk);
+}
+
+void VertexMenagerie::place(uint32_t range, int arena, uint32_t offset) {
+
+	Allocation& allocation = allocations[range];
+	int shift = static_cast<int>(offset) - static_cast<int>(allocation.offsets[arena]);
+	allocation.offsets[arena] = offset;
+
+	MeshDrawRange& mesh = ranges[range];
+	MeshLod* chain = lods.data() + mesh.firstLod;
+	switch (arena) {
+	case VERTEX_ARENA:
+		mesh.vertexOffset = static_cast<int>(offset);
+		break;
+	case INDEX_ARENA:
+		mesh.firstIndex = static_cast<int>(offset);
+		for (uint32_t lod = 0; lod < mesh.lodCount; ++lod) {
+			chain[lod].firstIndex += shift;
+		}
+		break;
+	case MESHLET_ARENA:
+		for (uint32_t lod = 0; lod < mesh.lodCount; ++lod) {
+			chain[lod].firstMeshlet += shift;
+		}
+		break;
+	case MESHLET_VERTEX_ARENA:
+		mesh.firstMeshletVertex = offset;
+		break;
+	}
+}
+
+void VertexMenagerie::finalize(vkUtil::UploadQueue* uploads) {
+
+	//primitive restart is off, so 0xFFFF is an ordinary index
+	uint32_t largestIndex = 0;
+	for (PendingMesh& mesh : pending) {
+		largestIndex = std::max(largestIndex, mesh.largestIndex);
+	}
+	indexType = (!pending.empty() && largestIndex <= 0xFFFF) ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+	arenas[INDEX_ARENA].stride = indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	//indices staged so far are 32 bit, narrow them where they are
+	if (indexType == vk::IndexType::eUint16) {
+		for (PendingMesh& mesh : pending) {
+			for (StagedCopy& copy : mesh.copies) {
+				if (copy.arena == INDEX_ARENA && !copy.triangles) {
+					size_t indexCount = copy.size / sizeof(uint32_t);
+					vkMesh::encode_indices(reinterpret_cast<const uint32_t*>(copy.data), indexCount, indexType, copy.data);
+					copy.size = sizeof(uint16_t) * indexCount;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < ARENA_COUNT; ++i) {
+
+		uint32_t needed = 0;
+		for (PendingMesh& mesh : pending) {
+			needed += allocations[mesh.range].counts[i];
+		}
+
+		Arena& arena = arenas[i];
+		uint32_t capacity = std::max(needed, kMinArenaCapacity);
+		arena.space.reset(capacity);
+		*arena.buffer = make_buffer(arena.stride * capacity, arena.usage);
+		if (i == INDEX_ARENA) {
+			meshletTriangleBuffer = make_buffer(triangle_bytes(capacity), vk::BufferUsageFlagBits::eStorageBuffer);
+		}
+	}
+
+	finalized = true;
+	flush(uploads);
+}
+
+void VertexMenagerie::flush(vkUtil::UploadQueue* uploads) {
+
+	if (!finalized) {
+		return;
+	}
+
+	//meshes wait until the arena they are staged for exists
+	if (widening) {
+		if (!readback.buffer) {
+			read_back_indices(uploads);
+		}
+		if (!readbackDone->load()) {
+			return;
+		}
+		widen_indices(uploads);
+	}
+
+	if (pending.empty()) {
+		release_staging(uploads);
+		return;
+	}
+
+	reclaim();
+
+	for (int i = 0; i < ARENA_COUNT; ++i) {
+
+		Arena& arena = arenas[i];
+		uint32_t needed = 0;
+		for (PendingMesh& mesh : pending) {
+			needed += allocations[mesh.range].counts[i];
+		}
+
+		std::vector<uint32_t> offsets(pending.size());
+		size_t placed = 0;
+		bool fits = arena.space.get_fragmentation() <= kMaxFragmentation;
+		while (fits && placed < pending.size()) {
+			fits = arena.space.allocate(allocations[pending[placed].range].counts[i], offsets[placed]);
+			placed += fits ? 1 : 0;
+		}
+
+		if (!fits) {
+			//give back what did fit and pack the arena with room for all of them at the end
+			for (size_t j = 0; j < placed; ++j) {
+				arena.space.free(offsets[j], allocations[pending[j].range].counts[i]);
+			}
+			relocate(uploads, i, needed);
+			for (size_t j = 0; j < pending.size(); ++j) {
+				arena.space.allocate(allocations[pending[j].range].counts[i], offsets[j]);
+			}
+		}
+
+		for (size_t j = 0; j < pending.size(); ++j) {
+			place(pending[j].range, i, offsets[j]);
+			allocations[pending[j].range].generations[i] = arena.generation;
+		}
+	}
+
+	//every staged part goes to its place in the mesh's allocation
+	std::vector<Copy> copies;
+	std::vector<uint32_t> uploaded;
+	for (PendingMesh& mesh : pending) {
+
+		Allocation& allocation = allocations[mesh.range];
+		allocation.live = true;
+		uploaded.push_back(mesh.range);
+
+		for (StagedCopy& staged : mesh.copies) {
+			Arena& arena = arenas[staged.arena];
+			uint32_t element = allocation.offsets[staged.arena] + staged.first;
+
+			Copy copy;
+			copy.source = staged.source;
+			copy.region.srcOffset = staged.offset;
+			copy.region.size = staged.size;
+			if (staged.triangles) {
+				copy.target = meshletTriangleBuffer.buffer;
+				copy.region.dstOffset = sizeof(uint32_t) * static_cast<vk::DeviceSize>(element / 3);
+			}
+			else {
+				copy.target = arena.buffer->buffer;
+				copy.region.dstOffset = arena.stride * element;
+			}
+			copies.push_back(copy);
+		}
+	}
+	pending.clear();
+
+	//the chunks go with the frame the copies are recorded into
+	release_staging(uploads);
+
+	vkUtil::UploadJob job;
+	job.stagingBuffer = {};
+	job.record = [this, copies, uploaded](vk::CommandBuffer commandBuffer) {
+
+		record_copies(commandBuffer, copies);
+
+		for (uint32_t range : uploaded) {
+			//unless it was removed in the meantime
+			ranges[range].resident = allocations[range].live;
+		}
+		resident.store(true);
+	};
+	uploads->push(job);
+}
+
+void VertexMenagerie::remove(uint32_t range, vkUtil::UploadQueue* uploads) {
+
+	Allocation& allocation = allocations[range];
+	if (allocation.live) {
+		//frames already recorded may still draw it
+		allocation.live = false;
+		std::shared_ptr<std::vector<Allocation>> released = reclaimed;
+		Allocation freed = allocation;
+		uploads->release_later([released, freed]() {
+			released->push_back(freed);
+		});
+	}
+	else {
+		pending.erase(
+			std::remove_if(pending.begin(), pending.end(), [range](const PendingMesh& mesh) { return mesh.range == range; }),
+			pending.end());
+	}
+
+	ranges[range].resident = false;
+	ranges[range].indexCount = 0;
+	ranges[range].lodCount = 0;
+	freeRanges.push_back(range);
+}
+
+void VertexMenagerie::reclaim() {
+
+	for (const Allocation& freed : *reclaimed) {
+		for (int i = 0; i < ARENA_COUNT; ++i) {
+			//a relocation already dropped it
+			if (freed.generations[i] == arenas[i].generation) {
+				arenas[i].space.free(freed.offsets[i], freed.counts[i]);
+			}
+		}
+	}
+	reclaimed->clear();
 }
 
-void VertexMenagerie::consume(meshTypes type, std::vector<float> vertexData,std::vector<uint32_t> indexData) {
+void VertexMenagerie::relocate(vkUtil::UploadQueue* uploads, int i, uint32_t extra) {
+
+	Arena& arena = arenas[i];
+
+	//live meshes in the order they sit in the arena
+	std::vector<uint32_t> order;
+	uint32_t used = 0;
+	for (uint32_t range = 0; range < allocations.size(); ++range) {
+		if (allocations[range].live) {
+			order.push_back(range);
+			used += allocations[range].counts[i];
+		}
+	}
+	std::sort(order.begin(), order.end(), [this, i](uint32_t a, uint32_t b) {
+		return allocations[a].offsets[i] < allocations[b].offsets[i];
+	});
+
+	uint32_t capacity = std::max(arena.space.get_capacity(), kMinArenaCapacity);
+	while (capacity < used + extra) {
+		capacity *= 2;
+	}
+
+	Buffer oldBuffer = *arena.buffer;
+	*arena.buffer = make_buffer(arena.stride * capacity, arena.usage);
+	Buffer oldTriangles = {};
+	if (i == INDEX_ARENA) {
+		oldTriangles = meshletTriangleBuffer;
+		meshletTriangleBuffer = make_buffer(triangle_bytes(capacity), vk::BufferUsageFlagBits::eStorageBuffer);
+	}
+
+	std::vector<Copy> copies;
+	uint32_t packed = 0;
+	for (uint32_t range : order) {
 
-	int indexCount = static_cast<int>(indexData.size());
-	int vertexCount = static_cast<int>(vertexData.size() / 7);
-	int lastIndex = static_cast<int>(indexLump.size());
+		uint32_t offset = allocations[range].offsets[i];
+		uint32_t count = allocations[range].counts[i];
+		if (count > 0) {
+			Copy copy;
+			copy.source = oldBuffer.buffer;
+			copy.target = arena.buffer->buffer;
+			copy.region.srcOffset = arena.stride * offset;
+			copy.region.dstOffset = arena.stride * packed;
+			copy.region.size = arena.stride * count;
+			copies.push_back(copy);
 
-	firstIndices.insert(std::make_pair(type, lastIndex));
-	indexCounts.insert(std::make_pair(type, indexCount));
+			//triangles follow their indices
+			if (i == INDEX_ARENA) {
+				copy.source = oldTriangles.buffer;
+				copy.target = meshletTriangleBuffer.buffer;
+				copy.region.srcOffset = sizeof(uint32_t) * static_cast<vk::DeviceSize>(offset / 3);
+				copy.region.dstOffset = sizeof(uint32_t) * static_cast<vk::DeviceSize>(packed / 3);
+				copy.region.size = sizeof(uint32_t) * static_cast<vk::DeviceSize>(count / 3);
+				copies.push_back(copy);
+			}
+		}
 
-	for (float attribute : vertexData) {
-		vertexLump.push_back(attribute);
+		place(range, i, packed);
+		packed += count;
 	}
-	for (uint32_t index : indexData) {
-		//std::cout << (index + indexOffset) << std::endl;
-		indexLump.push_back(index + indexOffset);
+
+	arena.space.reset(capacity, used);
+	++arena.generation;
+	for (uint32_t range : order) {
+		allocations[range].generations[i] = arena.generation;
 	}
 
-	indexOffset += vertexCount;
+	//nothing to stage, the data moves between device buffers
+	vkUtil::UploadJob job;
+	job.stagingBuffer = {};
+	job.record = [copies](vk::CommandBuffer commandBuffer) {
+		record_copies(commandBuffer, copies);
+	};
+	uploads->push(job);
+
+	//frames already recorded still read the old buffers
+	vk::Device device = logicalDevice;
+	uploads->release_later([device, oldBuffer, oldTriangles]() {
+		device.destroyBuffer(oldBuffer.buffer);
+		device.freeMemory(oldBuffer.bufferMemory);
+		device.destroyBuffer(oldTriangles.buffer);
+		device.freeMemory(oldTriangles.bufferMemory);
+	});
+}
+
+void VertexMenagerie::defragment(vkUtil::UploadQueue* uploads) {
+
+	if (!finalized) {
+		return;
+	}
+
+	reclaim();
+	for (int i = 0; i < ARENA_COUNT; ++i) {
+		//the readback describes the index arena where it is
+		if (widening && i == INDEX_ARENA) {
+			continue;
+		}
+		if (arenas[i].space.get_fragmentation() > 0.0f) {
+			relocate(uploads, i, 0);
+		}
+	}
+}
+
+void VertexMenagerie::begin_widening() {
+
+	widening = true;
+
+	//meshes staged since finalization hold 16 bit indices, stage them again at 32
+	for (PendingMesh& mesh : pending) {
+		size_t staged = mesh.copies.size();
+		for (size_t c = 0; c < staged; ++c) {
+			StagedCopy narrow = mesh.copies[c];
+			if (narrow.arena != INDEX_ARENA || narrow.triangles) {
+				continue;
+			}
+			size_t indexCount = narrow.size / sizeof(uint16_t);
+			const uint16_t* source = reinterpret_cast<const uint16_t*>(narrow.data);
+			uint32_t* wide = reinterpret_cast<uint32_t*>(stage(mesh, INDEX_ARENA, narrow.first, sizeof(uint32_t) * indexCount));
+			std::copy(source, source + indexCount, wide);
+		}
+		mesh.copies.erase(std::remove_if(mesh.copies.begin(), mesh.copies.begin() + staged, [](const StagedCopy& copy) {
+			return copy.arena == INDEX_ARENA && !copy.triangles;
+		}), mesh.copies.begin() + staged);
+	}
 }
 
-void VertexMenagerie::finalize(FinalizationChunk finalizationChunk) {
+void VertexMenagerie::read_back_indices(vkUtil::UploadQueue* uploads) {
 
-	logicalDevice = finalizationChunk.logicalDevice;
+	vk::DeviceSize size = sizeof(uint16_t) * static_cast<vk::DeviceSize>(arenas[INDEX_ARENA].space.get_capacity());
 
-	//make a staging buffer for vertices
 	BufferInputChunk inputChunk;
-	inputChunk.logicalDevice = finalizationChunk.logicalDevice;
-	inputChunk.physicalDevice = finalizationChunk.physicalDevice;
-	inputChunk.size = sizeof(float) * vertexLump.size();
-	inputChunk.usage = vk::BufferUsageFlagBits::eTransferSrc;
+	inputChunk.logicalDevice = logicalDevice;
+	inputChunk.physicalDevice = physicalDevice;
+	inputChunk.size = size;
+	inputChunk.usage = vk::BufferUsageFlagBits::eTransferDst;
 	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
-	Buffer stagingBuffer = vkUtil::createBuffer(inputChunk);
+	readback = vkUtil::createBuffer(inputChunk);
+	readbackData = static_cast<const uint16_t*>(logicalDevice.mapMemory(readback.bufferMemory, 0, size));
 
-	//fill it with vertex data
-	void* memoryLocation = logicalDevice.mapMemory(stagingBuffer.bufferMemory, 0, inputChunk.size);
-	memcpy(memoryLocation, vertexLump.data(), inputChunk.size);
-	logicalDevice.unmapMemory(stagingBuffer.bufferMemory);
+	vk::Buffer source = indexBuffer.buffer;
+	vk::Buffer target = readback.buffer;
+	vkUtil::UploadJob job;
+	job.stagingBuffer = {};
+	job.record = [source, target, size](vk::CommandBuffer commandBuffer) {
 
-	//make the vertex buffer
-	inputChunk.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer;
-	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
-	vertexBuffer = vkUtil::createBuffer(inputChunk);
-
-	//copy to it
-	vkUtil::copyBuffer(stagingBuffer, vertexBuffer, inputChunk.size, finalizationChunk.queue, finalizationChunk.commandBuffer);
-
-	//destroy staging buffer
-	logicalDevice.destroyBuffer(stagingBuffer.buffer);
-	logicalDevice.freeMemory(stagingBuffer.bufferMemory);
-
-	//make a staging buffer for indices
-	inputChunk.size = sizeof(uint32_t) * indexLump.size();
-	inputChunk.usage = vk::BufferUsageFlagBits::eTransferSrc;
-	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible 
-		| vk::MemoryPropertyFlagBits::eHostCoherent;
-	stagingBuffer = vkUtil::createBuffer(inputChunk);
-
-	//fill it with index data
-	memoryLocation = logicalDevice.mapMemory(stagingBuffer.bufferMemory, 0, inputChunk.size);
-	memcpy(memoryLocation, indexLump.data(), inputChunk.size);
-	logicalDevice.unmapMemory(stagingBuffer.bufferMemory);
-
-	//make the vertex buffer
-	inputChunk.usage = vk::BufferUsageFlagBits::eTransferDst
-		| vk::BufferUsageFlagBits::eIndexBuffer;
-	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
-	indexBuffer = vkUtil::createBuffer(inputChunk);
+		vk::BufferCopy region;
+		region.srcOffset = 0;
+		region.dstOffset = 0;
+		region.size = size;
+		commandBuffer.copyBuffer(source, target, 1, &region);
+
+		vk::MemoryBarrier barrier;
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+			vk::DependencyFlags(), barrier, nullptr, nullptr
+		);
+	};
+	uploads->push(job);
+
+	//runs once the frame the copy is recorded into has finished
+	std::shared_ptr<std::atomic<bool>> done = readbackDone;
+	done->store(false);
+	uploads->release_later([done]() {
+		done->store(true);
+	});
+}
+
+void VertexMenagerie::widen_indices(vkUtil::UploadQueue* uploads) {
+
+	Arena& arena = arenas[INDEX_ARENA];
+	uint32_t capacity = arena.space.get_capacity();
+
+	//live meshes keep their offsets, so nothing which points into the arena changes.
+	//Meshes removed since the readback are left out, their space may be handed out again
+	PendingMesh widened;
+	std::vector<Copy> copies;
+	Buffer oldBuffer = indexBuffer;
+	indexBuffer = make_buffer(sizeof(uint32_t) * static_cast<vk::DeviceSize>(capacity), arena.usage);
+	for (const Allocation& allocation : allocations) {
+
+		uint32_t count = allocation.counts[INDEX_ARENA];
+		if (!allocation.live || count == 0) {
+			continue;
+		}
+		uint32_t offset = allocation.offsets[INDEX_ARENA];
+		uint32_t* wide = reinterpret_cast<uint32_t*>(stage(widened, INDEX_ARENA, offset, sizeof(uint32_t) * count));
+		std::copy(readbackData + offset, readbackData + offset + count, wide);
 
-	//copy to it
-	vkUtil::copyBuffer(
-		stagingBuffer, indexBuffer, inputChunk.size, 
-		finalizationChunk.queue, finalizationChunk.commandBuffer
+		const StagedCopy& staged = widened.copies.back();
+		Copy copy;
+		copy.source = staged.source;
+		copy.target = indexBuffer.buffer;
+		copy.region.srcOffset = staged.offset;
+		copy.region.dstOffset = sizeof(uint32_t) * static_cast<vk::DeviceSize>(offset);
+		copy.region.size = staged.size;
+		copies.push_back(copy);
+	}
+
+	indexType = vk::IndexType::eUint32;
+	arena.stride = sizeof(uint32_t);
+
+	vkUtil::UploadJob job;
+	job.stagingBuffer = {};
+	job.record = [copies](vk::CommandBuffer commandBuffer) {
+		record_copies(commandBuffer, copies);
+	};
+	uploads->push(job);
+
+	//frames already recorded still draw from the 16 bit arena
+	vk::Device device = logicalDevice;
+	uploads->release_later([device, oldBuffer]() {
+		device.destroyBuffer(oldBuffer.buffer);
+		device.freeMemory(oldBuffer.bufferMemory);
+	});
+
+	//the device is done with the readback, freeing the memory unmaps it
+	logicalDevice.destroyBuffer(readback.buffer);
+	logicalDevice.freeMemory(readback.bufferMemory);
+	readback = {};
+	readbackData = nullptr;
+	widening = false;
+}
+
+void VertexMenagerie::record_copies(vk::CommandBuffer commandBuffer, const std::vector<Copy>& copies) {
+
+	for (const Copy& copy : copies) {
+		commandBuffer.copyBuffer(copy.source, copy.target, 1, &copy.region);
+	}
+
+	//make the copies visible to geometry, culling and later copies in the same command buffer
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead
+		| vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead;
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+		vk::DependencyFlags(), barrier, nullptr, nullptr
 	);
+}
 
-	//destroy staging buffer
-	logicalDevice.destroyBuffer(stagingBuffer.buffer);
-	logicalDevice.freeMemory(stagingBuffer.bufferMemory);
+bool VertexMenagerie::is_resident() {
+	return resident.load();
+}
+
+bool VertexMenagerie::is_resident(uint32_t range) {
+	return range < ranges.size() && ranges[range].resident;
+}
+
+float VertexMenagerie::get_fragmentation() {
+
+	float worst = 0.0f;
+	for (Arena& arena : arenas) {
+		worst = std::max(worst, arena.space.get_fragmentation());
+	}
+	return worst;
 }
 
 VertexMenagerie::~VertexMenagerie() {
 
-	//destroy vertex buffer
-	logicalDevice.destroyBuffer(vertexBuffer.buffer);
-	logicalDevice.freeMemory(vertexBuffer.bufferMemory);
+	//a widening which never finished
+	if (readback.buffer) {
+		logicalDevice.destroyBuffer(readback.buffer);
+		logicalDevice.freeMemory(readback.bufferMemory);
+	}
+
+	//meshes staged but never flushed
+	for (StagingChunk& chunk : staging) {
+		logicalDevice.destroyBuffer(chunk.buffer.buffer);
+		logicalDevice.freeMemory(chunk.buffer.bufferMemory);
+	}
 
-	//destroy index buffer
-	logicalDevice.destroyBuffer(indexBuffer.buffer);
-	logicalDevice.freeMemory(indexBuffer.bufferMemory);
-}
\ No newline at end of file
+	//destroy the arenas, buffers they moved out of belong to the upload queue
+	for (Buffer* buffer : { &vertexBuffer, &indexBuffer, &meshletBuffer, &meshletVertexBuffer, &meshletTriangleBuffer }) {
+		logicalDevice.destroyBuffer(buffer->buffer);
+		logicalDevice.freeMemory(buffer->bufferMemory);
+	}
+}
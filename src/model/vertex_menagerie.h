@@ -1,29 +1,292 @@
 #pragma once
 #include "../config.h"
+#include <memory>
+#include <atomic>
 #include "../view/vkUtil/memory.h"
+#include "../view/vkUtil/upload.h"
+#include "../view/vkUtil/range_allocator.h"
+#include "vertex_encoding.h"
+#include "meshlet.h"
 
-struct FinalizationChunk {
+/**
+	One level of detail, a range of the shared index buffer.
+	error is how far (in object space) the simplified surface may stray from the original.
+*/
+struct MeshLod {
+	int firstIndex;
+	int indexCount;
+	float error;
+	//the same triangles split into meshlets
+	int firstMeshlet;
+	int meshletCount;
+};
+
+/**
+	Everything a draw needs to know about one mesh, kept in a dense array.
+	Indices are local to the mesh and drawn with vertexOffset, so a mesh can be
+	moved around the pool without touching its data.
+*/
+struct MeshDrawRange {
+	//also the base its meshlets' firstIndex is relative to
+	int firstIndex;
+	int indexCount;
+	//added to each index when drawing
+	int vertexOffset;
+	//distance from the mesh origin to its furthest vertex
+	float boundingRadius;
+	//offset.xy, scale.xy for decoding compact positions, pushed per draw
+	glm::vec4 quantization;
+	//the full mesh then successively simplified versions, lods[firstLod] matches firstIndex/indexCount
+	uint32_t firstLod;
+	uint32_t lodCount;
+	//base its meshlets' firstVertex is relative to
+	uint32_t firstMeshletVertex;
+	//whether its upload into the pool has been recorded
+	bool resident;
+};
+
+/**
+	For making the vertex menagerie
+*/
+struct VertexMenagerieInputChunk {
 	vk::Device logicalDevice;
 	vk::PhysicalDevice physicalDevice;
-	vk::CommandBuffer commandBuffer;
-	vk::Queue queue;
+	//store vertices as vkMesh::CompactVertex
+	bool compact;
 };
 
+/**
+	A pool of device local arenas holding every mesh: vertices, indices,
+	meshlets and meshlet vertex lists, each handed out by a free list.
+	The packed meshlet triangles run parallel to the index arena.
+	Meshes can be added and removed at any time, all transfers go through the
+	upload queue. An arena which runs out of room, or whose free space is too
+	scattered, is moved into a new buffer with its meshes packed to the front.
+	The pool is always one buffer per arena, so drawing binds one vertex and one index buffer.
+	Consumed meshes are written straight into mapped staging memory, their only copy on the CPU.
+*/
 class VertexMenagerie {
 public:
-	VertexMenagerie();
+	VertexMenagerie(VertexMenagerieInputChunk input);
 	~VertexMenagerie();
-	void consume(
-		meshTypes type, 
-		std::vector<float> vertexData,
-		std::vector<uint32_t> indexData);
-	void finalize(FinalizationChunk finalizationChunk);
+	/**
+		\returns the mesh's position in ranges
+	*/
+	uint32_t consume(
+		const std::vector<float>& vertexData,
+		const std::vector<uint32_t>& indexData);
+	/**
+		Stage a mesh for the pool, it is uploaded by the next finalize or flush.
+		The data is read once, vertices and the full detail indices go straight to staging.
+		A mesh needing more than the pool's 16 bit indices widens the pool, it is uploaded
+		by the first flush after the live indices have been read back.
+		\param vertexData interleaved x y r g b u v
+		\param vertexFloats number of floats in vertexData
+		\param indexData triangle list indices, relative to the mesh
+		\param indexCount number of indices
+		\returns the mesh's position in ranges
+	*/
+	uint32_t consume(
+		const float* vertexData, size_t vertexFloats,
+		const uint32_t* indexData, size_t indexCount);
+	/**
+		Make the pool's buffers, sized for the meshes consumed so far,
+		and queue their upload.
+	*/
+	void finalize(vkUtil::UploadQueue* uploads);
+	/**
+		Queue the upload of every mesh consumed since the last finalize or flush,
+		growing or compacting arenas they do not fit in. Does nothing before finalize,
+		and holds the meshes back while the index arena is being widened.
+	*/
+	void flush(vkUtil::UploadQueue* uploads);
+	/**
+		Take a mesh out of the pool. It stops drawing immediately, its space
+		is reused once the frames which may still read it have finished.
+		\param range the mesh's position in ranges, which may be handed out again
+	*/
+	void remove(uint32_t range, vkUtil::UploadQueue* uploads);
+	/**
+		Pack every fragmented arena's meshes to the front of a new buffer.
+	*/
+	void defragment(vkUtil::UploadQueue* uploads);
+	/**
+		\returns whether the pool's buffers exist and hold their first upload
+	*/
+	bool is_resident();
+	/**
+		\returns whether the mesh's upload has been recorded
+	*/
+	bool is_resident(uint32_t range);
+	/**
+		\returns the worst fragmentation across the arenas, see vkUtil::RangeAllocator
+	*/
+	float get_fragmentation();
 	Buffer vertexBuffer,indexBuffer;
-	std::unordered_map<meshTypes, int> firstIndices;
-	std::unordered_map<meshTypes, int> indexCounts;
+	//storage buffers of vkMesh::Meshlet, meshlet vertex lists and packed meshlet triangles
+	Buffer meshletBuffer, meshletVertexBuffer, meshletTriangleBuffer;
+	//one per consumed mesh, removed meshes leave holes which are reused
+	std::vector<MeshDrawRange> ranges;
+	//kMaxLods per range, a range's levels start at firstLod
+	std::vector<MeshLod> lods;
+	static const int kMaxLods = 5;
+	//eUint16 when every mesh at finalization fits, widened to eUint32 once a larger mesh is added
+	vk::IndexType indexType;
+	bool compact;
 private:
-	int indexOffset;
+
+	enum arenaTypes {
+		VERTEX_ARENA,
+		INDEX_ARENA,
+		MESHLET_ARENA,
+		MESHLET_VERTEX_ARENA,
+		ARENA_COUNT
+	};
+
+	struct Arena {
+		//one of the public buffers
+		Buffer* buffer;
+		vkUtil::RangeAllocator space;
+		vk::DeviceSize stride;
+		vk::BufferUsageFlags usage;
+		//bumped every time the arena moves, older allocations no longer describe it
+		uint32_t generation;
+	};
+
+	/**
+		Where a range sits in each arena, in elements.
+	*/
+	struct Allocation {
+		uint32_t offsets[ARENA_COUNT];
+		uint32_t counts[ARENA_COUNT];
+		uint32_t generations[ARENA_COUNT];
+		bool live;
+	};
+
+	/**
+		Host visible memory, mapped for as long as it lives.
+		Meshes are staged into it back to back until the next flush.
+	*/
+	struct StagingChunk {
+		Buffer buffer;
+		char* data;
+		vk::DeviceSize size;
+		vk::DeviceSize used;
+	};
+
+	/**
+		Part of a pending mesh, waiting in a staging chunk.
+	*/
+	struct StagedCopy {
+		int arena;
+		//meshlet triangles, which follow the index arena
+		bool triangles;
+		//where the part starts in the mesh's allocation, in elements of the arena
+		uint32_t first;
+		vk::Buffer source;
+		char* data;
+		vk::DeviceSize offset;
+		vk::DeviceSize size;
+	};
+
+	/**
+		A consumed mesh waiting to be uploaded.
+	*/
+	struct PendingMesh {
+		uint32_t range;
+		uint32_t largestIndex;
+		//across every level of detail
+		uint32_t indexCount;
+		std::vector<StagedCopy> copies;
+	};
+
+	struct MeshletLists {
+		std::vector<vkMesh::Meshlet> meshlets;
+		std::vector<uint32_t> vertices;
+		std::vector<uint32_t> triangles;
+	};
+
+	struct Copy {
+		vk::Buffer source;
+		vk::Buffer target;
+		vk::BufferCopy region;
+	};
+
+	/**
+		Append simplified index ranges for a mesh until it stops shrinking.
+	*/
+	void build_lods(MeshDrawRange& range, PendingMesh& mesh, MeshletLists& meshlets, const float* vertexData, size_t vertexCount, const uint32_t* indexData, size_t indexCount);
+	/**
+		Split a level of detail into meshlets and record where they are.
+	*/
+	void add_meshlets(MeshLod& lod, MeshletLists& meshlets, const float* vertexData, const uint32_t* indexData);
+	/**
+		Reserve staging memory for part of a pending mesh.
+		\param first where the part starts in the mesh's allocation, in elements of the arena
+		\param size bytes to reserve
+		\returns where to write the part, 16 byte aligned
+	*/
+	char* stage(PendingMesh& mesh, int arena, uint32_t first, vk::DeviceSize size, bool triangles = false);
+	/**
+		Stage indices at the pool's width, 32 bit until finalization settles it.
+	*/
+	void stage_indices(PendingMesh& mesh, uint32_t first, const uint32_t* indices, size_t indexCount);
+	/**
+		Hand the staging chunks to the upload queue, to be freed after the next recorded frame.
+	*/
+	void release_staging(vkUtil::UploadQueue* uploads);
+	/**
+		Make a device local buffer which can be copied to and from.
+	*/
+	Buffer make_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage);
+	/**
+		Move a range within an arena, updating everything which points into it.
+	*/
+	void place(uint32_t range, int arena, uint32_t offset);
+	/**
+		Give back space released by removed meshes, unless its arena has moved since.
+	*/
+	void reclaim();
+	/**
+		Move an arena into a new buffer with its meshes packed to the front.
+		\param extra elements which must fit after the packed meshes, the buffer grows by doubling
+	*/
+	void relocate(vkUtil::UploadQueue* uploads, int arena, uint32_t extra);
+	/**
+		Restage pending 16 bit indices as 32 bit, and hold flushes back until the
+		index arena has been read back and widened.
+	*/
+	void begin_widening();
+	/**
+		Queue a copy of the index arena into host visible memory.
+	*/
+	void read_back_indices(vkUtil::UploadQueue* uploads);
+	/**
+		Move the read back indices of every live mesh into a 32 bit index arena,
+		each at the offset it had.
+	*/
+	void widen_indices(vkUtil::UploadQueue* uploads);
+	/**
+		Copy staged or relocated data, then make it visible to everything that draws.
+	*/
+	static void record_copies(vk::CommandBuffer commandBuffer, const std::vector<Copy>& copies);
+
+	std::atomic<bool> resident;
+	bool finalized;
 	vk::Device logicalDevice;
-	std::vector<float> vertexLump;
-	std::vector<uint32_t> indexLump;
+	vk::PhysicalDevice physicalDevice;
+	Arena arenas[ARENA_COUNT];
+	std::vector<Allocation> allocations;
+	std::vector<uint32_t> freeRanges;
+	std::vector<PendingMesh> pending;
+	std::vector<StagingChunk> staging;
+	//filled by releases queued on the upload queue, which may outlive the pool
+	std::shared_ptr<std::vector<Allocation>> reclaimed;
+	//set while a 16 bit index arena waits to be widened
+	bool widening;
+	//the index arena as it was when widening began, host visible
+	Buffer readback;
+	const uint16_t* readbackData;
+	//set once the frame which copied into the readback has finished
+	std::shared_ptr<std::atomic<bool>> readbackDone;
 };
\ No newline at end of file
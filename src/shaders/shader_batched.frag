@@ -0,0 +1,16 @@
+#version 450
+
+// The material comes from the draw, every invocation of a draw agrees on it.
+// The array is sized by vkMesh::DrawBatcher::kMaxMaterials.
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1 ) in vec2 fragTexCoord;
+layout(location = 2 ) flat in uint fragMaterial;
+
+layout(location = 0) out vec4 outColor;
+
+layout(set=1,binding=0) uniform sampler2D materials[1025];
+
+void main() {
+	outColor = vec4(fragColor, 1.0)*texture(materials[fragMaterial],fragTexCoord);
+}
@@ -0,0 +1,46 @@
+#version 450
+#extension GL_ARB_shader_draw_parameters : require
+
+// vkMesh::CompactVertex drawn in one multi-draw call: each draw finds its
+// mesh's quantization and its texture in vkMesh::DrawBatcher's records.
+
+layout(set=0,binding=0) uniform UBO {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+} cameraData;
+
+layout(std140,set=0,binding=1) readonly buffer storageBuffer {
+	mat4 model[];
+} ObjectData;
+
+struct Draw {
+	vec4 quantization; //offset.xy, scale.xy
+	uint material;
+};
+
+layout(std430,set=1,binding=1) readonly buffer drawBuffer {
+	Draw draws[];
+};
+
+//gl_DrawID restarts with each call when the batch is split
+layout (push_constant) uniform constants{
+	uint firstDraw;
+} Batch;
+
+layout(location = 0 ) in vec2 vertexPosition;
+layout(location = 1 ) in vec4 vertexColor;
+layout(location = 2 ) in vec2 vertexTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1 ) out vec2 fragTexCoord;
+layout(location = 2 ) flat out uint fragMaterial;
+
+void main() {
+	Draw draw = draws[Batch.firstDraw + gl_DrawIDARB];
+	vec2 position = draw.quantization.xy + vertexPosition * draw.quantization.zw;
+	gl_Position = cameraData.viewProjection * ObjectData.model[gl_InstanceIndex]* vec4(position, 0.0, 1.0);
+	fragColor = vertexColor.rgb;
+	fragTexCoord = vertexTexCoord;
+	fragMaterial = draw.material;
+}
@@ -0,0 +1,33 @@
+#version 450
+
+// vkMesh::CompactVertex: the fixed function fetch already expands
+// snorm16 positions, unorm8 colors and half texcoords to floats,
+// only the position still has to be taken back to mesh space.
+
+layout(set=0,binding=0) uniform UBO {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+} cameraData;
+
+layout(std140,set=0,binding=1) readonly buffer storageBuffer {
+	mat4 model[];
+} ObjectData;
+
+layout (push_constant) uniform constants{
+	vec4 quantization; //offset.xy, scale.xy
+} MeshData;
+
+layout(location = 0 ) in vec2 vertexPosition;
+layout(location = 1 ) in vec4 vertexColor;
+layout(location = 2 ) in vec2 vertexTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1 ) out vec2 fragTexCoord;
+
+void main() {
+	vec2 position = MeshData.quantization.xy + vertexPosition * MeshData.quantization.zw;
+	gl_Position = cameraData.viewProjection * ObjectData.model[gl_InstanceIndex]* vec4(position, 0.0, 1.0);
+	fragColor = vertexColor.rgb;
+	fragTexCoord = vertexTexCoord;
+}
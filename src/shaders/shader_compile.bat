@@ -1,2 +1,13 @@
 D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe shader.vert -o vertex.spv
-D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe shader.frag -o fragment.spv
\ No newline at end of file
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe shader.frag -o fragment.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe shader_compact.vert -o vertex_compact.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe meshlet_cull.comp -o meshlet_cull.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe shader_indirect.vert -o vertex_indirect.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe shader_batched.vert -o vertex_batched.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe shader_batched.frag -o fragment_batched.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe instance_cull.comp -o instance_cull.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe instance_compact.comp -o instance_compact.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe shader_static.vert -o vertex_static.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe depth_pyramid.comp -o depth_pyramid.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe --target-env=vulkan1.2 meshlet.task -o meshlet_task.spv
+D:\Data\VulkanSDK\1.2.198.1\Bin\glslc.exe --target-env=vulkan1.2 meshlet.mesh -o meshlet_mesh.spv
\ No newline at end of file
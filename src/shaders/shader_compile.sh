@@ -1,5 +1,27 @@
 glslangValidator shader.vert -V -o vertex.spv
 glslangValidator shader.frag -V -o fragment.spv
+glslangValidator shader_compact.vert -V -o vertex_compact.spv
+glslangValidator meshlet_cull.comp -V -o meshlet_cull.spv
+glslangValidator shader_indirect.vert -V -o vertex_indirect.spv
+glslangValidator shader_batched.vert -V -o vertex_batched.spv
+glslangValidator shader_batched.frag -V -o fragment_batched.spv
+glslangValidator instance_cull.comp -V -o instance_cull.spv
+glslangValidator instance_compact.comp -V -o instance_compact.spv
+glslangValidator shader_static.vert -V -o vertex_static.spv
+glslangValidator depth_pyramid.comp -V -o depth_pyramid.spv
+glslangValidator meshlet.task -V --target-env vulkan1.2 -o meshlet_task.spv
+glslangValidator meshlet.mesh -V --target-env vulkan1.2 -o meshlet_mesh.spv
 cp -r ./vertex.spv ../../bin//DebugEditor/shaders/
 cp -r ./fragment.spv ../../bin//DebugEditor/shaders/
+cp -r ./vertex_compact.spv ../../bin//DebugEditor/shaders/
+cp -r ./meshlet_cull.spv ../../bin//DebugEditor/shaders/
+cp -r ./vertex_indirect.spv ../../bin//DebugEditor/shaders/
+cp -r ./vertex_batched.spv ../../bin//DebugEditor/shaders/
+cp -r ./fragment_batched.spv ../../bin//DebugEditor/shaders/
+cp -r ./instance_cull.spv ../../bin//DebugEditor/shaders/
+cp -r ./instance_compact.spv ../../bin//DebugEditor/shaders/
+cp -r ./vertex_static.spv ../../bin//DebugEditor/shaders/
+cp -r ./depth_pyramid.spv ../../bin//DebugEditor/shaders/
+cp -r ./meshlet_task.spv ../../bin//DebugEditor/shaders/
+cp -r ./meshlet_mesh.spv ../../bin//DebugEditor/shaders/
 rm *.spv
\ No newline at end of file
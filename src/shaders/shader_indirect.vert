@@ -0,0 +1,57 @@
+#version 450
+#extension GL_ARB_shader_draw_parameters : require
+
+// vkMesh::CompactVertex drawn by vkMesh::InstanceCuller's commands: each
+// draw's instances are a run of the id list, which holds store indices
+// into the transforms. The commands of every group are drawn together, so
+// each one looks up its group, then the group's record in
+// vkMesh::DrawBatcher's set.
+
+layout(set=0,binding=0) uniform UBO {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+} cameraData;
+
+struct Draw {
+	vec4 quantization; //offset.xy, scale.xy
+	uint material;
+};
+
+layout(std430,set=1,binding=1) readonly buffer drawBuffer {
+	Draw draws[];
+};
+
+layout(std430,set=2,binding=0) readonly buffer transformBuffer {
+	mat4 transforms[];
+};
+
+layout(std430,set=2,binding=4) readonly buffer idBuffer {
+	uint ids[];
+};
+
+layout(std430,set=2,binding=8) readonly buffer drawGroupBuffer {
+	uint drawGroups[];
+};
+
+//gl_DrawID restarts with each call when the commands are split
+layout (push_constant) uniform constants{
+	uint firstDraw;
+} Batch;
+
+layout(location = 0 ) in vec2 vertexPosition;
+layout(location = 1 ) in vec4 vertexColor;
+layout(location = 2 ) in vec2 vertexTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1 ) out vec2 fragTexCoord;
+layout(location = 2 ) flat out uint fragMaterial;
+
+void main() {
+	Draw draw = draws[drawGroups[Batch.firstDraw + gl_DrawIDARB]];
+	vec2 position = draw.quantization.xy + vertexPosition * draw.quantization.zw;
+	gl_Position = cameraData.viewProjection * transforms[ids[gl_InstanceIndex]] * vec4(position, 0.0, 1.0);
+	fragColor = vertexColor.rgb;
+	fragTexCoord = vertexTexCoord;
+	fragMaterial = draw.material;
+}
@@ -0,0 +1,24 @@
+#version 450
+
+// vulkan NDC:	x: -1(left), 1(right)
+//				y: -1(top), 1(bottom)
+
+layout(set=0,binding=0) uniform UBO {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+} cameraData;
+
+//placed in the world when the static batch was built, no model transform
+layout(location = 0 ) in vec3 vertexPosition;
+layout(location = 1 ) in vec3 vertexColor;
+layout(location = 2 ) in vec2 vertexTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1 ) out vec2 fragTexCoord;
+
+void main() {
+	gl_Position = cameraData.viewProjection * vec4(vertexPosition, 1.0);
+	fragColor = vertexColor;
+	fragTexCoord = vertexTexCoord;
+}
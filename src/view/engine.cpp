@@ -12,6 +12,10 @@
 
 Engine::Engine(int width, int height, GLFWwindow* window, bool debug) {
 
+	startTime = std::chrono::steady_clock::now();
+	firstFrameReported = false;
+	assetsReadyReported = false;
+
 	this->width = width;
 	this->height = height;
 	this->window = window;
@@ -64,10 +68,51 @@ void Engine::make_device()
 {
 	physicalDevice = vkInit::choose_physical_device(instance,debugMode);
 	device = vkInit::create_logical_device(physicalDevice, surface, debugMode);
+	dldi.init(device);
+
+	//must agree with what create_logical_device enabled
+	meshletCulling = kMeshletCulling && vkInit::supports_indirect_culling(physicalDevice);
+	meshShading = false;
+#ifdef VK_EXT_mesh_shader
+	//the mesh shader decodes compact vertices itself
+	meshShading = meshletCulling && kMeshShaders && kCompactVertices && vkInit::supports_mesh_shaders(physicalDevice);
+#endif
+	//the batched vertex shaders only read compact vertices, every texture the assets may hold is one array
+	batchedDraws = false;
+#ifdef VK_VERSION_1_1
+	vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+	batchedDraws = kBatchedDraws && kCompactVertices && vkInit::supports_batched_draws(physicalDevice)
+		&& limits.maxPerStageDescriptorSamplers >= vkMesh::DrawBatcher::kMaxMaterials
+		&& limits.maxPerStageDescriptorSampledImages >= vkMesh::DrawBatcher::kMaxMaterials
+		&& limits.maxDescriptorSetSamplers >= vkMesh::DrawBatcher::kMaxMaterials
+		&& limits.maxDescriptorSetSampledImages >= vkMesh::DrawBatcher::kMaxMaterials;
+#endif
+	//culled instances are drawn as one batch
+	instanceCulling = kInstanceCulling && batchedDraws;
+	indirectCount = false;
+#ifdef VK_KHR_draw_indirect_count
+	indirectCount = instanceCulling && vkInit::supports_indirect_count(physicalDevice);
+#endif
+	maxDrawIndirectCount = physicalDevice.getProperties().limits.maxDrawIndirectCount;
+	culler = nullptr;
+	drawBatcher = nullptr;
+	instanceCuller = nullptr;
+	depthPyramid = nullptr;
+	staticBatcher = nullptr;
+	staticGeometry = nullptr;
+	gpuCullStats = { 0, 0, 0.0 };
+	gpuCulledLast = false;
+	coverageViewProjection = glm::mat4(0.0f);
+	coverageLayoutVersion = 0;
+	frustumCuller = new FrustumCuller();
+	occlusionBuffer = kOcclusionBuffer ? new OcclusionBuffer() : nullptr;
+	instanceBvh = new InstanceBvh();
 	std::array<vk::Queue,2> queues = vkInit::get_queues(physicalDevice, device, surface, debugMode);
 	graphicsQueue = queues[0];
 	presentQueue = queues[1];
 	make_swapchain();
+	//before the pipelines, the instance culler hands it the buffers it outgrows
+	uploads = new vkUtil::UploadQueue(device, maxFramesInFlight);
 	frameNumber=0;
 	frameNumberTotal.store(0);
 }
@@ -103,27 +148,53 @@ void Engine::recreate_swapchain(){
 	
 	device.waitIdle();
 
+	//cached recordings hold the old framebuffers, they go with the command buffers
+	vkInit::commandBufferInputChunk oldCommandBuffers = { device, commandPool, swapchainFrames };
+	vkInit::free_frame_command_buffers(oldCommandBuffers);
 	cleanup_swapchain();
 	make_swapchain();
+	if (depthPyramid) {
+		make_depth_pyramids();
+	}
+	uploads->reset(maxFramesInFlight);
 	make_framebuffers();
 	make_frame_resources();
 	vkInit::commandBufferInputChunk commandBufferInput = { device, commandPool, swapchainFrames };
 	vkInit::make_frame_command_buffers(commandBufferInput,debugMode);
+
+	//the new frames lay out every instance, their change copies may have been another image's
+	if (instanceCuller) {
+		for (uint32_t i = 0; i < kBufferSize; ++i) {
+			instanceCuller->invalidate(i);
+		}
+	}
 }
 
 void Engine::make_descriptor_set_layouts(){
+
+	//meshlet culling reads the camera and the model transforms too
+	vk::ShaderStageFlags frameStages = vk::ShaderStageFlagBits::eVertex;
+	if (meshletCulling || instanceCulling) {
+		frameStages |= vk::ShaderStageFlagBits::eCompute;
+	}
+#ifdef VK_EXT_mesh_shader
+	if (meshShading) {
+		frameStages |= vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+	}
+#endif
+
 	vkInit::descriptorSetLayoutData bindings;
 	bindings.count=2;
 
 	bindings.indices.push_back(0);
 	bindings.types.push_back(vk::DescriptorType::eUniformBuffer);
 	bindings.counts.push_back(1);
-	bindings.stages.push_back(vk::ShaderStageFlagBits::eVertex);
+	bindings.stages.push_back(frameStages);
 
 	bindings.indices.push_back(1);
 	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
 	bindings.counts.push_back(1);
-	bindings.stages.push_back(vk::ShaderStageFlagBits::eVertex);
+	bindings.stages.push_back(frameStages);
 
 	frameSetLayout = vkInit::make_descriptor_set_layout(device,bindings);
 
@@ -140,12 +211,13 @@ void Engine::make_descriptor_set_layouts(){
 void Engine::make_pipeline(){
 	vkInit::GraphicsPipelineInBundle specification = {};
 	specification.device = device;
-	specification.vertexFilepath = "shaders/vertex.spv";
+	specification.vertexFilepath = kCompactVertices ? "shaders/vertex_compact.spv" : "shaders/vertex.spv";
 	specification.fragmentFilepath = "shaders/fragment.spv";
 	specification.swapchainExtent = swapchainExtent;
 	specification.swapchainImageFormat = swapchainFormat;
 	specification.depthFormat = swapchainFrames[0].depthFormat;
 	specification.descriptorSetLayouts = { frameSetLayout, meshSetLayout };
+	specification.compactVertices = kCompactVertices;
 
 	vkInit::GraphicsPipelineOutBundle output = vkInit::create_graphics_pipeline(
 		specification
@@ -154,6 +226,146 @@ void Engine::make_pipeline(){
 	pipelineLayout = output.layout;
 	renderpass = output.renderpass;
 	pipeline = output.pipeline;
+
+	if (meshletCulling) {
+		make_meshlet_pipelines();
+	}
+	if (batchedDraws) {
+		make_batched_pipelines();
+	}
+	if (instanceCulling) {
+		make_instance_pipelines();
+	}
+	if (kStaticBatching) {
+		make_static_pipeline();
+	}
+}
+
+void Engine::make_meshlet_pipelines(){
+
+	vkMesh::MeshletCullerInputChunk cullerInfo;
+	cullerInfo.logicalDevice = device;
+	cullerInfo.physicalDevice = physicalDevice;
+	cullerInfo.frameCount = kBufferSize;
+	cullerInfo.stages = vk::ShaderStageFlagBits::eCompute;
+#ifdef VK_EXT_mesh_shader
+	if (meshShading) {
+		cullerInfo.stages |= vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+	}
+#endif
+	culler = new vkMesh::MeshletCuller(cullerInfo);
+
+	//set 1 (the material) is only read by the mesh shader path's fragment shader
+	culler->pipelineLayout = vkInit::make_pipeline_layout(
+		device, { frameSetLayout, meshSetLayout, culler->layout },
+		sizeof(vkMesh::MeshletCullJob), culler->stages);
+	culler->pipeline = vkInit::make_compute_pipeline(device, "shaders/meshlet_cull.spv", culler->pipelineLayout);
+
+#ifdef VK_EXT_mesh_shader
+	if (meshShading) {
+		vkInit::GraphicsPipelineInBundle specification = {};
+		specification.device = device;
+		specification.fragmentFilepath = "shaders/fragment.spv";
+		specification.swapchainExtent = swapchainExtent;
+		specification.swapchainImageFormat = swapchainFormat;
+		specification.depthFormat = swapchainFrames[0].depthFormat;
+		meshletPipeline = vkInit::create_mesh_pipeline(
+			specification, "shaders/meshlet_task.spv", "shaders/meshlet_mesh.spv",
+			culler->pipelineLayout, renderpass);
+	}
+#endif
+}
+
+void Engine::make_batched_pipelines(){
+
+	static_assert(kMaxTextures + 1 <= vkMesh::DrawBatcher::kMaxMaterials, "batched draws must have a slot for every texture");
+
+	vkMesh::DrawBatcherInputChunk batcherInfo;
+	batcherInfo.logicalDevice = device;
+	batcherInfo.physicalDevice = physicalDevice;
+	batcherInfo.frameCount = kBufferSize;
+	drawBatcher = new vkMesh::DrawBatcher(batcherInfo);
+
+	//set 1 holds every texture instead of one material's
+	vkInit::GraphicsPipelineInBundle specification = {};
+	specification.device = device;
+	specification.vertexFilepath = "shaders/vertex_batched.spv";
+	specification.fragmentFilepath = "shaders/fragment_batched.spv";
+	specification.swapchainExtent = swapchainExtent;
+	specification.swapchainImageFormat = swapchainFormat;
+	specification.depthFormat = swapchainFrames[0].depthFormat;
+	specification.compactVertices = true;
+	batchedPipelineLayout = vkInit::make_pipeline_layout(
+		device, { frameSetLayout, drawBatcher->layout }, sizeof(uint32_t));
+	batchedPipeline = vkInit::create_vertex_pipeline(specification, batchedPipelineLayout, renderpass);
+}
+
+void Engine::make_instance_pipelines(){
+
+	vkMesh::InstanceCullerInputChunk cullerInfo;
+	cullerInfo.logicalDevice = device;
+	cullerInfo.physicalDevice = physicalDevice;
+	cullerInfo.uploads = uploads;
+	cullerInfo.frameCount = kBufferSize;
+	instanceCuller = new vkMesh::InstanceCuller(cullerInfo);
+
+	//both passes share a layout, set 1 is unused by them
+	instanceCuller->pipelineLayout = vkInit::make_pipeline_layout(
+		device, { frameSetLayout, meshSetLayout, instanceCuller->layout },
+		sizeof(vkMesh::InstanceCullConstants), vk::ShaderStageFlagBits::eCompute);
+	instanceCuller->cullPipeline = vkInit::make_compute_pipeline(device, "shaders/instance_cull.spv", instanceCuller->pipelineLayout);
+	instanceCuller->compactPipeline = vkInit::make_compute_pipeline(device, "shaders/instance_compact.spv", instanceCuller->pipelineLayout);
+
+	//draws in the classic renderpass as one batch, finding transforms through the culled ids
+	vkInit::GraphicsPipelineInBundle specification = {};
+	specification.device = device;
+	specification.vertexFilepath = "shaders/vertex_indirect.spv";
+	specification.fragmentFilepath = "shaders/fragment_batched.spv";
+	specification.swapchainExtent = swapchainExtent;
+	specification.swapchainImageFormat = swapchainFormat;
+	specification.depthFormat = swapchainFrames[0].depthFormat;
+	specification.compactVertices = true;
+	indirectPipelineLayout = vkInit::make_pipeline_layout(
+		device, { frameSetLayout, drawBatcher->layout, instanceCuller->layout }, sizeof(uint32_t));
+	indirectPipeline = vkInit::create_vertex_pipeline(specification, indirectPipelineLayout, renderpass);
+
+	//the cull shader reads a pyramid whether or not it tests against it, so every image has one
+	vkMesh::DepthPyramidInputChunk pyramidInfo;
+	pyramidInfo.logicalDevice = device;
+	pyramidInfo.physicalDevice = physicalDevice;
+	pyramidInfo.frameCount = kBufferSize;
+	depthPyramid = new vkMesh::DepthPyramid(pyramidInfo);
+	depthPyramid->pipelineLayout = vkInit::make_pipeline_layout(
+		device, { depthPyramid->layout }, sizeof(vkMesh::DepthPyramidConstants), vk::ShaderStageFlagBits::eCompute);
+	depthPyramid->pipeline = vkInit::make_compute_pipeline(device, "shaders/depth_pyramid.spv", depthPyramid->pipelineLayout);
+	make_depth_pyramids();
+
+	//compatible with the framebuffers and every pipeline made against the whole renderpass
+	earlyRenderpass = vkInit::make_renderpass(device, swapchainFormat, swapchainFrames[0].depthFormat, true, false);
+	lateRenderpass = vkInit::make_renderpass(device, swapchainFormat, swapchainFrames[0].depthFormat, false, true);
+}
+
+void Engine::make_depth_pyramids(){
+
+	//the images' depth attachments go with the swapchain
+	for (uint32_t i = 0; i < swapchainFrames.size(); ++i) {
+		depthPyramid->set_depth(i, swapchainFrames[i].depthBufferView, swapchainExtent);
+		instanceCuller->set_depth_pyramid(i, depthPyramid->get_descriptor(i));
+	}
+}
+
+void Engine::make_static_pipeline(){
+
+	//same sets as the classic pipeline, the vertices need no model transform
+	vkInit::GraphicsPipelineInBundle specification = {};
+	specification.device = device;
+	specification.vertexFilepath = "shaders/vertex_static.spv";
+	specification.fragmentFilepath = "shaders/fragment.spv";
+	specification.swapchainExtent = swapchainExtent;
+	specification.swapchainImageFormat = swapchainFormat;
+	specification.depthFormat = swapchainFrames[0].depthFormat;
+	specification.staticVertices = true;
+	staticPipeline = vkInit::create_vertex_pipeline(specification, pipelineLayout, renderpass);
 }
 
 void Engine::make_framebuffers(){
@@ -186,6 +398,8 @@ void Engine::make_frame_resources(){
 		frame.make_descriptor_resources();
 
 		frame.descriptorSet = vkInit::allocate_descriptor_set(device,frameDescriptorPool,frameSetLayout);
+		//its buffers live as long as the frame, rewriting the set would invalidate cached recordings
+		frame.write_descriptor_set();
 	}
 }
 
@@ -204,7 +418,39 @@ void Engine::finalize_setup(){
 }
 
 void Engine::make_assets(){
-	meshes = new VertexMenagerie();
+
+	//Make a descriptor pool to allocate sets, one extra texture for the placeholder.
+	//Every texture holds two sets so streaming can swap between them.
+	vkInit::descriptorSetLayoutData bindings;
+	bindings.count = 1;
+	bindings.types.push_back(vk::DescriptorType::eCombinedImageSampler);
+	bindings.counts.push_back(1);
+
+	meshDescriptorPool = vkInit::make_descriptor_pool(device, 2 * (kMaxTextures + 1), bindings);
+
+	vkAsset::AssetManagerInputChunk assetInfo;
+	assetInfo.logicalDevice = device;
+	assetInfo.physicalDevice = physicalDevice;
+	assetInfo.commandBuffer = mainCommandBuffer;
+	assetInfo.queue = graphicsQueue;
+	assetInfo.layout = meshSetLayout;
+	assetInfo.descriptorPool = meshDescriptorPool;
+	assetInfo.uploads = uploads;
+	assetInfo.textureBudget = kTextureBudget;
+	assetInfo.framesInFlight = maxFramesInFlight;
+	assetInfo.compactVertices = kCompactVertices;
+	assetInfo.keepMeshSources = kStaticBatching || kOcclusionBuffer;
+	assets = new vkAsset::AssetManager(assetInfo);
+	meshes = assets->meshes;
+
+	//start decoding the textures first, they take the longest
+	const char* filenames[] = { "tex/face.jpg", "tex/haus.jpg", "tex/noroi.jpg" };
+	std::vector<vkAsset::MaterialHandle> builtinMaterials;
+	for (const char* filename : filenames) {
+		builtinMaterials.push_back(assets->create_material(assets->load_texture(filename)));
+	}
+	std::vector<vkAsset::MeshHandle> builtinMeshes;
+
 	std::vector<float> vertices = { {
 		 0.0f, -0.1f, 0.0f, 1.0f, 0.0f, 0.5f, 0.0f, //0
 		 0.1f, 0.1f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f,  //1
@@ -213,8 +459,7 @@ void Engine::make_assets(){
 	std::vector<uint32_t> indices = { {
 			0, 1, 2
 	} };
-	meshTypes type = meshTypes::TRIANGLE;
-	meshes->consume(type, vertices, indices);
+	builtinMeshes.push_back(assets->load_mesh(std::move(vertices), std::move(indices)));
 
 	vertices = { {
 		-0.1f,  0.1f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, //0
@@ -226,8 +471,7 @@ void Engine::make_assets(){
 			0, 1, 2,
 			2, 3, 0
 	} };
-	type = meshTypes::SQUARE;
-	meshes->consume(type, vertices, indices);
+	builtinMeshes.push_back(assets->load_mesh(std::move(vertices), std::move(indices)));
 
 	vertices = { {
 		-0.1f, -0.05f, 1.0f, 1.0f, 1.0f, 0.0f, 0.25f, //0
@@ -251,48 +495,31 @@ void Engine::make_assets(){
 			2, 6, 8, 
 			2, 8, 9  
 	} };
-	type = meshTypes::STAR;
-	meshes->consume(type, vertices, indices);
-
-	FinalizationChunk finalizationChunk;
-	finalizationChunk.logicalDevice = device;
-	finalizationChunk.physicalDevice=physicalDevice;
-	finalizationChunk.queue=graphicsQueue;
-	finalizationChunk.commandBuffer=mainCommandBuffer;
-	meshes->finalize(finalizationChunk);
-
-	//Materials
-	std::unordered_map<meshTypes, const char*> filenames = {
-		{meshTypes::TRIANGLE, "tex/face.jpg"},
-		{meshTypes::SQUARE, "tex/haus.jpg"},
-		{meshTypes::STAR, "tex/noroi.jpg"}
-	};
-
-	//Make a descriptor pool to allocate sets.
-	vkInit::descriptorSetLayoutData bindings;
-	bindings.count = 1;
-	bindings.types.push_back(vk::DescriptorType::eCombinedImageSampler);
+	builtinMeshes.push_back(assets->load_mesh(std::move(vertices), std::move(indices)));
+
+	for (size_t i = 0; i < builtinMeshes.size(); ++i) {
+		renderables.push_back(Renderable{ builtinMeshes[i].id, builtinMaterials[i].id });
+	}
 
-	meshDescriptorPool = vkInit::make_descriptor_pool(device, static_cast<uint32_t>(filenames.size()), bindings);
-	//meshDescriptorPool = vkInit::make_descriptor_pool(device, 3, bindings);
+	//anything else comes from the manifest, if there is one
+	for (const Renderable& renderable : assets->load_manifest("assets/manifest.txt")) {
+		renderables.push_back(renderable);
+	}
 
-	vkImage::TextureInputChunk textureInfo;
-	textureInfo.commandBuffer = mainCommandBuffer;
-	textureInfo.queue = graphicsQueue;
-	textureInfo.logicalDevice = device;
-	textureInfo.physicalDevice = physicalDevice;
-	textureInfo.layout = meshSetLayout;
-	textureInfo.descriptorPool = meshDescriptorPool;
+	assets->finalize_meshes();
 
-	for (const auto & [object, filename] : filenames) {
-		textureInfo.filename = filename;
-		materials[object] = new vkImage::Texture(textureInfo);
+	if (kStaticBatching) {
+		staticBatcher = new StaticBatcher();
+		vkMesh::StaticGeometryInputChunk geometryInfo;
+		geometryInfo.logicalDevice = device;
+		geometryInfo.physicalDevice = physicalDevice;
+		geometryInfo.uploads = uploads;
+		geometryInfo.frameCount = kBufferSize;
+		staticGeometry = new vkMesh::StaticGeometry(geometryInfo);
 	}
 }
 
-void Engine::prepare_frame(uint32_t imageIndex, Scene* scene){
-
-	vkUtil::SwapChainFrame _frame = swapchainFrames[imageIndex];
+vkUtil::UBO Engine::make_camera_data(){
 
 	glm::vec3 eye = {1.0f,0.0f,-1.0f};
 	glm::vec3 center = {0.0f,0.0f,0.0f};
@@ -306,34 +533,482 @@ void Engine::prepare_frame(uint32_t imageIndex, Scene* scene){
 
 	projection[1][1] *= -1;
 
-	_frame.cameraData.view = view;
-	_frame.cameraData.projection = projection;
-	_frame.cameraData.viewProjection = projection * view;
+	vkUtil::UBO cameraData;
+	cameraData.view = view;
+	cameraData.projection = projection;
+	cameraData.viewProjection = projection * view;
+	return cameraData;
+}
+
+void Engine::stream_textures(Scene* scene){
+
+	vkUtil::UBO cameraData = make_camera_data();
+
+	//pixels covered by one world unit at distance one
+	float pixelsPerUnit = std::abs(cameraData.projection[1][1]) * 0.5f * static_cast<float>(swapchainExtent.height);
+
+	{
+		std::lock_guard<std::mutex> lock(layoutMutex);
+		measure_coverage(scene, cameraData.viewProjection);
+
+		//the streamer forgets requests each update, so every group asks again from its kept depth
+		for (size_t g = 0; g < scene->groups.size(); ++g) {
+			const InstanceGroup& group = scene->groups[g];
+			const MeshDrawRange* mesh = assets->get_mesh(vkAsset::MeshHandle{ group.renderable.mesh });
+			if (!mesh) {
+				continue;
+			}
+			float diameter = 2.0f * mesh->boundingRadius;
+			assets->request_resolution(vkAsset::MaterialHandle{ group.renderable.material }, diameter * pixelsPerUnit / coverageNearest[g]);
+		}
+	}
+
+	assets->update_streaming();
+}
+
+void Engine::measure_coverage(Scene* scene, const glm::mat4& viewProjection){
+
+	InstanceStore& instances = scene->instances;
+	const std::vector<InstanceGroup>& groups = scene->groups;
+	const uint32_t pageSize = InstanceStore::kPageSize;
+
+	//coverage takes the copy after the tree's, and drains it every frame so the change list does not grow
+	std::vector<uint32_t> stalePages;
+	instances.take_stale_pages(1, get_change_copies(), stalePages);
+
+	//a new camera or layout moves every depth, so each page of each group is measured
+	if (coverageViewProjection != viewProjection
+		|| coverageLayoutVersion != instances.get_layout_version()
+		|| coverageNearest.size() != groups.size()) {
+
+		coverageViewProjection = viewProjection;
+		coverageLayoutVersion = instances.get_layout_version();
+		coverageSegments.resize(groups.size());
+		coverageNearest.resize(groups.size());
+		coverageDepths.clear();
+		for (size_t g = 0; g < groups.size(); ++g) {
+			uint32_t end = groups[g].firstInstance + groups[g].instanceCount;
+			coverageSegments[g] = static_cast<uint32_t>(coverageDepths.size());
+			coverageNearest[g] = std::numeric_limits<float>::infinity();
+			for (uint32_t first = groups[g].firstInstance; first < end; first = (first / pageSize + 1) * pageSize) {
+				float depth = nearest_depth(instances, first, std::min(end, (first / pageSize + 1) * pageSize), viewProjection);
+				coverageDepths.push_back(depth);
+				coverageNearest[g] = std::min(coverageNearest[g], depth);
+			}
+		}
+		return;
+	}
+
+	//otherwise only the pages instances moved in, and the groups they belong to
+	if (stalePages.empty()) {
+		return;
+	}
+	std::sort(stalePages.begin(), stalePages.end());
+	for (size_t g = 0; g < groups.size(); ++g) {
+
+		const InstanceGroup& group = groups[g];
+		if (group.instanceCount == 0) {
+			continue;
+		}
+		uint32_t end = group.firstInstance + group.instanceCount;
+		uint32_t firstPage = group.firstInstance / pageSize;
+		uint32_t lastPage = (end - 1) / pageSize;
+		std::vector<uint32_t>::iterator page = std::lower_bound(stalePages.begin(), stalePages.end(), firstPage);
+		if (page == stalePages.end() || *page > lastPage) {
+			continue;
+		}
+
+		float* depths = coverageDepths.data() + coverageSegments[g];
+		for (; page != stalePages.end() && *page <= lastPage; ++page) {
+			uint32_t first = std::max(group.firstInstance, *page * pageSize);
+			depths[*page - firstPage] = nearest_depth(instances, first, std::min(end, (*page + 1) * pageSize), viewProjection);
+		}
+		coverageNearest[g] = *std::min_element(depths, depths + (lastPage - firstPage + 1));
+	}
+}
+
+float Engine::nearest_depth(const InstanceStore& instances, uint32_t first, uint32_t end, const glm::mat4& viewProjection){
+
+	float nearest = std::numeric_limits<float>::infinity();
+	for (uint32_t instance = first; instance < end; ++instance) {
+		float depth = (viewProjection * glm::vec4(instances.get_position(instance), 1.0f)).w;
+		if (depth > 0.1f) {
+			nearest = std::min(nearest, depth);
+		}
+	}
+	return nearest;
+}
+
+uint32_t Engine::select_lod(const MeshDrawRange& mesh, const glm::vec3& position, const vkUtil::UBO& cameraData){
+
+	const MeshLod* chain = meshes->lods.data() + mesh.firstLod;
+	float depth = (cameraData.viewProjection * glm::vec4(position, 1.0f)).w;
+	if (depth <= 0.1f) {
+		return 0;
+	}
+
+	//pixels covered by one world unit at this depth
+	float pixelsPerUnit = std::abs(cameraData.projection[1][1]) * 0.5f * static_cast<float>(swapchainExtent.height) / depth;
+
+	uint32_t lod = 0;
+	while (lod + 1 < mesh.lodCount && chain[lod + 1].error * pixelsPerUnit <= kLodPixelError) {
+		++lod;
+	}
+	return lod;
+}
+
+void Engine::prepare_frame(uint32_t imageIndex, Scene* scene){
+
+	vkUtil::SwapChainFrame& _frame = swapchainFrames[imageIndex];
+
+	_frame.cameraData = make_camera_data();
 	memcpy(_frame.cameraDataWriteLocation, &(_frame.cameraData), sizeof(vkUtil::UBO));
 
+	std::lock_guard<std::mutex> lock(layoutMutex);
+	//pages of a streamed scene come and go with the camera before anything reads the store
+	scene->stream(glm::vec3(glm::inverse(_frame.cameraData.view)[3]), kStreamingRadius, [this](uint32_t mesh) {
+		const MeshDrawRange* range = assets->get_mesh(vkAsset::MeshHandle{ mesh });
+		return range ? range->boundingRadius : 0.0f;
+	});
+	scene->graph.propagate(scene->instances);
+	//batching flags instances, which the tree and the model buffers must see this frame
+	update_static_batches(scene);
+	update_bvh(scene);
+
+	//each image's model buffer is its own copy, it only needs the pages changed since it was last written
+	InstanceStore& instances = scene->instances;
+	std::vector<uint32_t> stalePages;
+	instances.take_stale_pages(get_frame_copy(imageIndex), get_change_copies(), stalePages);
+
+	//the image's pages go to whichever path runs, the other starts over when it is next used
+	_frame.instancesOnGpu = culls_on_gpu(scene);
+	gpuCulledLast = _frame.instancesOnGpu;
+	if (_frame.instancesOnGpu) {
+		_frame.modelSlots.clear();
+		prepare_instance_culling(imageIndex, scene, stalePages);
+	}
+	else {
+		if (instanceCuller) {
+			instanceCuller->invalidate(imageIndex);
+		}
+		if (!layout_current(_frame, scene, stalePages)) {
+			layout_instances(_frame, scene, stalePages);
+		}
+		else {
+			glm::mat4* transforms = static_cast<glm::mat4*>(_frame.modelBufferWriteLocation);
+			for (uint32_t page : stalePages) {
+				size_t first = static_cast<size_t>(page) * InstanceStore::kPageSize;
+				size_t count = std::min<size_t>(InstanceStore::kPageSize, instances.size() - first);
+				instances.write_transforms(first, count, _frame.modelSlots.data() + first, transforms);
+			}
+		}
+	}
+
+	if (staticGeometry) {
+		staticGeometry->prepare(imageIndex, make_frustum(_frame.cameraData.viewProjection));
+	}
+}
+
+bool Engine::culls_on_gpu(Scene* scene){
+	return instanceCulling && scene->instances.size() >= kGpuCullInstances;
+}
+
+void Engine::prepare_instance_culling(uint32_t imageIndex, Scene* scene, const std::vector<uint32_t>& stalePages){
+
+	vkUtil::SwapChainFrame& frame = swapchainFrames[imageIndex];
+	const InstanceStore& instances = scene->instances;
+
+	//a group's levels are its draws, each with room for every instance of the group
+	std::vector<vkMesh::InstanceCullGroup> groups(scene->groups.size());
+	std::vector<vk::DrawIndexedIndirectCommand> draws(scene->groups.size() * VertexMenagerie::kMaxLods);
+	for (size_t g = 0; g < scene->groups.size(); ++g) {
+
+		const InstanceGroup& group = scene->groups[g];
+		vkMesh::InstanceCullGroup& cull = groups[g];
+		cull = {};
+		const MeshDrawRange* mesh = assets->get_mesh(vkAsset::MeshHandle{ group.renderable.mesh });
+		if (mesh) {
+			cull.radius = mesh->boundingRadius;
+			cull.lodCount = mesh->lodCount;
+		}
+
+		for (uint32_t lod = 0; lod < VertexMenagerie::kMaxLods; ++lod) {
+			vk::DrawIndexedIndirectCommand& draw = draws[g * VertexMenagerie::kMaxLods + lod];
+			draw.instanceCount = 0;
+			draw.firstInstance = VertexMenagerie::kMaxLods * group.firstInstance + lod * group.instanceCount;
+			if (mesh && lod < mesh->lodCount) {
+				const MeshLod& level = meshes->lods[mesh->firstLod + lod];
+				cull.lodErrors[lod] = level.error;
+				draw.indexCount = level.indexCount;
+				draw.firstIndex = level.firstIndex;
+				draw.vertexOffset = mesh->vertexOffset;
+			}
+		}
+	}
+
+	bool relayout = frame.layoutVersion != instances.get_layout_version();
+	instanceCuller->prepare(imageIndex, instances, scene->groups, groups, draws, stalePages, relayout);
+	frame.layoutVersion = instances.get_layout_version();
+
+	//counted on the GPU, read back a few frames late
+	gpuCullStats.tested = instances.size();
+	gpuCullStats.visible = instanceCuller->get_visible(imageIndex);
+	gpuCullStats.milliseconds = 0.0;
+}
+
+uint32_t Engine::get_change_copies(){
+	return get_frame_copy(static_cast<uint32_t>(swapchainFrames.size()));
+}
+
+uint32_t Engine::get_frame_copy(uint32_t imageIndex){
+
+	//the tree's, texture coverage's, the static batches' when they are kept, then one per image.
+	//Only the images' copies move when the swapchain is recreated with a different image count
+	return imageIndex + (staticBatcher ? 3 : 2);
+}
+
+void Engine::update_static_batches(Scene* scene){
+
+	if (!staticBatcher) {
+		return;
+	}
+
+	//the batches take the copy after texture coverage's
+	staticBatcher->update(scene->instances, 2, get_change_copies(), [this](uint32_t mesh) {
+		return assets->get_mesh_source(vkAsset::MeshHandle{ mesh });
+	});
+	staticGeometry->update(*staticBatcher);
+}
+
+void Engine::update_bvh(Scene* scene){
+
+	//the tree takes the first copy
+	InstanceStore& instances = scene->instances;
+	std::vector<uint32_t> stalePages;
+	instances.take_stale_pages(0, get_change_copies(), stalePages);
+	if (instances.size() < kBvhInstances || culls_on_gpu(scene)) {
+		//missed changes, build again when the tree is next needed
+		bvhRadii.clear();
+		return;
+	}
+
+	//bounds grow when a mesh arrives, or when instances are added
+	std::vector<float> radii(scene->groups.size(), 0.0f);
+	for (size_t g = 0; g < scene->groups.size(); ++g) {
+		const MeshDrawRange* mesh = assets->get_mesh(vkAsset::MeshHandle{ scene->groups[g].renderable.mesh });
+		radii[g] = mesh ? mesh->boundingRadius : 0.0f;
+	}
+	if (instanceBvh->size() != instances.size() || radii != bvhRadii) {
+		instanceBvh->build(instances, scene->groups, radii);
+		bvhRadii = radii;
+		return;
+	}
+
+	std::vector<uint32_t> changed;
+	for (uint32_t page : stalePages) {
+		size_t first = static_cast<size_t>(page) * InstanceStore::kPageSize;
+		size_t last = std::min<size_t>(first + InstanceStore::kPageSize, instances.size());
+		for (size_t instance = first; instance < last; ++instance) {
+			changed.push_back(static_cast<uint32_t>(instance));
+		}
+	}
+	instanceBvh->refit(instances, changed.data(), changed.size());
+}
+
+bool Engine::layout_current(vkUtil::SwapChainFrame& frame, Scene* scene, const std::vector<uint32_t>& stalePages){
+
+	const InstanceStore& instances = scene->instances;
+	bool current = frame.modelSlots.size() == instances.size()
+		&& frame.layoutVersion == instances.get_layout_version()
+		&& frame.layoutViewProjection == frame.cameraData.viewProjection;
+
+	//levels of detail change as meshes arrive
+	std::vector<uint32_t> lodCounts(scene->groups.size());
+	for (size_t g = 0; g < scene->groups.size(); ++g) {
+		const MeshDrawRange* mesh = assets->get_mesh(vkAsset::MeshHandle{ scene->groups[g].renderable.mesh });
+		lodCounts[g] = mesh ? mesh->lodCount : 0;
+	}
+	current = current && lodCounts == frame.layoutLodCounts;
+	if (!current) {
+		return false;
+	}
+
+	//moved instances are tested against the occluders the layout was made with, which another
+	//image's layout may since have replaced. Moved occluders change what is hidden
+	bool occluding = occlusionBuffer && occlusionBuffer->stats.triangles > 0;
+	if (occlusionBuffer && !stalePages.empty()
+		&& occlusionBuffer->get_view_projection() != frame.cameraData.viewProjection) {
+		return false;
+	}
+
+	//moved instances keep their slot unless they entered or left the view, or changed level
+	Frustum frustum = make_frustum(frame.cameraData.viewProjection);
+	for (uint32_t page : stalePages) {
+		size_t first = static_cast<size_t>(page) * InstanceStore::kPageSize;
+		size_t last = std::min<size_t>(first + InstanceStore::kPageSize, instances.size());
+		for (size_t instance = first; instance < last; ++instance) {
+			if (occlusionBuffer && (instances.flags[instance] & INSTANCE_OCCLUDER)) {
+				return false;
+			}
+			const MeshDrawRange* mesh = assets->get_mesh(vkAsset::MeshHandle{ instances.meshes[instance] });
+			float radius = mesh ? mesh->boundingRadius : 0.0f;
+			bool drawn = frame.modelSlots[instance] != InstanceStore::kSkipSlot;
+			bool visible = is_instance_visible(frustum, instances, instance, radius);
+			if (visible && occluding) {
+				float scale = std::max(std::abs(instances.scaleX[instance]),
+					std::max(std::abs(instances.scaleY[instance]), std::abs(instances.scaleZ[instance])));
+				visible = occlusionBuffer->is_sphere_visible(instances.get_position(instance), radius * scale);
+			}
+			if (visible != drawn) {
+				return false;
+			}
+			if (!drawn) {
+				continue;
+			}
+			uint32_t lod = mesh ? select_lod(*mesh, instances.get_position(instance), frame.cameraData) : 0;
+			if (lod != frame.modelLods[instance]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void Engine::layout_instances(vkUtil::SwapChainFrame& frame, Scene* scene, const std::vector<uint32_t>& stalePages){
+
+	//instances of each group are sorted by level of detail, so each level is one instanced draw
+	std::vector<uint32_t>& counts = frame.lodInstanceCounts;
+	counts.assign(scene->groups.size() * VertexMenagerie::kMaxLods, 0);
+	std::vector<float>& depths = frame.lodDepths;
+	depths.assign(scene->groups.size() * VertexMenagerie::kMaxLods, std::numeric_limits<float>::max());
+	//the view matrix's third row gives minus the depth
+	const glm::mat4& view = frame.cameraData.view;
+	glm::vec4 viewRow(view[0][2], view[1][2], view[2][2], view[3][2]);
+	const InstanceStore& instances = scene->instances;
+	std::vector<uint32_t> instanceSlots(instances.size(), InstanceStore::kSkipSlot);
+	frame.modelLods.assign(instances.size(), 0);
+	frame.layoutLodCounts.assign(scene->groups.size(), 0);
+
+	//hidden instances, and those outside the view, are not drawn
+	std::vector<float> radii(scene->groups.size(), 0.0f);
+	std::vector<const MeshDrawRange*> groupMeshes(scene->groups.size());
+	for (size_t g = 0; g < scene->groups.size(); ++g) {
+		groupMeshes[g] = assets->get_mesh(vkAsset::MeshHandle{ scene->groups[g].renderable.mesh });
+		if (groupMeshes[g]) {
+			radii[g] = groupMeshes[g]->boundingRadius;
+			frame.layoutLodCounts[g] = groupMeshes[g]->lodCount;
+		}
+	}
+	Frustum frustum = make_frustum(frame.cameraData.viewProjection);
+	if (instances.size() >= kBvhInstances) {
+		frustumCuller->cull(*instanceBvh, instances, scene->groups, frustum);
+	}
+	else {
+		frustumCuller->cull(instances, scene->groups, radii, frustum);
+	}
+	//then those the occluders in view hide
+	if (occlusionBuffer) {
+		render_occluders(scene, frustum, frame.cameraData.viewProjection);
+		if (occlusionBuffer->stats.triangles > 0) {
+			occlusionBuffer->cull(instances, radii, frustumCuller->visible);
+		}
+	}
+
 	size_t i = 0;
-	for(glm::vec3& position:scene->trianglesPositions){
-		_frame.modelTransforms[i++] = glm::translate(glm::mat4(1.0f),position);
+	for (size_t g = 0; g < scene->groups.size(); ++g) {
+
+		const std::vector<uint32_t>& visible = frustumCuller->visible[g];
+		uint32_t* groupCounts = counts.data() + g * VertexMenagerie::kMaxLods;
+		float* groupDepths = depths.data() + g * VertexMenagerie::kMaxLods;
+		const MeshDrawRange* mesh = groupMeshes[g];
+
+		//nor are those past the end of the model buffer
+		size_t drawn = std::min<size_t>(visible.size(), frame.modelCapacity - i);
+		for (size_t k = 0; k < drawn; ++k) {
+			uint32_t instance = visible[k];
+			glm::vec3 position = instances.get_position(instance);
+			uint32_t lod = mesh ? select_lod(*mesh, position, frame.cameraData) : 0;
+			frame.modelLods[instance] = lod;
+			instanceSlots[instance] = lod;
+			++groupCounts[lod];
+			groupDepths[lod] = std::min(groupDepths[lod], -glm::dot(viewRow, glm::vec4(position, 1.0f)));
+		}
+
+		//levels to model buffer slots
+		size_t slots[VertexMenagerie::kMaxLods];
+		size_t slot = i;
+		for (size_t lod = 0; lod < VertexMenagerie::kMaxLods; ++lod) {
+			slots[lod] = slot;
+			slot += groupCounts[lod];
+		}
+		for (size_t k = 0; k < drawn; ++k) {
+			instanceSlots[visible[k]] = static_cast<uint32_t>(slots[instanceSlots[visible[k]]]++);
+		}
+		i = slot;
 	}
-	for(glm::vec3& position:scene->squarePositions){
-		_frame.modelTransforms[i++] = glm::translate(glm::mat4(1.0f),position);
+
+	//only instances which changed, or moved to another slot, are written
+	std::vector<bool> stale((instances.size() + InstanceStore::kPageSize - 1) / InstanceStore::kPageSize, false);
+	for (uint32_t page : stalePages) {
+		stale[page] = true;
+	}
+	std::vector<uint32_t> writeSlots(instanceSlots);
+	for (size_t instance = 0; instance < instances.size(); ++instance) {
+		bool moved = instance >= frame.modelSlots.size() || frame.modelSlots[instance] != instanceSlots[instance];
+		if (!moved && !stale[instance / InstanceStore::kPageSize]) {
+			writeSlots[instance] = InstanceStore::kSkipSlot;
+		}
 	}
-	for(glm::vec3& position:scene->starPositions){
-		_frame.modelTransforms[i++] = glm::translate(glm::mat4(1.0f),position);
+	instances.write_transforms(0, instances.size(), writeSlots.data(), static_cast<glm::mat4*>(frame.modelBufferWriteLocation));
+
+	frame.modelSlots.swap(instanceSlots);
+	frame.layoutVersion = instances.get_layout_version();
+	frame.layoutViewProjection = frame.cameraData.viewProjection;
+}
+
+void Engine::render_occluders(Scene* scene, const Frustum& frustum, const glm::mat4& viewProjection){
+
+	//batched occluders hide what is behind them too, so the flags are checked here rather than by the culler
+	const InstanceStore& instances = scene->instances;
+	occluders.clear();
+	for (size_t instance = 0; instance < instances.size(); ++instance) {
+
+		uint32_t flags = instances.flags[instance];
+		if ((flags & INSTANCE_OCCLUDER) == 0 || (flags & INSTANCE_HIDDEN)) {
+			continue;
+		}
+		vkAsset::MeshHandle handle{ instances.meshes[instance] };
+		const MeshDrawRange* mesh = assets->get_mesh(handle);
+		const MeshSource* source = assets->get_mesh_source(handle);
+		if (!mesh || !source) {
+			continue;
+		}
+
+		glm::vec3 position = instances.get_position(instance);
+		glm::vec3 scale(instances.scaleX[instance], instances.scaleY[instance], instances.scaleZ[instance]);
+		glm::vec3 reach(mesh->boundingRadius * std::max(std::abs(scale.x), std::max(std::abs(scale.y), std::abs(scale.z))));
+		if (!is_box_visible(frustum, position - reach, position + reach)) {
+			continue;
+		}
+
+		glm::quat rotation(instances.rotationW[instance], instances.rotationX[instance],
+			instances.rotationY[instance], instances.rotationZ[instance]);
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), position)
+			* glm::mat4_cast(rotation)
+			* glm::scale(glm::mat4(1.0f), scale);
+		occluders.push_back(Occluder{ source, transform });
 	}
-	memcpy(_frame.modelBufferWriteLocation, _frame.modelTransforms.data(), i*sizeof(glm::mat4));
 
-	swapchainFrames[imageIndex].write_descriptor_set();
+	//drawn even when there are none, so the buffer always holds the last layout's view
+	occlusionBuffer->render(occluders, viewProjection);
 }
 
-void Engine::prepare_scene(vk::CommandBuffer commandBuffer){
-	vk::Buffer vertexBuffers[] = { meshes->vertexBuffer.buffer };
-	vk::DeviceSize offsets[] = {0};
-	commandBuffer.bindVertexBuffers(0,1,vertexBuffers,offsets);
-	commandBuffer.bindIndexBuffer(meshes->indexBuffer.buffer, 0, vk::IndexType::eUint32);
+void Engine::prepare_scene(vkUtil::CommandRecorder& recorder){
+	recorder.bind_vertex_buffer(0, meshes->vertexBuffer.buffer, 0);
+	recorder.bind_index_buffer(meshes->indexBuffer.buffer, 0, meshes->indexType);
 }
 
-void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex,Scene* scene){
+void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex, int frameIndex, Scene* scene){
 	vk::CommandBufferBeginInfo beginInfo = {};
 
 	try {
@@ -345,8 +1020,48 @@ void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imag
 		}
 	}
 
+	//uploads finished by the asset workers since last frame
+	uploads->record(commandBuffer, frameIndex);
+
+	//instances, or else meshlets, are culled against this frame's camera before the renderpass begins
+	vkUtil::SwapChainFrame& frame = swapchainFrames[imageIndex];
+	//occlusion culled frames draw last frame's visible instances, then the rest which the depth they left does not hide
+	bool occlusion = frame.instancesOnGpu && kOcclusionCulling;
+	vkMesh::InstanceCullConstants constants;
+	if (frame.instancesOnGpu) {
+		constants.instanceCount = static_cast<uint32_t>(scene->instances.size());
+		constants.drawCount = static_cast<uint32_t>(scene->groups.size() * VertexMenagerie::kMaxLods);
+		constants.pixelScale = std::abs(frame.cameraData.projection[1][1]) * 0.5f * static_cast<float>(swapchainExtent.height);
+		constants.lodPixelError = kLodPixelError;
+		constants.pass = occlusion ? vkMesh::InstanceCullPass::eEarly : vkMesh::InstanceCullPass::eSingle;
+		constants.pyramidLevels = depthPyramid->get_levels(imageIndex);
+		constants.depthWidth = swapchainExtent.width;
+		constants.depthHeight = swapchainExtent.height;
+		instanceCuller->record(commandBuffer, imageIndex, frame.descriptorSet, constants);
+	}
+	bool culled = !frame.instancesOnGpu && meshletCulling && meshes->is_resident();
+	//paths whose draws come from buffers record the renderpass once, and submit it again while nothing it binds changes
+	bool cached = frame.instancesOnGpu || (!culled && batchedDraws);
+	uint32_t drawCount = 0;
+	if (frame.instancesOnGpu) {
+		drawCount = prepare_gpu_culled_instances(imageIndex, scene);
+	}
+	else if (cached) {
+		drawCount = prepare_batched_objects(imageIndex, scene);
+	}
+	std::vector<uint32_t> regionStarts;
+	std::vector<vkMesh::MeshletCullJob> meshletJobs;
+	if (culled) {
+		meshletJobs = make_meshlet_jobs(imageIndex, scene, regionStarts);
+		//the mesh shader path still binds the command buffers, so keep them non-empty
+		culler->prepare(imageIndex, meshes, std::max(regionStarts.back(), 1u), static_cast<uint32_t>(regionStarts.size()));
+		if (!meshShading) {
+			culler->record(commandBuffer, imageIndex, swapchainFrames[imageIndex].descriptorSet, meshletJobs);
+		}
+	}
+
 	vk::RenderPassBeginInfo renderPassInfo = {};
-	renderPassInfo.renderPass = renderpass;
+	renderPassInfo.renderPass = occlusion ? earlyRenderpass : renderpass;
 	renderPassInfo.framebuffer = swapchainFrames[imageIndex].framebuffer;
 	renderPassInfo.renderArea.offset.x = 0;
 	renderPassInfo.renderArea.offset.y = 0;
@@ -368,54 +1083,485 @@ void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imag
 	renderPassInfo.clearValueCount = clearValues.size();
 	renderPassInfo.pClearValues = clearValues.data();
 
-	commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
+	if (cached) {
+		commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+		vkUtil::CommandKey key = make_scene_commands_key(imageIndex, drawCount);
+		if (key.matches(frame.sceneCommandsKey)) {
+			recorderStats = { 0, 0 };
+		}
+		else {
+			record_scene_commands(imageIndex, drawCount);
+			frame.sceneCommandsKey = key;
+		}
+		commandBuffer.executeCommands(1, &frame.sceneCommandBuffer);
+		commandBuffer.endRenderPass();
+	}
+	else {
+		commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
+		record_inline_commands(commandBuffer, imageIndex, scene, culled, regionStarts, meshletJobs);
+		commandBuffer.endRenderPass();
+	}
 
-	commandBuffer.bindDescriptorSets(
-		vk::PipelineBindPoint::eGraphics,
-		pipelineLayout,0,swapchainFrames[imageIndex].descriptorSet,nullptr);
+	//a handful of commands, recorded each frame rather than cached
+	if (occlusion) {
+		depthPyramid->record(commandBuffer, imageIndex);
+		constants.pass = vkMesh::InstanceCullPass::eLate;
+		instanceCuller->record_late(commandBuffer, imageIndex, frame.descriptorSet, constants);
+
+		renderPassInfo.renderPass = lateRenderpass;
+		commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
+		vkUtil::CommandRecorder recorder(commandBuffer);
+		set_viewport_state(recorder);
+		render_gpu_culled_instances(recorder, imageIndex, drawCount, true);
+		commandBuffer.endRenderPass();
+	}
 
+	try {
+		commandBuffer.end();
+	}
+	catch (vk::SystemError err) {
+		
+		if (debugMode) {
+			std::cout << "failed to record command buffer!" << std::endl;
+		}
+	}
+}
 
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+void Engine::set_viewport_state(vkUtil::CommandRecorder& recorder){
 
-	prepare_scene(commandBuffer);
+	vk::Viewport viewport = {};
+	viewport.width = static_cast<float>(swapchainExtent.width);
+	viewport.height = static_cast<float>(swapchainExtent.height);
+	viewport.maxDepth = 1.0f;
+	recorder.set_viewport(viewport);
+	recorder.set_scissor(vk::Rect2D(vk::Offset2D(0, 0), swapchainExtent));
+}
 
-	uint32_t startInstance = 0;
-	//Triangles
-	render_objects(
-		commandBuffer, meshTypes::TRIANGLE, startInstance, static_cast<uint32_t>(scene->trianglesPositions.size())
-	);
+vkUtil::CommandKey Engine::make_scene_commands_key(uint32_t imageIndex, uint32_t drawCount){
+
+	//the framebuffer and extent are the image's for as long as the cache lives, it goes with the swapchain
+	const vkUtil::SwapChainFrame& frame = swapchainFrames[imageIndex];
+	vkUtil::CommandKey key;
+	key.add(frame.instancesOnGpu).add(drawCount)
+		.add_handle(meshes->vertexBuffer.buffer).add_handle(meshes->indexBuffer.buffer).add(static_cast<uint64_t>(meshes->indexType))
+		.add_handle(frame.descriptorSet)
+		.add_handle(drawBatcher->get_descriptor_set(imageIndex)).add(drawBatcher->get_descriptor_version(imageIndex));
+	if (frame.instancesOnGpu) {
+		key.add_handle(indirectPipeline)
+			.add_handle(instanceCuller->get_descriptor_set(imageIndex)).add(instanceCuller->get_descriptor_version(imageIndex))
+			.add_handle(instanceCuller->get_commands(imageIndex)).add_handle(instanceCuller->get_counts(imageIndex));
+	}
+	else {
+		key.add_handle(batchedPipeline).add_handle(drawBatcher->get_commands(imageIndex));
+	}
+	if (staticGeometry) {
+		//a texture arriving swaps the material's set
+		key.add_handle(staticPipeline).add(staticGeometry->get_layout_version())
+			.add_handle(staticGeometry->vertexBuffer.buffer).add_handle(staticGeometry->indexBuffer.buffer)
+			.add_handle(staticGeometry->get_commands(imageIndex));
+		for (const vkMesh::StaticDrawRun& run : staticGeometry->runs) {
+			key.add_handle(assets->get_material(vkAsset::MaterialHandle{ run.material })->get_descriptor_set());
+		}
+	}
+	return key;
+}
 
-	//Squares
-	render_objects(
-		commandBuffer, meshTypes::SQUARE, startInstance, static_cast<uint32_t>(scene->squarePositions.size())
-	);
+void Engine::record_scene_commands(uint32_t imageIndex, uint32_t drawCount){
 
-	//Stars
-	render_objects(
-		commandBuffer, meshTypes::STAR, startInstance, static_cast<uint32_t>(scene->starPositions.size())
-	);
-	
+	vkUtil::SwapChainFrame& frame = swapchainFrames[imageIndex];
+
+	//a pending command buffer must not be recorded again, wait for the image's last submission
+	if (frame.lastSubmission >= 0) {
+		device.waitForFences(1, &swapchainFrames[frame.lastSubmission].inFlight, VK_TRUE, UINT64_MAX);
+	}
 
-	commandBuffer.endRenderPass();
+	vk::CommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.renderPass = renderpass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = frame.framebuffer;
+
+	//once recorded it is executed again while earlier submissions of it are pending
+	vk::CommandBufferBeginInfo beginInfo = {};
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eSimultaneousUse;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
 
 	try {
-		commandBuffer.end();
+		frame.sceneCommandBuffer.begin(beginInfo);
 	}
 	catch (vk::SystemError err) {
-		
 		if (debugMode) {
-			std::cout << "failed to record command buffer!" << std::endl;
+			std::cout << "Failed to begin recording scene command buffer!" << std::endl;
+		}
+	}
+
+	vkUtil::CommandRecorder recorder(frame.sceneCommandBuffer);
+	set_viewport_state(recorder);
+	if (frame.instancesOnGpu) {
+		render_gpu_culled_instances(recorder, imageIndex, drawCount, false);
+	}
+	else {
+		render_batched_objects(recorder, imageIndex, drawCount);
+	}
+	render_static_geometry(recorder, imageIndex);
+	recorderStats = recorder.get_stats();
+
+	try {
+		frame.sceneCommandBuffer.end();
+	}
+	catch (vk::SystemError err) {
+		if (debugMode) {
+			std::cout << "failed to record scene command buffer!" << std::endl;
+		}
+	}
+}
+
+void Engine::record_inline_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex, Scene* scene, bool culled,
+	const std::vector<uint32_t>& regionStarts, const std::vector<vkMesh::MeshletCullJob>& meshletJobs){
+
+	//state set in the renderpass goes through the recorder, which leaves out what is already set
+	vkUtil::CommandRecorder recorder(commandBuffer);
+	set_viewport_state(recorder);
+
+	if (culled && meshShading) {
+		render_meshlets(recorder, imageIndex, scene, meshletJobs);
+	}
+	else {
+		recorder.bind_descriptor_set(
+			vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, swapchainFrames[imageIndex].descriptorSet);
+
+		recorder.bind_pipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+
+		prepare_scene(recorder);
+
+		if (culled) {
+			render_culled_objects(recorder, imageIndex, scene, regionStarts);
+		}
+		else {
+			render_objects(recorder, imageIndex, scene);
+		}
+	}
+	render_static_geometry(recorder, imageIndex);
+	recorderStats = recorder.get_stats();
+}
+
+std::vector<DrawItem> Engine::make_draw_list(uint32_t imageIndex, Scene* scene, const std::vector<vkMesh::BatchedDraw>& groupDraws,
+	std::vector<vk::DrawIndexedIndirectCommand>& commands, std::vector<uint32_t>& commandGroups){
+
+	//one command per non-empty (group, level), built in model buffer order
+	const vkUtil::SwapChainFrame& frame = swapchainFrames[imageIndex];
+	std::vector<DrawItem> items;
+	commands.clear();
+	commandGroups.clear();
+	uint32_t startInstance = 0;
+	for (size_t g = 0; g < scene->groups.size(); ++g) {
+
+		const Renderable& renderable = scene->groups[g].renderable;
+		const uint32_t* groupCounts = frame.lodInstanceCounts.data() + g * VertexMenagerie::kMaxLods;
+		const MeshDrawRange* mesh = assets->get_mesh(vkAsset::MeshHandle{ renderable.mesh });
+		for (uint32_t lod = 0; lod < VertexMenagerie::kMaxLods; ++lod) {
+
+			//meshes have nothing to fall back on, skip them until they arrive
+			if (mesh && lod < mesh->lodCount && groupCounts[lod] > 0) {
+				const MeshLod& level = meshes->lods[mesh->firstLod + lod];
+				vk::DrawIndexedIndirectCommand command;
+				command.indexCount = level.indexCount;
+				command.instanceCount = groupCounts[lod];
+				command.firstIndex = level.firstIndex;
+				command.vertexOffset = mesh->vertexOffset;
+				command.firstInstance = startInstance;
+
+				//everything is opaque and drawn with one pipeline for now
+				DrawItem item;
+				item.key = make_draw_key(
+					drawLayers::LAYER_OPAQUE, 0, groupDraws[g].material, renderable.mesh & vkAsset::kHandleSlotMask,
+					frame.lodDepths[g * VertexMenagerie::kMaxLods + lod]);
+				item.draw = static_cast<uint32_t>(commands.size());
+				items.push_back(item);
+				commands.push_back(command);
+				commandGroups.push_back(static_cast<uint32_t>(g));
+			}
+			startInstance += groupCounts[lod];
+		}
+	}
+
+	//by state, then nearest first
+	std::vector<DrawItem> scratch;
+	sort_draws(items, scratch);
+	return items;
+}
+
+void Engine::render_objects(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, Scene* scene) {
+
+	std::vector<vkMesh::BatchedDraw> groupDraws;
+	std::vector<vk::DescriptorImageInfo> materials;
+	gather_group_draws(scene, groupDraws, materials);
+	std::vector<vk::DrawIndexedIndirectCommand> commands;
+	std::vector<uint32_t> commandGroups;
+	std::vector<DrawItem> order = make_draw_list(imageIndex, scene, groupDraws, commands, commandGroups);
+
+	//draws sharing a texture, then a mesh, are next to each other, so the recorder binds each once a run
+	for (const DrawItem& item : order) {
+
+		uint32_t g = commandGroups[item.draw];
+		const Renderable& renderable = scene->groups[g].renderable;
+		recorder.bind_descriptor_set(vk::PipelineBindPoint::eGraphics, pipelineLayout, 1,
+			assets->get_material(vkAsset::MaterialHandle{ renderable.material })->get_descriptor_set());
+		if (meshes->compact) {
+			recorder.push_constants(
+				pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::vec4), &groupDraws[g].quantization
+			);
+		}
+
+		const vk::DrawIndexedIndirectCommand& command = commands[item.draw];
+		recorder.commandBuffer.drawIndexed(
+			command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+	}
+}
+
+std::vector<vkMesh::MeshletCullJob> Engine::make_meshlet_jobs(uint32_t imageIndex, Scene* scene, std::vector<uint32_t>& regionStarts){
+
+	//one region of indirect commands per scene group, in model buffer order
+	const std::vector<uint32_t>& lodInstanceCounts = swapchainFrames[imageIndex].lodInstanceCounts;
+
+	std::vector<vkMesh::MeshletCullJob> jobs;
+	regionStarts.assign(1, 0);
+	uint32_t startInstance = 0;
+	uint32_t commandBase = 0;
+	for (size_t g = 0; g < scene->groups.size(); ++g) {
+
+		const uint32_t* groupCounts = lodInstanceCounts.data() + g * VertexMenagerie::kMaxLods;
+		const MeshDrawRange* mesh = assets->get_mesh(vkAsset::MeshHandle{ scene->groups[g].renderable.mesh });
+		for (uint32_t lod = 0; lod < VertexMenagerie::kMaxLods; ++lod) {
+
+			if (!mesh || lod >= mesh->lodCount) {
+				startInstance += groupCounts[lod];
+				continue;
+			}
+
+			const MeshLod& level = meshes->lods[mesh->firstLod + lod];
+			vkMesh::MeshletCullJob job = {};
+			job.firstMeshlet = level.firstMeshlet;
+			job.meshletCount = level.meshletCount;
+			job.firstInstance = startInstance;
+			job.instanceCount = groupCounts[lod];
+			job.vertexOffset = mesh->vertexOffset;
+			job.commandBase = commandBase;
+			job.region = static_cast<uint32_t>(g);
+			job.firstIndex = static_cast<uint32_t>(mesh->firstIndex);
+			job.firstMeshletVertex = mesh->firstMeshletVertex;
+			job.quantization = mesh->quantization;
+			if (job.instanceCount > 0) {
+				jobs.push_back(job);
+			}
+
+			//every pair may survive, the region is sized for all of them
+			commandBase += job.meshletCount * job.instanceCount;
+			startInstance += job.instanceCount;
+		}
+		regionStarts.push_back(commandBase);
+	}
+
+	return jobs;
+}
+
+void Engine::render_culled_objects(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, Scene* scene, const std::vector<uint32_t>& regionStarts){
+
+	const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+
+	for (size_t region = 0; region + 1 < regionStarts.size(); ++region) {
+
+		if (regionStarts[region] == regionStarts[region + 1]) {
+			continue;
+		}
+
+		const Renderable& renderable = scene->groups[region].renderable;
+		recorder.bind_descriptor_set(vk::PipelineBindPoint::eGraphics, pipelineLayout, 1,
+			assets->get_material(vkAsset::MaterialHandle{ renderable.material })->get_descriptor_set());
+		if (meshes->compact) {
+			const MeshDrawRange* mesh = assets->get_mesh(vkAsset::MeshHandle{ renderable.mesh });
+			recorder.push_constants(
+				pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::vec4), &mesh->quantization
+			);
+		}
+
+		//culled slots are left zeroed, which draw nothing
+		for (uint32_t first = regionStarts[region]; first < regionStarts[region + 1]; first += maxDrawIndirectCount) {
+			uint32_t drawCount = std::min(regionStarts[region + 1] - first, maxDrawIndirectCount);
+			recorder.commandBuffer.drawIndexedIndirect(culler->get_commands(imageIndex), first * stride, drawCount, stride);
 		}
 	}
 }
 
-void Engine::render_objects(vk::CommandBuffer commandBuffer, meshTypes objectType, uint32_t& startInstance, uint32_t instanceCount) {
+void Engine::gather_group_draws(Scene* scene, std::vector<vkMesh::BatchedDraw>& groupDraws, std::vector<vk::DescriptorImageInfo>& materials){
 
-	int indexCount = meshes->indexCounts.find(objectType)->second;
-	int firstIndex = meshes->firstIndices.find(objectType)->second;
-	materials[objectType]->use(commandBuffer, pipelineLayout);
-	commandBuffer.drawIndexed(indexCount, instanceCount, firstIndex, 0, startInstance);
-	startInstance += instanceCount;
+	//materials sharing a texture share its slot, the placeholder included
+	std::unordered_map<vkImage::Texture*, uint32_t> slots;
+	groupDraws.resize(scene->groups.size());
+	materials.clear();
+	for (size_t g = 0; g < scene->groups.size(); ++g) {
+
+		const Renderable& renderable = scene->groups[g].renderable;
+		vkImage::Texture* texture = assets->get_material(vkAsset::MaterialHandle{ renderable.material });
+		auto slot = slots.find(texture);
+		if (slot == slots.end()) {
+			slot = slots.emplace(texture, static_cast<uint32_t>(materials.size())).first;
+			materials.push_back(texture->get_descriptor());
+		}
+
+		vkMesh::BatchedDraw& draw = groupDraws[g];
+		draw = {};
+		const MeshDrawRange* mesh = assets->get_mesh(vkAsset::MeshHandle{ renderable.mesh });
+		draw.quantization = mesh ? mesh->quantization : glm::vec4(0.0f);
+		draw.material = slot->second;
+	}
+}
+
+uint32_t Engine::prepare_batched_objects(uint32_t imageIndex, Scene* scene){
+
+	std::vector<vkMesh::BatchedDraw> groupDraws;
+	std::vector<vk::DescriptorImageInfo> materials;
+	gather_group_draws(scene, groupDraws, materials);
+	std::vector<vk::DrawIndexedIndirectCommand> listed;
+	std::vector<uint32_t> commandGroups;
+	std::vector<DrawItem> order = make_draw_list(imageIndex, scene, groupDraws, listed, commandGroups);
+
+	//there is no state left to change between draws, the order is for early depth rejection
+	std::vector<vk::DrawIndexedIndirectCommand> commands;
+	std::vector<vkMesh::BatchedDraw> draws;
+	commands.reserve(order.size());
+	draws.reserve(order.size());
+	for (const DrawItem& item : order) {
+		commands.push_back(listed[item.draw]);
+		draws.push_back(groupDraws[commandGroups[item.draw]]);
+	}
+
+	//descriptor sets may not change once bound, so the batch is written before recording
+	drawBatcher->prepare(imageIndex, commands, draws, materials);
+	return static_cast<uint32_t>(commands.size());
+}
+
+void Engine::render_batched_objects(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, uint32_t drawCount){
+
+	const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+
+	if (drawCount == 0) {
+		return;
+	}
+	recorder.bind_pipeline(vk::PipelineBindPoint::eGraphics, batchedPipeline);
+	recorder.bind_descriptor_set(
+		vk::PipelineBindPoint::eGraphics, batchedPipelineLayout, 0, swapchainFrames[imageIndex].descriptorSet);
+	recorder.bind_descriptor_set(
+		vk::PipelineBindPoint::eGraphics, batchedPipelineLayout, 1, drawBatcher->get_descriptor_set(imageIndex));
+	prepare_scene(recorder);
+
+	//one call, unless the device caps how many draws it takes
+	for (uint32_t first = 0; first < drawCount; first += maxDrawIndirectCount) {
+		recorder.push_constants(
+			batchedPipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(uint32_t), &first
+		);
+		recorder.commandBuffer.drawIndexedIndirect(
+			drawBatcher->get_commands(imageIndex), first * stride, std::min(drawCount - first, maxDrawIndirectCount), stride);
+	}
+}
+
+void Engine::render_static_geometry(vkUtil::CommandRecorder& recorder, uint32_t imageIndex){
+
+	const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+
+	if (!staticGeometry || staticGeometry->runs.empty()) {
+		return;
+	}
+	recorder.bind_pipeline(vk::PipelineBindPoint::eGraphics, staticPipeline);
+	recorder.bind_descriptor_set(
+		vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, swapchainFrames[imageIndex].descriptorSet);
+	recorder.bind_vertex_buffer(0, staticGeometry->vertexBuffer.buffer, 0);
+	recorder.bind_index_buffer(staticGeometry->indexBuffer.buffer, 0, vk::IndexType::eUint32);
+
+	//a run per material, clusters outside the view were given no instances
+	vk::Buffer commands = staticGeometry->get_commands(imageIndex);
+	for (const vkMesh::StaticDrawRun& run : staticGeometry->runs) {
+		recorder.bind_descriptor_set(vk::PipelineBindPoint::eGraphics, pipelineLayout, 1,
+			assets->get_material(vkAsset::MaterialHandle{ run.material })->get_descriptor_set());
+		for (uint32_t first = run.firstDraw; first < run.firstDraw + run.drawCount; first += maxDrawIndirectCount) {
+			uint32_t drawCount = std::min(run.firstDraw + run.drawCount - first, maxDrawIndirectCount);
+			recorder.commandBuffer.drawIndexedIndirect(commands, first * stride, drawCount, stride);
+		}
+	}
+}
+
+uint32_t Engine::prepare_gpu_culled_instances(uint32_t imageIndex, Scene* scene){
+
+	//the commands are the culler's, the batch only holds a record per group
+	std::vector<vkMesh::BatchedDraw> groupDraws;
+	std::vector<vk::DescriptorImageInfo> materials;
+	gather_group_draws(scene, groupDraws, materials);
+	drawBatcher->prepare(imageIndex, {}, groupDraws, materials);
+	return static_cast<uint32_t>(groupDraws.size() * VertexMenagerie::kMaxLods);
+}
+
+void Engine::render_gpu_culled_instances(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, uint32_t drawCapacity, bool late){
+
+	const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+
+	if (drawCapacity == 0) {
+		return;
+	}
+
+	recorder.bind_pipeline(vk::PipelineBindPoint::eGraphics, indirectPipeline);
+	recorder.bind_descriptor_set(
+		vk::PipelineBindPoint::eGraphics, indirectPipelineLayout, 0, swapchainFrames[imageIndex].descriptorSet);
+	recorder.bind_descriptor_set(
+		vk::PipelineBindPoint::eGraphics, indirectPipelineLayout, 1, drawBatcher->get_descriptor_set(imageIndex));
+	recorder.bind_descriptor_set(
+		vk::PipelineBindPoint::eGraphics, indirectPipelineLayout, 2, instanceCuller->get_descriptor_set(imageIndex));
+	prepare_scene(recorder);
+
+	//non-empty levels of every group were compacted to the front of the commands, the late
+	//pass's to the front of the second half
+	vk::Buffer commands = instanceCuller->get_commands(imageIndex);
+	uint32_t base = late ? drawCapacity : 0;
+	vk::DeviceSize countOffset = late ? vkMesh::InstanceCuller::kLateCountOffset : 0;
+	for (uint32_t first = base; first < base + drawCapacity; first += maxDrawIndirectCount) {
+
+		uint32_t drawCount = std::min(base + drawCapacity - first, maxDrawIndirectCount);
+		recorder.push_constants(
+			indirectPipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(uint32_t), &first
+		);
+#ifdef VK_KHR_draw_indirect_count
+		//the count is the scene's, commands past it are zeroed and draw nothing
+		if (indirectCount) {
+			recorder.commandBuffer.drawIndexedIndirectCountKHR(
+				commands, first * stride, instanceCuller->get_counts(imageIndex), countOffset, drawCount, stride, dldi);
+			continue;
+		}
+#endif
+		//the rest are zeroed, which draw nothing
+		recorder.commandBuffer.drawIndexedIndirect(commands, first * stride, drawCount, stride);
+	}
+}
+
+void Engine::render_meshlets(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, Scene* scene, const std::vector<vkMesh::MeshletCullJob>& jobs){
+
+#ifdef VK_EXT_mesh_shader
+	const uint32_t taskWorkgroupSize = 32;
+
+	recorder.bind_pipeline(vk::PipelineBindPoint::eGraphics, meshletPipeline);
+	recorder.bind_descriptor_set(
+		vk::PipelineBindPoint::eGraphics, culler->pipelineLayout, 0, swapchainFrames[imageIndex].descriptorSet);
+	recorder.bind_descriptor_set(
+		vk::PipelineBindPoint::eGraphics, culler->pipelineLayout, 2, culler->get_descriptor_set(imageIndex));
+
+	for (const vkMesh::MeshletCullJob& job : jobs) {
+		vkAsset::MaterialHandle material{ scene->groups[job.region].renderable.material };
+		recorder.bind_descriptor_set(
+			vk::PipelineBindPoint::eGraphics, culler->pipelineLayout, 1, assets->get_material(material)->get_descriptor_set());
+		recorder.push_constants(
+			culler->pipelineLayout, culler->stages, 0, sizeof(vkMesh::MeshletCullJob), &job
+		);
+		uint32_t pairs = job.meshletCount * job.instanceCount;
+		recorder.commandBuffer.drawMeshTasksEXT((pairs + taskWorkgroupSize - 1) / taskWorkgroupSize, 1, 1, dldi);
+	}
+#endif
 }
 
 int Engine::get_maxFramesInFlight(){
@@ -428,6 +1574,7 @@ void Engine::render(Scene* scene){
 	int frameAccumulate=frameNumberTotal.load();
 
 	device.waitForFences(1, &swapchainFrames[frameIndex].inFlight, VK_TRUE, UINT64_MAX);
+	uploads->retire(frameIndex);
 	
 	
 	//acquireNextImageKHR(vk::SwapChainKHR, timeout, semaphore_to_signal, fence)
@@ -455,7 +1602,9 @@ void Engine::render(Scene* scene){
 
 	prepare_frame(imageIndex,scene);
 
-	record_draw_commands(commandBuffer, imageIndex,scene);
+	stream_textures(scene);
+
+	record_draw_commands(commandBuffer, imageIndex, frameIndex, scene);
 
 	vk::SubmitInfo submitInfo = {};
 
@@ -475,6 +1624,7 @@ void Engine::render(Scene* scene){
 	device.resetFences(1, &swapchainFrames[frameIndex].inFlight);
 	try {
 		graphicsQueue.submit(submitInfo, swapchainFrames[frameIndex].inFlight); 
+		swapchainFrames[imageIndex].lastSubmission = frameIndex;
 	}
 	catch (vk::SystemError err) {
 		
@@ -511,6 +1661,8 @@ void Engine::render(Scene* scene){
 	frameNumber_atomic.store((frameIndex+1)% maxFramesInFlight);
 	frameNumberTotal.store(frameAccumulate+1);
 
+	report_startup_time();
+
 	//device.waitIdle();
 }
 
@@ -529,6 +1681,7 @@ void Engine::renderThreadFunc(Scene* scene,int frameIndex){
 
 		//int frameIndex=frameNumber_atomic.load();
 		device.waitForFences(1, &swapchainFrames[frameIndex].inFlight, VK_TRUE, UINT64_MAX);
+		uploads->retire(frameIndex);
 
 		/*
 		//now we can use this fence resource , but we need to see if other thread is using this
@@ -564,7 +1717,9 @@ void Engine::renderThreadFunc(Scene* scene,int frameIndex){
 
 		prepare_frame(imageIndex,scene);
 
-		record_draw_commands(commandBuffer, imageIndex,scene);
+		stream_textures(scene);
+
+		record_draw_commands(commandBuffer, imageIndex, frameIndex, scene);
 
 		vk::SubmitInfo submitInfo = {};
 
@@ -585,6 +1740,7 @@ void Engine::renderThreadFunc(Scene* scene,int frameIndex){
 
 		try {
 			graphicsQueue.submit(submitInfo, swapchainFrames[frameIndex].inFlight); 
+			swapchainFrames[imageIndex].lastSubmission = frameIndex;
 		}
 		catch (vk::SystemError err) {
 		
@@ -626,9 +1782,30 @@ void Engine::renderThreadFunc(Scene* scene,int frameIndex){
 		//frameIndex=(frameIndex+1) % maxFramesInFlight;
 		frameNumber_atomic.store((frameIndex+1) % maxFramesInFlight);
 		frameNumberTotal.store(frameAccumulate+1);
+
+		report_startup_time();
 		}
 }
 
+void Engine::report_startup_time(){
+
+	if (firstFrameReported && assetsReadyReported) {
+		return;
+	}
+
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	if (!firstFrameReported) {
+		firstFrameReported = true;
+		std::cout << "Time to first frame: " << elapsed << " ms\n";
+	}
+
+	if (!assetsReadyReported && assets->all_resident()) {
+		assetsReadyReported = true;
+		std::cout << "All assets resident after: " << elapsed << " ms\n";
+	}
+}
+
 int Engine::getLastTime(){
 	return frameTime_atomic.load();
 }
@@ -641,6 +1818,26 @@ int Engine::getCurrentFrame(){
 	return frameNumber_atomic.load();
 }
 
+const std::vector<Renderable>& Engine::get_renderables(){
+	return renderables;
+}
+
+CullStats Engine::get_cull_stats(){
+	if (gpuCulledLast) {
+		return gpuCullStats;
+	}
+	CullStats stats = frustumCuller->stats;
+	if (occlusionBuffer && occlusionBuffer->stats.triangles > 0) {
+		stats.visible -= occlusionBuffer->stats.occluded;
+		stats.milliseconds += occlusionBuffer->stats.rasterMilliseconds + occlusionBuffer->stats.testMilliseconds;
+	}
+	return stats;
+}
+
+vkUtil::RecorderStats Engine::get_recorder_stats(){
+	return recorderStats;
+}
+
 void Engine::cleanup_swapchain(){
 	for (vkUtil::SwapChainFrame& frame : swapchainFrames) {
 		frame.destroy();
@@ -663,17 +1860,48 @@ Engine::~Engine() {
 
 	device.destroyPipeline(pipeline);
 	device.destroyPipelineLayout(pipelineLayout);
+	if (culler) {
+		if (meshShading) {
+			device.destroyPipeline(meshletPipeline);
+		}
+		device.destroyPipeline(culler->pipeline);
+		device.destroyPipelineLayout(culler->pipelineLayout);
+		delete culler;
+	}
+	delete frustumCuller;
+	delete occlusionBuffer;
+	if (drawBatcher) {
+		device.destroyPipeline(batchedPipeline);
+		device.destroyPipelineLayout(batchedPipelineLayout);
+		delete drawBatcher;
+	}
+	if (instanceCuller) {
+		device.destroyPipeline(indirectPipeline);
+		device.destroyPipelineLayout(indirectPipelineLayout);
+		device.destroyPipeline(instanceCuller->cullPipeline);
+		device.destroyPipeline(instanceCuller->compactPipeline);
+		device.destroyPipelineLayout(instanceCuller->pipelineLayout);
+		delete instanceCuller;
+		device.destroyPipeline(depthPyramid->pipeline);
+		device.destroyPipelineLayout(depthPyramid->pipelineLayout);
+		delete depthPyramid;
+		device.destroyRenderPass(earlyRenderpass);
+		device.destroyRenderPass(lateRenderpass);
+	}
+	delete instanceBvh;
+	if (kStaticBatching) {
+		device.destroyPipeline(staticPipeline);
+	}
+	delete staticBatcher;
+	delete staticGeometry;
 	device.destroyRenderPass(renderpass);
 
 	cleanup_swapchain();
 
 	device.destroyDescriptorSetLayout(frameSetLayout);
 
-	delete meshes;
-
-	for (const auto& [key, texture] : materials) {
-		delete texture;
-	}
+	delete assets;
+	delete uploads;
 
 	device.destroyDescriptorSetLayout(meshSetLayout);
 	device.destroyDescriptorPool(meshDescriptorPool);
@@ -2,9 +2,23 @@
 #include "../config.h"
 #include"vkUtil/frame.h"
 #include "../model/scene.h"
+#include "../model/frustum_culler.h"
+#include "../model/occlusion_buffer.h"
+#include "../model/bvh.h"
+#include "../model/draw_sort.h"
 #include "../model/triangle_mesh.h"
 #include "../model/vertex_menagerie.h"
 #include "vkImage/image.h"
+#include "vkUtil/upload.h"
+#include "vkUtil/command_recorder.h"
+#include "vkAsset/asset_manager.h"
+#include "vkMesh/meshlet_culler.h"
+#include "vkMesh/instance_culler.h"
+#include "vkMesh/depth_pyramid.h"
+#include "vkMesh/draw_batcher.h"
+#include "vkMesh/static_geometry.h"
+#include <chrono>
+#include <mutex>
 
 class Engine {
 
@@ -21,10 +35,53 @@ public:
 	void setLatTime(int currentTime);
 	int getCurrentFrame();
 
+	/**
+		\returns every registered mesh with its material, for building a scene
+	*/
+	const std::vector<Renderable>& get_renderables();
+
+	/**
+		\returns what the last instance cull tested and kept
+	*/
+	CullStats get_cull_stats();
+
+	/**
+		\returns the state commands the last recording sent and left out
+	*/
+	vkUtil::RecorderStats get_recorder_stats();
+
 	bool shouldClose;
 	std::atomic<int> frameNumberTotal;
 
 	static const int kBufferSize=10;
+	//device memory all streamed textures may use together
+	static const size_t kTextureBudget = 64 * 1024 * 1024;
+	//textures the material descriptor pool has room for
+	static const uint32_t kMaxTextures = 1024;
+	//quantized 12 byte vertices instead of 28 byte float ones
+	static const bool kCompactVertices = true;
+	//a coarser level of detail is used once its error projects smaller than this many pixels
+	static constexpr float kLodPixelError = 1.0f;
+	//cull meshlets in a compute pass and draw the survivors indirectly, where the device allows it
+	static const bool kMeshletCulling = true;
+	//draw meshlets with task and mesh shaders instead, where VK_EXT_mesh_shader is available
+	static const bool kMeshShaders = true;
+	//scenes with at least this many instances are culled through a bvh instead of one by one
+	static const size_t kBvhInstances = 65536;
+	//draw every mesh and material in one indirect call, where the device allows it
+	static const bool kBatchedDraws = true;
+	//cull, pick levels for and draw instances from the GPU, where batched draws are available
+	static const bool kInstanceCulling = true;
+	//for scenes of at least this many instances, below it the CPU path and meshlet culling run
+	static const size_t kGpuCullInstances = 4096;
+	//draw GPU culled instances visible last frame first, then those the depth they left does not hide
+	static const bool kOcclusionCulling = true;
+	//merge instances flagged INSTANCE_STATIC into pre-transformed clusters, drawn a few indirect calls per frame
+	static const bool kStaticBatching = true;
+	//drop CPU culled instances hidden behind those flagged INSTANCE_OCCLUDER, drawn into a small buffer on the CPU
+	static const bool kOcclusionBuffer = true;
+	//pages of a streamed scene within this distance of the camera are kept resident, past the far plane
+	static constexpr float kStreamingRadius = 12.0f;
 	std::atomic<bool> frameIndexAvailable[kBufferSize];
 
 private:
@@ -58,6 +115,59 @@ private:
 	vk::RenderPass renderpass;
 	vk::Pipeline pipeline;
 
+	//meshlet culling, decided when the device is made
+	bool meshletCulling;
+	bool meshShading;
+	uint32_t maxDrawIndirectCount;
+	vkMesh::MeshletCuller* culler;
+	vk::Pipeline meshletPipeline;
+
+	//batched draws, decided when the device is made
+	bool batchedDraws;
+	vkMesh::DrawBatcher* drawBatcher;
+	vk::PipelineLayout batchedPipelineLayout;
+	vk::Pipeline batchedPipeline;
+
+	//instance culling on the GPU, decided when the device is made
+	bool instanceCulling;
+	bool indirectCount;
+	vkMesh::InstanceCuller* instanceCuller;
+	vk::PipelineLayout indirectPipelineLayout;
+	vk::Pipeline indirectPipeline;
+	CullStats gpuCullStats;
+	bool gpuCulledLast;
+	//the depth each image's early instances leave, reduced for the late instances to be tested against
+	vkMesh::DepthPyramid* depthPyramid;
+	//the renderpass's halves, for frames drawn around the occlusion test
+	vk::RenderPass earlyRenderpass;
+	vk::RenderPass lateRenderpass;
+
+	//static instances merged into clusters, drawn through their own pipeline after the rest
+	StaticBatcher* staticBatcher;
+	vkMesh::StaticGeometry* staticGeometry;
+	vk::Pipeline staticPipeline;
+
+	//state commands of the last recording, read by the app's title
+	vkUtil::RecorderStats recorderStats;
+
+	//instances outside the view are left out of the model buffer
+	FrustumCuller* frustumCuller;
+	//then those the occluders hide, when any are in view
+	OcclusionBuffer* occlusionBuffer;
+	std::vector<Occluder> occluders;
+	//large scenes are culled through a tree, kept fitted to the instances
+	InstanceBvh* instanceBvh;
+	std::vector<float> bvhRadii;
+	//the nearest depth of each group's instances in each page the group covers,
+	//measured again only for stale pages while the camera and the layout hold
+	std::vector<uint32_t> coverageSegments;
+	std::vector<float> coverageDepths;
+	std::vector<float> coverageNearest;
+	glm::mat4 coverageViewProjection;
+	uint64_t coverageLayoutVersion;
+	//render threads take turns laying out their frames
+	std::mutex layoutMutex;
+
 	//Command-related variables
 	vk::CommandPool commandPool;
 	vk::CommandBuffer mainCommandBuffer;
@@ -74,8 +184,15 @@ private:
 	vk::DescriptorPool meshDescriptorPool; //Descriptors bound on a "per mesh" basis
 
 	//asset pointers
-	VertexMenagerie* meshes;
-	std::unordered_map<meshTypes,vkImage::Texture*> materials;
+	vkUtil::UploadQueue* uploads;
+	vkAsset::AssetManager* assets;
+	VertexMenagerie* meshes; //owned by assets
+	std::vector<Renderable> renderables;
+
+	//startup timing
+	std::chrono::steady_clock::time_point startTime;
+	bool firstFrameReported;
+	bool assetsReadyReported;
 
     //instance setup
 	void make_instance();
@@ -88,6 +205,11 @@ private:
 	//pipline setup
 	void make_descriptor_set_layouts();
 	void make_pipeline();
+	void make_meshlet_pipelines();
+	void make_batched_pipelines();
+	void make_instance_pipelines();
+	void make_depth_pyramids();
+	void make_static_pipeline();
 
 	//final setup steps
 	void finalize_setup();
@@ -95,11 +217,43 @@ private:
 	void make_frame_resources();
 
 	void make_assets();
-	void prepare_scene(vk::CommandBuffer);
+	void prepare_scene(vkUtil::CommandRecorder& recorder);
 	void prepare_frame(uint32_t imageIndex, Scene* scene);
+	bool layout_current(vkUtil::SwapChainFrame& frame, Scene* scene, const std::vector<uint32_t>& stalePages);
+	void layout_instances(vkUtil::SwapChainFrame& frame, Scene* scene, const std::vector<uint32_t>& stalePages);
+	void render_occluders(Scene* scene, const Frustum& frustum, const glm::mat4& viewProjection);
+	void update_bvh(Scene* scene);
+	uint32_t get_change_copies();
+	uint32_t get_frame_copy(uint32_t imageIndex);
+	void update_static_batches(Scene* scene);
+	bool culls_on_gpu(Scene* scene);
+	void prepare_instance_culling(uint32_t imageIndex, Scene* scene, const std::vector<uint32_t>& stalePages);
+	vkUtil::UBO make_camera_data();
+	void stream_textures(Scene* scene);
+	void measure_coverage(Scene* scene, const glm::mat4& viewProjection);
+	float nearest_depth(const InstanceStore& instances, uint32_t first, uint32_t end, const glm::mat4& viewProjection);
+	uint32_t select_lod(const MeshDrawRange& mesh, const glm::vec3& position, const vkUtil::UBO& cameraData);
+
+	void record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex, int frameIndex, Scene* scene);
+	void set_viewport_state(vkUtil::CommandRecorder& recorder);
+	vkUtil::CommandKey make_scene_commands_key(uint32_t imageIndex, uint32_t drawCount);
+	void record_scene_commands(uint32_t imageIndex, uint32_t drawCount);
+	void record_inline_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex, Scene* scene, bool culled,
+		const std::vector<uint32_t>& regionStarts, const std::vector<vkMesh::MeshletCullJob>& meshletJobs);
+	std::vector<DrawItem> make_draw_list(uint32_t imageIndex, Scene* scene, const std::vector<vkMesh::BatchedDraw>& groupDraws,
+		std::vector<vk::DrawIndexedIndirectCommand>& commands, std::vector<uint32_t>& commandGroups);
+	void render_objects(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, Scene* scene);
+	std::vector<vkMesh::MeshletCullJob> make_meshlet_jobs(uint32_t imageIndex, Scene* scene, std::vector<uint32_t>& regionStarts);
+	void render_culled_objects(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, Scene* scene, const std::vector<uint32_t>& regionStarts);
+	void render_meshlets(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, Scene* scene, const std::vector<vkMesh::MeshletCullJob>& jobs);
+	uint32_t prepare_gpu_culled_instances(uint32_t imageIndex, Scene* scene);
+	void render_gpu_culled_instances(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, uint32_t drawCapacity, bool late);
+	void gather_group_draws(Scene* scene, std::vector<vkMesh::BatchedDraw>& groupDraws, std::vector<vk::DescriptorImageInfo>& materials);
+	uint32_t prepare_batched_objects(uint32_t imageIndex, Scene* scene);
+	void render_batched_objects(vkUtil::CommandRecorder& recorder, uint32_t imageIndex, uint32_t drawCount);
+	void render_static_geometry(vkUtil::CommandRecorder& recorder, uint32_t imageIndex);
 
-	void record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex, Scene* scene);
-	void render_objects(vk::CommandBuffer commandBuffer, meshTypes objectType, uint32_t& startInstance, uint32_t instanceCount);
+	void report_startup_time();
 
 	void cleanup_swapchain();
 };
\ No newline at end of file
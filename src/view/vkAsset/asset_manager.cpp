@@ -0,0 +1,317 @@
+#include "asset_manager.h"
+#include "../../control/thread_pool.h"
+#include "../../control/logging.h"
+#include "../../model/mesh_file.h"
+#include "../../model/mesh_optimizer.h"
+#include "../../model/obj_loader.h"
+
+vkAsset::AssetManager::AssetManager(AssetManagerInputChunk input) {
+
+	uploads = input.uploads;
+	meshesFinalized = false;
+	keepMeshSources = input.keepMeshSources;
+	streamer = new vkImage::TextureStreamer(input.textureBudget, input.framesInFlight);
+	VertexMenagerieInputChunk menagerieInfo;
+	menagerieInfo.logicalDevice = input.logicalDevice;
+	menagerieInfo.physicalDevice = input.physicalDevice;
+	menagerieInfo.compact = input.compactVertices;
+	meshes = new VertexMenagerie(menagerieInfo);
+
+	textureInfo.logicalDevice = input.logicalDevice;
+	textureInfo.physicalDevice = input.physicalDevice;
+	textureInfo.commandBuffer = input.commandBuffer;
+	textureInfo.queue = input.queue;
+	textureInfo.layout = input.layout;
+	textureInfo.descriptorPool = input.descriptorPool;
+	textureInfo.filename = "placeholder";
+
+	//2x2 white, so vertex colors show through until the real texture arrives
+	const stbi_uc white[2 * 2 * 4] = {
+		255, 255, 255, 255,   255, 255, 255, 255,
+		255, 255, 255, 255,   255, 255, 255, 255
+	};
+	placeholder = new vkImage::Texture(textureInfo, white, 2, 2);
+}
+
+vkAsset::TextureHandle vkAsset::AssetManager::load_texture(const char* filename) {
+
+	vkImage::TextureInputChunk info = textureInfo;
+	info.filename = filename;
+
+	TextureRecord* record = new TextureRecord();
+	record->texture = new vkImage::Texture(info, uploads);
+	record->state.store(assetStates::PENDING);
+
+	TextureHandle handle;
+	handle.id = textures.add(record);
+
+	vkJob::ThreadPool::get_pool()->submit([this, record]() {
+
+		record->state.store(assetStates::LOADING);
+
+		//decoding is the slow part and runs unlocked
+		if (!record->texture->load()) {
+			record->state.store(assetStates::FAILED);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(stagingMutex);
+			record->texture->stage();
+		}
+		streamer->add(record->texture);
+	});
+
+	return handle;
+}
+
+vkAsset::MeshHandle vkAsset::AssetManager::load_mesh(std::vector<float> vertexData, std::vector<uint32_t> indexData) {
+
+	MeshHandle handle;
+	MeshRecord record;
+	record.failed = false;
+
+	std::pair<vkMesh::VertexCacheStats, vkMesh::VertexCacheStats> stats = vkMesh::optimize_mesh(vertexData, 7, 2, indexData);
+	try {
+		record.range = meshes->consume(vertexData, indexData);
+		if (keepMeshSources) {
+			record.source = std::make_shared<MeshSource>();
+			record.source->vertices = std::move(vertexData);
+			record.source->indices = std::move(indexData);
+		}
+	}
+	catch (std::runtime_error err) {
+		vkLogging::Logger::get_logger()->print(err.what());
+		record.range = 0;
+		record.failed = true;
+	}
+	handle.id = meshRecords.add(record);
+
+	std::stringstream message;
+	message << "Mesh " << record.range << " ACMR " << stats.first.acmr << " -> " << stats.second.acmr
+		<< ", ATVR " << stats.first.atvr << " -> " << stats.second.atvr;
+	vkLogging::Logger::get_logger()->print(message.str());
+
+	return handle;
+}
+
+vkAsset::MeshHandle vkAsset::AssetManager::load_mesh_file(const char* filename) {
+
+	MeshHandle handle;
+	MeshRecord record;
+
+	try {
+		vkMesh::MappedMesh mesh(filename);
+		if (mesh.stream_stride(0) != 7 * sizeof(float)) {
+			throw std::runtime_error("mesh file does not match the vertex layout\n");
+		}
+		const float* vertices = static_cast<const float*>(mesh.stream(0));
+		size_t vertexFloats = 7 * static_cast<size_t>(mesh.header->vertexCount);
+		const uint32_t* indices = mesh.indices();
+		for (uint32_t i = 0; i < mesh.header->indexCount; ++i) {
+			if (indices[i] >= mesh.header->vertexCount) {
+				throw std::runtime_error("mesh file index out of range\n");
+			}
+		}
+		record.range = meshes->consume(vertices, vertexFloats, mesh.indices(), mesh.header->indexCount);
+		record.failed = false;
+		if (keepMeshSources) {
+			record.source = std::make_shared<MeshSource>();
+			record.source->vertices.assign(vertices, vertices + vertexFloats);
+			record.source->indices.assign(mesh.indices(), mesh.indices() + mesh.header->indexCount);
+		}
+	}
+	catch (std::runtime_error err) {
+		vkLogging::Logger::get_logger()->print(err.what());
+		record.range = 0;
+		record.failed = true;
+	}
+
+	handle.id = meshRecords.add(record);
+	return handle;
+}
+
+vkAsset::MeshHandle vkAsset::AssetManager::load_model(const char* filename) {
+
+	try {
+		vkMesh::Model model(filename);
+		return load_mesh(model.get_menagerie_vertices(), std::move(model.indices));
+	}
+	catch (std::runtime_error err) {
+		vkLogging::Logger::get_logger()->print(err.what());
+	}
+
+	MeshHandle handle;
+	handle.id = meshRecords.add(MeshRecord{ 0, true });
+	return handle;
+}
+
+vkAsset::MaterialHandle vkAsset::AssetManager::create_material(TextureHandle albedo) {
+
+	MaterialHandle handle;
+	handle.id = materials.add(MaterialRecord{ albedo });
+	return handle;
+}
+
+std::vector<Renderable> vkAsset::AssetManager::load_manifest(const char* filename) {
+
+	std::vector<Renderable> renderables;
+
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		vkLogging::Logger::get_logger()->print(std::string("No asset manifest at ") + filename);
+		return renderables;
+	}
+
+	std::string line;
+	while (std::getline(file, line)) {
+
+		std::stringstream words(line);
+		std::string meshFile, textureFile;
+		if (!(words >> meshFile >> textureFile) || meshFile[0] == '#') {
+			continue;
+		}
+
+		auto texture = texturesByFile.find(textureFile);
+		if (texture == texturesByFile.end()) {
+			texture = texturesByFile.insert(std::make_pair(textureFile, load_texture(textureFile.c_str()))).first;
+		}
+
+		bool binary = meshFile.size() > 5 && meshFile.compare(meshFile.size() - 5, 5, ".mesh") == 0;
+		MeshHandle mesh = binary ? load_mesh_file(meshFile.c_str()) : load_model(meshFile.c_str());
+
+		Renderable renderable;
+		renderable.mesh = mesh.id;
+		renderable.material = create_material(texture->second).id;
+		renderables.push_back(renderable);
+	}
+
+	return renderables;
+}
+
+void vkAsset::AssetManager::finalize_meshes() {
+
+	//the pool exists, only the meshes added since need uploading
+	if (meshesFinalized) {
+		meshes->flush(uploads);
+		return;
+	}
+
+	meshes->finalize(uploads);
+
+	meshesFinalized = true;
+}
+
+void vkAsset::AssetManager::free_mesh(MeshHandle handle) {
+
+	MeshRecord* record = meshRecords.get(handle.id);
+	if (!record) {
+		return;
+	}
+	if (!record->failed) {
+		meshes->remove(record->range, uploads);
+	}
+	meshRecords.remove(handle.id);
+}
+
+vkAsset::assetStates vkAsset::AssetManager::get_state(TextureHandle handle) {
+
+	TextureRecord** found = textures.get(handle.id);
+	if (!found) {
+		return assetStates::FAILED;
+	}
+	TextureRecord* record = *found;
+	if (record->state.load() == assetStates::LOADING && record->texture->is_resident()) {
+		record->state.store(assetStates::RESIDENT);
+	}
+	return record->state.load();
+}
+
+vkAsset::assetStates vkAsset::AssetManager::get_state(MeshHandle handle) {
+
+	MeshRecord* record = meshRecords.get(handle.id);
+	if (!record || record->failed) {
+		return assetStates::FAILED;
+	}
+	if (meshes->is_resident(record->range)) {
+		return assetStates::RESIDENT;
+	}
+	return meshesFinalized ? assetStates::LOADING : assetStates::PENDING;
+}
+
+vkImage::Texture* vkAsset::AssetManager::get_texture(TextureHandle handle) {
+
+	if (get_state(handle) == assetStates::RESIDENT) {
+		return (*textures.get(handle.id))->texture;
+	}
+	return placeholder;
+}
+
+vkImage::Texture* vkAsset::AssetManager::get_material(MaterialHandle handle) {
+
+	MaterialRecord* record = materials.get(handle.id);
+	return record ? get_texture(record->albedo) : placeholder;
+}
+
+const MeshDrawRange* vkAsset::AssetManager::get_mesh(MeshHandle handle) {
+
+	MeshRecord* record = meshRecords.get(handle.id);
+	if (!record || record->failed || !meshes->is_resident(record->range)) {
+		return nullptr;
+	}
+	return &meshes->ranges[record->range];
+}
+
+const MeshSource* vkAsset::AssetManager::get_mesh_source(MeshHandle handle) {
+
+	MeshRecord* record = meshRecords.get(handle.id);
+	return record ? record->source.get() : nullptr;
+}
+
+bool vkAsset::AssetManager::all_resident() {
+
+	for (uint32_t handle : textures.handles) {
+		assetStates state = get_state(TextureHandle{ handle });
+		if (state != assetStates::RESIDENT && state != assetStates::FAILED) {
+			return false;
+		}
+	}
+
+	for (MeshRecord& record : meshRecords.records) {
+		if (!record.failed && !meshes->is_resident(record.range)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void vkAsset::AssetManager::request_resolution(MaterialHandle handle, float screenPixels) {
+
+	MaterialRecord* record = materials.get(handle.id);
+	if (record && get_state(record->albedo) == assetStates::RESIDENT) {
+		streamer->request((*textures.get(record->albedo.id))->texture, screenPixels);
+	}
+}
+
+void vkAsset::AssetManager::update_streaming() {
+	streamer->update();
+}
+
+size_t vkAsset::AssetManager::get_texture_memory() {
+	return streamer->get_resident_bytes();
+}
+
+vkAsset::AssetManager::~AssetManager() {
+
+	//workers may still be decoding
+	vkJob::ThreadPool::get_pool()->wait();
+
+	for (TextureRecord* record : textures.records) {
+		delete record->texture;
+		delete record;
+	}
+	delete placeholder;
+	delete streamer;
+	delete meshes;
+}
@@ -0,0 +1,215 @@
+#pragma once
+#include "../../config.h"
+#include "../vkImage/image.h"
+#include "../vkImage/texture_streamer.h"
+#include "../vkUtil/upload.h"
+#include "../../model/vertex_menagerie.h"
+#include "../../model/static_batcher.h"
+#include "registry.h"
+
+namespace vkAsset {
+
+	/**
+		Lifetime of an asset: the handle is handed out PENDING, a worker
+		moves it to LOADING while decoding, and it is RESIDENT once its
+		upload has been recorded into a frame.
+	*/
+	enum class assetStates {
+		PENDING,
+		LOADING,
+		RESIDENT,
+		FAILED
+	};
+
+	/**
+		Refers to a texture owned by the asset manager
+	*/
+	struct TextureHandle {
+		uint32_t id;
+	};
+
+	/**
+		Refers to a mesh owned by the asset manager
+	*/
+	struct MeshHandle {
+		uint32_t id;
+	};
+
+	/**
+		Refers to a material owned by the asset manager
+	*/
+	struct MaterialHandle {
+		uint32_t id;
+	};
+
+	/**
+		For making the asset manager
+	*/
+	struct AssetManagerInputChunk {
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		vk::CommandBuffer commandBuffer;
+		vk::Queue queue;
+		vk::DescriptorSetLayout layout;
+		vk::DescriptorPool descriptorPool;
+		vkUtil::UploadQueue* uploads;
+		size_t textureBudget;
+		int framesInFlight;
+		bool compactVertices;
+		//keep each mesh's vertices and indices on the CPU, for static batching and occluders
+		bool keepMeshSources;
+	};
+
+	/**
+		Hands out asset handles immediately and loads the assets in the background.
+		Handles must be requested from the thread which owns the engine.
+	*/
+	class AssetManager {
+	public:
+
+		/**
+			Make the asset manager along with its placeholder texture,
+			the only blocking upload it performs.
+		*/
+		AssetManager(AssetManagerInputChunk input);
+		~AssetManager();
+
+		/**
+			Start loading a texture on a worker thread.
+			\param filename path to the image file
+			\returns a handle which is usable straight away
+		*/
+		TextureHandle load_texture(const char* filename);
+
+		/**
+			Optimize a mesh for the vertex cache, overdraw and fetch order,
+			then add it to the geometry pool.
+			It becomes resident once the finalize_meshes after it has been recorded.
+			The buffers are reordered in place, move them in to avoid copying them.
+			\returns a handle which is FAILED if the pool cannot hold the mesh
+		*/
+		MeshHandle load_mesh(std::vector<float> vertexData, std::vector<uint32_t> indexData);
+
+		/**
+			Add a mesh from a binary mesh file, copied straight out of the mapping.
+			The file is expected to have been optimized when it was written.
+			\param filename a file written by vkMesh::write_mesh_file
+			\returns a handle which is FAILED if the file could not be read
+		*/
+		MeshHandle load_mesh_file(const char* filename);
+
+		/**
+			Add a mesh from an OBJ file, through load_mesh.
+			\returns a handle which is FAILED if the file could not be read
+		*/
+		MeshHandle load_model(const char* filename);
+
+		/**
+			Make a material drawing with the given texture.
+		*/
+		MaterialHandle create_material(TextureHandle albedo);
+
+		/**
+			Register every mesh and material listed in a manifest. Each line holds
+			a mesh file (.mesh for the binary format, otherwise OBJ) and a texture file,
+			lines starting with # are skipped. Textures are shared between lines.
+			\param filename the manifest
+			\returns one renderable per line, empty if the manifest could not be read
+		*/
+		std::vector<Renderable> load_manifest(const char* filename);
+
+		/**
+			Queue the upload of every mesh loaded since the last call,
+			the first call makes the geometry pool.
+		*/
+		void finalize_meshes();
+
+		/**
+			Take a mesh out of the geometry pool, the handle becomes stale.
+			Its space is reused once the frames drawing it have finished.
+		*/
+		void free_mesh(MeshHandle handle);
+
+		assetStates get_state(TextureHandle handle);
+		assetStates get_state(MeshHandle handle);
+
+		/**
+			\returns the texture if it is resident, otherwise the placeholder
+		*/
+		vkImage::Texture* get_texture(TextureHandle handle);
+
+		/**
+			\returns the material's texture if it is resident, otherwise the placeholder
+		*/
+		vkImage::Texture* get_material(MaterialHandle handle);
+
+		/**
+			\returns where the mesh sits in the shared buffers, nullptr until it is resident
+		*/
+		const MeshDrawRange* get_mesh(MeshHandle handle);
+
+		/**
+			\returns the mesh as it was loaded, nullptr unless sources are kept
+		*/
+		const MeshSource* get_mesh_source(MeshHandle handle);
+
+		/**
+			\returns whether every requested asset is resident (or failed)
+		*/
+		bool all_resident();
+
+		/**
+			Report how large a surface using the material appears on screen this frame.
+			\param handle the material
+			\param screenPixels projected size of the surface, in pixels
+		*/
+		void request_resolution(MaterialHandle handle, float screenPixels);
+
+		/**
+			Move texture mips in or out of device memory to match this frame's requests.
+		*/
+		void update_streaming();
+
+		/**
+			\returns the device memory used by streamed textures
+		*/
+		size_t get_texture_memory();
+
+		VertexMenagerie* meshes;
+
+	private:
+
+		struct TextureRecord {
+			vkImage::Texture* texture;
+			std::atomic<assetStates> state;
+		};
+
+		struct MeshRecord {
+			//into meshes->ranges
+			uint32_t range;
+			bool failed;
+			//set when sources are kept
+			std::shared_ptr<MeshSource> source;
+		};
+
+		struct MaterialRecord {
+			TextureHandle albedo;
+		};
+
+		vkImage::TextureInputChunk textureInfo;
+		vkUtil::UploadQueue* uploads;
+		vkImage::Texture* placeholder;
+		vkImage::TextureStreamer* streamer;
+
+		Registry<TextureRecord*> textures;
+		Registry<MeshRecord> meshRecords;
+		Registry<MaterialRecord> materials;
+		//manifests refer to textures by file, so each is loaded once
+		std::unordered_map<std::string, TextureHandle> texturesByFile;
+		bool meshesFinalized;
+		bool keepMeshSources;
+
+		//descriptor set allocation from the shared pool must be externally synchronized
+		std::mutex stagingMutex;
+	};
+}
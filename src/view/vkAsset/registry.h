@@ -0,0 +1,116 @@
+#pragma once
+#include "../../config.h"
+
+namespace vkAsset {
+
+	/**
+		Handles pack a slot in the low bits and the slot's generation in the
+		high bits, so a handle to a removed record stops resolving instead of
+		aliasing whatever reuses its slot.
+	*/
+	const uint32_t kHandleSlotBits = 20;
+	const uint32_t kHandleSlotMask = (1u << kHandleSlotBits) - 1;
+	const uint32_t kHandleGenerationMask = (1u << (32 - kHandleSlotBits)) - 1;
+	const uint32_t kInvalidHandle = 0xFFFFFFFF;
+
+	/**
+		Owns records in one contiguous array, looked up through generational handles.
+		Resolving a handle is two array reads. Removal moves the last record into
+		the hole, so records stay dense for iteration but their order is not stable.
+	*/
+	template<class Record>
+	class Registry {
+	public:
+
+		/**
+			\returns a handle to the new record
+		*/
+		uint32_t add(Record record) {
+
+			uint32_t slot;
+			if (freeSlots.empty()) {
+				slot = static_cast<uint32_t>(slots.size());
+				if (slot > kHandleSlotMask) {
+					throw std::runtime_error("registry is full\n");
+				}
+				slots.push_back({ 0, 0 });
+			}
+			else {
+				slot = freeSlots.back();
+				freeSlots.pop_back();
+			}
+
+			slots[slot].dense = static_cast<uint32_t>(records.size());
+			uint32_t handle = (slots[slot].generation << kHandleSlotBits) | slot;
+			records.push_back(std::move(record));
+			handles.push_back(handle);
+			return handle;
+		}
+
+		/**
+			\returns whether the handle still refers to a record
+		*/
+		bool contains(uint32_t handle) const {
+			uint32_t slot = handle & kHandleSlotMask;
+			return handle != kInvalidHandle && slot < slots.size()
+				&& slots[slot].generation == (handle >> kHandleSlotBits)
+				&& slots[slot].dense != kInvalidHandle;
+		}
+
+		/**
+			\returns the record, or nullptr if the handle is stale
+		*/
+		Record* get(uint32_t handle) {
+			return contains(handle) ? &records[slots[handle & kHandleSlotMask].dense] : nullptr;
+		}
+
+		const Record* get(uint32_t handle) const {
+			return contains(handle) ? &records[slots[handle & kHandleSlotMask].dense] : nullptr;
+		}
+
+		/**
+			Remove a record, the handle and any copies of it become stale.
+			\returns whether there was a record to remove
+		*/
+		bool remove(uint32_t handle) {
+
+			if (!contains(handle)) {
+				return false;
+			}
+
+			uint32_t slot = handle & kHandleSlotMask;
+			uint32_t dense = slots[slot].dense;
+			uint32_t last = static_cast<uint32_t>(records.size()) - 1;
+			if (dense != last) {
+				records[dense] = std::move(records[last]);
+				handles[dense] = handles[last];
+				slots[handles[dense] & kHandleSlotMask].dense = dense;
+			}
+			records.pop_back();
+			handles.pop_back();
+
+			slots[slot].dense = kInvalidHandle;
+			slots[slot].generation = (slots[slot].generation + 1) & kHandleGenerationMask;
+			freeSlots.push_back(slot);
+			return true;
+		}
+
+		size_t size() const {
+			return records.size();
+		}
+
+		//dense records, handles[i] refers to records[i]
+		std::vector<Record> records;
+		std::vector<uint32_t> handles;
+
+	private:
+
+		struct Slot {
+			uint32_t dense;
+			uint32_t generation;
+		};
+
+		std::vector<Slot> slots;
+		std::vector<uint32_t> freeSlots;
+	};
+}
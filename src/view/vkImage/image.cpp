@@ -17,97 +17,326 @@ vkImage::Texture::Texture(TextureInputChunk input) {
 	queue = input.queue;
 	layout = input.layout;
 	descriptorPool = input.descriptorPool;
+	uploads = nullptr;
+	resident.store(false);
+	streaming.store(false);
+	baseMip.store(0);
+	activeSet.store(0);
 
 	load();
 
-	ImageInputChunk imageInput;
-	imageInput.logicalDevice = logicalDevice;
-	imageInput.physicalDevice = physicalDevice;
-	imageInput.width = width;
-	imageInput.height = height;
-    imageInput.format = vk::Format::eR8G8B8A8Unorm;
-	imageInput.tiling = vk::ImageTiling::eOptimal;
-	imageInput.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
-	imageInput.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
-	image = make_image(imageInput);
-	imageMemory = make_image_memory(imageInput, image);
+	finalize_blocking();
+}
 
-	populate();
+vkImage::Texture::Texture(TextureInputChunk input, const stbi_uc* source, int width, int height) {
 
-	free(pixels);
+	logicalDevice = input.logicalDevice;
+	physicalDevice = input.physicalDevice;
+	filename = input.filename;
+	commandBuffer = input.commandBuffer;
+	queue = input.queue;
+	layout = input.layout;
+	descriptorPool = input.descriptorPool;
+	uploads = nullptr;
+	resident.store(false);
+	streaming.store(false);
+	baseMip.store(0);
+	activeSet.store(0);
+
+	this->width = width;
+	this->height = height;
+	channels = 4;
+	//stbi frees with free(), so match its allocator
+	pixels = static_cast<stbi_uc*>(malloc(width * height * 4));
+	memcpy(pixels, source, width * height * 4);
+	generate_mips();
+
+	finalize_blocking();
+}
+
+vkImage::Texture::Texture(TextureInputChunk input, vkUtil::UploadQueue* uploads) {
+
+	logicalDevice = input.logicalDevice;
+	physicalDevice = input.physicalDevice;
+	filename = input.filename;
+	commandBuffer = input.commandBuffer;
+	queue = input.queue;
+	layout = input.layout;
+	descriptorPool = input.descriptorPool;
+	this->uploads = uploads;
+	resident.store(false);
+	streaming.store(false);
+	baseMip.store(0);
+	activeSet.store(0);
+	pixels = nullptr;
+}
 
-	make_view(imageInput.format);
+void vkImage::Texture::finalize_blocking() {
+
+	make_image_resources(0);
+
+	populate();
+
+	make_view(vk::Format::eR8G8B8A8Unorm, get_mip_count());
 
 	make_sampler();
 
 	make_descriptor_set();
+
+	resident.store(true);
 }
 
 vkImage::Texture::~Texture() {
 	
+	if (pixels) {
+		free(pixels);
+	}
+
+	//a streamed texture may be destroyed before it was ever staged
+	if (!image) {
+		return;
+	}
+
 	logicalDevice.freeMemory(imageMemory);
 	logicalDevice.destroyImage(image);
 	logicalDevice.destroyImageView(imageView);
 	logicalDevice.destroySampler(sampler);
 }
 
-void vkImage::Texture::load() {
+bool vkImage::Texture::load() {
 
 	pixels = stbi_load(filename, &width, &height, &channels, STBI_rgb_alpha);
 	if (!pixels) {
 		vkLogging::Logger::get_logger()->print_list({ "Unable to load: ", filename });
+		return false;
 	}
     else{
         vkLogging::Logger::get_logger()->print_list({ "loaded: ", filename });
     }
+
+	generate_mips();
+	return true;
 }
 
-void vkImage::Texture::populate() {
+void vkImage::Texture::generate_mips() {
+
+	mipOffsets.clear();
+	mipWidths.clear();
+	mipHeights.clear();
+
+	//lay out every level back to back, most detailed first
+	size_t total = 0;
+	int levelWidth = width;
+	int levelHeight = height;
+	while (true) {
+		mipOffsets.push_back(total);
+		mipWidths.push_back(levelWidth);
+		mipHeights.push_back(levelHeight);
+		total += static_cast<size_t>(levelWidth) * levelHeight * 4;
+		if (levelWidth == 1 && levelHeight == 1) {
+			break;
+		}
+		levelWidth = std::max(1, levelWidth / 2);
+		levelHeight = std::max(1, levelHeight / 2);
+	}
+
+	mipChain.resize(total);
+	memcpy(mipChain.data(), pixels, static_cast<size_t>(width) * height * 4);
+	free(pixels);
+	pixels = nullptr;
+
+	for (size_t level = 1; level < mipOffsets.size(); ++level) {
+
+		const stbi_uc* src = mipChain.data() + mipOffsets[level - 1];
+		stbi_uc* dst = mipChain.data() + mipOffsets[level];
+		int srcWidth = mipWidths[level - 1];
+		int srcHeight = mipHeights[level - 1];
+
+		for (int y = 0; y < mipHeights[level]; ++y) {
+			int y0 = std::min(2 * y, srcHeight - 1);
+			int y1 = std::min(2 * y + 1, srcHeight - 1);
+			for (int x = 0; x < mipWidths[level]; ++x) {
+				int x0 = std::min(2 * x, srcWidth - 1);
+				int x1 = std::min(2 * x + 1, srcWidth - 1);
+				for (int c = 0; c < 4; ++c) {
+					int sum = src[(y0 * srcWidth + x0) * 4 + c] + src[(y0 * srcWidth + x1) * 4 + c]
+						+ src[(y1 * srcWidth + x0) * 4 + c] + src[(y1 * srcWidth + x1) * 4 + c];
+					dst[(y * mipWidths[level] + x) * 4 + c] = static_cast<stbi_uc>((sum + 2) / 4);
+				}
+			}
+		}
+	}
+}
+
+void vkImage::Texture::make_image_resources(uint32_t firstMip) {
+
+	ImageInputChunk imageInput;
+	imageInput.logicalDevice = logicalDevice;
+	imageInput.physicalDevice = physicalDevice;
+	imageInput.width = mipWidths[firstMip];
+	imageInput.height = mipHeights[firstMip];
+	imageInput.mipLevels = get_mip_count() - firstMip;
+    imageInput.format = vk::Format::eR8G8B8A8Unorm;
+	imageInput.tiling = vk::ImageTiling::eOptimal;
+	imageInput.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+	imageInput.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+	image = make_image(imageInput);
+	imageMemory = make_image_memory(imageInput, image);
+}
+
+Buffer vkImage::Texture::make_staging_buffer(uint32_t firstMip) {
 
-	//First create a CPU-visible buffer...
 	BufferInputChunk input;
 	input.logicalDevice = logicalDevice;
 	input.physicalDevice = physicalDevice;
 	input.memoryProperties = vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible;
 	input.usage = vk::BufferUsageFlagBits::eTransferSrc;
-	input.size = width * height * 4;
+	input.size = get_bytes_from(firstMip);
 
 	Buffer stagingBuffer = vkUtil::createBuffer(input);
 
-	//...then fill it,
 	void* writeLocation = logicalDevice.mapMemory(stagingBuffer.bufferMemory, 0, input.size);
-	memcpy(writeLocation, pixels, input.size);
+	memcpy(writeLocation, mipChain.data() + mipOffsets[firstMip], input.size);
 	logicalDevice.unmapMemory(stagingBuffer.bufferMemory);
 
-	//then transfer it to image memory
+	return stagingBuffer;
+}
+
+void vkImage::Texture::record_upload(vk::CommandBuffer commandBuffer, vk::Buffer stagingBuffer, vk::Image target, uint32_t firstMip) {
+
+	uint32_t levels = get_mip_count() - firstMip;
+
 	ImageLayoutTransitionJob transitionJob;
 	transitionJob.commandBuffer = commandBuffer;
-	transitionJob.queue = queue;
-	transitionJob.image = image;
+	transitionJob.image = target;
+	transitionJob.mipLevels = levels;
 	transitionJob.oldLayout = vk::ImageLayout::eUndefined;
 	transitionJob.newLayout = vk::ImageLayout::eTransferDstOptimal;
-	transition_image_layout(transitionJob);
+	record_image_layout_transition(transitionJob);
 
 	BufferImageCopyJob copyJob;
 	copyJob.commandBuffer = commandBuffer;
-	copyJob.queue = queue;
-	copyJob.srcBuffer = stagingBuffer.buffer;
-	copyJob.dstImage = image;
-	copyJob.width = width;
-	copyJob.height = height;
-	copy_buffer_to_image(copyJob);
+	copyJob.srcBuffer = stagingBuffer;
+	copyJob.dstImage = target;
+	for (uint32_t level = 0; level < levels; ++level) {
+		copyJob.bufferOffset = mipOffsets[firstMip + level] - mipOffsets[firstMip];
+		copyJob.mipLevel = level;
+		copyJob.width = mipWidths[firstMip + level];
+		copyJob.height = mipHeights[firstMip + level];
+		record_copy_buffer_to_image(copyJob);
+	}
 
 	transitionJob.oldLayout = vk::ImageLayout::eTransferDstOptimal;
 	transitionJob.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-	transition_image_layout(transitionJob);
+	record_image_layout_transition(transitionJob);
+}
+
+void vkImage::Texture::populate() {
+
+	//First create a CPU-visible buffer and fill it,
+	Buffer stagingBuffer = make_staging_buffer(0);
+
+	//then transfer it to image memory in a single submission
+	vkUtil::startJob(commandBuffer);
+	record_upload(commandBuffer, stagingBuffer.buffer, image, 0);
+	vkUtil::endJob(commandBuffer, queue);
 
 	//Now the staging buffer can be destroyed
 	logicalDevice.freeMemory(stagingBuffer.bufferMemory);
 	logicalDevice.destroyBuffer(stagingBuffer.buffer);
 }
 
-void vkImage::Texture::make_view(vk::Format format /* format must be the same as created image */) {
-	imageView = make_image_view(logicalDevice, image, format,vk::ImageAspectFlagBits::eColor);
+void vkImage::Texture::stage() {
+
+	make_image_resources(0);
+
+	Buffer stagingBuffer = make_staging_buffer(0);
+
+	make_view(vk::Format::eR8G8B8A8Unorm, get_mip_count());
+
+	make_sampler();
+
+	make_descriptor_set();
+
+	//the copy rides along with the next frame, sampling is safe after its barrier
+	vkUtil::UploadJob job;
+	job.stagingBuffer = stagingBuffer;
+	vk::Image target = image;
+	job.record = [this, stagingBuffer, target](vk::CommandBuffer commandBuffer) {
+		record_upload(commandBuffer, stagingBuffer.buffer, target, 0);
+		resident.store(true);
+	};
+	uploads->push(job);
+}
+
+void vkImage::Texture::begin_stream() {
+	streaming.store(true);
+}
+
+void vkImage::Texture::stream(uint32_t newBaseMip) {
+
+	vk::Image oldImage = image;
+	vk::DeviceMemory oldMemory = imageMemory;
+	vk::ImageView oldView = imageView;
+
+	make_image_resources(newBaseMip);
+	Buffer stagingBuffer = make_staging_buffer(newBaseMip);
+	make_view(vk::Format::eR8G8B8A8Unorm, get_mip_count() - newBaseMip);
+
+	//frames in flight only read the active set, the other one is free to rewrite
+	int nextSet = 1 - activeSet.load();
+	write_descriptor_set(nextSet);
+
+	vkUtil::UploadJob job;
+	job.stagingBuffer = stagingBuffer;
+	vk::Image target = image;
+	vk::Device device = logicalDevice;
+	job.record = [this, stagingBuffer, target, newBaseMip, nextSet, oldImage, oldMemory, oldView, device](vk::CommandBuffer commandBuffer) {
+		record_upload(commandBuffer, stagingBuffer.buffer, target, newBaseMip);
+		activeSet.store(nextSet);
+		baseMip.store(newBaseMip);
+
+		//the previous image may still be sampled by frames already submitted
+		uploads->release_later([device, oldImage, oldMemory, oldView]() {
+			device.destroyImageView(oldView);
+			device.destroyImage(oldImage);
+			device.freeMemory(oldMemory);
+		});
+		streaming.store(false);
+	};
+	uploads->push(job);
+}
+
+bool vkImage::Texture::is_resident() {
+	return resident.load();
+}
+
+bool vkImage::Texture::is_streaming() {
+	return streaming.load();
+}
+
+uint32_t vkImage::Texture::get_mip_count() {
+	return static_cast<uint32_t>(mipOffsets.size());
+}
+
+uint32_t vkImage::Texture::get_base_mip() {
+	return baseMip.load();
+}
+
+int vkImage::Texture::get_width() {
+	return width;
+}
+
+int vkImage::Texture::get_height() {
+	return height;
+}
+
+size_t vkImage::Texture::get_bytes_from(uint32_t mip) {
+	return mipChain.size() - mipOffsets[mip];
+}
+
+void vkImage::Texture::make_view(vk::Format format /* format must be the same as created image */, uint32_t mipLevels) {
+	imageView = make_image_view(logicalDevice, image, format, vk::ImageAspectFlagBits::eColor, mipLevels);
 }
 
 void vkImage::Texture::make_sampler() {
@@ -153,7 +382,8 @@ void vkImage::Texture::make_sampler() {
 	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	//the resident mip count changes while streaming, so never clamp
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
 	try {
 		sampler = logicalDevice.createSampler(samplerInfo);
@@ -166,15 +396,23 @@ void vkImage::Texture::make_sampler() {
 
 void vkImage::Texture::make_descriptor_set() {
 
-	descriptorSet = vkInit::allocate_descriptor_set(logicalDevice, descriptorPool, layout);
+	descriptorSets[0] = vkInit::allocate_descriptor_set(logicalDevice, descriptorPool, layout);
+	descriptorSets[1] = vkInit::allocate_descriptor_set(logicalDevice, descriptorPool, layout);
+
+	write_descriptor_set(0);
+	activeSet.store(0);
+}
+
+void vkImage::Texture::write_descriptor_set(int index) {
 
 	vk::DescriptorImageInfo imageDescriptor;
 	imageDescriptor.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 	imageDescriptor.imageView = imageView;
 	imageDescriptor.sampler = sampler;
+	setViews[index] = imageView;
 
 	vk::WriteDescriptorSet descriptorWrite;
-	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstSet = descriptorSets[index];
 	descriptorWrite.dstBinding = 0;
 	descriptorWrite.dstArrayElement = 0;
 	descriptorWrite.descriptorType = vk::DescriptorType::eCombinedImageSampler;
@@ -184,8 +422,17 @@ void vkImage::Texture::make_descriptor_set() {
 	logicalDevice.updateDescriptorSets(descriptorWrite, nullptr);
 }
 
-void vkImage::Texture::use(vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout) {
-	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 1, descriptorSet, nullptr);
+vk::DescriptorSet vkImage::Texture::get_descriptor_set() {
+	return descriptorSets[activeSet.load()];
+}
+
+vk::DescriptorImageInfo vkImage::Texture::get_descriptor() {
+
+	vk::DescriptorImageInfo imageDescriptor;
+	imageDescriptor.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	imageDescriptor.imageView = setViews[activeSet.load()];
+	imageDescriptor.sampler = sampler;
+	return imageDescriptor;
 }
 
 vk::Image vkImage::make_image(ImageInputChunk input) {
@@ -214,7 +461,7 @@ vk::Image vkImage::make_image(ImageInputChunk input) {
 	imageInfo.flags = vk::ImageCreateFlagBits();
 	imageInfo.imageType = vk::ImageType::e2D;
 	imageInfo.extent = vk::Extent3D(input.width, input.height, 1);
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = input.mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = input.format;
 	imageInfo.tiling = input.tiling;
@@ -255,6 +502,13 @@ void vkImage::transition_image_layout(ImageLayoutTransitionJob transitionJob) {
 
 	vkUtil::startJob(transitionJob.commandBuffer);
 
+	record_image_layout_transition(transitionJob);
+
+	vkUtil::endJob(transitionJob.commandBuffer, transitionJob.queue);
+}
+
+void vkImage::record_image_layout_transition(ImageLayoutTransitionJob transitionJob) {
+
 	/*
 	typedef struct VkImageSubresourceRange {
 		VkImageAspectFlags    aspectMask;
@@ -267,7 +521,7 @@ void vkImage::transition_image_layout(ImageLayoutTransitionJob transitionJob) {
 	vk::ImageSubresourceRange access;
 	access.aspectMask = vk::ImageAspectFlagBits::eColor;
 	access.baseMipLevel = 0;
-	access.levelCount = 1;
+	access.levelCount = transitionJob.mipLevels;
 	access.baseArrayLayer = 0;
 	access.layerCount = 1;
 
@@ -314,14 +568,19 @@ void vkImage::transition_image_layout(ImageLayoutTransitionJob transitionJob) {
 	}
 	
 	transitionJob.commandBuffer.pipelineBarrier(sourceStage, destinationStage, vk::DependencyFlags(), nullptr, nullptr, barrier);
-
-	vkUtil::endJob(transitionJob.commandBuffer, transitionJob.queue);
 }
 
 void vkImage::copy_buffer_to_image(BufferImageCopyJob copyJob) {
 
 	vkUtil::startJob(copyJob.commandBuffer);
 
+	record_copy_buffer_to_image(copyJob);
+
+	vkUtil::endJob(copyJob.commandBuffer, copyJob.queue);
+}
+
+void vkImage::record_copy_buffer_to_image(BufferImageCopyJob copyJob) {
+
 	/*
 	typedef struct VkBufferImageCopy {
 		VkDeviceSize                bufferOffset;
@@ -333,13 +592,13 @@ void vkImage::copy_buffer_to_image(BufferImageCopyJob copyJob) {
 	} VkBufferImageCopy;
 	*/
 	vk::BufferImageCopy copy;
-	copy.bufferOffset = 0;
+	copy.bufferOffset = copyJob.bufferOffset;
 	copy.bufferRowLength = 0;
 	copy.bufferImageHeight = 0;
 
 	vk::ImageSubresourceLayers access;
 	access.aspectMask = vk::ImageAspectFlagBits::eColor;
-	access.mipLevel = 0;
+	access.mipLevel = copyJob.mipLevel;
 	access.baseArrayLayer = 0;
 	access.layerCount = 1;
 	copy.imageSubresource = access;
@@ -354,11 +613,18 @@ void vkImage::copy_buffer_to_image(BufferImageCopyJob copyJob) {
 	copyJob.commandBuffer.copyBufferToImage(
 		copyJob.srcBuffer, copyJob.dstImage, vk::ImageLayout::eTransferDstOptimal, copy
 	);
-
-	vkUtil::endJob(copyJob.commandBuffer, copyJob.queue);
 }
 
 vk::ImageView vkImage::make_image_view(vk::Device logicalDevice, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect) {
+	return make_image_view(logicalDevice, image, format, aspect, 1);
+}
+
+vk::ImageView vkImage::make_image_view(vk::Device logicalDevice, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect, uint32_t mipLevels) {
+	return make_image_view(logicalDevice, image, format, aspect, 0, mipLevels);
+}
+
+vk::ImageView vkImage::make_image_view(vk::Device logicalDevice, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect,
+	uint32_t baseMipLevel, uint32_t mipLevels) {
 
 	/*
 	* ImageViewCreateInfo( VULKAN_HPP_NAMESPACE::ImageViewCreateFlags flags_ = {},
@@ -378,8 +644,8 @@ vk::ImageView vkImage::make_image_view(vk::Device logicalDevice, vk::Image image
 	createInfo.components.b = vk::ComponentSwizzle::eIdentity;
 	createInfo.components.a = vk::ComponentSwizzle::eIdentity;
 	createInfo.subresourceRange.aspectMask = aspect;
-	createInfo.subresourceRange.baseMipLevel = 0;
-	createInfo.subresourceRange.levelCount = 1;
+	createInfo.subresourceRange.baseMipLevel = baseMipLevel;
+	createInfo.subresourceRange.levelCount = mipLevels;
 	createInfo.subresourceRange.baseArrayLayer = 0;
 	createInfo.subresourceRange.layerCount = 1;
 
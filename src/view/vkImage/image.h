@@ -4,6 +4,7 @@
 #endif
 #include "stb_image.h"
 #include "../../config.h"
+#include "../vkUtil/upload.h"
 
 namespace vkImage {
 
@@ -27,6 +28,7 @@ namespace vkImage {
 		vk::Device logicalDevice;
 		vk::PhysicalDevice physicalDevice;
 		int width, height;
+		uint32_t mipLevels;
 		vk::ImageTiling tiling;
 		vk::ImageUsageFlags usage;
 		vk::MemoryPropertyFlags memoryProperties;
@@ -40,6 +42,7 @@ namespace vkImage {
 		vk::CommandBuffer commandBuffer;
 		vk::Queue queue;
 		vk::Image image;
+		uint32_t mipLevels;
 		vk::ImageLayout oldLayout, newLayout;
 	};
 
@@ -50,7 +53,9 @@ namespace vkImage {
 		vk::CommandBuffer commandBuffer;
 		vk::Queue queue;
 		vk::Buffer srcBuffer;
+		vk::DeviceSize bufferOffset;
 		vk::Image dstImage;
+		uint32_t mipLevel;
 		int width, height;
 	};
 
@@ -58,9 +63,88 @@ namespace vkImage {
 
 	public:
 		
+		/**
+			Load a texture from file, blocking until it has been uploaded.
+		*/
 		Texture(TextureInputChunk input);
 
-		void use(vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout);
+		/**
+			Make a texture from pixels already in memory (RGBA8), blocking until it has been uploaded.
+		*/
+		Texture(TextureInputChunk input, const stbi_uc* source, int width, int height);
+
+		/**
+			Make a texture which is loaded later through load() and stage(),
+			typically on a worker thread. The copy to the image is recorded
+			by the upload queue, after which the texture is resident.
+		*/
+		Texture(TextureInputChunk input, vkUtil::UploadQueue* uploads);
+
+		/**
+			Load the raw image data from the internally set filepath and build its mip chain.
+			\returns whether the file could be decoded
+		*/
+		bool load();
+
+		/**
+			Make the image, view, sampler and descriptor set and queue the pixel upload.
+			The texture must be loaded before calling this function.
+		*/
+		void stage();
+
+		/**
+			\returns whether the upload has been recorded, and the texture may be sampled
+		*/
+		bool is_resident();
+
+		/**
+			Replace the image with one holding the mip chain from the given level down.
+			The new image is swapped in once its upload has been recorded, the old
+			one is released after the GPU is done with it. Must not be called
+			again until is_streaming() returns false.
+			\param newBaseMip the most detailed mip level to keep resident
+		*/
+		void stream(uint32_t newBaseMip);
+
+		/**
+			Flag the texture as having a stream() in flight.
+		*/
+		void begin_stream();
+
+		bool is_streaming();
+
+		uint32_t get_mip_count();
+
+		/**
+			\returns the most detailed mip level currently resident
+		*/
+		uint32_t get_base_mip();
+
+		/**
+			\returns the full resolution width, in texels
+		*/
+		int get_width();
+
+		/**
+			\returns the full resolution height, in texels
+		*/
+		int get_height();
+
+		/**
+			\returns the device memory needed to keep the given mip and all smaller ones resident
+		*/
+		size_t get_bytes_from(uint32_t mip);
+
+		/**
+			\returns the descriptor set frames should bind the texture through
+		*/
+		vk::DescriptorSet get_descriptor_set();
+
+		/**
+			\returns the view and sampler the active descriptor set points at,
+			for descriptor sets holding many textures
+		*/
+		vk::DescriptorImageInfo get_descriptor();
 
 		~Texture();
 
@@ -72,6 +156,13 @@ namespace vkImage {
 		const char* filename;
 		stbi_uc* pixels;
 
+		//Full mip chain kept on the CPU, so resident mips can be raised again
+		std::vector<stbi_uc> mipChain;
+		std::vector<size_t> mipOffsets;
+		std::vector<int> mipWidths, mipHeights;
+		std::atomic<uint32_t> baseMip;
+		std::atomic<bool> streaming;
+
 		//Resources
 		vk::Image image;
 		vk::DeviceMemory imageMemory;
@@ -80,16 +171,38 @@ namespace vkImage {
 
 		//Resource Descriptors
 		vk::DescriptorSetLayout layout;
-		vk::DescriptorSet descriptorSet;
+		//double buffered so the idle set can be rewritten while frames still use the other
+		vk::DescriptorSet descriptorSets[2];
+		//the view each set was written with, the current one may not be uploaded yet
+		vk::ImageView setViews[2];
+		std::atomic<int> activeSet;
 		vk::DescriptorPool descriptorPool;
 
 		vk::CommandBuffer commandBuffer;
 		vk::Queue queue;
+		vkUtil::UploadQueue* uploads;
+		std::atomic<bool> resident;
+
+		/**
+			Build the mip chain from the loaded pixels with a box filter, then free the pixels.
+		*/
+		void generate_mips();
+
+		/**
+			Make the image and its backing memory, holding the chain from the given mip down.
+		*/
+		void make_image_resources(uint32_t firstMip);
 
 		/**
-			Load the raw image data from the internally set filepath.
+			Copy the mip chain from the given level down into a new CPU-visible buffer.
+			\returns the staging buffer, the caller is responsible for freeing it
 		*/
-		void load();
+		Buffer make_staging_buffer(uint32_t firstMip);
+
+		/**
+			Record the layout transitions and copies which move the staging buffer into the image.
+		*/
+		void record_upload(vk::CommandBuffer commandBuffer, vk::Buffer stagingBuffer, vk::Image target, uint32_t firstMip);
 
 		/**
 			Send loaded data to the image. The image must be loaded before calling
@@ -97,10 +210,15 @@ namespace vkImage {
 		*/
 		void populate();
 
+		/**
+			The blocking construction path, shared by the file and memory constructors.
+		*/
+		void finalize_blocking();
+
 		/**
 			Create a view of the texture. The image must be populated before calling this function.
 		*/
-		void make_view(vk::Format format /* format must be the same as created image */);
+		void make_view(vk::Format format /* format must be the same as created image */, uint32_t mipLevels);
 
 		/**
 			Configure and create a sampler for the texture.
@@ -108,10 +226,15 @@ namespace vkImage {
 		void make_sampler();
 
 		/**
-			Allocate and write the descriptor set. Currently, this is only being done once.
+			Allocate both descriptor sets and write the first one.
 			This must be called after the image view and sampler have been made.
 		*/
 		void make_descriptor_set();
+
+		/**
+			Point one of the descriptor sets at the current image view.
+		*/
+		void write_descriptor_set(int index);
 	};
 
 	/**
@@ -133,16 +256,37 @@ namespace vkImage {
 	*/
 	void transition_image_layout(ImageLayoutTransitionJob transitionJob);
 
+	/**
+		Record a layout transition into the job's command buffer without submitting it.
+	*/
+	void record_image_layout_transition(ImageLayoutTransitionJob transitionJob);
+
 	/**
 		Copy from a buffer to an image. Image must be in the transfer_dst_optimal layout.
 	*/
 	void copy_buffer_to_image(BufferImageCopyJob copyJob);
 
+	/**
+		Record a buffer to image copy into the job's command buffer without submitting it.
+	*/
+	void record_copy_buffer_to_image(BufferImageCopyJob copyJob);
+
 	/**
 		Create a view of a vulkan image.
 	*/
 	vk::ImageView make_image_view(vk::Device logicalDevice, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect);
 
+	/**
+		Create a view of a vulkan image covering the given number of mip levels.
+	*/
+	vk::ImageView make_image_view(vk::Device logicalDevice, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect, uint32_t mipLevels);
+
+	/**
+		Create a view of a vulkan image covering the given run of mip levels.
+	*/
+	vk::ImageView make_image_view(vk::Device logicalDevice, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect,
+		uint32_t baseMipLevel, uint32_t mipLevels);
+
     /**
 		\returns an image format supporting the requested tiling and features
 	*/
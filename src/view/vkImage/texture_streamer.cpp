@@ -0,0 +1,126 @@
+#include "texture_streamer.h"
+#include "../../control/thread_pool.h"
+
+vkImage::TextureStreamer::TextureStreamer(size_t budget, int framesInFlight) {
+	this->budget = budget;
+	this->framesInFlight = framesInFlight;
+	frameCount = 0;
+}
+
+void vkImage::TextureStreamer::add(Texture* texture) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	StreamingState state;
+	state.texture = texture;
+	state.screenPixels = 0.0f;
+	state.desiredMip = texture->get_base_mip();
+	state.wasStreaming = false;
+	state.readyFrame = 0;
+
+	lookup[texture] = states.size();
+	states.push_back(state);
+}
+
+void vkImage::TextureStreamer::request(Texture* texture, float screenPixels) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto found = lookup.find(texture);
+	if (found == lookup.end()) {
+		return;
+	}
+	StreamingState& state = states[found->second];
+	state.screenPixels = std::max(state.screenPixels, screenPixels);
+}
+
+uint32_t vkImage::TextureStreamer::choose_mip(StreamingState& state) {
+
+	uint32_t lastMip = state.texture->get_mip_count() - 1;
+	if (state.screenPixels < 1.0f) {
+		return lastMip;
+	}
+
+	//each mip halves the texels, so stop at the one still covering every pixel,
+	//along the longer side so tall textures are not left too coarse
+	int extent = std::max(state.texture->get_width(), state.texture->get_height());
+	float ratio = static_cast<float>(extent) / state.screenPixels;
+	if (ratio <= 1.0f) {
+		return 0;
+	}
+	uint32_t mip = static_cast<uint32_t>(std::floor(std::log2(ratio)));
+	return std::min(mip, lastMip);
+}
+
+void vkImage::TextureStreamer::update() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	++frameCount;
+
+	size_t total = 0;
+	for (StreamingState& state : states) {
+		state.desiredMip = choose_mip(state);
+		state.screenPixels = 0.0f;
+		total += state.texture->get_bytes_from(state.desiredMip);
+	}
+
+	//over budget: drop a level from whichever texture costs the most until it fits
+	while (total > budget) {
+
+		StreamingState* largest = nullptr;
+		size_t largestBytes = 0;
+		for (StreamingState& state : states) {
+			if (state.desiredMip + 1 >= state.texture->get_mip_count()) {
+				continue;
+			}
+			size_t bytes = state.texture->get_bytes_from(state.desiredMip);
+			if (bytes > largestBytes) {
+				largest = &state;
+				largestBytes = bytes;
+			}
+		}
+
+		if (largest == nullptr) {
+			break;
+		}
+
+		++largest->desiredMip;
+		total -= largestBytes - largest->texture->get_bytes_from(largest->desiredMip);
+	}
+
+	for (StreamingState& state : states) {
+
+		Texture* texture = state.texture;
+
+		//a finished change holds the texture until the frames using its old descriptor set retire
+		bool streaming = texture->is_streaming();
+		if (state.wasStreaming && !streaming) {
+			state.readyFrame = frameCount + framesInFlight + 1;
+		}
+		state.wasStreaming = streaming;
+
+		if (streaming || !texture->is_resident() || frameCount < state.readyFrame
+			|| state.desiredMip == texture->get_base_mip()) {
+			continue;
+		}
+
+		uint32_t mip = state.desiredMip;
+		texture->begin_stream();
+		state.wasStreaming = true;
+		vkJob::ThreadPool::get_pool()->submit([texture, mip]() {
+			texture->stream(mip);
+		});
+	}
+}
+
+size_t vkImage::TextureStreamer::get_resident_bytes() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t total = 0;
+	for (StreamingState& state : states) {
+		total += state.texture->get_bytes_from(state.texture->get_base_mip());
+	}
+	return total;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "../../config.h"
+#include "image.h"
+#include <mutex>
+
+namespace vkImage {
+
+	/**
+		Raises or lowers the resident mips of textures to match how large they
+		appear on screen, while keeping their total device memory under a budget.
+	*/
+	class TextureStreamer {
+	public:
+
+		/**
+			\param budget the device memory, in bytes, all streamed textures may use together
+			\param framesInFlight frames to wait after a change before touching the texture again
+		*/
+		TextureStreamer(size_t budget, int framesInFlight);
+
+		/**
+			Start streaming a resident texture.
+		*/
+		void add(Texture* texture);
+
+		/**
+			Report the on-screen size of something using the texture this frame,
+			the largest report of the frame wins.
+			\param texture the texture being sampled
+			\param screenPixels the projected size, in pixels, of the surface using it
+		*/
+		void request(Texture* texture, float screenPixels);
+
+		/**
+			Pick the mip each texture needs, fit them into the budget and start the
+			changes on the worker pool. Call once per frame, after the requests.
+		*/
+		void update();
+
+		/**
+			\returns the device memory currently used by streamed textures
+		*/
+		size_t get_resident_bytes();
+
+	private:
+
+		struct StreamingState {
+			Texture* texture;
+			float screenPixels;
+			uint32_t desiredMip;
+			bool wasStreaming;
+			uint64_t readyFrame;
+		};
+
+		std::vector<StreamingState> states;
+		std::unordered_map<Texture*, size_t> lookup;
+		size_t budget;
+		int framesInFlight;
+		uint64_t frameCount;
+		std::mutex mutex;
+
+		/**
+			\returns the least detailed mip which still gives a texel per pixel
+		*/
+		uint32_t choose_mip(StreamingState& state);
+	};
+}
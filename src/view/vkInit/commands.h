@@ -84,11 +84,16 @@ namespace vkInit {
 		allocInfo.commandPool = inputChunk.commandPool;
 		allocInfo.level = vk::CommandBufferLevel::ePrimary;
 		allocInfo.commandBufferCount = 1;
+
+		vk::CommandBufferAllocateInfo secondaryInfo = allocInfo;
+		secondaryInfo.level = vk::CommandBufferLevel::eSecondary;
 		
-		//Make a command buffer for each frame
+		//Make a command buffer for each frame, and one its renderpass contents are cached in
 		for (int i = 0; i < inputChunk.frames.size(); ++i) {
 			try {
 				inputChunk.frames[i].commandBuffer = inputChunk.device.allocateCommandBuffers(allocInfo)[0];
+				inputChunk.frames[i].sceneCommandBuffer = inputChunk.device.allocateCommandBuffers(secondaryInfo)[0];
+				inputChunk.frames[i].sceneCommandsKey.clear();
 				
 				if (debug) {
 					std::cout << "Allocated command buffer for frame " << i << std::endl;
@@ -102,4 +107,17 @@ namespace vkInit {
 			}
 		}
 	}
+
+	/**
+		Free the command buffers of each swapchain frame, and with them any cached recordings.
+		The frames must not be in flight.
+	*/
+	void free_frame_command_buffers(commandBufferInputChunk inputChunk) {
+
+		for (vkUtil::SwapChainFrame& frame : inputChunk.frames) {
+			vk::CommandBuffer commandBuffers[] = { frame.commandBuffer, frame.sceneCommandBuffer };
+			inputChunk.device.freeCommandBuffers(inputChunk.commandPool, 2, commandBuffers);
+			frame.sceneCommandsKey.clear();
+		}
+	}
 }
\ No newline at end of file
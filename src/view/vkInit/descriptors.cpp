@@ -73,7 +73,7 @@ vk::DescriptorPool vkInit::make_descriptor_pool(
 
 		vk::DescriptorPoolSize poolSize;
 		poolSize.type = bindings.types[i];
-		poolSize.descriptorCount = size;
+		poolSize.descriptorCount = size * bindings.counts[i];
 		poolSizes.push_back(poolSize);
 	}
 
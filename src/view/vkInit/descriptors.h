@@ -27,7 +27,7 @@ namespace vkInit {
 		Make a descriptor pool
 		\param device the logical device
 		\param size the number of descriptor sets to allocate from the pool
-		\param bindings	used to get the descriptor types
+		\param bindings	used to get the descriptor types and counts per set
 		\returns the created descriptor pool
 	*/
 	vk::DescriptorPool make_descriptor_pool(
@@ -91,6 +91,86 @@ namespace vkInit
 		return true;
 	}
 
+	/**
+		Check the features meshlet culling needs: many indirect draws per call,
+		each starting at its own instance.
+		\param physicalDevice the physical device
+		\returns whether the compute culling path can run
+	*/
+	bool supports_indirect_culling(const vk::PhysicalDevice& physicalDevice) {
+
+		vk::PhysicalDeviceFeatures features = physicalDevice.getFeatures();
+		return features.multiDrawIndirect && features.drawIndirectFirstInstance;
+	}
+
+#ifdef VK_KHR_draw_indirect_count
+	/**
+		Check for draws whose count is read from a buffer, so compacted
+		indirect commands are drawn without empty ones.
+		\param physicalDevice the physical device
+		\returns whether vkCmdDrawIndexedIndirectCountKHR is available
+	*/
+	bool supports_indirect_count(const vk::PhysicalDevice& physicalDevice) {
+		return supports_indirect_culling(physicalDevice)
+			&& checkDeviceExtensionSupport(physicalDevice, { VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME }, false);
+	}
+#endif
+
+#ifdef VK_VERSION_1_1
+	/**
+		Check for what drawing the whole scene in one indirect call needs: the
+		draw's index in the vertex shader, and arrays of textures indexed once
+		per draw. Needs a Vulkan 1.1 instance to query.
+		\param physicalDevice the physical device
+		\returns whether batched draws can run
+	*/
+	bool supports_batched_draws(const vk::PhysicalDevice& physicalDevice) {
+
+		if (physicalDevice.getProperties().apiVersion < VK_API_VERSION_1_1
+			|| !supports_indirect_culling(physicalDevice)) {
+			return false;
+		}
+
+		vk::PhysicalDeviceShaderDrawParametersFeatures drawParameterFeatures;
+		vk::PhysicalDeviceFeatures2 features;
+		features.pNext = &drawParameterFeatures;
+		physicalDevice.getFeatures2(&features);
+		return drawParameterFeatures.shaderDrawParameters && features.features.shaderSampledImageArrayDynamicIndexing;
+	}
+#endif
+
+#ifdef VK_EXT_mesh_shader
+	/**
+		\returns the device extensions the task/mesh shader path needs
+	*/
+	std::vector<const char*> mesh_shader_extensions() {
+		return {
+			VK_EXT_MESH_SHADER_EXTENSION_NAME,
+			VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+			VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME
+		};
+	}
+
+	/**
+		Check for task and mesh shaders, which need a Vulkan 1.1 instance to query.
+		\param physicalDevice the physical device
+		\returns whether the mesh shader path can run
+	*/
+	bool supports_mesh_shaders(const vk::PhysicalDevice& physicalDevice) {
+
+		if (physicalDevice.getProperties().apiVersion < VK_API_VERSION_1_1
+			|| !checkDeviceExtensionSupport(physicalDevice, mesh_shader_extensions(), false)) {
+			return false;
+		}
+
+		vk::PhysicalDeviceMeshShaderFeaturesEXT meshFeatures;
+		vk::PhysicalDeviceFeatures2 features;
+		features.pNext = &meshFeatures;
+		physicalDevice.getFeatures2(&features);
+		return meshFeatures.taskShader && meshFeatures.meshShader;
+	}
+#endif
+
     vk::PhysicalDevice choose_physical_device( vk::Instance& instance,bool debug){
     
         /*
@@ -170,6 +250,39 @@ namespace vkInit
 		*/
 
 		vk::PhysicalDeviceFeatures deviceFeatures = vk::PhysicalDeviceFeatures();
+		if (supports_indirect_culling(physicalDevice)) {
+			deviceFeatures.multiDrawIndirect = true;
+			deviceFeatures.drawIndirectFirstInstance = true;
+		}
+
+#ifdef VK_KHR_draw_indirect_count
+		if (supports_indirect_count(physicalDevice)) {
+			deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+#endif
+
+		const void* featureChain = nullptr;
+#ifdef VK_EXT_mesh_shader
+		vk::PhysicalDeviceMeshShaderFeaturesEXT meshFeatures;
+		if (supports_mesh_shaders(physicalDevice)) {
+			meshFeatures.taskShader = true;
+			meshFeatures.meshShader = true;
+			featureChain = &meshFeatures;
+			for (const char* extension : mesh_shader_extensions()) {
+				deviceExtensions.push_back(extension);
+			}
+		}
+#endif
+
+#ifdef VK_VERSION_1_1
+		vk::PhysicalDeviceShaderDrawParametersFeatures drawParameterFeatures;
+		if (supports_batched_draws(physicalDevice)) {
+			deviceFeatures.shaderSampledImageArrayDynamicIndexing = true;
+			drawParameterFeatures.shaderDrawParameters = true;
+			drawParameterFeatures.pNext = const_cast<void*>(featureChain);
+			featureChain = &drawParameterFeatures;
+		}
+#endif
 
 		/*
 		* VULKAN_HPP_CONSTEXPR DeviceCreateInfo( VULKAN_HPP_NAMESPACE::DeviceCreateFlags flags_                         = {},
@@ -192,6 +305,7 @@ namespace vkInit
 			deviceExtensions.size(), deviceExtensions.data(),
 			&deviceFeatures
 		);
+		deviceInfo.pNext = featureChain;
 
 		try {
 			vk::Device device = physicalDevice.createDevice(deviceInfo);
@@ -114,8 +114,17 @@ namespace vkInit {
 		* Or drop down to an earlier version to ensure compatibility with more devices
 		* VK_MAKE_API_VERSION(variant, major, minor, patch)
 		*/
+		uint32_t supported = version;
 		version = VK_MAKE_API_VERSION(0, 1, 0, 0);
 
+		/*
+		* Meshlet mesh shaders are queried through vkGetPhysicalDeviceFeatures2,
+		* so ask for 1.1 where the loader has it
+		*/
+		if (supported >= VK_MAKE_API_VERSION(0, 1, 1, 0)) {
+			version = VK_MAKE_API_VERSION(0, 1, 1, 0);
+		}
+
 		/*
 		* from vulkan_structs.hpp:
 		*
@@ -16,6 +16,10 @@ namespace vkInit {
 		vk::Extent2D swapchainExtent;
 		vk::Format swapchainImageFormat, depthFormat;
 		std::vector<vk::DescriptorSetLayout> descriptorSetLayouts;
+		//read vkMesh::CompactVertex, with a push constant holding each mesh's quantization range
+		bool compactVertices;
+		//read StaticVertex, already placed in the world, takes precedence over compactVertices
+		bool staticVertices;
 	};
 
 	/**
@@ -35,6 +39,17 @@ namespace vkInit {
 	*/
 	GraphicsPipelineOutBundle create_graphics_pipeline(GraphicsPipelineInBundle& specification);
 
+	/**
+		Make a vertex pipeline against a layout and renderpass made elsewhere,
+		as create_graphics_pipeline does with its own.
+		\param specification the description, its descriptor set layouts are not used
+		\param layout the pipeline layout, with the quantization push constant for compact vertices
+		\param renderpass the renderpass to draw in
+		\returns the created pipeline
+	*/
+	vk::Pipeline create_vertex_pipeline(
+		GraphicsPipelineInBundle& specification, vk::PipelineLayout layout, vk::RenderPass renderpass);
+
 	/**
 		Configure the vertex input stage.
 		\param bindingDescription describes the vertex inputs (ie. layouts)
@@ -81,6 +96,13 @@ namespace vkInit {
 	*/
 	vk::PipelineViewportStateCreateInfo make_viewport_state(const vk::Viewport& viewport, const vk::Rect2D& scissor);
 
+	/**
+		The viewport and scissor are set while recording, so they follow the
+		swapchain without the pipeline being made again.
+		\returns the dynamic state creation info
+	*/
+	vk::PipelineDynamicStateCreateInfo make_dynamic_state();
+
 	/**
 		\returns the creation info for the configured rasterizer stage
 	*/
@@ -106,27 +128,64 @@ namespace vkInit {
 		Make a pipeline layout, this consists mostly of describing the
 		push constants and descriptor set layouts which will be used.
 		\param device the logical device
+		\param pushConstantSize bytes of push constants, 0 for none
+		\param pushConstantStages the shader stages which read the push constants
 		\returns the created pipeline layout
 	*/
-	vk::PipelineLayout make_pipeline_layout(vk::Device device, std::vector<vk::DescriptorSetLayout> descriptorSetLayouts);
+	vk::PipelineLayout make_pipeline_layout(
+		vk::Device device, std::vector<vk::DescriptorSetLayout> descriptorSetLayouts, uint32_t pushConstantSize = 0,
+		vk::ShaderStageFlags pushConstantStages = vk::ShaderStageFlagBits::eVertex);
+
+	/**
+		Make a compute pipeline.
+		\param device the logical device
+		\param computeFilepath the compiled compute shader
+		\param layout the pipeline layout to build against
+		\returns the created pipeline
+	*/
+	vk::Pipeline make_compute_pipeline(vk::Device device, const std::string& computeFilepath, vk::PipelineLayout layout);
+
+#ifdef VK_EXT_mesh_shader
+	/**
+		Make a task/mesh shader pipeline drawing into the renderpass of the classic pipeline.
+		The specification's vertex file is not used.
+		\param specification the same description the classic pipeline was made from
+		\param taskFilepath the compiled task shader
+		\param meshFilepath the compiled mesh shader
+		\param layout the pipeline layout, its push constants must reach the task and mesh stages
+		\param renderpass the renderpass made with the classic pipeline
+		\returns the created pipeline
+	*/
+	vk::Pipeline create_mesh_pipeline(
+		GraphicsPipelineInBundle& specification, const std::string& taskFilepath, const std::string& meshFilepath,
+		vk::PipelineLayout layout, vk::RenderPass renderpass);
+#endif
 
 	/**
 		Make a renderpass, a renderpass describes the subpasses involved
-		as well as the attachments which will be used.
+		as well as the attachments which will be used. A frame may be drawn
+		in more than one, all of them compatible with the same framebuffers
+		and pipelines: the first clears the attachments, the last leaves the
+		image ready to present, and between them the depth is kept where
+		compute shaders may read it.
 		\param device the logical device
 		\param swapchainImageFormat the image format chosen for the swapchain images
+		\param first whether the renderpass begins the frame
+		\param last whether the renderpass finishes the frame
 		\returns the created renderpass
 	*/
 	vk::RenderPass make_renderpass(
-		vk::Device device, vk::Format swapchainImageFormat, vk::Format depthFormat
+		vk::Device device, vk::Format swapchainImageFormat, vk::Format depthFormat, bool first = true, bool last = true
 	);
 
 	/**
 		Make a color attachment description
 		\param swapchainImageFormat the image format used by the swapchain
+		\param first whether the renderpass begins the frame
+		\param last whether the renderpass finishes the frame
 		\returns a description of the corresponding color attachment
 	*/
-	vk::AttachmentDescription make_color_attachment(const vk::Format& swapchainImageFormat);
+	vk::AttachmentDescription make_color_attachment(const vk::Format& swapchainImageFormat, bool first, bool last);
 
 	/**
 		\returns Make a color attachment refernce
@@ -136,9 +195,11 @@ namespace vkInit {
 	/**
 		Make a depth attachment description
 		\param swapchainImageFormat the image format used by the swapchain
+		\param first whether the renderpass begins the frame
+		\param last whether the renderpass finishes the frame
 		\returns a description of the corresponding depth attachment
 	*/
-	vk::AttachmentDescription make_depth_attachment(const vk::Format& depthFormat);
+	vk::AttachmentDescription make_depth_attachment(const vk::Format& depthFormat, bool first, bool last);
 
 	/**
 		\returns Make a depth attachment refernce
@@ -232,6 +293,18 @@ namespace vkInit {
 		return viewportState;
 	}
 
+	vk::PipelineDynamicStateCreateInfo make_dynamic_state() {
+
+		static const vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+
+		vk::PipelineDynamicStateCreateInfo dynamicState = {};
+		dynamicState.flags = vk::PipelineDynamicStateCreateFlags();
+		dynamicState.dynamicStateCount = 2;
+		dynamicState.pDynamicStates = dynamicStates;
+
+		return dynamicState;
+	}
+
 	vk::PipelineRasterizationStateCreateInfo make_rasterizer_info() {
 
 		vk::PipelineRasterizationStateCreateInfo rasterizer = {};
@@ -282,7 +355,9 @@ namespace vkInit {
 		return colorBlending;
 	}
 
-	vk::PipelineLayout make_pipeline_layout(vk::Device device, std::vector<vk::DescriptorSetLayout> descriptorSetLayouts) {
+	vk::PipelineLayout make_pipeline_layout(
+		vk::Device device, std::vector<vk::DescriptorSetLayout> descriptorSetLayouts, uint32_t pushConstantSize,
+		vk::ShaderStageFlags pushConstantStages) {
 
 		/*
 		typedef struct VkPipelineLayoutCreateInfo {
@@ -302,7 +377,12 @@ namespace vkInit {
 		layoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
 		layoutInfo.pSetLayouts = descriptorSetLayouts.data();
 
-		layoutInfo.pushConstantRangeCount = 0;
+		vk::PushConstantRange pushConstantInfo;
+		pushConstantInfo.stageFlags = pushConstantStages;
+		pushConstantInfo.offset = 0;
+		pushConstantInfo.size = pushConstantSize;
+		layoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+		layoutInfo.pPushConstantRanges = &pushConstantInfo;
 
 		try {
 			return device.createPipelineLayout(layoutInfo);
@@ -313,17 +393,17 @@ namespace vkInit {
 	}
 
 	vk::RenderPass make_renderpass(
-		vk::Device device, vk::Format swapchainImageFormat, vk::Format depthFormat) {
+		vk::Device device, vk::Format swapchainImageFormat, vk::Format depthFormat, bool first, bool last) {
 
 		std::vector<vk::AttachmentDescription> attachments;
 		std::vector<vk::AttachmentReference> attachmentReferences;
 
 		//Color Buffer
-		attachments.push_back(make_color_attachment(swapchainImageFormat));
+		attachments.push_back(make_color_attachment(swapchainImageFormat, first, last));
 		attachmentReferences.push_back(make_color_attachment_reference());
 
 		//Depth Buffer
-		attachments.push_back(make_depth_attachment(depthFormat));
+		attachments.push_back(make_depth_attachment(depthFormat, first, last));
 		attachmentReferences.push_back(make_depth_attachment_reference());
 
 		//Renderpasses are broken down into subpasses, there's always at least one.
@@ -331,6 +411,36 @@ namespace vkInit {
 
 		//Now create the renderpass
 		vk::RenderPassCreateInfo renderpassInfo = make_renderpass_info(attachments, subpass);
+
+		//a frame drawn in parts reads the depth in compute passes between them
+		std::vector<vk::SubpassDependency> dependencies;
+		const vk::PipelineStageFlags attachmentStages = vk::PipelineStageFlagBits::eColorAttachmentOutput
+			| vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+		const vk::AccessFlags attachmentAccess = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite
+			| vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+		if (!first) {
+			vk::SubpassDependency dependency;
+			dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependency.dstSubpass = 0;
+			dependency.srcStageMask = attachmentStages | vk::PipelineStageFlagBits::eComputeShader;
+			dependency.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+			dependency.dstStageMask = attachmentStages;
+			dependency.dstAccessMask = attachmentAccess;
+			dependencies.push_back(dependency);
+		}
+		if (!last) {
+			vk::SubpassDependency dependency;
+			dependency.srcSubpass = 0;
+			dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+			dependency.srcStageMask = attachmentStages;
+			dependency.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+			dependency.dstStageMask = attachmentStages | vk::PipelineStageFlagBits::eComputeShader;
+			dependency.dstAccessMask = attachmentAccess | vk::AccessFlagBits::eShaderRead;
+			dependencies.push_back(dependency);
+		}
+		renderpassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderpassInfo.pDependencies = dependencies.data();
+
 		try {
 			return device.createRenderPass(renderpassInfo);
 		}
@@ -340,18 +450,18 @@ namespace vkInit {
 
 	}
 
-	vk::AttachmentDescription make_color_attachment(const vk::Format& swapchainImageFormat) {
+	vk::AttachmentDescription make_color_attachment(const vk::Format& swapchainImageFormat, bool first, bool last) {
 
 		vk::AttachmentDescription colorAttachment = {};
 		colorAttachment.flags = vk::AttachmentDescriptionFlags();
 		colorAttachment.format = swapchainImageFormat;
 		colorAttachment.samples = vk::SampleCountFlagBits::e1;
-		colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
+		colorAttachment.loadOp = first ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
 		colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
 		colorAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
 		colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-		colorAttachment.initialLayout = vk::ImageLayout::eUndefined;
-		colorAttachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
+		colorAttachment.initialLayout = first ? vk::ImageLayout::eUndefined : vk::ImageLayout::eColorAttachmentOptimal;
+		colorAttachment.finalLayout = last ? vk::ImageLayout::ePresentSrcKHR : vk::ImageLayout::eColorAttachmentOptimal;
 
 		return colorAttachment;
 	}
@@ -365,18 +475,19 @@ namespace vkInit {
 		return colorAttachmentRef;
 	}
 
-	vk::AttachmentDescription make_depth_attachment(const vk::Format& depthFormat) {
+	vk::AttachmentDescription make_depth_attachment(const vk::Format& depthFormat, bool first, bool last) {
 
+		//kept between parts of a frame in a layout it may be sampled in
 		vk::AttachmentDescription depthAttachment = {};
 		depthAttachment.flags = vk::AttachmentDescriptionFlags();
 		depthAttachment.format = depthFormat;
 		depthAttachment.samples = vk::SampleCountFlagBits::e1;
-		depthAttachment.loadOp = vk::AttachmentLoadOp::eClear;
-		depthAttachment.storeOp = vk::AttachmentStoreOp::eDontCare;
+		depthAttachment.loadOp = first ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+		depthAttachment.storeOp = last ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore;
 		depthAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
 		depthAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-		depthAttachment.initialLayout = vk::ImageLayout::eUndefined;
-		depthAttachment.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+		depthAttachment.initialLayout = first ? vk::ImageLayout::eUndefined : vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+		depthAttachment.finalLayout = last ? vk::ImageLayout::eDepthStencilAttachmentOptimal : vk::ImageLayout::eDepthStencilReadOnlyOptimal;
 
 		return depthAttachment;
 	}
@@ -428,6 +539,30 @@ namespace vkInit {
 		* Build and return a graphics pipeline based on the given info.
 		*/
 
+		//Pipeline Layout
+		vkLogging::Logger::get_logger()->print("Create Pipeline Layout");
+		vk::PipelineLayout pipelineLayout = make_pipeline_layout(
+			specification.device, specification.descriptorSetLayouts,
+			specification.compactVertices ? sizeof(glm::vec4) : 0);
+
+		//Renderpass
+		vkLogging::Logger::get_logger()->print("Create RenderPass");
+		vk::RenderPass renderpass = make_renderpass(
+			specification.device, specification.swapchainImageFormat, 
+			specification.depthFormat
+		);
+
+		GraphicsPipelineOutBundle output;
+		output.layout = pipelineLayout;
+		output.renderpass = renderpass;
+		output.pipeline = create_vertex_pipeline(specification, pipelineLayout, renderpass);
+
+		return output;
+	}
+
+	vk::Pipeline create_vertex_pipeline(
+		GraphicsPipelineInBundle& specification, vk::PipelineLayout layout, vk::RenderPass renderpass) {
+
 		//The info for the graphics pipeline
 		vk::GraphicsPipelineCreateInfo pipelineInfo = {};
 		pipelineInfo.flags = vk::PipelineCreateFlags();
@@ -436,8 +571,14 @@ namespace vkInit {
 		std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
 
 		//Vertex Input
-		vk::VertexInputBindingDescription bindingDescription = vkMesh::getPosColorBindingDescription();
-		std::vector<vk::VertexInputAttributeDescription> attributeDescriptions = vkMesh::getPosColorAttributeDescriptions();
+		vk::VertexInputBindingDescription bindingDescription = specification.compactVertices ?
+			vkMesh::getCompactBindingDescription() : vkMesh::getPosColorBindingDescription();
+		std::vector<vk::VertexInputAttributeDescription> attributeDescriptions = specification.compactVertices ?
+			vkMesh::getCompactAttributeDescriptions() : vkMesh::getPosColorAttributeDescriptions();
+		if (specification.staticVertices) {
+			bindingDescription = vkMesh::getStaticBindingDescription();
+			attributeDescriptions = vkMesh::getStaticAttributeDescriptions();
+		}
 		vk::PipelineVertexInputStateCreateInfo vertexInputInfo = make_vertex_input_info(bindingDescription, attributeDescriptions);
 		pipelineInfo.pVertexInputState = &vertexInputInfo;
 
@@ -458,6 +599,8 @@ namespace vkInit {
 		vk::Rect2D scissor = make_scissor(specification);
 		vk::PipelineViewportStateCreateInfo viewportState = make_viewport_state(viewport, scissor);
 		pipelineInfo.pViewportState = &viewportState;
+		vk::PipelineDynamicStateCreateInfo dynamicState = make_dynamic_state();
+		pipelineInfo.pDynamicState = &dynamicState;
 
 		//Rasterizer
 		vk::PipelineRasterizationStateCreateInfo rasterizer = make_rasterizer_info();
@@ -493,17 +636,7 @@ namespace vkInit {
 		vk::PipelineColorBlendStateCreateInfo colorBlending = make_color_blend_attachment_stage(colorBlendAttachment);
 		pipelineInfo.pColorBlendState = &colorBlending;
 
-		//Pipeline Layout
-		vkLogging::Logger::get_logger()->print("Create Pipeline Layout");
-		vk::PipelineLayout pipelineLayout = make_pipeline_layout(specification.device, specification.descriptorSetLayouts);
-		pipelineInfo.layout = pipelineLayout;
-
-		//Renderpass
-		vkLogging::Logger::get_logger()->print("Create RenderPass");
-		vk::RenderPass renderpass = make_renderpass(
-			specification.device, specification.swapchainImageFormat, 
-			specification.depthFormat
-		);
+		pipelineInfo.layout = layout;
 		pipelineInfo.renderPass = renderpass;
 		pipelineInfo.subpass = 0;
 
@@ -524,16 +657,109 @@ namespace vkInit {
 			vkLogging::Logger::get_logger()->print("Failed to create Pipeline");
 		}
 
-		GraphicsPipelineOutBundle output;
-		output.layout = pipelineLayout;
-		output.renderpass = renderpass;
-		output.pipeline = graphicsPipeline;
-
 		//Finally clean up by destroying shader modules
 		specification.device.destroyShaderModule(vertexShader);
 		specification.device.destroyShaderModule(fragmentShader);
 
-		return output;
+		return graphicsPipeline;
+	}
+
+	vk::Pipeline make_compute_pipeline(vk::Device device, const std::string& computeFilepath, vk::PipelineLayout layout) {
+
+		vkLogging::Logger::get_logger()->print("Create compute shader module");
+		vk::ShaderModule computeShader = vkUtil::createModule(computeFilepath, device, true);
+
+		vk::ComputePipelineCreateInfo pipelineInfo;
+		pipelineInfo.flags = vk::PipelineCreateFlags();
+		pipelineInfo.stage = make_shader_info(computeShader, vk::ShaderStageFlagBits::eCompute);
+		pipelineInfo.layout = layout;
+		pipelineInfo.basePipelineHandle = nullptr;
+
+		vkLogging::Logger::get_logger()->print("Create Compute Pipeline");
+		vk::Pipeline computePipeline;
+		try {
+#ifdef VK_MAKE_VERSION
+			computePipeline = device.createComputePipeline(nullptr, pipelineInfo);
+#else
+			computePipeline = device.createComputePipeline(nullptr, pipelineInfo).value;
+#endif
+		}
+		catch (vk::SystemError err) {
+			vkLogging::Logger::get_logger()->print("Failed to create compute Pipeline");
+		}
+
+		device.destroyShaderModule(computeShader);
+
+		return computePipeline;
+	}
+
+#ifdef VK_EXT_mesh_shader
+	vk::Pipeline create_mesh_pipeline(
+		GraphicsPipelineInBundle& specification, const std::string& taskFilepath, const std::string& meshFilepath,
+		vk::PipelineLayout layout, vk::RenderPass renderpass) {
+
+		//vertex input and input assembly belong to the vertex pipeline, mesh shaders emit primitives themselves
+		vk::GraphicsPipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.flags = vk::PipelineCreateFlags();
+
+		vkLogging::Logger::get_logger()->print("Create task and mesh shader modules");
+		vk::ShaderModule taskShader = vkUtil::createModule(taskFilepath, specification.device, true);
+		vk::ShaderModule meshShader = vkUtil::createModule(meshFilepath, specification.device, true);
+		vk::ShaderModule fragmentShader = vkUtil::createModule(specification.fragmentFilepath, specification.device, true);
+		std::vector<vk::PipelineShaderStageCreateInfo> shaderStages = {
+			make_shader_info(taskShader, vk::ShaderStageFlagBits::eTaskEXT),
+			make_shader_info(meshShader, vk::ShaderStageFlagBits::eMeshEXT),
+			make_shader_info(fragmentShader, vk::ShaderStageFlagBits::eFragment)
+		};
+		pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineInfo.pStages = shaderStages.data();
+
+		vk::Viewport viewport = make_viewport(specification);
+		vk::Rect2D scissor = make_scissor(specification);
+		vk::PipelineViewportStateCreateInfo viewportState = make_viewport_state(viewport, scissor);
+		pipelineInfo.pViewportState = &viewportState;
+		vk::PipelineDynamicStateCreateInfo dynamicState = make_dynamic_state();
+		pipelineInfo.pDynamicState = &dynamicState;
+
+		vk::PipelineRasterizationStateCreateInfo rasterizer = make_rasterizer_info();
+		pipelineInfo.pRasterizationState = &rasterizer;
+
+		vk::PipelineDepthStencilStateCreateInfo depthState;
+		depthState.flags = vk::PipelineDepthStencilStateCreateFlags();
+		depthState.depthTestEnable = true;
+		depthState.depthWriteEnable = true;
+		depthState.depthCompareOp = vk::CompareOp::eLess;
+		depthState.depthBoundsTestEnable = false;
+		depthState.stencilTestEnable = false;
+		pipelineInfo.pDepthStencilState = &depthState;
+
+		vk::PipelineMultisampleStateCreateInfo multisampling = make_multisampling_info();
+		pipelineInfo.pMultisampleState = &multisampling;
+
+		vk::PipelineColorBlendAttachmentState colorBlendAttachment = make_color_blend_attachment_state();
+		vk::PipelineColorBlendStateCreateInfo colorBlending = make_color_blend_attachment_stage(colorBlendAttachment);
+		pipelineInfo.pColorBlendState = &colorBlending;
+
+		pipelineInfo.layout = layout;
+		pipelineInfo.renderPass = renderpass;
+		pipelineInfo.subpass = 0;
+		pipelineInfo.basePipelineHandle = nullptr;
+
+		vkLogging::Logger::get_logger()->print("Create Mesh Shader Pipeline");
+		vk::Pipeline meshPipeline;
+		try {
+			meshPipeline = specification.device.createGraphicsPipeline(nullptr, pipelineInfo).value;
+		}
+		catch (vk::SystemError err) {
+			vkLogging::Logger::get_logger()->print("Failed to create mesh shader Pipeline");
+		}
+
+		specification.device.destroyShaderModule(taskShader);
+		specification.device.destroyShaderModule(meshShader);
+		specification.device.destroyShaderModule(fragmentShader);
+
+		return meshPipeline;
 	}
+#endif
 }
 
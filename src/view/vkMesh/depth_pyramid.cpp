@@ -0,0 +1,205 @@
+#include "depth_pyramid.h"
+#include "../vkInit/descriptors.h"
+#include "../vkImage/image.h"
+#include <algorithm>
+
+namespace {
+
+	//farthest and nearest depth
+	const vk::Format kPyramidFormat = vk::Format::eR32G32Sfloat;
+}
+
+vkMesh::DepthPyramid::DepthPyramid(DepthPyramidInputChunk input) {
+
+	logicalDevice = input.logicalDevice;
+	physicalDevice = input.physicalDevice;
+
+	//the source, then the level written
+	vkInit::descriptorSetLayoutData bindings;
+	bindings.count = 2;
+	bindings.indices = { 0, 1 };
+	bindings.types = { vk::DescriptorType::eCombinedImageSampler, vk::DescriptorType::eStorageImage };
+	bindings.counts = { 1, 1 };
+	bindings.stages = { vk::ShaderStageFlagBits::eCompute, vk::ShaderStageFlagBits::eCompute };
+	layout = vkInit::make_descriptor_set_layout(logicalDevice, bindings);
+	descriptorPool = vkInit::make_descriptor_pool(logicalDevice, input.frameCount * kMaxLevels, bindings);
+
+	vk::SamplerCreateInfo samplerInfo;
+	samplerInfo.flags = vk::SamplerCreateFlags();
+	samplerInfo.minFilter = vk::Filter::eNearest;
+	samplerInfo.magFilter = vk::Filter::eNearest;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.anisotropyEnable = false;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+	samplerInfo.unnormalizedCoordinates = false;
+	samplerInfo.compareEnable = false;
+	samplerInfo.compareOp = vk::CompareOp::eAlways;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = static_cast<float>(kMaxLevels);
+	sampler = logicalDevice.createSampler(samplerInfo);
+
+	frames.resize(input.frameCount);
+}
+
+void vkMesh::DepthPyramid::set_depth(uint32_t frameIndex, vk::ImageView depth, vk::Extent2D extent) {
+
+	FrameResources& frame = frames[frameIndex];
+	destroy_frame(frame);
+
+	//each level half the one before, rounded up, until one texel is left
+	frame.depthSize = extent;
+	frame.levelSizes.clear();
+	vk::Extent2D size = extent;
+	do {
+		size.width = std::max((size.width + 1) / 2, 1u);
+		size.height = std::max((size.height + 1) / 2, 1u);
+		frame.levelSizes.push_back(size);
+	} while ((size.width > 1 || size.height > 1) && frame.levelSizes.size() < kMaxLevels);
+	uint32_t levels = static_cast<uint32_t>(frame.levelSizes.size());
+
+	vkImage::ImageInputChunk imageInfo;
+	imageInfo.logicalDevice = logicalDevice;
+	imageInfo.physicalDevice = physicalDevice;
+	imageInfo.tiling = vk::ImageTiling::eOptimal;
+	imageInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+	imageInfo.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+	imageInfo.width = frame.levelSizes[0].width;
+	imageInfo.height = frame.levelSizes[0].height;
+	imageInfo.mipLevels = levels;
+	imageInfo.format = kPyramidFormat;
+	frame.image = vkImage::make_image(imageInfo);
+	frame.imageMemory = vkImage::make_image_memory(imageInfo, frame.image);
+	frame.view = vkImage::make_image_view(logicalDevice, frame.image, kPyramidFormat, vk::ImageAspectFlagBits::eColor, levels);
+	for (uint32_t level = 0; level < levels; ++level) {
+		frame.levelViews.push_back(vkImage::make_image_view(
+			logicalDevice, frame.image, kPyramidFormat, vk::ImageAspectFlagBits::eColor, level, 1));
+	}
+
+	while (frame.descriptorSets.size() < levels) {
+		frame.descriptorSets.push_back(vkInit::allocate_descriptor_set(logicalDevice, descriptorPool, layout));
+	}
+
+	//level 0 reads the attachment, the rest read the level before
+	std::vector<vk::DescriptorImageInfo> sources(levels), targets(levels);
+	std::vector<vk::WriteDescriptorSet> writes(2 * levels);
+	for (uint32_t level = 0; level < levels; ++level) {
+		sources[level].sampler = sampler;
+		sources[level].imageView = level == 0 ? depth : frame.levelViews[level - 1];
+		sources[level].imageLayout = level == 0 ? vk::ImageLayout::eDepthStencilReadOnlyOptimal : vk::ImageLayout::eGeneral;
+		targets[level].imageView = frame.levelViews[level];
+		targets[level].imageLayout = vk::ImageLayout::eGeneral;
+
+		for (uint32_t binding = 0; binding < 2; ++binding) {
+			vk::WriteDescriptorSet& write = writes[2 * level + binding];
+			write.dstSet = frame.descriptorSets[level];
+			write.dstBinding = binding;
+			write.dstArrayElement = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = binding == 0 ? vk::DescriptorType::eCombinedImageSampler : vk::DescriptorType::eStorageImage;
+			write.pImageInfo = binding == 0 ? &sources[level] : &targets[level];
+		}
+	}
+	logicalDevice.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void vkMesh::DepthPyramid::record(vk::CommandBuffer commandBuffer, uint32_t frameIndex) {
+
+	FrameResources& frame = frames[frameIndex];
+	uint32_t levels = static_cast<uint32_t>(frame.levelSizes.size());
+
+	//every level is written again, last frame's contents can go. The culling
+	//which read them must finish first
+	vk::ImageMemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlags();
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.oldLayout = vk::ImageLayout::eUndefined;
+	barrier.newLayout = vk::ImageLayout::eGeneral;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = frame.image;
+	barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = levels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), nullptr, nullptr, barrier
+	);
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+
+	//each level waits for the one it reads
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+	barrier.oldLayout = vk::ImageLayout::eGeneral;
+	barrier.newLayout = vk::ImageLayout::eGeneral;
+	barrier.subresourceRange.levelCount = 1;
+	for (uint32_t level = 0; level < levels; ++level) {
+
+		DepthPyramidConstants constants;
+		vk::Extent2D source = level == 0 ? frame.depthSize : frame.levelSizes[level - 1];
+		constants.sourceWidth = source.width;
+		constants.sourceHeight = source.height;
+		constants.width = frame.levelSizes[level].width;
+		constants.height = frame.levelSizes[level].height;
+		constants.fromDepth = level == 0 ? 1 : 0;
+
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, frame.descriptorSets[level], nullptr);
+		commandBuffer.pushConstants(
+			pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(DepthPyramidConstants), &constants
+		);
+		commandBuffer.dispatch(
+			(constants.width + kWorkgroupSize - 1) / kWorkgroupSize, (constants.height + kWorkgroupSize - 1) / kWorkgroupSize, 1);
+
+		barrier.subresourceRange.baseMipLevel = level;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+			vk::DependencyFlags(), nullptr, nullptr, barrier
+		);
+	}
+}
+
+vk::DescriptorImageInfo vkMesh::DepthPyramid::get_descriptor(uint32_t frameIndex) {
+
+	vk::DescriptorImageInfo descriptor;
+	descriptor.sampler = sampler;
+	descriptor.imageView = frames[frameIndex].view;
+	descriptor.imageLayout = vk::ImageLayout::eGeneral;
+	return descriptor;
+}
+
+uint32_t vkMesh::DepthPyramid::get_levels(uint32_t frameIndex) {
+	return static_cast<uint32_t>(frames[frameIndex].levelSizes.size());
+}
+
+void vkMesh::DepthPyramid::destroy_frame(FrameResources& frame) {
+
+	if (!frame.image) {
+		return;
+	}
+	for (vk::ImageView view : frame.levelViews) {
+		logicalDevice.destroyImageView(view);
+	}
+	frame.levelViews.clear();
+	logicalDevice.destroyImageView(frame.view);
+	logicalDevice.destroyImage(frame.image);
+	logicalDevice.freeMemory(frame.imageMemory);
+	frame.image = nullptr;
+}
+
+vkMesh::DepthPyramid::~DepthPyramid() {
+
+	for (FrameResources& frame : frames) {
+		destroy_frame(frame);
+	}
+	logicalDevice.destroySampler(sampler);
+	//the sets go with their pool
+	logicalDevice.destroyDescriptorPool(descriptorPool);
+	logicalDevice.destroyDescriptorSetLayout(layout);
+}
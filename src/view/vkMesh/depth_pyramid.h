@@ -0,0 +1,108 @@
+#pragma once
+#include "../../config.h"
+
+namespace vkMesh {
+
+	/**
+		Pushed to each level's pass.
+	*/
+	struct DepthPyramidConstants {
+		uint32_t sourceWidth;
+		uint32_t sourceHeight;
+		uint32_t width;
+		uint32_t height;
+		//the source is the depth attachment rather than the level before
+		uint32_t fromDepth;
+	};
+
+	/**
+		For making the depth pyramid
+	*/
+	struct DepthPyramidInputChunk {
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		//most frames which may be recorded at once
+		uint32_t frameCount;
+	};
+
+	/**
+		A mip chain per frame reduced from its depth attachment by a compute
+		pass, for testing bounds against what has already been drawn.
+
+		Each texel holds the farthest depth under it in red and the nearest
+		in green. The first level is half the attachment, rounded up, and
+		each level after it half the one before, down to a single texel, so
+		a texel of level l covers exactly the pixels whose coordinates shifted
+		right by l + 1 give its own. Rows and columns past the attachment's
+		edge repeat its last, which keeps every texel conservative.
+
+		The levels are kept in the general layout, written as storage images
+		and read through a sampler with texelFetch. The descriptor set layout
+		(set 0) holds the source and the level being written.
+	*/
+	class DepthPyramid {
+	public:
+
+		DepthPyramid(DepthPyramidInputChunk input);
+		~DepthPyramid();
+
+		/**
+			Make the frame's pyramid for a depth attachment, replacing any it had.
+			The frame's old pyramid must no longer be in use.
+
+			\param frame the swapchain image whose attachment it is
+			\param depth a view of the attachment's depth aspect, which must be sampleable
+			\param extent the attachment's size, in pixels
+		*/
+		void set_depth(uint32_t frame, vk::ImageView depth, vk::Extent2D extent);
+
+		/**
+			Reduce the frame's depth attachment into its pyramid. Must be recorded
+			outside a renderpass, after the attachment has been moved to the depth
+			read only layout; leaves every level readable by compute shaders.
+		*/
+		void record(vk::CommandBuffer commandBuffer, uint32_t frame);
+
+		/**
+			\returns the whole chain, to bind as a combined image sampler
+		*/
+		vk::DescriptorImageInfo get_descriptor(uint32_t frame);
+
+		/**
+			\returns how many levels the frame's pyramid has
+		*/
+		uint32_t get_levels(uint32_t frame);
+
+		vk::DescriptorSetLayout layout;
+		//made by the engine against layout, destroyed by it too
+		vk::PipelineLayout pipelineLayout;
+		vk::Pipeline pipeline;
+
+		//enough for attachments up to 65536 pixels across
+		static constexpr uint32_t kMaxLevels = 16;
+		static constexpr uint32_t kWorkgroupSize = 8;
+
+	private:
+
+		struct FrameResources {
+			vk::Image image;
+			vk::DeviceMemory imageMemory;
+			vk::ImageView view;
+			//one per level, for writing it and reading it into the next
+			std::vector<vk::ImageView> levelViews;
+			std::vector<vk::Extent2D> levelSizes;
+			vk::Extent2D depthSize;
+			//allocated the first time the frame is given an attachment, then rewritten
+			std::vector<vk::DescriptorSet> descriptorSets;
+		};
+
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		vk::DescriptorPool descriptorPool;
+		//nearest filtering, texelFetch ignores it but a combined image sampler needs one
+		vk::Sampler sampler;
+		std::vector<FrameResources> frames;
+
+		void destroy_frame(FrameResources& frame);
+	};
+}
@@ -0,0 +1,170 @@
+#include "draw_batcher.h"
+#include "../vkInit/descriptors.h"
+#include "../vkUtil/memory.h"
+#include <algorithm>
+
+vkMesh::DrawBatcher::DrawBatcher(DrawBatcherInputChunk input) {
+
+	logicalDevice = input.logicalDevice;
+	physicalDevice = input.physicalDevice;
+
+	vkInit::descriptorSetLayoutData bindings;
+	bindings.count = 2;
+
+	bindings.indices.push_back(0);
+	bindings.types.push_back(vk::DescriptorType::eCombinedImageSampler);
+	bindings.counts.push_back(kMaxMaterials);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eFragment);
+
+	bindings.indices.push_back(1);
+	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eVertex);
+
+	layout = vkInit::make_descriptor_set_layout(logicalDevice, bindings);
+	descriptorPool = vkInit::make_descriptor_pool(logicalDevice, input.frameCount, bindings);
+
+	frames.resize(input.frameCount);
+	for (FrameResources& frame : frames) {
+		frame.commandCapacity = 0;
+		frame.drawCapacity = 0;
+		frame.materialViews.assign(kMaxMaterials, vk::ImageView());
+		frame.descriptorSet = vkInit::allocate_descriptor_set(logicalDevice, descriptorPool, layout);
+		frame.descriptorWrites = 0;
+	}
+}
+
+Buffer vkMesh::DrawBatcher::make_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage, void** writeLocation) {
+
+	BufferInputChunk inputChunk;
+	inputChunk.logicalDevice = logicalDevice;
+	inputChunk.physicalDevice = physicalDevice;
+	inputChunk.size = size;
+	inputChunk.usage = usage;
+	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+
+	Buffer buffer = vkUtil::createBuffer(inputChunk);
+	*writeLocation = logicalDevice.mapMemory(buffer.bufferMemory, 0, size);
+	return buffer;
+}
+
+void vkMesh::DrawBatcher::prepare(uint32_t frameIndex, const std::vector<vk::DrawIndexedIndirectCommand>& commands,
+	const std::vector<BatchedDraw>& draws, const std::vector<vk::DescriptorImageInfo>& materials) {
+
+	FrameResources& frame = frames[frameIndex];
+	uint32_t commandCount = static_cast<uint32_t>(commands.size());
+	uint32_t drawCount = static_cast<uint32_t>(draws.size());
+
+	//grow by doubling. Empty batches still bind real buffers
+	if (commandCount > frame.commandCapacity || frame.commandCapacity == 0) {
+		if (frame.commandCapacity > 0) {
+			retired.push_back(frame.commands);
+		}
+		frame.commandCapacity = std::max({ commandCount, 2 * frame.commandCapacity, 1u });
+		frame.commands = make_buffer(
+			sizeof(vk::DrawIndexedIndirectCommand) * frame.commandCapacity,
+			vk::BufferUsageFlagBits::eIndirectBuffer, &frame.commandsWriteLocation);
+	}
+	if (drawCount > frame.drawCapacity || frame.drawCapacity == 0) {
+		if (frame.drawCapacity > 0) {
+			retired.push_back(frame.draws);
+		}
+		frame.drawCapacity = std::max({ drawCount, 2 * frame.drawCapacity, 1u });
+		frame.draws = make_buffer(
+			sizeof(BatchedDraw) * frame.drawCapacity,
+			vk::BufferUsageFlagBits::eStorageBuffer, &frame.drawsWriteLocation);
+
+		vk::DescriptorBufferInfo bufferInfo;
+		bufferInfo.buffer = frame.draws.buffer;
+		bufferInfo.offset = 0;
+		bufferInfo.range = VK_WHOLE_SIZE;
+
+		vk::WriteDescriptorSet writeInfo;
+		writeInfo.dstSet = frame.descriptorSet;
+		writeInfo.dstBinding = 1;
+		writeInfo.dstArrayElement = 0;
+		writeInfo.descriptorType = vk::DescriptorType::eStorageBuffer;
+		writeInfo.descriptorCount = 1;
+		writeInfo.pBufferInfo = &bufferInfo;
+		logicalDevice.updateDescriptorSets(writeInfo, nullptr);
+		++frame.descriptorWrites;
+	}
+
+	memcpy(frame.commandsWriteLocation, commands.data(), sizeof(vk::DrawIndexedIndirectCommand) * commandCount);
+	memcpy(frame.drawsWriteLocation, draws.data(), sizeof(BatchedDraw) * drawCount);
+	write_materials(frame, materials);
+}
+
+void vkMesh::DrawBatcher::write_materials(FrameResources& frame, const std::vector<vk::DescriptorImageInfo>& materials) {
+
+	//nothing is drawn without a texture, the slots keep what they had
+	if (materials.empty()) {
+		return;
+	}
+
+	//textures stream in and out, so most frames rewrite a slot or two at most
+	std::vector<vk::DescriptorImageInfo> imageInfo;
+	std::vector<vk::WriteDescriptorSet> writeInfo;
+	imageInfo.reserve(kMaxMaterials);
+	for (uint32_t slot = 0; slot < kMaxMaterials; ++slot) {
+
+		const vk::DescriptorImageInfo& material = slot < materials.size() ? materials[slot] : materials[0];
+		if (frame.materialViews[slot] == material.imageView) {
+			continue;
+		}
+		frame.materialViews[slot] = material.imageView;
+
+		//runs of changed slots go in one write
+		if (!writeInfo.empty() && writeInfo.back().dstArrayElement + writeInfo.back().descriptorCount == slot) {
+			imageInfo.push_back(material);
+			++writeInfo.back().descriptorCount;
+			continue;
+		}
+		imageInfo.push_back(material);
+		vk::WriteDescriptorSet write;
+		write.dstSet = frame.descriptorSet;
+		write.dstBinding = 0;
+		write.dstArrayElement = slot;
+		write.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+		write.descriptorCount = 1;
+		write.pImageInfo = &imageInfo.back();
+		writeInfo.push_back(write);
+	}
+
+	if (!writeInfo.empty()) {
+		logicalDevice.updateDescriptorSets(static_cast<uint32_t>(writeInfo.size()), writeInfo.data(), 0, nullptr);
+		++frame.descriptorWrites;
+	}
+}
+
+vk::Buffer vkMesh::DrawBatcher::get_commands(uint32_t frameIndex) {
+	return frames[frameIndex].commands.buffer;
+}
+
+vk::DescriptorSet vkMesh::DrawBatcher::get_descriptor_set(uint32_t frameIndex) {
+	return frames[frameIndex].descriptorSet;
+}
+
+uint64_t vkMesh::DrawBatcher::get_descriptor_version(uint32_t frameIndex) {
+	return frames[frameIndex].descriptorWrites;
+}
+
+vkMesh::DrawBatcher::~DrawBatcher() {
+
+	for (FrameResources& frame : frames) {
+		if (frame.commandCapacity > 0) {
+			retired.push_back(frame.commands);
+		}
+		if (frame.drawCapacity > 0) {
+			retired.push_back(frame.draws);
+		}
+	}
+	//freeing mapped memory unmaps it
+	for (Buffer& buffer : retired) {
+		logicalDevice.destroyBuffer(buffer.buffer);
+		logicalDevice.freeMemory(buffer.bufferMemory);
+	}
+
+	logicalDevice.destroyDescriptorPool(descriptorPool);
+	logicalDevice.destroyDescriptorSetLayout(layout);
+}
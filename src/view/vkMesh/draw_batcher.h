@@ -0,0 +1,104 @@
+#pragma once
+#include "../../config.h"
+
+namespace vkMesh {
+
+	/**
+		What the vertex shader looks up for one batched draw.
+	*/
+	struct BatchedDraw {
+		//offset.xy, scale.xy of the draw's mesh
+		glm::vec4 quantization;
+		//into the batch's texture array
+		uint32_t material;
+		uint32_t padding[3];
+	};
+	static_assert(sizeof(BatchedDraw) == 32, "batched draw layout changed");
+
+	/**
+		For making the draw batcher
+	*/
+	struct DrawBatcherInputChunk {
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		//most frames which may be recorded at once
+		uint32_t frameCount;
+	};
+
+	/**
+		Lets every mesh and material of the scene go out in one multi-draw
+		indirect call. Each draw finds its mesh's quantization and its texture
+		through gl_DrawID instead of push constants and a descriptor set bound
+		per material.
+
+		The descriptor set (set 1) holds the frame's textures as one array
+		(binding 0), then the per draw records (binding 1). Texture slots past
+		the ones in use point at the first texture, so the whole array stays
+		valid without partially bound descriptors.
+	*/
+	class DrawBatcher {
+	public:
+
+		//every texture the asset manager has room for, and its placeholder
+		static const uint32_t kMaxMaterials = 1025;
+
+		DrawBatcher(DrawBatcherInputChunk input);
+		~DrawBatcher();
+
+		/**
+			Write the frame's commands and draw records, and point its texture
+			array at the given textures, rewriting only the slots which changed.
+
+			\param frame the swapchain image being recorded
+			\param commands the indirect commands, may be empty when another
+				buffer holds them
+			\param draws the records the vertex shader indexes
+			\param materials at most kMaxMaterials textures, indexed by the records
+		*/
+		void prepare(uint32_t frame, const std::vector<vk::DrawIndexedIndirectCommand>& commands,
+			const std::vector<BatchedDraw>& draws, const std::vector<vk::DescriptorImageInfo>& materials);
+
+		/**
+			\returns the frame's indirect commands
+		*/
+		vk::Buffer get_commands(uint32_t frame);
+
+		/**
+			\returns the frame's descriptor set
+		*/
+		vk::DescriptorSet get_descriptor_set(uint32_t frame);
+
+		/**
+			Writing a descriptor set invalidates recordings which bind it.
+			\returns how many times the frame's descriptor set has been written
+		*/
+		uint64_t get_descriptor_version(uint32_t frame);
+
+		vk::DescriptorSetLayout layout;
+
+	private:
+
+		struct FrameResources {
+			Buffer commands;
+			Buffer draws;
+			void* commandsWriteLocation;
+			void* drawsWriteLocation;
+			uint32_t commandCapacity;
+			uint32_t drawCapacity;
+			//what each texture slot points at, null until first written
+			std::vector<vk::ImageView> materialViews;
+			vk::DescriptorSet descriptorSet;
+			uint64_t descriptorWrites;
+		};
+
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		vk::DescriptorPool descriptorPool;
+		std::vector<FrameResources> frames;
+		//outgrown buffers may still be read by a frame in flight, they go at shutdown
+		std::vector<Buffer> retired;
+
+		Buffer make_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage, void** writeLocation);
+		void write_materials(FrameResources& frame, const std::vector<vk::DescriptorImageInfo>& materials);
+	};
+}
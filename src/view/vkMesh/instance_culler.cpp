@@ -0,0 +1,375 @@
+#include "instance_culler.h"
+#include "../vkInit/descriptors.h"
+#include "../vkUtil/memory.h"
+#include <algorithm>
+
+namespace {
+
+	//the storage buffers, the vertex shader reads the first nine
+	const uint32_t kBufferBindings = 10;
+	const uint32_t kVertexBindings = 9;
+	const uint32_t kPyramidBinding = 10;
+
+	//matches VkDrawIndexedIndirectCommand
+	const vk::DeviceSize kCommandStride = 5 * sizeof(uint32_t);
+
+	//set in an instance record when the instance is hidden
+	const uint32_t kHiddenRecord = 0x80000000;
+}
+
+vkMesh::InstanceCuller::InstanceCuller(InstanceCullerInputChunk input) {
+
+	logicalDevice = input.logicalDevice;
+	physicalDevice = input.physicalDevice;
+	uploads = input.uploads;
+
+	//the vertex shader reads the transforms, ids and command groups
+	vkInit::descriptorSetLayoutData bindings;
+	bindings.count = kPyramidBinding + 1;
+	for (uint32_t i = 0; i < kBufferBindings; ++i) {
+		bindings.indices.push_back(i);
+		bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+		bindings.counts.push_back(1);
+		bindings.stages.push_back(i < kVertexBindings ?
+			vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eVertex : vk::ShaderStageFlags(vk::ShaderStageFlagBits::eCompute));
+	}
+	bindings.indices.push_back(kPyramidBinding);
+	bindings.types.push_back(vk::DescriptorType::eCombinedImageSampler);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eCompute);
+	layout = vkInit::make_descriptor_set_layout(logicalDevice, bindings);
+	descriptorPool = vkInit::make_descriptor_pool(logicalDevice, input.frameCount, bindings);
+
+	visibilityCapacity = 0;
+	frames.resize(input.frameCount);
+	for (FrameResources& frame : frames) {
+		frame.instanceCapacity = 0;
+		frame.groupCapacity = 0;
+		frame.current = false;
+		frame.boundVisibility = nullptr;
+		frame.clearVisibility = false;
+		frame.pyramid = vk::DescriptorImageInfo();
+		frame.descriptorSet = vkInit::allocate_descriptor_set(logicalDevice, descriptorPool, layout);
+		frame.descriptorWrites = 0;
+	}
+}
+
+Buffer vkMesh::InstanceCuller::make_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage, bool hostVisible, void** writeLocation) {
+
+	BufferInputChunk inputChunk;
+	inputChunk.logicalDevice = logicalDevice;
+	inputChunk.physicalDevice = physicalDevice;
+	inputChunk.size = size;
+	inputChunk.usage = usage;
+	inputChunk.memoryProperties = hostVisible ?
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent :
+		vk::MemoryPropertyFlagBits::eDeviceLocal;
+
+	Buffer buffer = vkUtil::createBuffer(inputChunk);
+	if (hostVisible) {
+		*writeLocation = logicalDevice.mapMemory(buffer.bufferMemory, 0, size);
+	}
+	return buffer;
+}
+
+void vkMesh::InstanceCuller::release_later(const std::vector<Buffer>& buffers) {
+
+	//frames already recorded may still read them, freeing mapped memory unmaps it
+	vk::Device device = logicalDevice;
+	uploads->release_later([device, buffers]() {
+		for (const Buffer& buffer : buffers) {
+			device.destroyBuffer(buffer.buffer);
+			device.freeMemory(buffer.bufferMemory);
+		}
+	});
+}
+
+void vkMesh::InstanceCuller::prepare(uint32_t frameIndex, const InstanceStore& instances, const std::vector<InstanceGroup>& sceneGroups,
+	const std::vector<InstanceCullGroup>& groups, const std::vector<vk::DrawIndexedIndirectCommand>& draws,
+	const std::vector<uint32_t>& stalePages, bool relayout) {
+
+	FrameResources& frame = frames[frameIndex];
+	uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+	uint32_t groupCount = static_cast<uint32_t>(groups.size());
+	const vk::BufferUsageFlags storage = vk::BufferUsageFlagBits::eStorageBuffer;
+	const vk::BufferUsageFlags cleared = storage | vk::BufferUsageFlagBits::eTransferDst;
+	const vk::BufferUsageFlags indirect = cleared | vk::BufferUsageFlagBits::eIndirectBuffer;
+
+	//grow by doubling, a grown frame starts over. Empty scenes still bind real buffers
+	bool grown = false;
+	if (instanceCount > frame.instanceCapacity || frame.instanceCapacity == 0) {
+		if (frame.instanceCapacity > 0) {
+			release_later({ frame.transforms, frame.records, frame.ids });
+		}
+		frame.instanceCapacity = std::max({ instanceCount, 2 * frame.instanceCapacity, 1u });
+		frame.transforms = make_buffer(sizeof(glm::mat4) * frame.instanceCapacity, storage, true, &frame.transformsWriteLocation);
+		frame.records = make_buffer(sizeof(uint32_t) * frame.instanceCapacity, storage, true, &frame.recordsWriteLocation);
+		//any level may take every instance of its group
+		frame.ids = make_buffer(sizeof(uint32_t) * VertexMenagerie::kMaxLods * frame.instanceCapacity, storage, false, nullptr);
+		grown = true;
+	}
+	if (groupCount > frame.groupCapacity || frame.groupCapacity == 0) {
+		if (frame.groupCapacity > 0) {
+			release_later({
+				frame.groups, frame.templates, frame.counters, frame.commands, frame.counts, frame.drawGroups, frame.readback });
+		}
+		frame.groupCapacity = std::max({ groupCount, 2 * frame.groupCapacity, 1u });
+		uint32_t drawCapacity = VertexMenagerie::kMaxLods * frame.groupCapacity;
+		frame.groups = make_buffer(sizeof(InstanceCullGroup) * frame.groupCapacity, storage, true, &frame.groupsWriteLocation);
+		frame.templates = make_buffer(kCommandStride * drawCapacity, storage, true, &frame.templatesWriteLocation);
+		//the late pass's follow the early pass's
+		frame.counters = make_buffer(2 * sizeof(uint32_t) * drawCapacity, cleared, false, nullptr);
+		frame.commands = make_buffer(2 * kCommandStride * drawCapacity, indirect, false, nullptr);
+		frame.counts = make_buffer(4 * sizeof(uint32_t), indirect | vk::BufferUsageFlagBits::eTransferSrc, false, nullptr);
+		frame.drawGroups = make_buffer(2 * sizeof(uint32_t) * drawCapacity, storage, false, nullptr);
+		frame.readback = make_buffer(2 * sizeof(uint32_t), vk::BufferUsageFlagBits::eTransferDst, true, &frame.readbackLocation);
+		memset(frame.readbackLocation, 0, 2 * sizeof(uint32_t));
+		grown = true;
+	}
+
+	//shared by the frames, each points its set at the current one when it is next prepared.
+	//Frames recorded before the one which made it has cleared it see undefined visibility, which
+	//only moves instances between the early and late draws
+	if (instanceCount > visibilityCapacity || visibilityCapacity == 0) {
+		if (visibilityCapacity > 0) {
+			release_later({ visibility });
+		}
+		visibilityCapacity = std::max({ instanceCount, 2 * visibilityCapacity, 1u });
+		visibility = make_buffer(sizeof(uint32_t) * visibilityCapacity, cleared, false, nullptr);
+		frame.clearVisibility = true;
+	}
+	if (grown) {
+		frame.current = false;
+	}
+	if (grown || frame.boundVisibility != visibility.buffer) {
+		frame.boundVisibility = visibility.buffer;
+		write_descriptor_set(frame);
+	}
+
+	//instances only change group or visibility when the layout does
+	if (!frame.current || relayout) {
+		uint32_t* records = static_cast<uint32_t*>(frame.recordsWriteLocation);
+		for (uint32_t g = 0; g < sceneGroups.size(); ++g) {
+			for (uint32_t i = 0; i < sceneGroups[g].instanceCount; ++i) {
+				uint32_t instance = sceneGroups[g].firstInstance + i;
+				records[instance] = g | ((instances.flags[instance] & INSTANCE_UNDRAWN) ? kHiddenRecord : 0);
+			}
+		}
+	}
+
+	glm::mat4* transforms = static_cast<glm::mat4*>(frame.transformsWriteLocation);
+	if (!frame.current) {
+		instances.write_transforms(0, instanceCount, nullptr, transforms);
+	}
+	else {
+		for (uint32_t page : stalePages) {
+			size_t first = static_cast<size_t>(page) * InstanceStore::kPageSize;
+			size_t count = std::min<size_t>(InstanceStore::kPageSize, instanceCount - first);
+			instances.write_transforms(first, count, nullptr, transforms + first);
+		}
+	}
+	frame.current = true;
+
+	//a few bytes a group, meshes arriving change them
+	memcpy(frame.groupsWriteLocation, groups.data(), sizeof(InstanceCullGroup) * groupCount);
+	memcpy(frame.templatesWriteLocation, draws.data(), kCommandStride * draws.size());
+}
+
+void vkMesh::InstanceCuller::write_descriptor_set(FrameResources& frame) {
+
+	vk::Buffer buffers[kBufferBindings] = {
+		frame.transforms.buffer, frame.records.buffer, frame.groups.buffer, frame.templates.buffer,
+		frame.ids.buffer, frame.counters.buffer, frame.commands.buffer, frame.counts.buffer,
+		frame.drawGroups.buffer, frame.boundVisibility
+	};
+	vk::DescriptorBufferInfo bufferInfo[kBufferBindings];
+	vk::WriteDescriptorSet writeInfo[kBufferBindings + 1];
+	for (uint32_t i = 0; i < kBufferBindings; ++i) {
+		bufferInfo[i].buffer = buffers[i];
+		bufferInfo[i].offset = 0;
+		bufferInfo[i].range = VK_WHOLE_SIZE;
+
+		writeInfo[i].dstSet = frame.descriptorSet;
+		writeInfo[i].dstBinding = i;
+		writeInfo[i].dstArrayElement = 0;
+		writeInfo[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+		writeInfo[i].descriptorCount = 1;
+		writeInfo[i].pBufferInfo = &bufferInfo[i];
+	}
+
+	writeInfo[kBufferBindings].dstSet = frame.descriptorSet;
+	writeInfo[kBufferBindings].dstBinding = kPyramidBinding;
+	writeInfo[kBufferBindings].dstArrayElement = 0;
+	writeInfo[kBufferBindings].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+	writeInfo[kBufferBindings].descriptorCount = 1;
+	writeInfo[kBufferBindings].pImageInfo = &frame.pyramid;
+	logicalDevice.updateDescriptorSets(kBufferBindings + 1, writeInfo, 0, nullptr);
+	++frame.descriptorWrites;
+}
+
+void vkMesh::InstanceCuller::set_depth_pyramid(uint32_t frameIndex, const vk::DescriptorImageInfo& pyramid) {
+
+	FrameResources& frame = frames[frameIndex];
+	frame.pyramid = pyramid;
+	if (frame.groupCapacity == 0) {
+		//written with the buffers once they are made
+		return;
+	}
+
+	vk::WriteDescriptorSet writeInfo;
+	writeInfo.dstSet = frame.descriptorSet;
+	writeInfo.dstBinding = kPyramidBinding;
+	writeInfo.dstArrayElement = 0;
+	writeInfo.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+	writeInfo.descriptorCount = 1;
+	writeInfo.pImageInfo = &frame.pyramid;
+	logicalDevice.updateDescriptorSets(1, &writeInfo, 0, nullptr);
+	++frame.descriptorWrites;
+}
+
+void vkMesh::InstanceCuller::record(vk::CommandBuffer commandBuffer, uint32_t frameIndex, vk::DescriptorSet frameSet,
+	const InstanceCullConstants& constants) {
+
+	FrameResources& frame = frames[frameIndex];
+	uint32_t drawCapacity = VertexMenagerie::kMaxLods * frame.groupCapacity;
+
+	//without a draw count the whole region is drawn, the tail must read as empty draws
+	commandBuffer.fillBuffer(frame.commands.buffer, 0, 2 * kCommandStride * drawCapacity, 0);
+	commandBuffer.fillBuffer(frame.counters.buffer, 0, 2 * sizeof(uint32_t) * drawCapacity, 0);
+	commandBuffer.fillBuffer(frame.counts.buffer, 0, 4 * sizeof(uint32_t), 0);
+	if (frame.clearVisibility) {
+		commandBuffer.fillBuffer(visibility.buffer, 0, sizeof(uint32_t) * visibilityCapacity, 0);
+		frame.clearVisibility = false;
+	}
+
+	//the last frame's late pass wrote the visibility this one reads
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), barrier, nullptr, nullptr
+	);
+
+	record_passes(commandBuffer, frame, frameSet, constants);
+
+	//the late pass adds its own
+	if (constants.pass == InstanceCullPass::eSingle) {
+		copy_totals(commandBuffer, frame);
+	}
+}
+
+void vkMesh::InstanceCuller::record_late(vk::CommandBuffer commandBuffer, uint32_t frameIndex, vk::DescriptorSet frameSet,
+	const InstanceCullConstants& constants) {
+
+	//the early passes left everything they wrote readable
+	FrameResources& frame = frames[frameIndex];
+	record_passes(commandBuffer, frame, frameSet, constants);
+	copy_totals(commandBuffer, frame);
+}
+
+void vkMesh::InstanceCuller::record_passes(vk::CommandBuffer commandBuffer, FrameResources& frame, vk::DescriptorSet frameSet,
+	const InstanceCullConstants& constants) {
+
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, frameSet, nullptr);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 2, frame.descriptorSet, nullptr);
+	commandBuffer.pushConstants(
+		pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(InstanceCullConstants), &constants
+	);
+
+	if (constants.instanceCount > 0) {
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline);
+		commandBuffer.dispatch((constants.instanceCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+	}
+
+	//the compaction reads every counter the cull wrote
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), barrier, nullptr, nullptr
+	);
+
+	if (constants.drawCount > 0) {
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compactPipeline);
+		commandBuffer.dispatch((constants.drawCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+	}
+
+	//the late pass reads the early counters, and appends to the id lists the early draws read
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead
+		| vk::AccessFlagBits::eTransferRead;
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eComputeShader,
+		vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eTransfer
+		| vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), barrier, nullptr, nullptr
+	);
+}
+
+void vkMesh::InstanceCuller::copy_totals(vk::CommandBuffer commandBuffer, FrameResources& frame) {
+
+	//read on the host once the frame's fence is signalled
+	vk::BufferCopy totals[2];
+	for (uint32_t i = 0; i < 2; ++i) {
+		totals[i].srcOffset = i * kLateCountOffset + sizeof(uint32_t);
+		totals[i].dstOffset = i * sizeof(uint32_t);
+		totals[i].size = sizeof(uint32_t);
+	}
+	commandBuffer.copyBuffer(frame.counts.buffer, frame.readback.buffer, 2, totals);
+}
+
+void vkMesh::InstanceCuller::invalidate(uint32_t frameIndex) {
+	frames[frameIndex].current = false;
+}
+
+vk::Buffer vkMesh::InstanceCuller::get_commands(uint32_t frameIndex) {
+	return frames[frameIndex].commands.buffer;
+}
+
+vk::Buffer vkMesh::InstanceCuller::get_counts(uint32_t frameIndex) {
+	return frames[frameIndex].counts.buffer;
+}
+
+vk::DescriptorSet vkMesh::InstanceCuller::get_descriptor_set(uint32_t frameIndex) {
+	return frames[frameIndex].descriptorSet;
+}
+
+uint64_t vkMesh::InstanceCuller::get_descriptor_version(uint32_t frameIndex) {
+	return frames[frameIndex].descriptorWrites;
+}
+
+uint32_t vkMesh::InstanceCuller::get_visible(uint32_t frameIndex) {
+	const FrameResources& frame = frames[frameIndex];
+	if (frame.groupCapacity == 0) {
+		return 0;
+	}
+	const uint32_t* totals = static_cast<const uint32_t*>(frame.readbackLocation);
+	return totals[0] + totals[1];
+}
+
+vkMesh::InstanceCuller::~InstanceCuller() {
+
+	std::vector<Buffer> buffers;
+	for (FrameResources& frame : frames) {
+		if (frame.instanceCapacity > 0) {
+			buffers.insert(buffers.end(), { frame.transforms, frame.records, frame.ids });
+		}
+		if (frame.groupCapacity > 0) {
+			buffers.insert(buffers.end(), {
+				frame.groups, frame.templates, frame.counters, frame.commands, frame.counts, frame.drawGroups, frame.readback });
+		}
+	}
+	if (visibilityCapacity > 0) {
+		buffers.push_back(visibility);
+	}
+	//freeing mapped memory unmaps it
+	for (Buffer& buffer : buffers) {
+		logicalDevice.destroyBuffer(buffer.buffer);
+		logicalDevice.freeMemory(buffer.bufferMemory);
+	}
+
+	logicalDevice.destroyDescriptorPool(descriptorPool);
+	logicalDevice.destroyDescriptorSetLayout(layout);
+}
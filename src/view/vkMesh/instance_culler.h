@@ -0,0 +1,248 @@
+#pragma once
+#include "../../config.h"
+#include "../../model/vertex_menagerie.h"
+#include "../../model/scene.h"
+#include "../vkUtil/upload.h"
+
+namespace vkMesh {
+
+	/**
+		What the culling shader needs to know about one scene group.
+	*/
+	struct InstanceCullGroup {
+		//of the group's mesh, 0 leaves the group undrawn until the mesh arrives
+		float radius;
+		uint32_t lodCount;
+		uint32_t padding[2];
+		//simplification error of each level, in mesh units
+		float lodErrors[VertexMenagerie::kMaxLods];
+		uint32_t padding2[3];
+	};
+	static_assert(sizeof(InstanceCullGroup) == 48, "instance cull group layout changed");
+
+	/**
+		Which instances a cull takes, see InstanceCuller.
+	*/
+	enum class InstanceCullPass : uint32_t {
+		//everything in view, with no occlusion test
+		eSingle = 0,
+		//in view and visible last frame
+		eEarly = 1,
+		//in view, not drawn early and in front of the depth pyramid
+		eLate = 2
+	};
+
+	/**
+		Pushed to both passes.
+	*/
+	struct InstanceCullConstants {
+		uint32_t instanceCount;
+		//groups times VertexMenagerie::kMaxLods
+		uint32_t drawCount;
+		//pixels one world unit covers at depth 1
+		float pixelScale;
+		float lodPixelError;
+		InstanceCullPass pass;
+		//of the frame's DepthPyramid, read by the late pass
+		uint32_t pyramidLevels;
+		//the depth attachment the pyramid was reduced from, in pixels
+		uint32_t depthWidth;
+		uint32_t depthHeight;
+	};
+
+	/**
+		For making the instance culler
+	*/
+	struct InstanceCullerInputChunk {
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		vkUtil::UploadQueue* uploads;
+		//most frames which may be recorded at once
+		uint32_t frameCount;
+	};
+
+	/**
+		Culls and sorts scene instances on the GPU, so the CPU's cost per
+		frame is the changed transforms and a few bytes per group.
+
+		Every instance's transform lives in store order in the frame's
+		transform buffer. A first pass runs a thread per instance: visible
+		instances pick their level of detail and append their store index to
+		that (group, level) draw's id list. A second pass runs a thread per
+		draw and compacts the non-empty ones to the front of the commands,
+		counting them and noting each one's group, so the whole scene is one
+		drawIndexedIndirectCount. The vertex shader finds its transform
+		through the id list, and its mesh and material through the group.
+
+		With occlusion culling the scene is drawn in two halves. The early
+		pass takes the instances in view which were visible last frame, and
+		they are drawn. The frame's depth pyramid is reduced from what they
+		left, then the late pass tests every instance in view against it:
+		each one's visibility is kept for next frame, and those which are
+		visible but were not drawn early are drawn in a second renderpass.
+		The late pass appends to each draw's id list after the early
+		instances, counting them separately, and its commands, counts and
+		command groups follow the early ones', drawCount commands along.
+
+		The descriptor set (set 2) holds, in binding order: transforms,
+		instance records (group, and the hidden flag in the top bit), groups,
+		draw templates, instance ids, per draw instance counters (early, then
+		late), commands, the command count followed by the total of visible
+		instances (early, then late), the group of each command, each
+		instance's visibility last frame, shared by every frame, and the
+		frame's depth pyramid.
+	*/
+	class InstanceCuller {
+	public:
+
+		InstanceCuller(InstanceCullerInputChunk input);
+		~InstanceCuller();
+
+		/**
+			Size the frame's buffers for the scene, point its descriptor set at
+			them and write what the frame has not seen yet.
+
+			\param frame the swapchain image being recorded
+			\param instances every instance of the scene
+			\param sceneGroups the runs of instances each group covers
+			\param groups what the shader needs of each group
+			\param draws a template per (group, level), instanceCount is ignored
+				and firstInstance is where the draw's id list starts
+			\param stalePages pages of instances changed since the frame last took them
+			\param relayout whether instances were added or their flags changed
+		*/
+		void prepare(uint32_t frame, const InstanceStore& instances, const std::vector<InstanceGroup>& sceneGroups,
+			const std::vector<InstanceCullGroup>& groups, const std::vector<vk::DrawIndexedIndirectCommand>& draws,
+			const std::vector<uint32_t>& stalePages, bool relayout);
+
+		/**
+			Clear the counters, run both passes and make the commands visible to
+			the indirect draws. Must be recorded outside a renderpass.
+			\param frameSet the frame's camera descriptor set (set 0)
+			\param constants a single or early pass
+		*/
+		void record(vk::CommandBuffer commandBuffer, uint32_t frame, vk::DescriptorSet frameSet, const InstanceCullConstants& constants);
+
+		/**
+			Run both passes again for the late instances, once the early ones
+			are drawn and the depth pyramid is reduced from them.
+			Must be recorded outside a renderpass.
+			\param frameSet the frame's camera descriptor set (set 0)
+			\param constants the early pass's, with the late pass and the pyramid
+		*/
+		void record_late(vk::CommandBuffer commandBuffer, uint32_t frame, vk::DescriptorSet frameSet, const InstanceCullConstants& constants);
+
+		/**
+			Point the frame's descriptor set at its depth pyramid. Must be given
+			before the frame is first prepared, and again whenever the pyramid is
+			made again.
+			\param pyramid the whole chain, as a combined image sampler
+		*/
+		void set_depth_pyramid(uint32_t frame, const vk::DescriptorImageInfo& pyramid);
+
+		/**
+			The frame's transforms were not kept up to date, write them in full next time.
+		*/
+		void invalidate(uint32_t frame);
+
+		/**
+			\returns the frame's indirect commands, room for VertexMenagerie::kMaxLods per group,
+			twice over
+		*/
+		vk::Buffer get_commands(uint32_t frame);
+
+		/**
+			\returns the frame's count buffer, the number of early commands comes first,
+			the number of late ones at kLateCountOffset
+		*/
+		vk::Buffer get_counts(uint32_t frame);
+
+		/**
+			\returns the frame's descriptor set
+		*/
+		vk::DescriptorSet get_descriptor_set(uint32_t frame);
+
+		/**
+			Writing a descriptor set invalidates recordings which bind it.
+			\returns how many times the frame's descriptor set has been written
+		*/
+		uint64_t get_descriptor_version(uint32_t frame);
+
+		/**
+			\returns instances drawn the last time the frame finished
+		*/
+		uint32_t get_visible(uint32_t frame);
+
+		vk::DescriptorSetLayout layout;
+		//made by the engine against layout, destroyed by it too
+		vk::PipelineLayout pipelineLayout;
+		vk::Pipeline cullPipeline;
+		vk::Pipeline compactPipeline;
+
+		static constexpr uint32_t kWorkgroupSize = 64;
+		//bytes into the count buffer
+		static constexpr vk::DeviceSize kLateCountOffset = 2 * sizeof(uint32_t);
+
+	private:
+
+		struct FrameResources {
+			//written by the host
+			Buffer transforms;
+			Buffer records;
+			Buffer groups;
+			Buffer templates;
+			void* transformsWriteLocation;
+			void* recordsWriteLocation;
+			void* groupsWriteLocation;
+			void* templatesWriteLocation;
+			//written by the passes
+			Buffer ids;
+			Buffer counters;
+			Buffer commands;
+			Buffer counts;
+			Buffer drawGroups;
+			//the early and late visible totals, copied back
+			Buffer readback;
+			void* readbackLocation;
+			uint32_t instanceCapacity;
+			uint32_t groupCapacity;
+			//whether the transforms and records match the store, bar the stale pages
+			bool current;
+			//the visibility buffer the set points at, which the frame clears if it made it
+			vk::Buffer boundVisibility;
+			bool clearVisibility;
+			vk::DescriptorImageInfo pyramid;
+			vk::DescriptorSet descriptorSet;
+			uint64_t descriptorWrites;
+		};
+
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		vk::DescriptorPool descriptorPool;
+		std::vector<FrameResources> frames;
+		//per store instance, written by every frame's late pass, read by the next frame's early pass
+		Buffer visibility;
+		uint32_t visibilityCapacity;
+		vkUtil::UploadQueue* uploads;
+
+		Buffer make_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage, bool hostVisible, void** writeLocation);
+
+		/**
+			Free outgrown buffers once the frames which may still read them have finished.
+		*/
+		void release_later(const std::vector<Buffer>& buffers);
+		void write_descriptor_set(FrameResources& frame);
+
+		/**
+			Bind the frame's sets and constants, run the cull, then the compaction,
+			and make the commands visible to the draws and to later passes.
+		*/
+		void record_passes(vk::CommandBuffer commandBuffer, FrameResources& frame, vk::DescriptorSet frameSet,
+			const InstanceCullConstants& constants);
+
+		/**
+			Copy the visible totals back, once the last pass has run.
+		*/
+		void copy_totals(vk::CommandBuffer commandBuffer, FrameResources& frame);
+	};
+}
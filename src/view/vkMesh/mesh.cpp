@@ -1,4 +1,6 @@
 #include "mesh.h"
+#include "../../model/vertex_encoding.h"
+#include "../../model/static_batcher.h"
 
 /**
 		\returns the input binding description for a (vec2 pos, vec3 color) vertex format.
@@ -61,4 +63,109 @@
 		attributes[2].offset = 5 * sizeof(float);
 
 		return attributes;
-	}
\ No newline at end of file
+	}
+
+	vk::VertexInputBindingDescription vkMesh::getCompactBindingDescription() {
+
+		vk::VertexInputBindingDescription bindingDescription;
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(CompactVertex);
+		bindingDescription.inputRate = vk::VertexInputRate::eVertex;
+
+		return bindingDescription;
+	}
+
+	std::vector<vk::VertexInputAttributeDescription> vkMesh::getCompactAttributeDescriptions() {
+
+		std::vector<vk::VertexInputAttributeDescription> attributes(3);
+
+		//Pos, dequantized in the vertex shader
+		attributes[0].binding = 0;
+		attributes[0].location = 0;
+		attributes[0].format = vk::Format::eR16G16Snorm;
+		attributes[0].offset = offsetof(CompactVertex, position);
+
+		//Color
+		attributes[1].binding = 0;
+		attributes[1].location = 1;
+		attributes[1].format = vk::Format::eR8G8B8A8Unorm;
+		attributes[1].offset = offsetof(CompactVertex, color);
+
+		//TexCoord
+		attributes[2].binding = 0;
+		attributes[2].location = 2;
+		attributes[2].format = vk::Format::eR16G16Sfloat;
+		attributes[2].offset = offsetof(CompactVertex, texCoord);
+
+		return attributes;
+	}
+
+	vk::VertexInputBindingDescription vkMesh::getCompactModelBindingDescription() {
+
+		vk::VertexInputBindingDescription bindingDescription;
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(CompactModelVertex);
+		bindingDescription.inputRate = vk::VertexInputRate::eVertex;
+
+		return bindingDescription;
+	}
+
+	std::vector<vk::VertexInputAttributeDescription> vkMesh::getCompactModelAttributeDescriptions() {
+
+		std::vector<vk::VertexInputAttributeDescription> attributes(3);
+
+		//Pos, dequantized in the vertex shader
+		attributes[0].binding = 0;
+		attributes[0].location = 0;
+		attributes[0].format = vk::Format::eR16G16B16A16Snorm;
+		attributes[0].offset = offsetof(CompactModelVertex, position);
+
+		//Normal, octahedral
+		attributes[1].binding = 0;
+		attributes[1].location = 1;
+		attributes[1].format = vk::Format::eR16G16Snorm;
+		attributes[1].offset = offsetof(CompactModelVertex, normal);
+
+		//TexCoord
+		attributes[2].binding = 0;
+		attributes[2].location = 2;
+		attributes[2].format = vk::Format::eR16G16Sfloat;
+		attributes[2].offset = offsetof(CompactModelVertex, texCoord);
+
+		return attributes;
+	}
+
+	vk::VertexInputBindingDescription vkMesh::getStaticBindingDescription() {
+
+		vk::VertexInputBindingDescription bindingDescription;
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(StaticVertex);
+		bindingDescription.inputRate = vk::VertexInputRate::eVertex;
+
+		return bindingDescription;
+	}
+
+	std::vector<vk::VertexInputAttributeDescription> vkMesh::getStaticAttributeDescriptions() {
+
+		std::vector<vk::VertexInputAttributeDescription> attributes(3);
+
+		//Pos, already in world space
+		attributes[0].binding = 0;
+		attributes[0].location = 0;
+		attributes[0].format = vk::Format::eR32G32B32Sfloat;
+		attributes[0].offset = offsetof(StaticVertex, position);
+
+		//Color
+		attributes[1].binding = 0;
+		attributes[1].location = 1;
+		attributes[1].format = vk::Format::eR32G32B32Sfloat;
+		attributes[1].offset = offsetof(StaticVertex, color);
+
+		//TexCoord
+		attributes[2].binding = 0;
+		attributes[2].location = 2;
+		attributes[2].format = vk::Format::eR32G32Sfloat;
+		attributes[2].offset = offsetof(StaticVertex, texCoord);
+
+		return attributes;
+	}
@@ -12,6 +12,39 @@ namespace vkMesh{
 	*/
 	std::vector<vk::VertexInputAttributeDescription> getPosColorAttributeDescriptions();
 
+	/**
+		\returns the input binding description for the compact (snorm16 pos, unorm8 color, half uv) vertex format.
+	*/
+	vk::VertexInputBindingDescription getCompactBindingDescription();
+
+	/**
+		\returns the input attribute descriptions for the compact (snorm16 pos, unorm8 color, half uv) vertex format,
+		laid out as vkMesh::CompactVertex.
+	*/
+	std::vector<vk::VertexInputAttributeDescription> getCompactAttributeDescriptions();
+
+	/**
+		\returns the input binding description for the compact model (snorm16 pos, octahedral normal, half uv) vertex format.
+	*/
+	vk::VertexInputBindingDescription getCompactModelBindingDescription();
+
+	/**
+		\returns the input attribute descriptions for the compact model vertex format,
+		laid out as vkMesh::CompactModelVertex.
+	*/
+	std::vector<vk::VertexInputAttributeDescription> getCompactModelAttributeDescriptions();
+
+	/**
+		\returns the input binding description for pre-transformed static (vec3 pos, vec3 color, vec2 uv) vertices.
+	*/
+	vk::VertexInputBindingDescription getStaticBindingDescription();
+
+	/**
+		\returns the input attribute descriptions for pre-transformed static vertices,
+		laid out as StaticVertex.
+	*/
+	std::vector<vk::VertexInputAttributeDescription> getStaticAttributeDescriptions();
+
 }
 
 struct QuadArealignt {
@@ -0,0 +1,153 @@
+#include "meshlet_culler.h"
+#include "../vkInit/descriptors.h"
+#include "../vkUtil/memory.h"
+
+namespace {
+
+	const uint32_t kMeshletBindings = 6;
+
+	//matches VkDrawIndexedIndirectCommand
+	const vk::DeviceSize kCommandStride = 5 * sizeof(uint32_t);
+}
+
+vkMesh::MeshletCuller::MeshletCuller(MeshletCullerInputChunk input) {
+
+	logicalDevice = input.logicalDevice;
+	physicalDevice = input.physicalDevice;
+	stages = input.stages;
+
+	vkInit::descriptorSetLayoutData bindings;
+	bindings.count = kMeshletBindings;
+	for (uint32_t i = 0; i < kMeshletBindings; ++i) {
+		bindings.indices.push_back(i);
+		bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+		bindings.counts.push_back(1);
+		bindings.stages.push_back(input.stages);
+	}
+	layout = vkInit::make_descriptor_set_layout(logicalDevice, bindings);
+	descriptorPool = vkInit::make_descriptor_pool(logicalDevice, input.frameCount, bindings);
+
+	frames.resize(input.frameCount);
+	for (FrameResources& frame : frames) {
+		frame.commandCapacity = 0;
+		frame.regionCapacity = 0;
+		frame.descriptorSet = vkInit::allocate_descriptor_set(logicalDevice, descriptorPool, layout);
+	}
+}
+
+void vkMesh::MeshletCuller::prepare(uint32_t frameIndex, VertexMenagerie* meshes, uint32_t commandCount, uint32_t regionCount) {
+
+	FrameResources& frame = frames[frameIndex];
+
+	BufferInputChunk inputChunk;
+	inputChunk.logicalDevice = logicalDevice;
+	inputChunk.physicalDevice = physicalDevice;
+	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+
+	//grow by doubling, instance counts creep up a frame at a time
+	if (commandCount > frame.commandCapacity) {
+		if (frame.commandCapacity > 0) {
+			retired.push_back(frame.commands);
+		}
+		frame.commandCapacity = std::max(commandCount, 2 * frame.commandCapacity);
+		inputChunk.size = kCommandStride * frame.commandCapacity;
+		inputChunk.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+			| vk::BufferUsageFlagBits::eTransferDst;
+		frame.commands = vkUtil::createBuffer(inputChunk);
+	}
+	if (regionCount > frame.regionCapacity) {
+		if (frame.regionCapacity > 0) {
+			retired.push_back(frame.counters);
+		}
+		frame.regionCapacity = std::max(regionCount, 2 * frame.regionCapacity);
+		inputChunk.size = sizeof(uint32_t) * frame.regionCapacity;
+		inputChunk.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+		frame.counters = vkUtil::createBuffer(inputChunk);
+	}
+
+	vk::Buffer buffers[kMeshletBindings] = {
+		meshes->meshletBuffer.buffer, meshes->meshletVertexBuffer.buffer, meshes->meshletTriangleBuffer.buffer,
+		meshes->vertexBuffer.buffer, frame.commands.buffer, frame.counters.buffer
+	};
+	vk::DescriptorBufferInfo bufferInfo[kMeshletBindings];
+	vk::WriteDescriptorSet writeInfo[kMeshletBindings];
+	for (uint32_t i = 0; i < kMeshletBindings; ++i) {
+		bufferInfo[i].buffer = buffers[i];
+		bufferInfo[i].offset = 0;
+		bufferInfo[i].range = VK_WHOLE_SIZE;
+
+		writeInfo[i].dstSet = frame.descriptorSet;
+		writeInfo[i].dstBinding = i;
+		writeInfo[i].dstArrayElement = 0;
+		writeInfo[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+		writeInfo[i].descriptorCount = 1;
+		writeInfo[i].pBufferInfo = &bufferInfo[i];
+	}
+	logicalDevice.updateDescriptorSets(kMeshletBindings, writeInfo, 0, nullptr);
+}
+
+void vkMesh::MeshletCuller::record(vk::CommandBuffer commandBuffer, uint32_t frameIndex, vk::DescriptorSet frameSet, const std::vector<MeshletCullJob>& jobs) {
+
+	FrameResources& frame = frames[frameIndex];
+
+	//unwritten commands must read as empty draws
+	commandBuffer.fillBuffer(frame.commands.buffer, 0, kCommandStride * frame.commandCapacity, 0);
+	commandBuffer.fillBuffer(frame.counters.buffer, 0, sizeof(uint32_t) * frame.regionCapacity, 0);
+
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), barrier, nullptr, nullptr
+	);
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, frameSet, nullptr);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 2, frame.descriptorSet, nullptr);
+
+	for (const MeshletCullJob& job : jobs) {
+		uint32_t threads = job.meshletCount * job.instanceCount;
+		if (threads == 0) {
+			continue;
+		}
+		commandBuffer.pushConstants(
+			pipelineLayout, stages, 0, sizeof(MeshletCullJob), &job
+		);
+		commandBuffer.dispatch((threads + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+	}
+
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect,
+		vk::DependencyFlags(), barrier, nullptr, nullptr
+	);
+}
+
+vk::Buffer vkMesh::MeshletCuller::get_commands(uint32_t frameIndex) {
+	return frames[frameIndex].commands.buffer;
+}
+
+vk::DescriptorSet vkMesh::MeshletCuller::get_descriptor_set(uint32_t frameIndex) {
+	return frames[frameIndex].descriptorSet;
+}
+
+vkMesh::MeshletCuller::~MeshletCuller() {
+
+	for (FrameResources& frame : frames) {
+		if (frame.commandCapacity > 0) {
+			retired.push_back(frame.commands);
+		}
+		if (frame.regionCapacity > 0) {
+			retired.push_back(frame.counters);
+		}
+	}
+	for (Buffer& buffer : retired) {
+		logicalDevice.destroyBuffer(buffer.buffer);
+		logicalDevice.freeMemory(buffer.bufferMemory);
+	}
+
+	logicalDevice.destroyDescriptorPool(descriptorPool);
+	logicalDevice.destroyDescriptorSetLayout(layout);
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include "../../config.h"
+#include "../../model/vertex_menagerie.h"
+
+namespace vkMesh {
+
+	/**
+		One mesh at one level of detail, drawn for a run of instances.
+		Pushed as is to the culling compute shader and the task shader.
+	*/
+	struct MeshletCullJob {
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+		//into the model buffer, the instances are contiguous
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+		int32_t vertexOffset;
+		//first indirect command of this job's draw region
+		uint32_t commandBase;
+		//which visible counter the region appends to
+		uint32_t region;
+		//the mesh's place in the pool, its meshlets' firstIndex and firstVertex are relative to these
+		uint32_t firstIndex;
+		uint32_t firstMeshletVertex;
+		uint32_t padding[3];
+		//offset.xy, scale.xy of compact positions, read by the mesh shader
+		glm::vec4 quantization;
+	};
+	static_assert(sizeof(MeshletCullJob) == 64, "meshlet cull job layout changed");
+
+	/**
+		For making the meshlet culler
+	*/
+	struct MeshletCullerInputChunk {
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		//most frames which may be recorded at once
+		uint32_t frameCount;
+		//stages reading the meshlet descriptor set
+		vk::ShaderStageFlags stages;
+	};
+
+	/**
+		Culls meshlets on the GPU ahead of the draw.
+		For every (meshlet, instance) pair a compute thread tests the meshlet's
+		bounding sphere against the frustum and its normal cone against the eye,
+		and appends a VkDrawIndexedIndirectCommand for survivors to its region.
+		Slots nobody wrote stay zeroed, so each region is drawn whole with
+		drawIndexedIndirect and the empty commands cost nothing to rasterize.
+
+		The descriptor set (set 2) holds, in binding order: meshlets, meshlet vertices,
+		meshlet triangles, vertices, indirect commands, visible counters.
+		The mesh shader path reads the same set.
+	*/
+	class MeshletCuller {
+	public:
+
+		MeshletCuller(MeshletCullerInputChunk input);
+		~MeshletCuller();
+
+		/**
+			Make sure a frame's command buffer fits, and point its descriptor set at the geometry.
+			\param frame the swapchain image being recorded
+			\param meshes the resident vertex menagerie
+			\param commandCount indirect commands across all regions
+			\param regionCount number of regions, one visible counter each
+		*/
+		void prepare(uint32_t frame, VertexMenagerie* meshes, uint32_t commandCount, uint32_t regionCount);
+
+		/**
+			Clear the frame's commands, dispatch one culling pass per job and
+			make the results visible to the indirect draws.
+			Must be recorded outside a renderpass.
+			\param frameSet the frame's camera and model descriptor set (set 0)
+		*/
+		void record(vk::CommandBuffer commandBuffer, uint32_t frame, vk::DescriptorSet frameSet, const std::vector<MeshletCullJob>& jobs);
+
+		/**
+			\returns the frame's indirect command buffer
+		*/
+		vk::Buffer get_commands(uint32_t frame);
+
+		/**
+			\returns the frame's meshlet descriptor set
+		*/
+		vk::DescriptorSet get_descriptor_set(uint32_t frame);
+
+		vk::DescriptorSetLayout layout;
+		//stages given at creation, the pipeline layout's push constants must reach exactly these
+		vk::ShaderStageFlags stages;
+		//made by the engine against layout, destroyed by it too
+		vk::PipelineLayout pipelineLayout;
+		vk::Pipeline pipeline;
+
+		static constexpr uint32_t kWorkgroupSize = 64;
+
+	private:
+
+		struct FrameResources {
+			Buffer commands;
+			Buffer counters;
+			uint32_t commandCapacity;
+			uint32_t regionCapacity;
+			vk::DescriptorSet descriptorSet;
+		};
+
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		vk::DescriptorPool descriptorPool;
+		std::vector<FrameResources> frames;
+		//outgrown buffers may still be read by a frame in flight, they go at shutdown
+		std::vector<Buffer> retired;
+	};
+}
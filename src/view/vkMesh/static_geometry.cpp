@@ -0,0 +1,326 @@
+#include "static_geometry.h"
+#include "../vkUtil/memory.h"
+#include <algorithm>
+
+namespace {
+
+	//elements the buffers start with, they grow by doubling
+	const uint32_t kMinCapacity = 4096;
+}
+
+vkMesh::StaticGeometry::StaticGeometry(StaticGeometryInputChunk input) {
+
+	logicalDevice = input.logicalDevice;
+	physicalDevice = input.physicalDevice;
+	uploads = input.uploads;
+	generation = 0;
+	layoutVersion = 0;
+	visible = 0;
+	vertexBuffer = {};
+	indexBuffer = {};
+	reclaimed = std::make_shared<std::vector<Allocation>>();
+
+	frames.resize(input.frameCount);
+	for (FrameResources& frame : frames) {
+		frame.capacity = 0;
+	}
+}
+
+Buffer vkMesh::StaticGeometry::make_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties) {
+
+	BufferInputChunk inputChunk;
+	inputChunk.logicalDevice = logicalDevice;
+	inputChunk.physicalDevice = physicalDevice;
+	inputChunk.size = size;
+	inputChunk.usage = usage;
+	inputChunk.memoryProperties = properties;
+	return vkUtil::createBuffer(inputChunk);
+}
+
+void vkMesh::StaticGeometry::update(const StaticBatcher& batcher) {
+
+	if (batcher.changed.empty()) {
+		return;
+	}
+
+	reclaim();
+	allocations.resize(batcher.clusters.size(), Allocation{ 0, 0, 0, 0, 0, false });
+	lowers.resize(batcher.clusters.size());
+	uppers.resize(batcher.clusters.size());
+
+	//the old ranges go once the frames drawing them have finished
+	std::shared_ptr<std::vector<Allocation>> released = reclaimed;
+	for (uint32_t cluster : batcher.changed) {
+		Allocation& allocation = allocations[cluster];
+		if (allocation.live) {
+			Allocation freed = allocation;
+			uploads->release_later([released, freed]() {
+				released->push_back(freed);
+			});
+			allocation.live = false;
+		}
+	}
+
+	std::vector<uint32_t> placed;
+	bool fits = vertexBuffer.buffer && indexBuffer.buffer;
+	for (uint32_t cluster : batcher.changed) {
+
+		const StaticCluster& source = batcher.clusters[cluster];
+		if (!fits || !source.live || source.indices.empty()) {
+			continue;
+		}
+
+		Allocation& allocation = allocations[cluster];
+		allocation.vertexCount = static_cast<uint32_t>(source.vertices.size());
+		allocation.indexCount = static_cast<uint32_t>(source.indices.size());
+		if (!vertexSpace.allocate(allocation.vertexCount, allocation.firstVertex)) {
+			fits = false;
+			continue;
+		}
+		if (!indexSpace.allocate(allocation.indexCount, allocation.firstIndex)) {
+			vertexSpace.free(allocation.firstVertex, allocation.vertexCount);
+			fits = false;
+			continue;
+		}
+		allocation.generation = generation;
+		allocation.live = true;
+		lowers[cluster] = source.lower;
+		uppers[cluster] = source.upper;
+		placed.push_back(cluster);
+	}
+
+	if (fits) {
+		upload(batcher, placed);
+	}
+	else {
+		grow(batcher);
+	}
+
+	//draws sharing a material are next to each other
+	order.clear();
+	for (uint32_t cluster = 0; cluster < allocations.size(); ++cluster) {
+		if (allocations[cluster].live) {
+			order.push_back(cluster);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [&batcher](uint32_t a, uint32_t b) {
+		return batcher.clusters[a].material < batcher.clusters[b].material;
+	});
+	runs.clear();
+	for (uint32_t draw = 0; draw < order.size(); ++draw) {
+		uint32_t material = batcher.clusters[order[draw]].material;
+		if (runs.empty() || runs.back().material != material) {
+			runs.push_back(StaticDrawRun{ material, draw, 0 });
+		}
+		++runs.back().drawCount;
+	}
+	++layoutVersion;
+}
+
+void vkMesh::StaticGeometry::reclaim() {
+
+	for (const Allocation& freed : *reclaimed) {
+		//a grow already dropped it
+		if (freed.generation == generation) {
+			vertexSpace.free(freed.firstVertex, freed.vertexCount);
+			indexSpace.free(freed.firstIndex, freed.indexCount);
+		}
+	}
+	reclaimed->clear();
+}
+
+void vkMesh::StaticGeometry::grow(const StaticBatcher& batcher) {
+
+	uint32_t vertices = 0;
+	uint32_t indices = 0;
+	std::vector<uint32_t> placed;
+	for (uint32_t cluster = 0; cluster < batcher.clusters.size(); ++cluster) {
+		const StaticCluster& source = batcher.clusters[cluster];
+		allocations[cluster].live = false;
+		if (source.live && !source.indices.empty()) {
+			vertices += static_cast<uint32_t>(source.vertices.size());
+			indices += static_cast<uint32_t>(source.indices.size());
+			placed.push_back(cluster);
+		}
+	}
+
+	uint32_t vertexCapacity = std::max(vertexSpace.get_capacity(), kMinCapacity);
+	while (vertexCapacity < vertices) {
+		vertexCapacity *= 2;
+	}
+	uint32_t indexCapacity = std::max(indexSpace.get_capacity(), kMinCapacity);
+	while (indexCapacity < indices) {
+		indexCapacity *= 2;
+	}
+
+	//frames already recorded still read the old buffers
+	Buffer oldVertices = vertexBuffer;
+	Buffer oldIndices = indexBuffer;
+	if (oldVertices.buffer) {
+		vk::Device device = logicalDevice;
+		uploads->release_later([device, oldVertices, oldIndices]() {
+			device.destroyBuffer(oldVertices.buffer);
+			device.freeMemory(oldVertices.bufferMemory);
+			device.destroyBuffer(oldIndices.buffer);
+			device.freeMemory(oldIndices.bufferMemory);
+		});
+	}
+	vertexBuffer = make_buffer(sizeof(StaticVertex) * static_cast<vk::DeviceSize>(vertexCapacity),
+		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::MemoryPropertyFlagBits::eDeviceLocal);
+	indexBuffer = make_buffer(sizeof(uint32_t) * static_cast<vk::DeviceSize>(indexCapacity),
+		vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::MemoryPropertyFlagBits::eDeviceLocal);
+	vertexSpace.reset(vertexCapacity, vertices);
+	indexSpace.reset(indexCapacity, indices);
+	++generation;
+
+	//packed to the front, in cluster order
+	uint32_t firstVertex = 0;
+	uint32_t firstIndex = 0;
+	for (uint32_t cluster : placed) {
+		const StaticCluster& source = batcher.clusters[cluster];
+		Allocation& allocation = allocations[cluster];
+		allocation.firstVertex = firstVertex;
+		allocation.vertexCount = static_cast<uint32_t>(source.vertices.size());
+		allocation.firstIndex = firstIndex;
+		allocation.indexCount = static_cast<uint32_t>(source.indices.size());
+		allocation.generation = generation;
+		allocation.live = true;
+		lowers[cluster] = source.lower;
+		uppers[cluster] = source.upper;
+		firstVertex += allocation.vertexCount;
+		firstIndex += allocation.indexCount;
+	}
+	upload(batcher, placed);
+}
+
+void vkMesh::StaticGeometry::upload(const StaticBatcher& batcher, const std::vector<uint32_t>& clusters) {
+
+	if (clusters.empty()) {
+		return;
+	}
+
+	vk::DeviceSize size = 0;
+	for (uint32_t cluster : clusters) {
+		size += sizeof(StaticVertex) * static_cast<vk::DeviceSize>(allocations[cluster].vertexCount)
+			+ sizeof(uint32_t) * static_cast<vk::DeviceSize>(allocations[cluster].indexCount);
+	}
+
+	Buffer staging = make_buffer(size, vk::BufferUsageFlagBits::eTransferSrc,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	char* data = static_cast<char*>(logicalDevice.mapMemory(staging.bufferMemory, 0, size));
+
+	//each cluster's vertices then its indices, back to back
+	std::vector<vk::BufferCopy> vertexCopies, indexCopies;
+	vk::DeviceSize offset = 0;
+	for (uint32_t cluster : clusters) {
+
+		const StaticCluster& source = batcher.clusters[cluster];
+		const Allocation& allocation = allocations[cluster];
+
+		vk::BufferCopy copy;
+		copy.srcOffset = offset;
+		copy.dstOffset = sizeof(StaticVertex) * static_cast<vk::DeviceSize>(allocation.firstVertex);
+		copy.size = sizeof(StaticVertex) * source.vertices.size();
+		memcpy(data + offset, source.vertices.data(), copy.size);
+		vertexCopies.push_back(copy);
+		offset += copy.size;
+
+		copy.srcOffset = offset;
+		copy.dstOffset = sizeof(uint32_t) * static_cast<vk::DeviceSize>(allocation.firstIndex);
+		copy.size = sizeof(uint32_t) * source.indices.size();
+		memcpy(data + offset, source.indices.data(), copy.size);
+		indexCopies.push_back(copy);
+		offset += copy.size;
+	}
+	logicalDevice.unmapMemory(staging.bufferMemory);
+
+	vk::Buffer vertices = vertexBuffer.buffer;
+	vk::Buffer indices = indexBuffer.buffer;
+	vkUtil::UploadJob job;
+	job.stagingBuffer = staging;
+	job.record = [staging, vertices, indices, vertexCopies, indexCopies](vk::CommandBuffer commandBuffer) {
+
+		commandBuffer.copyBuffer(staging.buffer, vertices, static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+		commandBuffer.copyBuffer(staging.buffer, indices, static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+
+		vk::MemoryBarrier barrier;
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput,
+			vk::DependencyFlags(), barrier, nullptr, nullptr
+		);
+	};
+	uploads->push(job);
+}
+
+void vkMesh::StaticGeometry::prepare(uint32_t frameIndex, const Frustum& frustum) {
+
+	FrameResources& frame = frames[frameIndex];
+	uint32_t drawCount = static_cast<uint32_t>(order.size());
+
+	//grow by doubling. Empty scenes still bind a real buffer
+	if (drawCount > frame.capacity || frame.capacity == 0) {
+		if (frame.capacity > 0) {
+			retired.push_back(frame.commands);
+		}
+		frame.capacity = std::max({ drawCount, 2 * frame.capacity, 1u });
+		vk::DeviceSize size = sizeof(vk::DrawIndexedIndirectCommand) * static_cast<vk::DeviceSize>(frame.capacity);
+		frame.commands = make_buffer(size, vk::BufferUsageFlagBits::eIndirectBuffer,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+		frame.writeLocation = logicalDevice.mapMemory(frame.commands.bufferMemory, 0, size);
+	}
+
+	vk::DrawIndexedIndirectCommand* commands = static_cast<vk::DrawIndexedIndirectCommand*>(frame.writeLocation);
+	visible = 0;
+	for (uint32_t draw = 0; draw < drawCount; ++draw) {
+
+		uint32_t cluster = order[draw];
+		const Allocation& allocation = allocations[cluster];
+		bool inside = is_box_visible(frustum, lowers[cluster], uppers[cluster]);
+		visible += inside ? 1 : 0;
+
+		vk::DrawIndexedIndirectCommand command;
+		command.indexCount = allocation.indexCount;
+		command.instanceCount = inside ? 1 : 0;
+		command.firstIndex = allocation.firstIndex;
+		command.vertexOffset = static_cast<int32_t>(allocation.firstVertex);
+		command.firstInstance = 0;
+		commands[draw] = command;
+	}
+}
+
+vk::Buffer vkMesh::StaticGeometry::get_commands(uint32_t frameIndex) {
+	return frames[frameIndex].commands.buffer;
+}
+
+uint64_t vkMesh::StaticGeometry::get_layout_version() {
+	return layoutVersion;
+}
+
+uint32_t vkMesh::StaticGeometry::get_visible() {
+	return visible;
+}
+
+vkMesh::StaticGeometry::~StaticGeometry() {
+
+	for (FrameResources& frame : frames) {
+		if (frame.capacity > 0) {
+			retired.push_back(frame.commands);
+		}
+	}
+	//freeing mapped memory unmaps it
+	for (Buffer& buffer : retired) {
+		logicalDevice.destroyBuffer(buffer.buffer);
+		logicalDevice.freeMemory(buffer.bufferMemory);
+	}
+
+	if (vertexBuffer.buffer) {
+		logicalDevice.destroyBuffer(vertexBuffer.buffer);
+		logicalDevice.freeMemory(vertexBuffer.bufferMemory);
+		logicalDevice.destroyBuffer(indexBuffer.buffer);
+		logicalDevice.freeMemory(indexBuffer.bufferMemory);
+	}
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "../../config.h"
+#include "../../model/static_batcher.h"
+#include "../../model/frustum_culler.h"
+#include "../vkUtil/upload.h"
+#include "../vkUtil/range_allocator.h"
+#include <memory>
+
+namespace vkMesh {
+
+	/**
+		For making the static geometry
+	*/
+	struct StaticGeometryInputChunk {
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		vkUtil::UploadQueue* uploads;
+		//most frames which may be recorded at once
+		uint32_t frameCount;
+	};
+
+	/**
+		Draws sharing a material, next to each other in the commands.
+	*/
+	struct StaticDrawRun {
+		uint32_t material;
+		uint32_t firstDraw;
+		uint32_t drawCount;
+	};
+
+	/**
+		The static batcher's clusters on the GPU: one device local vertex and
+		index buffer holding every cluster, and per frame an indirect command
+		for each, ordered by material so a run of draws needs one material bound.
+
+		A rebuilt cluster is written to new space, the frames in flight may
+		still draw its old range, which is handed back once they have finished.
+		When the space runs out both buffers are made again, twice the size,
+		with every cluster uploaded from the batcher.
+	*/
+	class StaticGeometry {
+	public:
+
+		StaticGeometry(StaticGeometryInputChunk input);
+		~StaticGeometry();
+
+		/**
+			Queue the upload of the clusters the batcher's last update changed.
+		*/
+		void update(const StaticBatcher& batcher);
+
+		/**
+			Write the frame's commands, clusters outside the view draw no instances.
+
+			\param frame the swapchain image being recorded
+			\param frustum the view to test the cluster bounds against
+		*/
+		void prepare(uint32_t frame, const Frustum& frustum);
+
+		/**
+			\returns the frame's indirect commands
+		*/
+		vk::Buffer get_commands(uint32_t frame);
+
+		/**
+			\returns a number which changes whenever the buffers, runs or draw order change
+		*/
+		uint64_t get_layout_version();
+
+		/**
+			\returns how many clusters the last prepare found in view
+		*/
+		uint32_t get_visible();
+
+		//StaticVertex, and 32 bit indices relative to each cluster's first vertex
+		Buffer vertexBuffer, indexBuffer;
+		std::vector<StaticDrawRun> runs;
+
+	private:
+
+		/**
+			Where a cluster sits in the buffers, in elements.
+		*/
+		struct Allocation {
+			uint32_t firstVertex;
+			uint32_t vertexCount;
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			//the buffers it was placed in, older allocations are dropped with them
+			uint32_t generation;
+			bool live;
+		};
+
+		struct FrameResources {
+			Buffer commands;
+			void* writeLocation;
+			uint32_t capacity;
+		};
+
+		vk::Device logicalDevice;
+		vk::PhysicalDevice physicalDevice;
+		vkUtil::UploadQueue* uploads;
+		vkUtil::RangeAllocator vertexSpace, indexSpace;
+		uint32_t generation;
+		uint64_t layoutVersion;
+		uint32_t visible;
+
+		//per cluster
+		std::vector<Allocation> allocations;
+		std::vector<glm::vec3> lowers, uppers;
+		//the cluster each command draws
+		std::vector<uint32_t> order;
+		std::vector<FrameResources> frames;
+		//outgrown command buffers may still be read by a frame in flight, they go at shutdown
+		std::vector<Buffer> retired;
+		//filled by releases queued on the upload queue, which may outlive the geometry
+		std::shared_ptr<std::vector<Allocation>> reclaimed;
+
+		/**
+			Give back ranges released by rebuilt clusters, unless the buffers have moved since.
+		*/
+		void reclaim();
+
+		/**
+			Make both buffers again with room for every live cluster, and place them all.
+		*/
+		void grow(const StaticBatcher& batcher);
+
+		/**
+			Stage the given clusters and queue their copies into place.
+		*/
+		void upload(const StaticBatcher& batcher, const std::vector<uint32_t>& clusters);
+
+		Buffer make_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties);
+	};
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "../../config.h"
+#include <cstring>
+
+namespace vkUtil {
+
+	/**
+		What a recording was made against: the pipelines, buffers and
+		descriptor sets it binds, how many times those sets have been
+		written, and the counts it draws with. Two recordings with equal keys
+		hold the same commands, so one made earlier may be submitted again.
+
+		What the commands read through buffers (the camera, the transforms,
+		indirect commands) stays out of the key, it may change freely under a
+		recording. An empty key matches no recording.
+	*/
+	class CommandKey {
+	public:
+
+		CommandKey& add(uint64_t value) {
+			values.push_back(value);
+			return *this;
+		}
+
+		/**
+			Handles are pointers or 64 bit integers depending on the platform.
+		*/
+		template<typename Handle>
+		CommandKey& add_handle(Handle handle) {
+			typename Handle::CType raw = static_cast<typename Handle::CType>(handle);
+			uint64_t bits = 0;
+			memcpy(&bits, &raw, sizeof(raw));
+			return add(bits);
+		}
+
+		bool matches(const CommandKey& other) const {
+			return !values.empty() && values == other.values;
+		}
+
+		void clear() {
+			values.clear();
+		}
+
+	private:
+
+		std::vector<uint64_t> values;
+	};
+}
@@ -0,0 +1,144 @@
+#include "command_recorder.h"
+#include <cstring>
+
+vkUtil::CommandRecorder::CommandRecorder(vk::CommandBuffer commandBuffer) {
+	this->commandBuffer = commandBuffer;
+	stats = { 0, 0 };
+	forget();
+}
+
+void vkUtil::CommandRecorder::forget() {
+
+	graphics = BindPointState();
+	compute = BindPointState();
+	for (uint32_t binding = 0; binding < kMaxVertexBindings; ++binding) {
+		vertexBuffers[binding] = nullptr;
+		vertexOffsets[binding] = 0;
+	}
+	indexBuffer = nullptr;
+	indexOffset = 0;
+	indexType = vk::IndexType::eUint32;
+	viewportSet = false;
+	scissorSet = false;
+	pushLayout = nullptr;
+	pushSize = 0;
+}
+
+vkUtil::CommandRecorder::BindPointState& vkUtil::CommandRecorder::get_bind_point(vk::PipelineBindPoint bindPoint) {
+	return bindPoint == vk::PipelineBindPoint::eCompute ? compute : graphics;
+}
+
+void vkUtil::CommandRecorder::bind_pipeline(vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline) {
+
+	BindPointState& state = get_bind_point(bindPoint);
+	if (state.pipeline == pipeline) {
+		++stats.elided;
+		return;
+	}
+	commandBuffer.bindPipeline(bindPoint, pipeline);
+	state.pipeline = pipeline;
+	++stats.issued;
+}
+
+void vkUtil::CommandRecorder::bind_descriptor_set(vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout,
+	uint32_t set, vk::DescriptorSet descriptorSet) {
+
+	BindPointState& state = get_bind_point(bindPoint);
+	if (set < kMaxSets && state.layouts[set] == layout && state.sets[set] == descriptorSet) {
+		++stats.elided;
+		return;
+	}
+	commandBuffer.bindDescriptorSets(bindPoint, layout, set, descriptorSet, nullptr);
+	++stats.issued;
+
+	//sets bound through another layout may have been disturbed, unless it is the same handle
+	for (uint32_t other = 0; other < kMaxSets; ++other) {
+		if (state.layouts[other] != layout) {
+			state.layouts[other] = nullptr;
+			state.sets[other] = nullptr;
+		}
+	}
+	if (set < kMaxSets) {
+		state.layouts[set] = layout;
+		state.sets[set] = descriptorSet;
+	}
+}
+
+void vkUtil::CommandRecorder::bind_vertex_buffer(uint32_t binding, vk::Buffer buffer, vk::DeviceSize offset) {
+
+	if (binding < kMaxVertexBindings && vertexBuffers[binding] == buffer && vertexOffsets[binding] == offset) {
+		++stats.elided;
+		return;
+	}
+	commandBuffer.bindVertexBuffers(binding, 1, &buffer, &offset);
+	++stats.issued;
+	if (binding < kMaxVertexBindings) {
+		vertexBuffers[binding] = buffer;
+		vertexOffsets[binding] = offset;
+	}
+}
+
+void vkUtil::CommandRecorder::bind_index_buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::IndexType indexType) {
+
+	if (indexBuffer == buffer && indexOffset == offset && this->indexType == indexType) {
+		++stats.elided;
+		return;
+	}
+	commandBuffer.bindIndexBuffer(buffer, offset, indexType);
+	indexBuffer = buffer;
+	indexOffset = offset;
+	this->indexType = indexType;
+	++stats.issued;
+}
+
+void vkUtil::CommandRecorder::push_constants(vk::PipelineLayout layout, vk::ShaderStageFlags stages,
+	uint32_t offset, uint32_t size, const void* values) {
+
+	if (pushLayout == layout && pushStages == stages && pushOffset == offset && pushSize == size
+		&& memcmp(pushValues, values, size) == 0) {
+		++stats.elided;
+		return;
+	}
+	commandBuffer.pushConstants(layout, stages, offset, size, values);
+	++stats.issued;
+
+	//larger pushes than the shadow holds are always recorded
+	if (size <= kMaxPushConstantBytes) {
+		pushLayout = layout;
+		pushStages = stages;
+		pushOffset = offset;
+		pushSize = size;
+		memcpy(pushValues, values, size);
+	}
+	else {
+		pushLayout = nullptr;
+	}
+}
+
+void vkUtil::CommandRecorder::set_viewport(const vk::Viewport& viewport) {
+
+	if (viewportSet && this->viewport == viewport) {
+		++stats.elided;
+		return;
+	}
+	commandBuffer.setViewport(0, 1, &viewport);
+	this->viewport = viewport;
+	viewportSet = true;
+	++stats.issued;
+}
+
+void vkUtil::CommandRecorder::set_scissor(const vk::Rect2D& scissor) {
+
+	if (scissorSet && this->scissor == scissor) {
+		++stats.elided;
+		return;
+	}
+	commandBuffer.setScissor(0, 1, &scissor);
+	this->scissor = scissor;
+	scissorSet = true;
+	++stats.issued;
+}
+
+vkUtil::RecorderStats vkUtil::CommandRecorder::get_stats() {
+	return stats;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "../../config.h"
+
+namespace vkUtil {
+
+	/**
+		State commands a recording sent to the driver, and those it left out
+	*/
+	struct RecorderStats {
+		size_t issued;
+		size_t elided;
+	};
+
+	/**
+		Records state commands into a command buffer, leaving out those which
+		would set what is already set: the pipeline and descriptor sets of
+		each bind point, the vertex and index buffers, the dynamic viewport and
+		scissor, and the last push constants.
+
+		The shadowed state starts out unknown, so one recorder serves one
+		recording. Descriptor sets are only taken as bound for the layout they
+		were bound with, binding with another layout forgets the other sets
+		that layout might have disturbed. Draws, dispatches and barriers go
+		straight to commandBuffer, as must anything the recorder does not
+		shadow; call forget() after setting shadowed state that way.
+	*/
+	class CommandRecorder {
+	public:
+
+		CommandRecorder(vk::CommandBuffer commandBuffer);
+
+		void bind_pipeline(vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline);
+
+		void bind_descriptor_set(vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t set, vk::DescriptorSet descriptorSet);
+
+		void bind_vertex_buffer(uint32_t binding, vk::Buffer buffer, vk::DeviceSize offset);
+
+		void bind_index_buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::IndexType indexType);
+
+		/**
+			Only the last push is shadowed, repeating it is left out.
+		*/
+		void push_constants(vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void* values);
+
+		void set_viewport(const vk::Viewport& viewport);
+
+		void set_scissor(const vk::Rect2D& scissor);
+
+		/**
+			Treat all state as unknown again, so the next command of each kind is recorded.
+		*/
+		void forget();
+
+		RecorderStats get_stats();
+
+		vk::CommandBuffer commandBuffer;
+
+	private:
+
+		static const uint32_t kMaxSets = 4;
+		static const uint32_t kMaxVertexBindings = 4;
+		//the least maxPushConstantsSize a device may have
+		static const uint32_t kMaxPushConstantBytes = 128;
+
+		struct BindPointState {
+			vk::Pipeline pipeline;
+			vk::PipelineLayout layouts[kMaxSets];
+			vk::DescriptorSet sets[kMaxSets];
+		};
+
+		BindPointState graphics;
+		BindPointState compute;
+
+		vk::Buffer vertexBuffers[kMaxVertexBindings];
+		vk::DeviceSize vertexOffsets[kMaxVertexBindings];
+		vk::Buffer indexBuffer;
+		vk::DeviceSize indexOffset;
+		vk::IndexType indexType;
+		bool viewportSet;
+		vk::Viewport viewport;
+		bool scissorSet;
+		vk::Rect2D scissor;
+
+		vk::PipelineLayout pushLayout;
+		vk::ShaderStageFlags pushStages;
+		uint32_t pushOffset;
+		uint32_t pushSize;
+		uint8_t pushValues[kMaxPushConstantBytes];
+
+		RecorderStats stats;
+
+		BindPointState& get_bind_point(vk::PipelineBindPoint bindPoint);
+	};
+}
@@ -14,16 +14,13 @@ void vkUtil::SwapChainFrame::make_descriptor_resources() {
 
 	cameraDataWriteLocation = logicalDevice.mapMemory(cameraDataBuffer.bufferMemory, 0, sizeof(UBO));
 
-	input.size = 1024 * sizeof(glm::mat4);
+	modelCapacity = 1024;
+	input.size = modelCapacity * sizeof(glm::mat4);
 	input.usage = vk::BufferUsageFlagBits::eStorageBuffer;
 	modelBuffer = createBuffer(input);
 
-	modelBufferWriteLocation = logicalDevice.mapMemory(modelBuffer.bufferMemory, 0, 1024 * sizeof(glm::mat4));
-
-	modelTransforms.reserve(1024);
-	for (int i = 0; i < 1024; ++i) {
-		modelTransforms.push_back(glm::mat4(1.0f));
-	}
+	//instance transforms are built straight into this
+	modelBufferWriteLocation = logicalDevice.mapMemory(modelBuffer.bufferMemory, 0, modelCapacity * sizeof(glm::mat4));
 
 	/*
 	typedef struct VkDescriptorBufferInfo {
@@ -38,7 +35,7 @@ void vkUtil::SwapChainFrame::make_descriptor_resources() {
 
 	modelBufferDescriptor.buffer = modelBuffer.buffer;
 	modelBufferDescriptor.offset = 0;
-	modelBufferDescriptor.range = 1024 * sizeof(glm::mat4);
+	modelBufferDescriptor.range = modelCapacity * sizeof(glm::mat4);
 
 }
 
@@ -48,17 +45,19 @@ void vkUtil::SwapChainFrame::make_depth_resources() {
 		physicalDevice,
 		{ vk::Format::eD32Sfloat, vk::Format::eD24UnormS8Uint },
 		vk::ImageTiling::eOptimal,
-		vk::FormatFeatureFlagBits::eDepthStencilAttachment
+		vk::FormatFeatureFlagBits::eDepthStencilAttachment | vk::FormatFeatureFlagBits::eSampledImage
 	);
 
 	vkImage::ImageInputChunk imageInfo;
 	imageInfo.logicalDevice = logicalDevice;
 	imageInfo.physicalDevice = physicalDevice;
 	imageInfo.tiling = vk::ImageTiling::eOptimal;
-	imageInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+	//read back by the depth pyramid
+	imageInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled;
 	imageInfo.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
 	imageInfo.width = width;
 	imageInfo.height = height;
+	imageInfo.mipLevels = 1;
 	imageInfo.format = depthFormat;
 	depthBuffer = vkImage::make_image(imageInfo);
 	depthBufferMemory = vkImage::make_image_memory(imageInfo, depthBuffer);
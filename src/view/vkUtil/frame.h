@@ -1,5 +1,6 @@
 #pragma once
 #include "../../config.h"
+#include "command_key.h"
 
 namespace vkUtil {
 
@@ -35,6 +36,11 @@ namespace vkUtil {
 		int width, height;
 
 		vk::CommandBuffer commandBuffer;
+		//the renderpass contents, a secondary buffer executed again for as long as its key matches
+		vk::CommandBuffer sceneCommandBuffer;
+		CommandKey sceneCommandsKey;
+		//index of the frame whose fence guards the image's last submission, -1 before the first
+		int lastSubmission = -1;
 
 		//Sync objects
 		vk::Semaphore imageAvailable, renderFinished;
@@ -44,9 +50,24 @@ namespace vkUtil {
 		UBO cameraData;
 		Buffer cameraDataBuffer;
 		void* cameraDataWriteLocation;
-		std::vector<glm::mat4> modelTransforms;
+		//transforms the model buffer holds
+		uint32_t modelCapacity;
 		Buffer modelBuffer;
 		void* modelBufferWriteLocation;
+		//instances of each scene group drawn at each level of detail, VertexMenagerie::kMaxLods
+		//entries per group, in model buffer order
+		std::vector<uint32_t> lodInstanceCounts;
+		//view depth of the nearest instance of each of those draws, laid out the same
+		std::vector<float> lodDepths;
+		//model buffer slot and level of detail of each store instance, as last written
+		std::vector<uint32_t> modelSlots;
+		std::vector<uint32_t> modelLods;
+		//what the slots were laid out for, the buffer is rewritten in full when any of it changes
+		uint64_t layoutVersion = 0;
+		glm::mat4 layoutViewProjection = glm::mat4(0.0f);
+		std::vector<uint32_t> layoutLodCounts;
+		//instances were culled on the GPU, the model buffer was left as it was
+		bool instancesOnGpu = false;
 
 		//Resource Descriptors
 		vk::DescriptorBufferInfo uniformBufferDescriptor;
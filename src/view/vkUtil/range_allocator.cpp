@@ -0,0 +1,113 @@
+#include "range_allocator.h"
+
+vkUtil::RangeAllocator::RangeAllocator() {
+	capacity = 0;
+	freeCount = 0;
+}
+
+void vkUtil::RangeAllocator::reset(uint32_t capacity, uint32_t used) {
+
+	blocksByOffset.clear();
+	blocksBySize.clear();
+	this->capacity = capacity;
+	freeCount = 0;
+	if (used < capacity) {
+		insert_block(used, capacity - used);
+	}
+}
+
+void vkUtil::RangeAllocator::grow(uint32_t capacity) {
+
+	if (capacity <= this->capacity) {
+		return;
+	}
+	uint32_t oldCapacity = this->capacity;
+	this->capacity = capacity;
+	free(oldCapacity, capacity - oldCapacity);
+}
+
+bool vkUtil::RangeAllocator::allocate(uint32_t count, uint32_t& offset) {
+
+	if (count == 0) {
+		offset = 0;
+		return true;
+	}
+
+	auto fit = blocksBySize.lower_bound(count);
+	if (fit == blocksBySize.end()) {
+		return false;
+	}
+
+	uint32_t size = fit->first;
+	offset = fit->second;
+	erase_block(blocksByOffset.find(offset));
+	if (size > count) {
+		insert_block(offset + count, size - count);
+	}
+	return true;
+}
+
+void vkUtil::RangeAllocator::free(uint32_t offset, uint32_t count) {
+
+	if (count == 0) {
+		return;
+	}
+
+	//merge with the block after
+	auto next = blocksByOffset.find(offset + count);
+	if (next != blocksByOffset.end()) {
+		count += next->second;
+		erase_block(next);
+	}
+
+	//and the block before
+	auto previous = blocksByOffset.lower_bound(offset);
+	if (previous != blocksByOffset.begin()) {
+		--previous;
+		if (previous->first + previous->second == offset) {
+			offset = previous->first;
+			count += previous->second;
+			erase_block(previous);
+		}
+	}
+
+	insert_block(offset, count);
+}
+
+uint32_t vkUtil::RangeAllocator::get_capacity() {
+	return capacity;
+}
+
+uint32_t vkUtil::RangeAllocator::get_free() {
+	return freeCount;
+}
+
+uint32_t vkUtil::RangeAllocator::get_largest_free() {
+	return blocksBySize.empty() ? 0 : blocksBySize.rbegin()->first;
+}
+
+float vkUtil::RangeAllocator::get_fragmentation() {
+	if (freeCount == 0) {
+		return 0.0f;
+	}
+	return 1.0f - static_cast<float>(get_largest_free()) / static_cast<float>(freeCount);
+}
+
+void vkUtil::RangeAllocator::insert_block(uint32_t offset, uint32_t size) {
+	blocksByOffset[offset] = size;
+	blocksBySize.insert(std::make_pair(size, offset));
+	freeCount += size;
+}
+
+void vkUtil::RangeAllocator::erase_block(std::map<uint32_t, uint32_t>::iterator block) {
+
+	auto sized = blocksBySize.equal_range(block->second);
+	for (auto it = sized.first; it != sized.second; ++it) {
+		if (it->second == block->first) {
+			blocksBySize.erase(it);
+			break;
+		}
+	}
+	freeCount -= block->second;
+	blocksByOffset.erase(block);
+}
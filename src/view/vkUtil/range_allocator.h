@@ -0,0 +1,60 @@
+#pragma once
+#include "../../config.h"
+#include <map>
+
+namespace vkUtil {
+
+	/**
+		Hands out ranges of some linear space (elements of a buffer) from a free list.
+		Only free blocks are tracked: allocations take the smallest block they fit in,
+		frees merge with their neighbours, so the list holds as many blocks as there are holes.
+	*/
+	class RangeAllocator {
+	public:
+
+		RangeAllocator();
+
+		/**
+			Start over with the given space, the first used elements are taken.
+		*/
+		void reset(uint32_t capacity, uint32_t used = 0);
+
+		/**
+			Make the space larger, the new elements join the block at the end.
+		*/
+		void grow(uint32_t capacity);
+
+		/**
+			\param count elements to take
+			\param offset receives the first element taken
+			\returns whether a block was large enough
+		*/
+		bool allocate(uint32_t count, uint32_t& offset);
+
+		/**
+			Give back a range returned by allocate.
+		*/
+		void free(uint32_t offset, uint32_t count);
+
+		uint32_t get_capacity();
+		uint32_t get_free();
+		uint32_t get_largest_free();
+
+		/**
+			\returns 0 when the free space is one block, approaching 1 as it is scattered into small holes
+		*/
+		float get_fragmentation();
+
+	private:
+
+		uint32_t capacity;
+		uint32_t freeCount;
+		//offset -> size, for merging neighbours
+		std::map<uint32_t, uint32_t> blocksByOffset;
+		//size -> offset, for best fit
+		std::multimap<uint32_t, uint32_t> blocksBySize;
+
+		void insert_block(uint32_t offset, uint32_t size);
+		void erase_block(std::map<uint32_t, uint32_t>::iterator block);
+	};
+}
@@ -0,0 +1,84 @@
+#include "upload.h"
+
+vkUtil::UploadQueue::UploadQueue(vk::Device logicalDevice, int framesInFlight) {
+	this->logicalDevice = logicalDevice;
+	inFlight.resize(framesInFlight);
+}
+
+void vkUtil::UploadQueue::push(UploadJob job) {
+	std::lock_guard<std::mutex> lock(mutex);
+	pending.push_back(std::move(job));
+}
+
+void vkUtil::UploadQueue::release_later(std::function<void()> release) {
+	std::lock_guard<std::mutex> lock(mutex);
+	pendingReleases.push_back(std::move(release));
+}
+
+bool vkUtil::UploadQueue::has_pending() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return !pending.empty();
+}
+
+void vkUtil::UploadQueue::record(vk::CommandBuffer commandBuffer, int frameIndex) {
+
+	std::vector<UploadJob> jobs;
+	std::vector<std::function<void()>> releases;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.swap(pending);
+		releases.swap(pendingReleases);
+	}
+
+	std::vector<std::function<void()>>& retired = inFlight[frameIndex];
+	for (UploadJob& job : jobs) {
+		job.record(commandBuffer);
+
+		Buffer stagingBuffer = job.stagingBuffer;
+		vk::Device device = logicalDevice;
+		retired.push_back([device, stagingBuffer]() {
+			device.destroyBuffer(stagingBuffer.buffer);
+			device.freeMemory(stagingBuffer.bufferMemory);
+		});
+	}
+	for (std::function<void()>& release : releases) {
+		retired.push_back(std::move(release));
+	}
+}
+
+void vkUtil::UploadQueue::retire(int frameIndex) {
+
+	std::vector<std::function<void()>> retired;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		retired.swap(inFlight[frameIndex]);
+	}
+
+	for (std::function<void()>& release : retired) {
+		release();
+	}
+}
+
+void vkUtil::UploadQueue::reset(int framesInFlight) {
+
+	for (int i = 0; i < static_cast<int>(inFlight.size()); ++i) {
+		retire(i);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	inFlight.resize(framesInFlight);
+}
+
+vkUtil::UploadQueue::~UploadQueue() {
+
+	reset(0);
+
+	//uploads which never made it into a frame
+	for (UploadJob& job : pending) {
+		logicalDevice.destroyBuffer(job.stagingBuffer.buffer);
+		logicalDevice.freeMemory(job.stagingBuffer.bufferMemory);
+	}
+	for (std::function<void()>& release : pendingReleases) {
+		release();
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "../../config.h"
+#include <mutex>
+#include <functional>
+
+namespace vkUtil {
+
+	/**
+		A transfer to be recorded into the next frame's command buffer,
+		along with the staging buffer it reads from.
+	*/
+	struct UploadJob {
+		std::function<void(vk::CommandBuffer)> record;
+		Buffer stagingBuffer;
+	};
+
+	/**
+		Collects uploads from any thread and records them at the start of a
+		frame's command buffer, so the render thread never waits on the queue.
+		Staging buffers (and anything else handed to release_later) are freed
+		once the fence of the frame they were recorded into has been waited on.
+	*/
+	class UploadQueue {
+	public:
+
+		UploadQueue(vk::Device logicalDevice, int framesInFlight);
+		~UploadQueue();
+
+		/**
+			Queue an upload, safe to call from any thread.
+		*/
+		void push(UploadJob job);
+
+		/**
+			Queue work which must wait until the GPU is done with the next recorded frame,
+			eg. destroying a replaced image. Safe to call from any thread.
+		*/
+		void release_later(std::function<void()> release);
+
+		/**
+			Record every queued upload. Must be called outside of a renderpass.
+			\param commandBuffer the frame's command buffer, already begun
+			\param frameIndex the frame whose fence guards the recorded work
+		*/
+		void record(vk::CommandBuffer commandBuffer, int frameIndex);
+
+		/**
+			Free the resources of work recorded for the given frame.
+			Call after waiting on that frame's fence.
+		*/
+		void retire(int frameIndex);
+
+		/**
+			Free everything recorded so far, the device must be idle.
+			\param framesInFlight the new number of frames in flight
+		*/
+		void reset(int framesInFlight);
+
+		bool has_pending();
+
+	private:
+		vk::Device logicalDevice;
+		std::mutex mutex;
+		std::vector<UploadJob> pending;
+		std::vector<std::function<void()>> pendingReleases;
+		std::vector<std::vector<std::function<void()>>> inFlight;
+	};
+}
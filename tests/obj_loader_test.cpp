@@ -0,0 +1,41 @@
+#include "model/obj_loader.h"
+
+namespace {
+
+	int failures = 0;
+
+	/**
+		Load an OBJ file written from text and check how many indices it triangulates to.
+	*/
+	void expect_indices(const char* name, const std::string& text, size_t expected) {
+
+		const std::string filename = "obj_loader_test.obj";
+		{
+			std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+			file << text;
+		}
+
+		size_t count = vkMesh::Model(filename).indices.size();
+		std::remove(filename.c_str());
+		if (count != expected) {
+			std::cout << name << ": " << count << " indices, expected " << expected << std::endl;
+			++failures;
+		}
+	}
+}
+
+int main() {
+
+	const std::string triangle = "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n";
+
+	expect_indices("plain face", triangle + "f 1 2 3\n", 3);
+	expect_indices("inline comment", triangle + "f 1 2 3 # tri\n", 3);
+	expect_indices("comment without newline", triangle + "f 1 2 3 # tri", 3);
+	expect_indices("line continuation", triangle + "f 1 2 3 \\\n", 3);
+	expect_indices("commented quad", triangle + "f 1 2 4 3 #quad\nf -4 -3 -2\n", 9);
+
+	if (failures == 0) {
+		std::cout << "obj loader tests passed" << std::endl;
+	}
+	return failures == 0 ? 0 : 1;
+}